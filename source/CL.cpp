@@ -37,10 +37,11 @@ CL::~CL() {
 		this->checkError( err, "clReleaseKernel" );
 	}
 
-	if( mProgram ) {
-		err = clReleaseProgram( mProgram );
+	for( uint i = 0; i < mPrograms.size(); i++ ) {
+		err = clReleaseProgram( mPrograms[i] );
 		this->checkError( err, "clReleaseProgram" );
 	}
+
 	if( mCommandQueue ) {
 		err = clReleaseCommandQueue( mCommandQueue );
 		this->checkError( err, "clReleaseCommandQueue" );
@@ -127,6 +128,22 @@ string CL::combineParts( string filepath ) {
 }
 
 
+/**
+ * Create a read-only buffer and fill it with a copy of the data.
+ * @param  {const void*} data Data to copy into the buffer.
+ * @param  {size_t}      size Size of the data.
+ * @return {cl_mem}           Handle for the buffer.
+ */
+cl_mem CL::createBuffer( const void* data, size_t size ) {
+	cl_int err;
+	cl_mem buffer = clCreateBuffer( mContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, size, (void*) data, &err );
+	this->checkError( err, "clCreateBuffer" );
+	mMemObjects.push_back( buffer );
+
+	return buffer;
+}
+
+
 /**
  * Create an empty buffer that can be updated with data later.
  * @param  {size_t}       size  Size of the buffer.
@@ -306,6 +323,27 @@ void CL::execute( cl_kernel kernel ) {
 }
 
 
+/**
+ * Execute a kernel over a one-dimensional range.
+ * The local work size is left to the OpenCL implementation.
+ * @param {cl_kernel} kernel         Handle of the kernel to execute.
+ * @param {size_t}    globalWorkSize Number of work-items.
+ */
+void CL::execute( cl_kernel kernel, size_t globalWorkSize ) {
+	cl_int err;
+	cl_event event;
+
+	const cl_event* eventWaitList = ( mEvents.size() == 0 ) ? NULL : &( mEvents[0] );
+	err = clEnqueueNDRangeKernel( mCommandQueue, kernel, 1, NULL, &globalWorkSize, NULL, (cl_uint) mEvents.size(), eventWaitList, &event );
+	this->checkError( err, "clEnqueueNDRangeKernel" );
+
+	if( event != NULL ) {
+		mEvents.push_back( event );
+		mKernelTime[kernel] = this->getKernelExecutionTime( event );
+	}
+}
+
+
 /**
  * Finish a kernel execution by flushing the command queue and clearing all events.
  */
@@ -316,6 +354,23 @@ void CL::finish() {
 }
 
 
+/**
+ * Free a single memory object.
+ * @param {cl_mem} buffer Handle of the buffer.
+ */
+void CL::freeBuffer( cl_mem buffer ) {
+	vector<cl_mem>::iterator it = std::find( mMemObjects.begin(), mMemObjects.end(), buffer );
+
+	if( it == mMemObjects.end() ) {
+		return;
+	}
+
+	cl_int err = clReleaseMemObject( buffer );
+	this->checkError( err, "clReleaseMemObject" );
+	mMemObjects.erase( it );
+}
+
+
 /**
  * Free memory objects.
  */
@@ -331,6 +386,19 @@ void CL::freeBuffers() {
 }
 
 
+/**
+ * Get the number of compute units of the used device.
+ * @return {cl_uint} Number of compute units.
+ */
+cl_uint CL::getComputeUnits() {
+	cl_uint computeUnits = 0;
+	cl_int err = clGetDeviceInfo( mDevice, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof( cl_uint ), &computeUnits, NULL );
+	this->checkError( err, "clGetDeviceInfo" );
+
+	return computeUnits;
+}
+
+
 /**
  * Get the default device of the platform.
  * @param {const bool} silent
@@ -381,6 +449,10 @@ void CL::getDefaultDevice( const bool silent ) {
 		snprintf( msg, 128, "[OpenCL] Global memory size is %lu MB.", globalMemSize / 1024 / 1024 );
 		Logger::logDebug( msg );
 
+		// Get the number of compute units
+		snprintf( msg, 128, "[OpenCL] Device has %u compute units.", this->getComputeUnits() );
+		Logger::logDebug( msg );
+
 		// Get the global memory cache size
 		cl_ulong globalCacheSize;
 		clGetDeviceInfo( devices[0], CL_DEVICE_GLOBAL_MEM_CACHE_SIZE, sizeof( cl_ulong ), &globalCacheSize, NULL );
@@ -548,7 +620,7 @@ void CL::initCommandQueue() {
 
 
 /**
- * Load a program.
+ * Load a program. Kernels will be created from the last loaded program.
  * @param {string} filepath Path to the CL code file.
  */
 void CL::loadProgram( string filepath ) {
@@ -565,12 +637,33 @@ void CL::loadProgram( string filepath ) {
 		exit( EXIT_FAILURE );
 	}
 
+	mPrograms.push_back( mProgram );
+
 	Logger::logInfo( string( "[OpenCL] Loaded program " ).append( filepath ) );
 
 	this->buildProgram();
 }
 
 
+/**
+ * Read the content of a buffer. Blocks until the data has been read.
+ * @param {cl_mem} buffer Handle of the buffer.
+ * @param {size_t} size   Size of the data to read.
+ * @param {void*}  data   Write target for the data.
+ */
+void CL::readBuffer( cl_mem buffer, size_t size, void* data ) {
+	cl_event event;
+
+	const cl_event* eventWaitList = ( mEvents.size() == 0 ) ? NULL : &( mEvents[0] );
+	cl_int err = clEnqueueReadBuffer( mCommandQueue, buffer, CL_TRUE, 0, size, data, (cl_uint) mEvents.size(), eventWaitList, &event );
+	this->checkError( err, "clEnqueueReadBuffer" );
+
+	if( event != NULL ) {
+		mEvents.push_back( event );
+	}
+}
+
+
 /**
  * Read the content of an image buffer.
  * @param {cl_mem}    image        Handle to the image buffer.
@@ -637,24 +730,32 @@ string CL::setValues( string clProgramString ) {
 	valueReplace.clear();
 	valueReplace.push_back( "ACCEL_STRUCT" );
 	valueReplace.push_back( "BRDF" );
+	valueReplace.push_back( "BVH_TRAVERSAL" );
 	valueReplace.push_back( "IMG_HEIGHT" );
 	valueReplace.push_back( "IMG_WIDTH" );
 	valueReplace.push_back( "SHADOW_RAYS" );
 	valueReplace.push_back( "MAX_DEPTH" );
 	valueReplace.push_back( "MAX_ADDED_DEPTH" );
+	valueReplace.push_back( "PERSISTENT_THREADS" );
 	valueReplace.push_back( "PHONGTESS" );
 	valueReplace.push_back( "SAMPLES" );
+	valueReplace.push_back( "STATISTICS" );
+	valueReplace.push_back( "WAVEFRONT" );
 
 	vector<cl_uint> configInt;
 	configInt.push_back( Cfg::get().value<cl_uint>( Cfg::ACCEL_STRUCT ) );
 	configInt.push_back( Cfg::get().value<cl_uint>( Cfg::RENDER_BRDF ) );
+	configInt.push_back( Cfg::get().value<cl_uint>( Cfg::BVH_TRAVERSAL ) );
 	configInt.push_back( Cfg::get().value<cl_uint>( Cfg::WINDOW_HEIGHT ) );
 	configInt.push_back( Cfg::get().value<cl_uint>( Cfg::WINDOW_WIDTH ) );
 	configInt.push_back( Cfg::get().value<cl_uint>( Cfg::RENDER_SHADOWRAYS ) );
 	configInt.push_back( Cfg::get().value<cl_uint>( Cfg::RENDER_MAXDEPTH ) );
 	configInt.push_back( Cfg::get().value<cl_uint>( Cfg::RENDER_MAXADDEDDEPTH ) );
+	configInt.push_back( Cfg::get().value<cl_uint>( Cfg::OPENCL_PERSISTENTTHREADS ) );
 	configInt.push_back( PhongTess_ALPHA > 0.0f ? 1 : 0 );
 	configInt.push_back( Cfg::get().value<cl_uint>( Cfg::RENDER_SAMPLES ) );
+	configInt.push_back( Cfg::get().value<bool>( Cfg::OPENCL_STATISTICS ) ? 1 : 0 );
+	configInt.push_back( Cfg::get().value<bool>( Cfg::OPENCL_WAVEFRONT ) ? 1 : 0 );
 
 	for( int i = 0; i < valueReplace.size(); i++ ) {
 		search = "#" + valueReplace[i] + "#";
@@ -1,6 +1,7 @@
 #ifndef CL_H
 #define CL_H
 
+#include <algorithm>
 #include "cl.hpp"
 #include <GL/gl.h>
 #include <iostream>
@@ -32,16 +33,21 @@ class CL {
 			return buffer;
 		}
 
+		cl_mem createBuffer( const void* data, size_t size );
 		cl_mem createEmptyBuffer( size_t size, cl_mem_flags flags );
 		cl_mem createImage2DReadOnly( size_t width, size_t height, cl_float* data );
 		cl_mem createImage2DWriteOnly( size_t width, size_t height );
 		cl_kernel createKernel( const char* functionName );
 		void execute( cl_kernel kernel );
+		void execute( cl_kernel kernel, size_t globalWorkSize );
 		void finish();
+		void freeBuffer( cl_mem buffer );
 		void freeBuffers();
+		cl_uint getComputeUnits();
 		map<cl_kernel, string> getKernelNames();
 		map<cl_kernel, double> getKernelTimes();
 		void loadProgram( string filepath );
+		void readBuffer( cl_mem buffer, size_t size, void* data );
 		void readImageOutput( cl_mem image, size_t width, size_t height, cl_float* outputTarget );
 		void setKernelArg( cl_kernel kernel, cl_uint index, size_t size, void* data );
 		void setReplacement( string before, string after );
@@ -73,6 +79,7 @@ class CL {
 		cl_program mProgram;
 
 		vector<cl_kernel> mKernels;
+		vector<cl_program> mPrograms;
 		vector<cl_event> mEvents;
 		vector<cl_mem> mMemObjects;
 
@@ -2,10 +2,27 @@
 
 
 const char* Cfg::ACCEL_STRUCT = "accel_struct";
+const char* Cfg::BVH_BUILDMETHOD = "bvh.build_method";
+const char* Cfg::BVH_BUILDTHREADS = "bvh.build_threads";
+const char* Cfg::BVH_CACHE = "bvh.cache";
+const char* Cfg::BVH_CACHEDIR = "bvh.cache_dir";
+const char* Cfg::BVH_COMPACTNODES = "bvh.compact_nodes";
+const char* Cfg::BVH_EARLYSPLITBUDGET = "bvh.early_split_budget";
+const char* Cfg::BVH_EARLYSPLITRATIO = "bvh.early_split_ratio";
 const char* Cfg::BVH_MAXFACES = "bvh.max_faces";
+const char* Cfg::BVH_OPTIMIZEPASSES = "bvh.optimize_passes";
+const char* Cfg::BVH_PLOCRADIUS = "bvh.ploc_radius";
+const char* Cfg::BVH_REFIT = "bvh.refit";
+const char* Cfg::BVH_REFITREBUILD = "bvh.refit_rebuild";
+const char* Cfg::BVH_SAHBINS = "bvh.sah_bins";
+const char* Cfg::BVH_SAHCOSTTRAVERSAL = "bvh.sah_cost_traversal";
 const char* Cfg::BVH_SAHFACESLIMIT = "bvh.sah_faces_limit";
+const char* Cfg::BVH_SBVHALPHA = "bvh.sbvh_alpha";
+const char* Cfg::BVH_SBVHBUDGET = "bvh.sbvh_budget";
 const char* Cfg::BVH_SKIPAHEAD = "bvh.skip_ahead";
 const char* Cfg::BVH_SKIPAHEAD_CMP = "bvh.skip_ahead_compare";
+const char* Cfg::BVH_STORAGE = "bvh.storage";
+const char* Cfg::BVH_TRAVERSAL = "bvh.traversal";
 const char* Cfg::CAM_CENTER_X = "camera.center.x";
 const char* Cfg::CAM_CENTER_Y = "camera.center.y";
 const char* Cfg::CAM_CENTER_Z = "camera.center.z";
@@ -21,7 +38,12 @@ const char* Cfg::LOG_LEVEL = "logging.level";
 const char* Cfg::OPENCL_BUILDOPTIONS = "opencl.build_options";
 const char* Cfg::OPENCL_CHECKERRORS = "opencl.check_errors";
 const char* Cfg::OPENCL_LOCALGROUPSIZE = "opencl.localgroupsize";
+const char* Cfg::OPENCL_PERSISTENTTHREADS = "opencl.persistent_threads";
 const char* Cfg::OPENCL_PROGRAM = "opencl.program";
+const char* Cfg::OPENCL_STATISTICS = "opencl.statistics";
+const char* Cfg::OPENCL_WAVEFRONT = "opencl.wavefront";
+const char* Cfg::OPENCL_WAVEFRONTSORT = "opencl.wavefront_sort";
+const char* Cfg::OPENCL_WAVEFRONTSORTMAXBOUNCE = "opencl.wavefront_sort_max_bounce";
 const char* Cfg::PERS_FOV = "camera.perspective.fov";
 const char* Cfg::PERS_ZFAR = "camera.perspective.zfar";
 const char* Cfg::PERS_ZNEAR = "camera.perspective.znear";
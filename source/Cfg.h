@@ -21,10 +21,27 @@ class Cfg {
 		}
 
 		static const char* ACCEL_STRUCT;
+		static const char* BVH_BUILDMETHOD;
+		static const char* BVH_BUILDTHREADS;
+		static const char* BVH_CACHE;
+		static const char* BVH_CACHEDIR;
+		static const char* BVH_COMPACTNODES;
+		static const char* BVH_EARLYSPLITBUDGET;
+		static const char* BVH_EARLYSPLITRATIO;
 		static const char* BVH_MAXFACES;
+		static const char* BVH_OPTIMIZEPASSES;
+		static const char* BVH_PLOCRADIUS;
+		static const char* BVH_REFIT;
+		static const char* BVH_REFITREBUILD;
+		static const char* BVH_SAHBINS;
+		static const char* BVH_SAHCOSTTRAVERSAL;
 		static const char* BVH_SAHFACESLIMIT;
+		static const char* BVH_SBVHALPHA;
+		static const char* BVH_SBVHBUDGET;
 		static const char* BVH_SKIPAHEAD;
 		static const char* BVH_SKIPAHEAD_CMP;
+		static const char* BVH_STORAGE;
+		static const char* BVH_TRAVERSAL;
 		static const char* CAM_CENTER_X;
 		static const char* CAM_CENTER_Y;
 		static const char* CAM_CENTER_Z;
@@ -40,7 +57,12 @@ class Cfg {
 		static const char* OPENCL_BUILDOPTIONS;
 		static const char* OPENCL_CHECKERRORS;
 		static const char* OPENCL_LOCALGROUPSIZE;
+		static const char* OPENCL_PERSISTENTTHREADS;
 		static const char* OPENCL_PROGRAM;
+		static const char* OPENCL_STATISTICS;
+		static const char* OPENCL_WAVEFRONT;
+		static const char* OPENCL_WAVEFRONTSORT;
+		static const char* OPENCL_WAVEFRONTSORTMAXBOUNCE;
 		static const char* PERS_FOV;
 		static const char* PERS_ZFAR;
 		static const char* PERS_ZNEAR;
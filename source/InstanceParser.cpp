@@ -0,0 +1,128 @@
+#include "InstanceParser.h"
+
+using std::string;
+using std::vector;
+
+
+/**
+ * Get an instance with some default values, meant to be overwritten.
+ * @return {instance_t} Default instance.
+ */
+instance_t InstanceParser::getEmptyInstance() {
+	instance_t instance;
+	instance.instanceName = "";
+	instance.objectName = "";
+	instance.transform = glm::mat4( 1.0f );
+
+	return instance;
+}
+
+
+/**
+ * Get the loaded instances.
+ * @return {std::vector<instance_t>} The instances.
+ */
+vector<instance_t> InstanceParser::getInstances() {
+	return mInstances;
+}
+
+
+/**
+ * Load the instances from the file.
+ * The transformations of an instance are applied in the order they are listed.
+ * @param {std::string} file File path and name of the INSTANCES file.
+ */
+void InstanceParser::load( string file ) {
+	mInstances.clear();
+
+	std::ifstream fileIn( file.c_str() );
+	instance_t instance;
+	int numInstancesFound = 0;
+
+	if( !fileIn ) {
+		char msg[256];
+		snprintf( msg, 256, "[InstanceParser] No file \"%s\". Each object will be placed once.", file.c_str() );
+		Logger::logInfo( msg );
+		return;
+	}
+
+	while( fileIn.good() ) {
+		string line;
+		getline( fileIn, line );
+		boost::algorithm::trim( line );
+
+		if( line.length() < 3 || line[0] == '#' ) {
+			continue;
+		}
+
+		vector<string> parts;
+		boost::split( parts, line, boost::is_any_of( " \t" ), boost::token_compress_on );
+
+		// Beginning of a new instance
+		if( parts[0] == "newinstance" ) {
+			if( parts.size() < 2 ) {
+				Logger::logWarning( "[InstanceParser] No name for <newinstance>. Ignoring entry." );
+				continue;
+			}
+			if( numInstancesFound > 0 ) {
+				mInstances.push_back( instance );
+			}
+			numInstancesFound++;
+
+			instance = this->getEmptyInstance();
+			instance.instanceName = parts[1];
+		}
+		// Name of the object in the OBJ
+		else if( parts[0] == "object" ) {
+			if( parts.size() < 2 ) {
+				Logger::logWarning( "[InstanceParser] Not enough parameters for <object>. Ignoring attribute." );
+				continue;
+			}
+			instance.objectName = parts[1];
+		}
+		// Translation
+		else if( parts[0] == "translate" ) {
+			if( parts.size() < 4 ) {
+				Logger::logWarning( "[InstanceParser] Not enough parameters for <translate>. Ignoring attribute." );
+				continue;
+			}
+			glm::vec3 t(
+				atof( parts[1].c_str() ), atof( parts[2].c_str() ), atof( parts[3].c_str() )
+			);
+			instance.transform = glm::translate( glm::mat4( 1.0f ), t ) * instance.transform;
+		}
+		// Rotation around an axis in degree
+		else if( parts[0] == "rotate" ) {
+			if( parts.size() < 5 ) {
+				Logger::logWarning( "[InstanceParser] Not enough parameters for <rotate>. Ignoring attribute." );
+				continue;
+			}
+			glm::vec3 axis(
+				atof( parts[1].c_str() ), atof( parts[2].c_str() ), atof( parts[3].c_str() )
+			);
+			cl_float angle = MathHelp::degToRad( atof( parts[4].c_str() ) );
+			instance.transform = glm::rotate( glm::mat4( 1.0f ), angle, axis ) * instance.transform;
+		}
+		// Scaling
+		else if( parts[0] == "scale" ) {
+			if( parts.size() < 4 ) {
+				Logger::logWarning( "[InstanceParser] Not enough parameters for <scale>. Ignoring attribute." );
+				continue;
+			}
+			glm::vec3 s(
+				atof( parts[1].c_str() ), atof( parts[2].c_str() ), atof( parts[3].c_str() )
+			);
+			instance.transform = glm::scale( glm::mat4( 1.0f ), s ) * instance.transform;
+		}
+	}
+
+	if( numInstancesFound > 0 ) {
+		mInstances.push_back( instance );
+	}
+
+	fileIn.close();
+
+	char msg[64];
+	snprintf( msg, 64, "[InstanceParser] Loaded %lu instance(s).", mInstances.size() );
+	Logger::logInfo( msg );
+}
@@ -0,0 +1,43 @@
+#ifndef INSTANCEPARSER_H
+#define INSTANCEPARSER_H
+
+#define GLM_FORCE_RADIANS
+
+#include <boost/algorithm/string.hpp>
+#include "cl.hpp"
+#include <fstream>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <string>
+#include <vector>
+
+#include "Logger.h"
+#include "MathHelp.h"
+
+using std::string;
+using std::vector;
+
+
+// Placement of an object of the OBJ in the scene.
+struct instance_t {
+	string instanceName;
+	string objectName;
+	glm::mat4 transform;
+};
+
+
+class InstanceParser {
+
+	public:
+		vector<instance_t> getInstances();
+		void load( string file );
+
+	protected:
+		instance_t getEmptyInstance();
+
+	private:
+		vector<instance_t> mInstances;
+
+};
+
+#endif
@@ -11,6 +11,48 @@ cl_float MathHelp::degToRad( cl_float deg ) {
 }
 
 
+/**
+ * Convert a float to half precision. Instead of rounding to the nearest value,
+ * the result is rounded in the given direction, so it can be used for bounds.
+ * Values beyond the range of half precision become infinity when rounded
+ * away from zero.
+ * @param  {const cl_float} value   Value to convert.
+ * @param  {const bool}     roundUp True to round up, false to round down.
+ * @return {cl_ushort}              Bits of the half.
+ */
+cl_ushort MathHelp::floatToHalf( const cl_float value, const bool roundUp ) {
+	cl_uint bits;
+	memcpy( &bits, &value, sizeof( cl_uint ) );
+
+	const cl_ushort sign = ( bits >> 16 ) & 0x8000;
+	const cl_int exponent = (cl_int) ( ( bits >> 23 ) & 0xFF ) - 127;
+	const cl_uint mantissa = bits & 0x7FFFFF;
+	cl_ushort half = 0;
+
+	// Truncate towards zero.
+	if( exponent > 15 ) {
+		half = 0x7BFF; // largest finite half
+	}
+	else if( exponent >= -14 ) {
+		half = ( ( exponent + 15 ) << 10 ) | ( mantissa >> 13 );
+	}
+	else if( exponent >= -24 ) {
+		half = ( mantissa | 0x800000 ) >> ( -exponent - 1 ); // subnormal
+	}
+
+	half |= sign;
+
+	// Step away from zero, if that is the direction of the rounding.
+	const bool awayFromZero = ( sign == 0 ) ? roundUp : !roundUp;
+
+	if( awayFromZero && MathHelp::halfToFloat( half ) != value ) {
+		half++;
+	}
+
+	return half;
+}
+
+
 /**
  * Calculate the bounding box from the given vertices.
  * @param {std::vector<cl_float4>} vertices
@@ -103,19 +145,19 @@ cl_float MathHelp::getSurfaceArea( glm::vec3 bbMin, glm::vec3 bbMax ) {
 
 /**
  * Get the bounding box a face (triangle).
- * @param {cl_uint4}               face
- * @param {std::vector<cl_float4>} vertices
- * @param {glm::vec3*}             bbMin
- * @param {glm::vec3*}             bbMax
+ * @param {cl_float4}  v0
+ * @param {cl_float4}  v1
+ * @param {cl_float4}  v2
+ * @param {glm::vec3*} bbMin
+ * @param {glm::vec3*} bbMax
  */
 void MathHelp::getTriangleAABB( cl_float4 v0, cl_float4 v1, cl_float4 v2, glm::vec3* bbMin, glm::vec3* bbMax ) {
-	vector<cl_float4> vertices;
-
-	vertices.push_back( v0 );
-	vertices.push_back( v1 );
-	vertices.push_back( v2 );
+	const glm::vec3 a( v0.x, v0.y, v0.z );
+	const glm::vec3 b( v1.x, v1.y, v1.z );
+	const glm::vec3 c( v2.x, v2.y, v2.z );
 
-	MathHelp::getAABB( vertices, bbMin, bbMax );
+	*bbMin = glm::min( glm::min( a, b ), c );
+	*bbMax = glm::max( glm::max( a, b ), c );
 }
 
 
@@ -151,6 +193,28 @@ glm::vec3 MathHelp::getTriangleCentroid( cl_float4 v0, cl_float4 v1, cl_float4 v
 }
 
 
+/**
+ * Convert a half precision value to a float.
+ * @param  {const cl_ushort} value Bits of the half.
+ * @return {cl_float}              Value as float.
+ */
+cl_float MathHelp::halfToFloat( const cl_ushort value ) {
+	const cl_float sign = ( value & 0x8000 ) ? -1.0f : 1.0f;
+	const cl_int exponent = ( value >> 10 ) & 0x1F;
+	const cl_uint mantissa = value & 0x3FF;
+
+	if( exponent == 0 ) {
+		return sign * ldexp( (cl_float) mantissa, -24 );
+	}
+
+	if( exponent == 31 ) {
+		return ( mantissa == 0 ) ? sign * INFINITY : NAN;
+	}
+
+	return sign * ldexp( (cl_float) ( mantissa | 0x400 ), exponent - 25 );
+}
+
+
 /**
  * Find the intersection of a line with a plane (3D).
  * @param  {glm::vec3} p          A point p on the line.
@@ -250,15 +314,13 @@ cl_float MathHelp::radToDeg( cl_float rad ) {
 void MathHelp::triCalcAABB(
 	Tri* tri, const vector<cl_float4>* vertices, const vector<cl_float4>* normals
 ) {
-	vector<cl_float4> v;
-	v.push_back( (*vertices)[tri->face.x] );
-	v.push_back( (*vertices)[tri->face.y] );
-	v.push_back( (*vertices)[tri->face.z] );
+	const cl_float4 v[3] = {
+		(*vertices)[tri->face.x],
+		(*vertices)[tri->face.y],
+		(*vertices)[tri->face.z]
+	};
 
-	glm::vec3 bbMin, bbMax;
-	MathHelp::getAABB( v, &bbMin, &bbMax );
-	tri->bbMin = bbMin;
-	tri->bbMax = bbMax;
+	MathHelp::getTriangleAABB( v[0], v[1], v[2], &tri->bbMin, &tri->bbMax );
 
 	// ALPHA <= 0.0, no Phong Tessellation
 	if( Cfg::get().value<float>( Cfg::RENDER_PHONGTESS ) <= 0.0f ) {
@@ -375,4 +437,50 @@ void MathHelp::triThicknessAndSidedrop(
 		*sidedropMin = glm::min( *sidedropMin, ptsd[i] );
 		*sidedropMax = glm::max( *sidedropMax, ptsd[i] );
 	}
+}
+
+
+/**
+ * Twist vertices around the vertical axis through the center of their bounding
+ * box. The rotation grows from none at the bottom to the given angle at the
+ * top. A simple vertex animation to move a model without changing its faces.
+ * @param  {const std::vector<cl_float>*} vertices The vertices (x, y, z each).
+ * @param  {const cl_float}               angle    Rotation at the top in radians.
+ * @return {std::vector<cl_float>}                 The twisted vertices.
+ */
+vector<cl_float> MathHelp::twistVertices( const vector<cl_float>* vertices, const cl_float angle ) {
+	vector<cl_float> twisted( *vertices );
+
+	if( vertices->size() < 3 ) {
+		return twisted;
+	}
+
+	glm::vec3 bbMin( (*vertices)[0], (*vertices)[1], (*vertices)[2] );
+	glm::vec3 bbMax = bbMin;
+
+	for( cl_uint i = 3; i < vertices->size(); i += 3 ) {
+		const glm::vec3 v( (*vertices)[i], (*vertices)[i + 1], (*vertices)[i + 2] );
+		bbMin = glm::min( bbMin, v );
+		bbMax = glm::max( bbMax, v );
+	}
+
+	const cl_float height = bbMax.y - bbMin.y;
+
+	if( height <= 0.0f ) {
+		return twisted;
+	}
+
+	const cl_float centerX = ( bbMin.x + bbMax.x ) * 0.5f;
+	const cl_float centerZ = ( bbMin.z + bbMax.z ) * 0.5f;
+
+	for( cl_uint i = 0; i < vertices->size(); i += 3 ) {
+		const cl_float a = angle * ( (*vertices)[i + 1] - bbMin.y ) / height;
+		const cl_float x = (*vertices)[i] - centerX;
+		const cl_float z = (*vertices)[i + 2] - centerZ;
+
+		twisted[i] = centerX + x * cos( a ) - z * sin( a );
+		twisted[i + 2] = centerZ + x * sin( a ) + z * cos( a );
+	}
+
+	return twisted;
 }
\ No newline at end of file
@@ -4,6 +4,8 @@
 #define GLM_FORCE_RADIANS
 
 #include "cl.hpp"
+#include <cmath>
+#include <cstring>
 #include <glm/glm.hpp>
 #include <vector>
 
@@ -20,6 +22,7 @@ class MathHelp {
 
 	public:
 		static cl_float degToRad( cl_float deg );
+		static cl_ushort floatToHalf( const cl_float value, const bool roundUp );
 		static void getAABB(
 			vector<cl_float4> vertices, glm::vec3* bbMin, glm::vec3* bbMax
 		);
@@ -38,6 +41,7 @@ class MathHelp {
 		static glm::vec3 getTriangleCentroid(
 			cl_float4 v0, cl_float4 v1, cl_float4 v2
 		);
+		static cl_float halfToFloat( const cl_ushort value );
 		static glm::vec3 intersectLinePlane(
 			glm::vec3 p, glm::vec3 q, glm::vec3 x, glm::vec3 nl, bool* isParallel
 		);
@@ -55,6 +59,7 @@ class MathHelp {
 			const glm::vec3 n1, const glm::vec3 n2, const glm::vec3 n3,
 			float* thickness, glm::vec3* sidedropMin, glm::vec3* sidedropMax
 		);
+		static vector<cl_float> twistVertices( const vector<cl_float>* vertices, const cl_float angle );
 
 };
 
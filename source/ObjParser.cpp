@@ -11,6 +11,7 @@ using std::vector;
 ObjParser::ObjParser() {
 	mMtlParser = new MtlParser();
 	mLightParser = new LightParser();
+	mInstanceParser = new InstanceParser();
 }
 
 
@@ -20,6 +21,7 @@ ObjParser::ObjParser() {
 ObjParser::~ObjParser() {
 	delete mMtlParser;
 	delete mLightParser;
+	delete mInstanceParser;
 }
 
 
@@ -59,6 +61,15 @@ vector<cl_uint> ObjParser::getFacesVT() {
 }
 
 
+/**
+ * Get the loaded instances.
+ * @return {std::vector<instance_t>} The instances from the INSTANCES file.
+ */
+vector<instance_t> ObjParser::getInstances() {
+	return mInstanceParser->getInstances();
+}
+
+
 /**
  * Get the loaded lights.
  * @return {std::vector<light_t>} The lights from the LIGHT file.
@@ -134,6 +145,10 @@ void ObjParser::load( string filepath, string filename ) {
 		this->loadLights( filepath );
 	}
 
+	if( Cfg::get().value<cl_uint>( Cfg::ACCEL_STRUCT ) == ACCELSTRUCT_TWOLEVELBVH ) {
+		this->loadInstances( filepath );
+	}
+
 	this->loadMtl( filepath );
 	vector<material_t> materials = mMtlParser->getMaterials();
 	vector<string> materialNames;
@@ -221,6 +236,18 @@ void ObjParser::load( string filepath, string filename ) {
 }
 
 
+/**
+ * Load the INSTANCES file to the OBJ.
+ * @param {std::string} file File path and name of the OBJ. Assuming the INSTANCES file has the same name aside from the file extension.
+ */
+void ObjParser::loadInstances( string file ) {
+	size_t extensionIndex = file.rfind( ".obj" );
+	file.replace( extensionIndex, 4, ".instances" );
+
+	mInstanceParser->load( file );
+}
+
+
 /**
  * Load the LIGHTS file to the OBJ.
  * @param {std::string} file File path and name of the OBJ. Assuming the LIGHTS file has the same name aside from the file extension.
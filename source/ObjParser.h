@@ -10,9 +10,11 @@
 #include <string>
 #include <vector>
 
+#include "InstanceParser.h"
 #include "Logger.h"
 #include "MtlParser.h"
 #include "LightParser.h"
+#include "accelstructures/AccelStructure.h"
 
 using std::map;
 using std::string;
@@ -36,6 +38,7 @@ class ObjParser {
 		vector<cl_uint> getFacesV();
 		vector<cl_uint> getFacesVN();
 		vector<cl_uint> getFacesVT();
+		vector<instance_t> getInstances();
 		vector<light_t> getLights();
 		vector<material_t> getMaterials();
 		vector<cl_float> getNormals();
@@ -44,6 +47,7 @@ class ObjParser {
 		vector<cl_float> getVertices();
 
 	protected:
+		void loadInstances( string file );
 		void loadLights( string file );
 		void loadMtl( string file );
 		void parseFace(
@@ -55,6 +59,7 @@ class ObjParser {
 		void parseVertexTexture( string line, vector<cl_float>* textures );
 
 	private:
+		InstanceParser* mInstanceParser;
 		LightParser* mLightParser;
 		MtlParser* mMtlParser;
 
@@ -16,9 +16,20 @@ PathTracer::PathTracer( GLWidget* parent ) {
 
 	mGLWidget = parent;
 	mCL = NULL;
+	mBVHRefit = NULL;
 
 	mFOV = Cfg::get().value<cl_float>( Cfg::PERS_FOV );
 	mSampleCount = 0;
+	mStatistics = Cfg::get().value<bool>( Cfg::OPENCL_STATISTICS );
+	mBVHTexDim = 0;
+	mWavefront = Cfg::get().value<bool>( Cfg::OPENCL_WAVEFRONT );
+	mWavefrontSort = mWavefront && Cfg::get().value<bool>( Cfg::OPENCL_WAVEFRONTSORT );
+	mWavefrontSortMaxBounce = Cfg::get().value<cl_uint>( Cfg::OPENCL_WAVEFRONTSORTMAXBOUNCE );
+	mPersistentWorkSize = 0;
+	mBenchmarkFrames = 0;
+	mBenchmarkTime = 0.0;
+	mBenchmarkSortTime = 0.0;
+	mBenchmarkExtendTime = 0.0;
 	mTimeSinceStart = boost::posix_time::microsec_clock::local_time();
 
 	mStructCam.focusPoint.x = -1;
@@ -32,6 +43,7 @@ PathTracer::PathTracer( GLWidget* parent ) {
  * Destructor.
  */
 PathTracer::~PathTracer() {
+	delete mBVHRefit;
 	delete mCL;
 }
 
@@ -47,8 +59,137 @@ void PathTracer::clPathTracing( cl_float timeSinceStart ) {
 	mCL->setKernelArg( mKernelPathTracing, 1, sizeof( cl_float ), &pixelWeight );
 	mCL->setKernelArg( mKernelPathTracing, 3, sizeof( camera_cl ), &mStructCam );
 
-	mCL->execute( mKernelPathTracing );
+	// Persistent threads: The work-items take the pixels from a counter.
+	if( mPersistentWorkSize > 0 ) {
+		cl_uint pixelCounter = 0;
+		mCL->updateBuffer( mBufPixelCounter, sizeof( cl_uint ), &pixelCounter );
+		mCL->execute( mKernelPathTracing, mPersistentWorkSize );
+	}
+	else {
+		mCL->execute( mKernelPathTracing );
+	}
+
+	mCL->finish();
+
+	this->updateBenchmark( mCL->getKernelTimes()[mKernelPathTracing] );
+}
+
+
+/**
+ * OpenCL: Find the paths in the scene with one kernel per stage (wavefront).
+ * For each sample the camera rays are generated. Then each bounce finds the
+ * closest hits, shades them and tests the shadow rays, until no path is left.
+ * If enabled, the queue is sorted before the bounces of the secondary rays
+ * up to the configured bounce.
+ * @param {cl_float} timeSinceStart Time since start of the program in seconds.
+ */
+void PathTracer::clPathTracingWavefront( cl_float timeSinceStart ) {
+	const cl_uint numSamples = Cfg::get().value<cl_uint>( Cfg::RENDER_SAMPLES );
+	const cl_uint maxBounces = Cfg::get().value<cl_uint>( Cfg::RENDER_MAXDEPTH ) +
+		Cfg::get().value<cl_uint>( Cfg::RENDER_MAXADDEDDEPTH );
+	const size_t localSize = Cfg::get().value<size_t>( Cfg::OPENCL_LOCALGROUPSIZE );
+	const size_t groupSize = localSize * localSize;
+
+	cl_float pixelWeight = mSampleCount / (cl_float) ( mSampleCount + 1 );
+	cl_double kernelTime = 0.0;
+	cl_double sortTime = 0.0;
+	cl_double extendTime = 0.0;
+
+	mCL->setKernelArg( mKernelGenerate, 0, sizeof( cl_float ), &timeSinceStart );
+	mCL->setKernelArg( mKernelGenerate, 3, sizeof( camera_cl ), &mStructCam );
+	mCL->setKernelArg( mKernelFinish, 0, sizeof( cl_float ), &pixelWeight );
+
+	for( cl_uint sample = 0; sample < numSamples; sample++ ) {
+		mCL->setKernelArg( mKernelGenerate, 1, sizeof( cl_uint ), &sample );
+		mCL->execute( mKernelGenerate );
+		kernelTime += mCL->getKernelTimes()[mKernelGenerate];
+
+		cl_uint numPaths = mWidth * mHeight;
+		cl_uint q = 0;
+
+		for( cl_uint bounce = 0; bounce < maxBounces && numPaths > 0; bounce++ ) {
+			// 0: paths in the next queue; 1: shadow rays
+			cl_uint counters[2] = { 0, 0 };
+			mCL->updateBuffer( mBufCounters, sizeof( cl_uint ) * 2, counters );
+
+			// Whole work-groups. Work-items beyond the queue return right away.
+			size_t workSize = ( numPaths + groupSize - 1 ) / groupSize * groupSize;
+			cl_mem queue = mBufQueues[q];
+
+			// The camera rays are coherent already. After a few bounces the
+			// queue is short and the sort costs more than it saves.
+			if( mWavefrontSort && bounce > 0 && bounce <= mWavefrontSortMaxBounce ) {
+				sortTime += this->clSortPaths( queue, numPaths );
+				queue = mBufQueueSorted;
+			}
+
+			mCL->setKernelArg( mKernelExtend, 0, sizeof( cl_uint ), &numPaths );
+			mCL->setKernelArg( mKernelExtend, 1, sizeof( cl_mem ), &queue );
+			mCL->execute( mKernelExtend, workSize );
+			extendTime += mCL->getKernelTimes()[mKernelExtend];
+
+			mCL->setKernelArg( mKernelShade, 0, sizeof( cl_uint ), &numPaths );
+			mCL->setKernelArg( mKernelShade, 1, sizeof( cl_mem ), &queue );
+			mCL->setKernelArg( mKernelShade, 2, sizeof( cl_mem ), &mBufQueues[1 - q] );
+			mCL->execute( mKernelShade, workSize );
+			kernelTime += mCL->getKernelTimes()[mKernelShade];
+
+			mCL->readBuffer( mBufCounters, sizeof( cl_uint ) * 2, counters );
+
+			if( counters[1] > 0 ) {
+				workSize = ( counters[1] + groupSize - 1 ) / groupSize * groupSize;
+
+				mCL->setKernelArg( mKernelConnect, 0, sizeof( cl_uint ), &counters[1] );
+				mCL->execute( mKernelConnect, workSize );
+				kernelTime += mCL->getKernelTimes()[mKernelConnect];
+			}
+
+			numPaths = counters[0];
+			q = 1 - q;
+		}
+	}
+
+	mCL->execute( mKernelFinish );
 	mCL->finish();
+	kernelTime += mCL->getKernelTimes()[mKernelFinish];
+
+	mBenchmarkSortTime += sortTime;
+	mBenchmarkExtendTime += extendTime;
+	this->updateBenchmark( kernelTime + sortTime + extendTime );
+}
+
+
+/**
+ * OpenCL: Sort the queue of the wavefront path tracing by the sort key of
+ * the rays (counting sort). The result is written to mBufQueueSorted.
+ * @param  {cl_mem}    queue    Queue of path indices.
+ * @param  {cl_uint}   numPaths Number of paths in the queue.
+ * @return {cl_double}          Time of the sort kernels.
+ */
+cl_double PathTracer::clSortPaths( cl_mem queue, cl_uint numPaths ) {
+	const size_t localSize = Cfg::get().value<size_t>( Cfg::OPENCL_LOCALGROUPSIZE );
+	const size_t groupSize = localSize * localSize;
+	const size_t workSize = ( numPaths + groupSize - 1 ) / groupSize * groupSize;
+	const size_t numBlocks = ( 8 << ( 3 * PATHTRACER_SORT_AXIS_BITS ) ) / PATHTRACER_SORT_SCAN_BLOCK;
+	cl_double time = 0.0;
+
+	mCL->setKernelArg( mKernelSortCount, 0, sizeof( cl_uint ), &numPaths );
+	mCL->setKernelArg( mKernelSortCount, 1, sizeof( cl_mem ), &queue );
+	mCL->execute( mKernelSortCount, workSize );
+	time += mCL->getKernelTimes()[mKernelSortCount];
+
+	mCL->execute( mKernelSortScan, numBlocks );
+	time += mCL->getKernelTimes()[mKernelSortScan];
+
+	mCL->execute( mKernelSortScanBlockSums, 1 );
+	time += mCL->getKernelTimes()[mKernelSortScanBlockSums];
+
+	mCL->setKernelArg( mKernelSortScatter, 0, sizeof( cl_uint ), &numPaths );
+	mCL->setKernelArg( mKernelSortScatter, 1, sizeof( cl_mem ), &queue );
+	mCL->execute( mKernelSortScatter, workSize );
+	time += mCL->getKernelTimes()[mKernelSortScatter];
+
+	return time;
 }
 
 
@@ -61,7 +202,13 @@ vector<cl_float> PathTracer::generateImage( vector<cl_float>* textureDebug ) {
 	mCL->updateImageReadOnly( mBufTextureIn, mWidth, mHeight, &mTextureOut[0] );
 
 	cl_float timeSinceStart = this->getTimeSinceStart();
-	this->clPathTracing( timeSinceStart );
+
+	if( mWavefront ) {
+		this->clPathTracingWavefront( timeSinceStart );
+	}
+	else {
+		this->clPathTracing( timeSinceStart );
+	}
 
 	mCL->readImageOutput( mBufTextureOut, mWidth, mHeight, &mTextureOut[0] );
 	mCL->readImageOutput( mBufTextureDebug, mWidth, mHeight, &(*textureDebug)[0] );
@@ -71,6 +218,263 @@ vector<cl_float> PathTracer::generateImage( vector<cl_float>* textureDebug ) {
 }
 
 
+/**
+ * Compact the flattened BVH nodes to 16 bytes. The bounding boxes are stored
+ * as half precision and rounded outwards, so they still enclose the faces.
+ * Leaf nodes keep the first face in 23 bits and the number of faces in 8 bits,
+ * inner nodes the next node in 30 bits and the skip ahead flag.
+ * @param  {const bvhNode_cl*}               nodes        The flattened nodes.
+ * @param  {const cl_uint}                   numNodes     Number of nodes.
+ * @param  {std::vector<bvhNodeCompact_cl>*} compactNodes Output. The compact nodes.
+ * @return {bool}                                         False, if the indices don't fit.
+ */
+bool PathTracer::compactBVHNodes(
+	const bvhNode_cl* nodes, const cl_uint numNodes, vector<bvhNodeCompact_cl>* compactNodes
+) {
+	compactNodes->resize( numNodes );
+
+	for( cl_uint i = 0; i < numNodes; i++ ) {
+		const bvhNode_cl* node = &nodes[i];
+		bvhNodeCompact_cl* cn = &( *compactNodes )[i];
+
+		for( cl_uint axis = 0; axis < 3; axis++ ) {
+			cn->bb[axis] = MathHelp::floatToHalf( node->bbMin[axis], false );
+			cn->bb[axis + 3] = MathHelp::floatToHalf( node->bbMax[axis], true );
+		}
+
+		// Leaf node
+		if( node->first >= 0 ) {
+			const cl_uint firstFace = (cl_uint) node->first;
+			const cl_uint numFaces = (cl_uint) node->next;
+
+			if( firstFace > 0x7FFFFF || numFaces > 0xFF ) {
+				return false;
+			}
+
+			cn->data = 0x80000000 | ( firstFace << 8 ) | numFaces;
+		}
+		// Inner node. No next node (-1) becomes 0, which also ends the traversal.
+		else {
+			const cl_int next = std::max( node->next, 0 );
+
+			if( next > 0x3FFFFFFF ) {
+				return false;
+			}
+
+			cn->data = ( node->first <= -2 ) ? 0x40000000 | next : next;
+		}
+	}
+
+	return true;
+}
+
+
+/**
+ * Create a read-only image for the BVH nodes or triangles.
+ * The texels are written in rows of PATHTRACER_TEX_DIM, the last row is padded.
+ * @param  {const cl_float4*} texels    The texels.
+ * @param  {const size_t}     numTexels Number of texels.
+ * @param  {size_t*}          bytes     Output. Size of the image.
+ * @return {cl_mem}                     The image.
+ */
+cl_mem PathTracer::createTexelImage( const cl_float4* texels, const size_t numTexels, size_t* bytes ) {
+	const size_t height = std::max( ( numTexels + mBVHTexDim - 1 ) / mBVHTexDim, (size_t) 1 );
+	vector<cl_float4> data( mBVHTexDim * height );
+	std::copy( texels, texels + numTexels, data.begin() );
+
+	*bytes = sizeof( cl_float4 ) * data.size();
+
+	return mCL->createImage2DReadOnly( mBVHTexDim, height, (cl_float*) &data[0] );
+}
+
+
+/**
+ * Flatten a BVH into the node layout of the kernel and collect the faces in the order of the leaf nodes.
+ * The nodes are appended to the given list. Links to other nodes are shifted by the number of nodes
+ * already in the list. The right-most inner nodes of the tree have no next node (-1).
+ * The indices are stored as integers, so the nodes and faces have to fit into a cl_int.
+ * The nodes have to be in depth-first order, so the next nodes are found in one pass.
+ * @param {BVH*}                        bvh        The BVH.
+ * @param {const std::vector<cl_uint>*} faces      Vertex indices of the faces of the model.
+ * @param {const std::vector<cl_uint>*} facesVN    Normal indices of the faces of the model.
+ * @param {const std::vector<cl_int>*}  facesMtl   Material of each face of the model.
+ * @param {std::vector<bvhNode_cl>*}    bvhNodesCL Output. Flattened nodes.
+ * @param {std::vector<cl_uint4>*}      facesV     Output. Vertex indices and material of the faces.
+ * @param {std::vector<cl_uint4>*}      facesN     Output. Normal indices of the faces.
+ */
+void PathTracer::flattenBVH(
+	BVH* bvh, const vector<cl_uint>* faces, const vector<cl_uint>* facesVN, const vector<cl_int>* facesMtl,
+	vector<bvhNode_cl>* bvhNodesCL, vector<cl_uint4>* facesV, vector<cl_uint4>* facesN
+) {
+	boost::posix_time::ptime timerStart = boost::posix_time::microsec_clock::local_time();
+
+	const vector<BVHNode>* bvhNodes = bvh->getNodes();
+	const vector<Tri>* bvhFaces = bvh->getFaces();
+	const cl_uint nodeOffset = bvhNodesCL->size();
+
+	// The kernel gets the node and face indices as cl_int. Reject a BVH
+	// whose indices don't fit, instead of letting them wrap around.
+	if(
+		(cl_ulong) nodeOffset + bvhNodes->size() > (cl_ulong) CL_INT_MAX ||
+		(cl_ulong) facesV->size() + bvhFaces->size() > (cl_ulong) CL_INT_MAX
+	) {
+		Logger::logError( "[PathTracer] The BVH has too many nodes or faces for the 32 bit indices of the kernel." );
+		exit( EXIT_FAILURE );
+	}
+
+	// Next node to visit after the sub-tree of each node (escape index), in the
+	// indices of the BVH. The left child continues with its sibling, the right
+	// child with the next node of its parent. Parents come before their children,
+	// so the index of a node is set before the loop reaches it.
+	vector<cl_int> escape( bvhNodes->size(), -1 );
+	bool skipNext = false;
+
+
+	for( cl_uint i = 0; i < bvhNodes->size(); i++ ) {
+		const BVHNode* node = &(*bvhNodes)[i];
+
+		if( node->leftChild >= 0 ) {
+			escape[node->leftChild] = node->rightChild;
+			escape[node->rightChild] = escape[i];
+		}
+
+		if( skipNext ) {
+			skipNext = node->skipNextLeft;
+			continue;
+		}
+
+		bvhNode_cl sn;
+
+		for( cl_uint axis = 0; axis < 3; axis++ ) {
+			sn.bbMin[axis] = node->bbMin[axis];
+			sn.bbMax[axis] = node->bbMax[axis];
+		}
+
+		cl_uint fvecLen = node->numFaces;
+		// Leaf node: Index of the first face and number of faces.
+		sn.first = ( fvecLen > 0 ) ? (cl_int) facesV->size() : -1;
+		sn.next = ( fvecLen > 0 ) ? (cl_int) fvecLen : -1;
+
+		// Set the flag to skip the next left child node.
+		if( fvecLen == 0 && node->skipNextLeft ) {
+			skipNext = true;
+		}
+
+		// Leaf nodes continue with the node next in memory. The root node and the
+		// right-most inner nodes have no next node. Skipped nodes are always left
+		// child nodes, so no escape index points to one.
+		if( fvecLen == 0 && escape[i] >= 0 ) {
+			const cl_int next = escape[i];
+			sn.next = nodeOffset + next - (*bvhNodes)[next].numSkipsToHere;
+		}
+
+		bvhNodesCL->push_back( sn );
+		this->flattenFaces( bvhFaces, node, faces, facesVN, facesMtl, facesV, facesN );
+	}
+
+	boost::posix_time::ptime timerEnd = boost::posix_time::microsec_clock::local_time();
+	cl_float timeDiff = ( timerEnd - timerStart ).total_milliseconds();
+	char msg[128];
+	snprintf(
+		msg, 128, "[PathTracer] Flattened %lu BVH nodes in %g ms.",
+		bvhNodesCL->size() - nodeOffset, timeDiff
+	);
+	Logger::logDebug( msg );
+}
+
+
+/**
+ * Append the faces of a leaf node to the face lists of the kernel.
+ * @param {const std::vector<Tri>*}     bvhFaces Faces of the BVH.
+ * @param {const BVHNode*}              node     The leaf node.
+ * @param {const std::vector<cl_uint>*} faces    Vertex indices of the faces of the model.
+ * @param {const std::vector<cl_uint>*} facesVN  Normal indices of the faces of the model.
+ * @param {const std::vector<cl_int>*}  facesMtl Material of each face of the model.
+ * @param {std::vector<cl_uint4>*}      facesV   Output. Vertex indices and material of the faces.
+ * @param {std::vector<cl_uint4>*}      facesN   Output. Normal indices of the faces.
+ */
+void PathTracer::flattenFaces(
+	const vector<Tri>* bvhFaces, const BVHNode* node,
+	const vector<cl_uint>* faces, const vector<cl_uint>* facesVN, const vector<cl_int>* facesMtl,
+	vector<cl_uint4>* facesV, vector<cl_uint4>* facesN
+) {
+	for( cl_uint j = 0; j < node->numFaces; j++ ) {
+		const Tri* tri = &(*bvhFaces)[node->facesStart + j];
+		cl_uint4 fv;
+		cl_uint4 fn;
+
+		fv.x = (*faces)[tri->face.w * 3];
+		fv.y = (*faces)[tri->face.w * 3 + 1];
+		fv.z = (*faces)[tri->face.w * 3 + 2];
+		// Material of face
+		fv.w = (*facesMtl)[tri->face.w];
+
+		fn.x = (*facesVN)[tri->normals.w * 3];
+		fn.y = (*facesVN)[tri->normals.w * 3 + 1];
+		fn.z = (*facesVN)[tri->normals.w * 3 + 2];
+		fn.w = 0;
+
+		facesV->push_back( fv );
+		facesN->push_back( fn );
+	}
+}
+
+
+/**
+ * Get the depth of a flattened BVH. The nodes are in depth-first order and
+ * the next node to visit of an inner node is the end of its sub-tree. A stack
+ * for the traversal needs at most one entry less than the depth.
+ * @param  {const bvhNode_cl*} nodes    The nodes in the layout of the kernel.
+ * @param  {const cl_uint}     numNodes Number of nodes.
+ * @return {cl_uint}                    Depth of the tree.
+ */
+cl_uint PathTracer::getDepthOfFlatBVH( const bvhNode_cl* nodes, const cl_uint numNodes ) {
+	// End of the sub-tree of each inner node on the current path.
+	vector<cl_uint> ends;
+	cl_uint depth = 0;
+
+	for( cl_uint i = 0; i < numNodes; i++ ) {
+		while( !ends.empty() && ends.back() <= i ) {
+			ends.pop_back();
+		}
+
+		depth = std::max( depth, (cl_uint) ends.size() + 1 );
+
+		// Inner node. The right-most ones have no next node.
+		if( nodes[i].first < 0 ) {
+			cl_int next = nodes[i].next;
+			ends.push_back( ( next > (cl_int) i ) ? next : numNodes );
+		}
+	}
+
+	return depth;
+}
+
+
+/**
+ * Get the number of work-items to start for the persistent threads:
+ * Enough work-groups to keep each compute unit of the device busy.
+ * @return {size_t} Number of work-items. 0 if persistent threads are disabled.
+ */
+size_t PathTracer::getPersistentWorkSize() {
+	const cl_uint groupsPerUnit = Cfg::get().value<cl_uint>( Cfg::OPENCL_PERSISTENTTHREADS );
+
+	if( groupsPerUnit == 0 ) {
+		return 0;
+	}
+
+	const size_t localSize = Cfg::get().value<size_t>( Cfg::OPENCL_LOCALGROUPSIZE );
+	const size_t groupSize = localSize * localSize;
+	const size_t numPixels = mWidth * mHeight;
+	size_t workSize = mCL->getComputeUnits() * groupsPerUnit * groupSize;
+
+	// No more work-items than pixels, rounded up to full work-groups.
+	workSize = std::min( workSize, ( numPixels + groupSize - 1 ) / groupSize * groupSize );
+
+	return std::max( workSize, groupSize );
+}
+
+
 /**
  * Get the time in seconds since start of rendering.
  * @return {cl_float} Time since start of rendering.
@@ -82,6 +486,42 @@ cl_float PathTracer::getTimeSinceStart() {
 }
 
 
+/**
+ * Get the precomputed triangles of the faces, in the order of the leaf nodes.
+ * Each triangle holds its first vertex, both edges and the normal, so the
+ * intersection test doesn't have to look up the vertices of the face.
+ * @param  {const std::vector<cl_float>*} vertices Vertices of the model.
+ * @return {std::vector<triangle_cl>}              Triangles.
+ */
+vector<triangle_cl> PathTracer::getTriangles( const vector<cl_float>* vertices ) {
+	vector<triangle_cl> triangles( mFacesV.size() );
+
+	for( cl_uint i = 0; i < mFacesV.size(); i++ ) {
+		const cl_uint4 fv = mFacesV[i];
+		const glm::vec3 a( ( *vertices )[fv.x * 3], ( *vertices )[fv.x * 3 + 1], ( *vertices )[fv.x * 3 + 2] );
+		const glm::vec3 b( ( *vertices )[fv.y * 3], ( *vertices )[fv.y * 3 + 1], ( *vertices )[fv.y * 3 + 2] );
+		const glm::vec3 c( ( *vertices )[fv.z * 3], ( *vertices )[fv.z * 3 + 1], ( *vertices )[fv.z * 3 + 2] );
+		const glm::vec3 edge1 = b - a;
+		const glm::vec3 edge2 = c - a;
+		glm::vec3 normal = glm::cross( edge1, edge2 );
+
+		// Degenerated faces keep a zero normal.
+		if( glm::length( normal ) > 0.0f ) {
+			normal = glm::normalize( normal );
+		}
+
+		triangle_cl tri = {
+			{ a.x, a.y, a.z, normal.x },
+			{ edge1.x, edge1.y, edge1.z, normal.y },
+			{ edge2.x, edge2.y, edge2.z, normal.z }
+		};
+		triangles[i] = tri;
+	}
+
+	return triangles;
+}
+
+
 /**
  * Init the kernel arguments for the OpenCL kernel to do the path tracing
  */
@@ -94,16 +534,66 @@ void PathTracer::initKernelArgs() {
 	snprintf( msg, 128, "[PathTracer] Aspect ratio: %g. Pixel size: %g", aspect, pxDim );
 	Logger::logDebugVerbose( msg );
 
+	if( mWavefront ) {
+		this->initKernelArgs_Wavefront( pxDim );
+		return;
+	}
+
 	cl_uint i = 0;
 	i++; // 0: timeSinceStart
 	i++; // 1: pixelWeight
 	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_float ), &pxDim );
 	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( camera_cl ), &mStructCam );
 
+	i = this->initKernelArgs_AccelStruct( mKernelPathTracing, i );
+
+	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufTriangles );
+	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufFacesV );
+	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufFacesN );
+	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufVertices );
+	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufNormals );
+	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufMaterials );
+	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufLights );
+
+	if( mBVHTexDim > 0 ) {
+		mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mImageBVH );
+		mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mImageTriangles );
+	}
+
+	if( mPersistentWorkSize > 0 ) {
+		mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufPixelCounter );
+	}
+
+	if( mStatistics ) {
+		mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufStats );
+	}
+
+	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufTextureIn );
+	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufTextureOut );
+	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufTextureDebug );
+}
+
+
+/**
+ * Set the kernel arguments of the acceleration structure.
+ * @param  {cl_kernel} kernel The kernel.
+ * @param  {cl_uint}   i      Index of the first argument.
+ * @return {cl_uint}          Index of the next argument.
+ */
+cl_uint PathTracer::initKernelArgs_AccelStruct( cl_kernel kernel, cl_uint i ) {
 	switch( Cfg::get().value<int>( Cfg::ACCEL_STRUCT ) ) {
 
 		case ACCELSTRUCT_BVH:
-			mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufBVH );
+			mCL->setKernelArg( kernel, i++, sizeof( cl_mem ), &mBufBVH );
+			break;
+
+		case ACCELSTRUCT_TWOLEVELBVH:
+			mCL->setKernelArg( kernel, i++, sizeof( cl_mem ), &mBufBVH );
+			mCL->setKernelArg( kernel, i++, sizeof( cl_mem ), &mBufInstances );
+			break;
+
+		case ACCELSTRUCT_WIDEBVH:
+			mCL->setKernelArg( kernel, i++, sizeof( cl_mem ), &mBufBVH );
 			break;
 
 		default:
@@ -112,16 +602,156 @@ void PathTracer::initKernelArgs() {
 
 	}
 
-	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufFacesV );
-	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufFacesN );
-	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufVertices );
-	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufNormals );
-	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufMaterials );
-	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufLights );
+	return i;
+}
 
-	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufTextureIn );
-	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufTextureOut );
-	mCL->setKernelArg( mKernelPathTracing, i++, sizeof( cl_mem ), &mBufTextureDebug );
+
+/**
+ * Init the kernel arguments of the stage kernels for the wavefront path tracing.
+ * Arguments that change for each frame, sample or bounce are set before each execution.
+ * @param {cl_float} pxDim Pixel width and height.
+ */
+void PathTracer::initKernelArgs_Wavefront( cl_float pxDim ) {
+	cl_uint i;
+
+	// Generate
+	i = 0;
+	i++; // 0: timeSinceStart
+	i++; // 1: sample
+	mCL->setKernelArg( mKernelGenerate, i++, sizeof( cl_float ), &pxDim );
+	mCL->setKernelArg( mKernelGenerate, i++, sizeof( camera_cl ), &mStructCam );
+	mCL->setKernelArg( mKernelGenerate, i++, sizeof( cl_mem ), &mBufTextureIn );
+
+	if( mStatistics ) {
+		mCL->setKernelArg( mKernelGenerate, i++, sizeof( cl_mem ), &mBufStats );
+	}
+
+	mCL->setKernelArg( mKernelGenerate, i++, sizeof( cl_mem ), &mBufQueues[0] );
+	mCL->setKernelArg( mKernelGenerate, i++, sizeof( cl_mem ), &mBufPathOrigin );
+	mCL->setKernelArg( mKernelGenerate, i++, sizeof( cl_mem ), &mBufPathDir );
+	mCL->setKernelArg( mKernelGenerate, i++, sizeof( cl_mem ), &mBufPathColor );
+	mCL->setKernelArg( mKernelGenerate, i++, sizeof( cl_mem ), &mBufPathFinalColor );
+	mCL->setKernelArg( mKernelGenerate, i++, sizeof( cl_mem ), &mBufPathState );
+	mCL->setKernelArg( mKernelGenerate, i++, sizeof( cl_mem ), &mBufPathRandom );
+
+	// Extend
+	i = 0;
+	i++; // 0: numPaths
+	i++; // 1: queue
+	i = this->initKernelArgs_AccelStruct( mKernelExtend, i );
+	mCL->setKernelArg( mKernelExtend, i++, sizeof( cl_mem ), &mBufTriangles );
+	mCL->setKernelArg( mKernelExtend, i++, sizeof( cl_mem ), &mBufFacesV );
+	mCL->setKernelArg( mKernelExtend, i++, sizeof( cl_mem ), &mBufFacesN );
+	mCL->setKernelArg( mKernelExtend, i++, sizeof( cl_mem ), &mBufVertices );
+	mCL->setKernelArg( mKernelExtend, i++, sizeof( cl_mem ), &mBufNormals );
+	mCL->setKernelArg( mKernelExtend, i++, sizeof( cl_mem ), &mBufLights );
+
+	if( mBVHTexDim > 0 ) {
+		mCL->setKernelArg( mKernelExtend, i++, sizeof( cl_mem ), &mImageBVH );
+		mCL->setKernelArg( mKernelExtend, i++, sizeof( cl_mem ), &mImageTriangles );
+	}
+
+	if( mStatistics ) {
+		mCL->setKernelArg( mKernelExtend, i++, sizeof( cl_mem ), &mBufStats );
+	}
+
+	mCL->setKernelArg( mKernelExtend, i++, sizeof( cl_mem ), &mBufPathOrigin );
+	mCL->setKernelArg( mKernelExtend, i++, sizeof( cl_mem ), &mBufPathDir );
+	mCL->setKernelArg( mKernelExtend, i++, sizeof( cl_mem ), &mBufPathNormal );
+
+	// Shade
+	i = 0;
+	i++; // 0: numPaths
+	i++; // 1: queue
+	i++; // 2: queueNext
+	mCL->setKernelArg( mKernelShade, i++, sizeof( cl_mem ), &mBufQueueShadow );
+	mCL->setKernelArg( mKernelShade, i++, sizeof( cl_mem ), &mBufCounters );
+	mCL->setKernelArg( mKernelShade, i++, sizeof( cl_mem ), &mBufFacesV );
+	mCL->setKernelArg( mKernelShade, i++, sizeof( cl_mem ), &mBufMaterials );
+	mCL->setKernelArg( mKernelShade, i++, sizeof( cl_mem ), &mBufLights );
+	mCL->setKernelArg( mKernelShade, i++, sizeof( cl_mem ), &mBufPathOrigin );
+	mCL->setKernelArg( mKernelShade, i++, sizeof( cl_mem ), &mBufPathDir );
+	mCL->setKernelArg( mKernelShade, i++, sizeof( cl_mem ), &mBufPathNormal );
+	mCL->setKernelArg( mKernelShade, i++, sizeof( cl_mem ), &mBufPathColor );
+	mCL->setKernelArg( mKernelShade, i++, sizeof( cl_mem ), &mBufPathFinalColor );
+	mCL->setKernelArg( mKernelShade, i++, sizeof( cl_mem ), &mBufPathState );
+	mCL->setKernelArg( mKernelShade, i++, sizeof( cl_mem ), &mBufPathRandom );
+	mCL->setKernelArg( mKernelShade, i++, sizeof( cl_mem ), &mBufShadowOrigin );
+	mCL->setKernelArg( mKernelShade, i++, sizeof( cl_mem ), &mBufShadowDir );
+	mCL->setKernelArg( mKernelShade, i++, sizeof( cl_mem ), &mBufShadowColor );
+
+	// Connect
+	i = 0;
+	i++; // 0: numShadowRays
+	mCL->setKernelArg( mKernelConnect, i++, sizeof( cl_mem ), &mBufQueueShadow );
+	i = this->initKernelArgs_AccelStruct( mKernelConnect, i );
+	mCL->setKernelArg( mKernelConnect, i++, sizeof( cl_mem ), &mBufTriangles );
+	mCL->setKernelArg( mKernelConnect, i++, sizeof( cl_mem ), &mBufFacesV );
+	mCL->setKernelArg( mKernelConnect, i++, sizeof( cl_mem ), &mBufFacesN );
+	mCL->setKernelArg( mKernelConnect, i++, sizeof( cl_mem ), &mBufVertices );
+	mCL->setKernelArg( mKernelConnect, i++, sizeof( cl_mem ), &mBufNormals );
+	mCL->setKernelArg( mKernelConnect, i++, sizeof( cl_mem ), &mBufLights );
+
+	if( mBVHTexDim > 0 ) {
+		mCL->setKernelArg( mKernelConnect, i++, sizeof( cl_mem ), &mImageBVH );
+		mCL->setKernelArg( mKernelConnect, i++, sizeof( cl_mem ), &mImageTriangles );
+	}
+
+	if( mStatistics ) {
+		mCL->setKernelArg( mKernelConnect, i++, sizeof( cl_mem ), &mBufStats );
+	}
+
+	mCL->setKernelArg( mKernelConnect, i++, sizeof( cl_mem ), &mBufPathFinalColor );
+	mCL->setKernelArg( mKernelConnect, i++, sizeof( cl_mem ), &mBufPathState );
+	mCL->setKernelArg( mKernelConnect, i++, sizeof( cl_mem ), &mBufShadowOrigin );
+	mCL->setKernelArg( mKernelConnect, i++, sizeof( cl_mem ), &mBufShadowDir );
+	mCL->setKernelArg( mKernelConnect, i++, sizeof( cl_mem ), &mBufShadowColor );
+
+	// Finish
+	i = 0;
+	i++; // 0: pixelWeight
+	mCL->setKernelArg( mKernelFinish, i++, sizeof( cl_mem ), &mBufTextureIn );
+	mCL->setKernelArg( mKernelFinish, i++, sizeof( cl_mem ), &mBufTextureOut );
+	mCL->setKernelArg( mKernelFinish, i++, sizeof( cl_mem ), &mBufTextureDebug );
+
+	if( mStatistics ) {
+		mCL->setKernelArg( mKernelFinish, i++, sizeof( cl_mem ), &mBufStats );
+	}
+
+	mCL->setKernelArg( mKernelFinish, i++, sizeof( cl_mem ), &mBufPathFinalColor );
+	mCL->setKernelArg( mKernelFinish, i++, sizeof( cl_mem ), &mBufPathState );
+	mCL->setKernelArg( mKernelFinish, i++, sizeof( cl_mem ), &mBufPathRandom );
+
+	if( !mWavefrontSort ) {
+		return;
+	}
+
+	// Sort: count
+	i = 0;
+	i++; // 0: numPaths
+	i++; // 1: queue
+	mCL->setKernelArg( mKernelSortCount, i++, sizeof( cl_float4 ), &mSortBoundsMin );
+	mCL->setKernelArg( mKernelSortCount, i++, sizeof( cl_float4 ), &mSortBoundsScale );
+	mCL->setKernelArg( mKernelSortCount, i++, sizeof( cl_mem ), &mBufSortBins );
+	mCL->setKernelArg( mKernelSortCount, i++, sizeof( cl_mem ), &mBufSortKeys );
+	mCL->setKernelArg( mKernelSortCount, i++, sizeof( cl_mem ), &mBufPathOrigin );
+	mCL->setKernelArg( mKernelSortCount, i++, sizeof( cl_mem ), &mBufPathDir );
+
+	// Sort: prefix sum
+	i = 0;
+	mCL->setKernelArg( mKernelSortScan, i++, sizeof( cl_mem ), &mBufSortBins );
+	mCL->setKernelArg( mKernelSortScan, i++, sizeof( cl_mem ), &mBufSortBinOffsets );
+	mCL->setKernelArg( mKernelSortScan, i++, sizeof( cl_mem ), &mBufSortBlockSums );
+	mCL->setKernelArg( mKernelSortScanBlockSums, 0, sizeof( cl_mem ), &mBufSortBlockSums );
+
+	// Sort: scatter
+	i = 0;
+	i++; // 0: numPaths
+	i++; // 1: queue
+	mCL->setKernelArg( mKernelSortScatter, i++, sizeof( cl_mem ), &mBufSortKeys );
+	mCL->setKernelArg( mKernelSortScatter, i++, sizeof( cl_mem ), &mBufSortBinOffsets );
+	mCL->setKernelArg( mKernelSortScatter, i++, sizeof( cl_mem ), &mBufSortBlockSums );
+	mCL->setKernelArg( mKernelSortScatter, i++, sizeof( cl_mem ), &mBufQueueSorted );
 }
 
 
@@ -132,10 +762,11 @@ void PathTracer::initKernelArgs() {
  * @param {std::vector<cl_float>} normals    Normals of the model.
  * @param {ModelLoader*}          ml         Model loader already holding the needed model data.
  * @param {AccelStructure*}       accelStruc The generated acceleration structure.
+ * @param {BVHCache*}             bvhCache   Cache for the BVH buffers. NULL to not use a cache.
  */
 void PathTracer::initOpenCLBuffers(
 	vector<cl_float> vertices, vector<cl_uint> faces, vector<cl_float> normals,
-	ModelLoader* ml, AccelStructure* accelStruc
+	ModelLoader* ml, AccelStructure* accelStruc, BVHCache* bvhCache
 ) {
 	boost::posix_time::ptime timerStart;
 	boost::posix_time::ptime timerEnd;
@@ -147,6 +778,11 @@ void PathTracer::initOpenCLBuffers(
 	#define MSG_LENGTH 128
 	char msg[MSG_LENGTH];
 
+	if( mBVHRefit != NULL ) {
+		delete mBVHRefit;
+		mBVHRefit = NULL;
+	}
+
 	if( mCL != NULL ) {
 		delete mCL;
 	}
@@ -163,6 +799,25 @@ void PathTracer::initOpenCLBuffers(
 	Logger::indent( LOG_INDENT );
 
 
+	// Storage of the BVH nodes and triangles: buffers or images
+	mBVHTexDim = 0;
+
+	if( Cfg::get().value<cl_uint>( Cfg::BVH_STORAGE ) == 1 ) {
+		if(
+			Cfg::get().value<short>( Cfg::ACCEL_STRUCT ) != ACCELSTRUCT_BVH ||
+			Cfg::get().value<cl_uint>( Cfg::BVH_BUILDMETHOD ) == BVH_BUILD_GPU_LBVH ||
+			Cfg::get().value<bool>( Cfg::BVH_REFIT )
+		) {
+			Logger::logWarning( "[PathTracer] Images for the BVH are only available for the BVH built on the host without refit. Using buffers." );
+		}
+		else {
+			mBVHTexDim = PATHTRACER_TEX_DIM;
+		}
+	}
+
+	snprintf( msg, MSG_LENGTH, "%u", mBVHTexDim );
+	mCL->setReplacement( string( "#BVH_TEX_DIM#" ), string( msg ) );
+
 	// Buffer: Faces
 	timerStart = boost::posix_time::microsec_clock::local_time();
 	bytes = this->initOpenCLBuffers_Faces( ml, vertices, faces, normals );
@@ -177,10 +832,29 @@ void PathTracer::initOpenCLBuffers(
 	const short usedAccelStruct = Cfg::get().value<short>( Cfg::ACCEL_STRUCT );
 	string accelName;
 
-	if( usedAccelStruct == ACCELSTRUCT_BVH ) {
-		bytes = this->initOpenCLBuffers_BVH( (BVH*) accelStruc, ml, faces );
+	if(
+		usedAccelStruct == ACCELSTRUCT_BVH &&
+		Cfg::get().value<cl_uint>( Cfg::BVH_BUILDMETHOD ) == BVH_BUILD_GPU_LBVH
+	) {
+		bytes = this->initOpenCLBuffers_LBVH( ml, faces );
+		accelName = "LBVH";
+	}
+	else if( usedAccelStruct == ACCELSTRUCT_BVH && bvhCache != NULL && bvhCache->isLoaded() ) {
+		bytes = this->initOpenCLBuffers_BVHCache( bvhCache );
+		accelName = "BVH (cached)";
+	}
+	else if( usedAccelStruct == ACCELSTRUCT_BVH ) {
+		bytes = this->initOpenCLBuffers_BVH( (BVH*) accelStruc, ml, faces, bvhCache );
 		accelName = "BVH";
 	}
+	else if( usedAccelStruct == ACCELSTRUCT_TWOLEVELBVH ) {
+		bytes = this->initOpenCLBuffers_TwoLevelBVH( (TwoLevelBVH*) accelStruc, ml, faces );
+		accelName = "two-level BVH";
+	}
+	else if( usedAccelStruct == ACCELSTRUCT_WIDEBVH ) {
+		bytes = this->initOpenCLBuffers_WideBVH( (WideBVH*) accelStruc, ml, faces );
+		accelName = "wide BVH";
+	}
 
 	timerEnd = boost::posix_time::microsec_clock::local_time();
 	timeDiff = ( timerEnd - timerStart ).total_milliseconds();
@@ -188,6 +862,15 @@ void PathTracer::initOpenCLBuffers(
 	snprintf( msg, MSG_LENGTH, "[PathTracer] Created %s buffer in %g ms -- %.2f %s.", accelName.c_str(), timeDiff, bytesFloat, unit.c_str() );
 	Logger::logInfo( msg );
 
+	// Buffer: Triangles
+	timerStart = boost::posix_time::microsec_clock::local_time();
+	bytes = this->initOpenCLBuffers_Triangles( &vertices );
+	timerEnd = boost::posix_time::microsec_clock::local_time();
+	timeDiff = ( timerEnd - timerStart ).total_milliseconds();
+	utils::formatBytes( bytes, &bytesFloat, &unit );
+	snprintf( msg, MSG_LENGTH, "[PathTracer] Created triangle buffer in %g ms -- %.2f %s.", timeDiff, bytesFloat, unit.c_str() );
+	Logger::logInfo( msg );
+
 	// Buffer: Material(s)
 	timerStart = boost::posix_time::microsec_clock::local_time();
 	bytes = this->initOpenCLBuffers_Materials( ml );
@@ -218,12 +901,61 @@ void PathTracer::initOpenCLBuffers(
 	snprintf( msg, MSG_LENGTH, "[PathTracer] Created texture buffer in %g ms -- %.2f %s.", timeDiff, bytesFloat, unit.c_str() );
 	Logger::logInfo( msg );
 
+	// Buffer: State and queues of the paths for the wavefront path tracing
+	if( mWavefront ) {
+		timerStart = boost::posix_time::microsec_clock::local_time();
+		bytes = this->initOpenCLBuffers_Wavefront( &vertices );
+		timerEnd = boost::posix_time::microsec_clock::local_time();
+		timeDiff = ( timerEnd - timerStart ).total_milliseconds();
+		utils::formatBytes( bytes, &bytesFloat, &unit );
+		snprintf( msg, MSG_LENGTH, "[PathTracer] Created wavefront buffers in %g ms -- %.2f %s.", timeDiff, bytesFloat, unit.c_str() );
+		Logger::logInfo( msg );
+	}
+
+	// Buffer: Next pixel for the persistent threads
+	mPersistentWorkSize = mWavefront ? 0 : this->getPersistentWorkSize();
+
+	if( mPersistentWorkSize > 0 ) {
+		mBufPixelCounter = mCL->createEmptyBuffer( sizeof( cl_uint ), CL_MEM_READ_WRITE );
+
+		snprintf( msg, MSG_LENGTH, "[PathTracer] Persistent threads: %lu work-items.", mPersistentWorkSize );
+		Logger::logInfo( msg );
+	}
+
+	// Buffer: Counters of each pixel for the statistics mode
+	if( mStatistics ) {
+		bytes = sizeof( cl_uint4 ) * mWidth * mHeight;
+		mBufStats = mCL->createEmptyBuffer( bytes, CL_MEM_READ_WRITE );
+
+		utils::formatBytes( bytes, &bytesFloat, &unit );
+		snprintf( msg, MSG_LENGTH, "[PathTracer] Created statistics buffer -- %.2f %s.", bytesFloat, unit.c_str() );
+		Logger::logInfo( msg );
+	}
+
 	Logger::indent( 0 );
 	Logger::logInfo( "[PathTracer] ... Done." );
 
 
 	mCL->loadProgram( Cfg::get().value<string>( Cfg::OPENCL_PROGRAM ) );
-	mKernelPathTracing = mCL->createKernel( "pathTracing" );
+
+	if( mWavefront ) {
+		mKernelGenerate = mCL->createKernel( "generatePaths" );
+		mKernelExtend = mCL->createKernel( "extendPaths" );
+		mKernelShade = mCL->createKernel( "shadePaths" );
+		mKernelConnect = mCL->createKernel( "connectPaths" );
+		mKernelFinish = mCL->createKernel( "finishPaths" );
+
+		if( mWavefrontSort ) {
+			mKernelSortCount = mCL->createKernel( "sortPathsCount" );
+			mKernelSortScan = mCL->createKernel( "sortPathsScan" );
+			mKernelSortScanBlockSums = mCL->createKernel( "sortPathsScanBlockSums" );
+			mKernelSortScatter = mCL->createKernel( "sortPathsScatter" );
+		}
+	}
+	else {
+		mKernelPathTracing = mCL->createKernel( "pathTracing" );
+	}
+
 	mGLWidget->createKernelWindow( mCL );
 
 	this->initKernelArgs();
@@ -232,11 +964,15 @@ void PathTracer::initOpenCLBuffers(
 
 /**
  * Init OpenCL buffers for the BVH.
- * @param  {BVH*}   bvh The generated Bounding Volume Hierarchy.
- * @return {size_t}     Buffer size.
+ * @param  {BVH*}                 bvh      The generated Bounding Volume Hierarchy.
+ * @param  {ModelLoader*}         ml       Model loader already holding the needed model data.
+ * @param  {std::vector<cl_uint>} faces    Faces of the model.
+ * @param  {BVHCache*}            bvhCache Cache to write the buffers to. Can be NULL.
+ * @return {size_t}                        Buffer size.
  */
-size_t PathTracer::initOpenCLBuffers_BVH( BVH* bvh, ModelLoader* ml, vector<cl_uint> faces ) {
-	vector<BVHNode*> bvhNodes = bvh->getNodes();
+size_t PathTracer::initOpenCLBuffers_BVH(
+	BVH* bvh, ModelLoader* ml, vector<cl_uint> faces, BVHCache* bvhCache
+) {
 	vector<bvhNode_cl> bvhNodesCL;
 
 	vector<cl_uint> facesVN = ml->getObjParser()->getFacesVN();
@@ -244,106 +980,134 @@ size_t PathTracer::initOpenCLBuffers_BVH( BVH* bvh, ModelLoader* ml, vector<cl_u
 	vector<cl_uint4> facesV;
 	vector<cl_uint4> facesN;
 
-	bool skipNext = false;
+	this->flattenBVH( bvh, &faces, &facesVN, &facesMtl, &bvhNodesCL, &facesV, &facesN );
 
+	size_t bytesBVH = sizeof( bvhNode_cl ) * bvhNodesCL.size();
+	size_t bytesBuffer = bytesBVH;
 
-	for( cl_uint i = 0; i < bvhNodes.size(); i++ ) {
-		BVHNode* node = bvhNodes[i];
+	// The refit writes to the nodes, so they keep their full size.
+	if( Cfg::get().value<bool>( Cfg::BVH_REFIT ) ) {
+		mBufBVH = mCL->createEmptyBuffer( bytesBVH, CL_MEM_READ_WRITE );
+		mCL->updateBuffer( mBufBVH, bytesBVH, &bvhNodesCL[0] );
+		mBVHRefit = new BVHRefit( mCL, (const cl_int4*) &bvhNodesCL[0], bvhNodesCL.size() );
+		mCL->setReplacement( string( "#BVH_COMPACT#" ), string( "0" ) );
 
-		if( skipNext ) {
-			skipNext = node->skipNextLeft;
-			continue;
+		if( Cfg::get().value<bool>( Cfg::BVH_COMPACTNODES ) ) {
+			Logger::logWarning( "[PathTracer] Compact BVH nodes are not available with the refit. Using the full nodes." );
 		}
+	}
+	else {
+		bytesBuffer = this->initOpenCLBuffers_BVHNodes( &bvhNodesCL[0], bvhNodesCL.size() );
+	}
 
-		cl_float4 bbMin = { node->bbMin[0], node->bbMin[1], node->bbMin[2], 0.0f };
-		cl_float4 bbMax = { node->bbMax[0], node->bbMax[1], node->bbMax[2], 0.0f };
+	char msg[16];
+	snprintf( msg, 16, "%lu", bvhNodesCL.size() );
+	mCL->setReplacement( string( "#BVH_NUM_NODES#" ), string( msg ) );
 
-		bvhNode_cl sn;
-		sn.bbMin = bbMin;
-		sn.bbMax = bbMax;
+	snprintf( msg, 16, "%u", this->getDepthOfFlatBVH( &bvhNodesCL[0], bvhNodesCL.size() ) );
+	mCL->setReplacement( string( "#BVH_STACK_SIZE#" ), string( msg ) );
 
-		vector<Tri> facesVec = node->faces;
-		cl_uint fvecLen = facesVec.size();
-		sn.bbMin.w = ( fvecLen > 0 ) ? (cl_float) facesV.size() + 0 : -1.0f;
-		sn.bbMax.w = ( fvecLen > 1 ) ? (cl_float) facesV.size() + 1 : -1.0f;
+	size_t bytesFV = sizeof( cl_uint4 ) * facesV.size();
+	mBufFacesV = mCL->createBuffer( facesV, bytesFV );
+	mFacesV = facesV;
 
-		// Set the flag to skip the next left child node.
-		if( fvecLen == 0 && node->skipNextLeft ) {
-			skipNext = true;
-		}
+	size_t bytesFN = sizeof( cl_uint4 ) * facesN.size();
+	mBufFacesN = mCL->createBuffer( facesN, bytesFN );
 
-		// No parent means it's the root node.
-		// Otherwise it is some other node, including leaves.
-		// Also for leaf nodes the next node to visit is given by the position in memory.
-		if( node->parent != NULL && fvecLen == 0 ) {
-			bool isLeftNode = ( node->parent->leftChild == node );
-
-			if( !isLeftNode ) {
-				if( node->parent->parent != NULL ) {
-					BVHNode* dummy = new BVHNode();
-					dummy->parent = node->parent;
-
-					// As long as we are on the right side of a (sub)tree,
-					// skip parents until we either are at the root or
-					// our parent has a true sibling again.
-					while( dummy->parent->parent->rightChild == dummy->parent ) {
-						dummy->parent = dummy->parent->parent;
-
-						if( dummy->parent->parent == NULL ) {
-							break;
-						}
-					}
-
-					// Reached a parent with a true sibling.
-					if( dummy->parent->parent != NULL ) {
-						sn.bbMax.w = dummy->parent->parent->rightChild->id - dummy->parent->parent->rightChild->numSkipsToHere;
-					}
-				}
-			}
-			// Node on the left, go to the right sibling.
-			else {
-				sn.bbMax.w = node->parent->rightChild->id - node->parent->rightChild->numSkipsToHere;
-			}
-		}
+	if( bvhCache != NULL ) {
+		bvhCache->save(
+			&bvhNodesCL[0], bytesBVH, bvhNodesCL.size(),
+			&facesV[0], bytesFV, &facesN[0], bytesFN
+		);
+	}
+
+	return bytesBuffer + bytesFV + bytesFN;
+}
+
+
+/**
+ * Init OpenCL buffers for the BVH from the cache file.
+ * @param  {BVHCache*} bvhCache Cache with a loaded cache file.
+ * @return {size_t}             Buffer size.
+ */
+size_t PathTracer::initOpenCLBuffers_BVHCache( BVHCache* bvhCache ) {
+	const bvhNode_cl* nodes = (const bvhNode_cl*) bvhCache->getNodes();
+	size_t bytesBVH = this->initOpenCLBuffers_BVHNodes( nodes, bvhCache->getNumNodes() );
+
+	char msg[16];
+	snprintf( msg, 16, "%u", bvhCache->getNumNodes() );
+	mCL->setReplacement( string( "#BVH_NUM_NODES#" ), string( msg ) );
+
+	snprintf( msg, 16, "%u", this->getDepthOfFlatBVH( nodes, bvhCache->getNumNodes() ) );
+	mCL->setReplacement( string( "#BVH_STACK_SIZE#" ), string( msg ) );
+
+	size_t bytesFV = bvhCache->getBytesFacesV();
+	mBufFacesV = mCL->createBuffer( bvhCache->getFacesV(), bytesFV );
+
+	const cl_uint4* facesV = (const cl_uint4*) bvhCache->getFacesV();
+	mFacesV.assign( facesV, facesV + bytesFV / sizeof( cl_uint4 ) );
+
+	size_t bytesFN = bvhCache->getBytesFacesN();
+	mBufFacesN = mCL->createBuffer( bvhCache->getFacesN(), bytesFN );
+
+	return bytesBVH + bytesFV + bytesFN;
+}
 
-		bvhNodesCL.push_back( sn );
 
-		// Faces
-		for( int j = 0; j < fvecLen; j++) {
-			Tri tri = facesVec[j];
-			cl_uint4 fv;
-			cl_uint4 fn;
-
-			fv.x = faces[tri.face.w * 3];
-			fv.y = faces[tri.face.w * 3 + 1];
-			fv.z = faces[tri.face.w * 3 + 2];
-			// Material of face
-			fv.w = facesMtl[tri.face.w];
-
-			fn.x = facesVN[tri.normals.w * 3];
-			fn.y = facesVN[tri.normals.w * 3 + 1];
-			fn.z = facesVN[tri.normals.w * 3 + 2];
-			fn.w = 0;
-
-			facesV.push_back( fv );
-			facesN.push_back( fn );
+/**
+ * Init OpenCL buffer for the nodes of the BVH.
+ * If enabled and the indices fit, the nodes are compacted to 16 bytes.
+ * For the image storage, the nodes are written to an image instead.
+ * @param  {const bvhNode_cl*} nodes    The flattened nodes.
+ * @param  {const cl_uint}     numNodes Number of nodes.
+ * @return {size_t}                     Buffer size.
+ */
+size_t PathTracer::initOpenCLBuffers_BVHNodes( const bvhNode_cl* nodes, const cl_uint numNodes ) {
+	size_t bytesBVH = sizeof( bvhNode_cl ) * numNodes;
+	vector<bvhNodeCompact_cl> compactNodes;
+	bool isCompact = false;
+
+	// Two texels per node. The kernel argument for the buffer gets NULL.
+	if( mBVHTexDim > 0 ) {
+		mCL->setReplacement( string( "#BVH_COMPACT#" ), string( "0" ) );
+		mBufBVH = NULL;
+		mImageBVH = this->createTexelImage( (const cl_float4*) nodes, numNodes * 2, &bytesBVH );
+
+		return bytesBVH;
+	}
+
+	if( Cfg::get().value<bool>( Cfg::BVH_COMPACTNODES ) ) {
+		isCompact = this->compactBVHNodes( nodes, numNodes, &compactNodes );
+
+		if( !isCompact ) {
+			Logger::logWarning( "[PathTracer] Too many faces or nodes for compact BVH nodes. Using the full nodes." );
 		}
 	}
 
-	size_t bytesBVH = sizeof( bvhNode_cl ) * bvhNodesCL.size();
-	mBufBVH = mCL->createBuffer( bvhNodesCL, bytesBVH );
+	mCL->setReplacement( string( "#BVH_COMPACT#" ), string( isCompact ? "1" : "0" ) );
 
-	char msg[16];
-	snprintf( msg, 16, "%lu", bvhNodesCL.size() );
-	mCL->setReplacement( string( "#BVH_NUM_NODES#" ), string( msg ) );
+	if( !isCompact ) {
+		mBufBVH = mCL->createBuffer( nodes, bytesBVH );
 
-	size_t bytesFV = sizeof( cl_uint4 ) * facesV.size();
-	mBufFacesV = mCL->createBuffer( facesV, bytesFV );
+		return bytesBVH;
+	}
 
-	size_t bytesFN = sizeof( cl_uint4 ) * facesN.size();
-	mBufFacesN = mCL->createBuffer( facesN, bytesFN );
+	size_t bytesCompact = sizeof( bvhNodeCompact_cl ) * compactNodes.size();
+	mBufBVH = mCL->createBuffer( compactNodes, bytesCompact );
 
-	return bytesBVH + bytesFV + bytesFN;
+	float bytesFloat, bytesFloatFull;
+	string unit, unitFull;
+	utils::formatBytes( bytesCompact, &bytesFloat, &unit );
+	utils::formatBytes( bytesBVH, &bytesFloatFull, &unitFull );
+
+	char msg[128];
+	snprintf(
+		msg, 128, "[PathTracer] Compact BVH nodes: %.2f %s instead of %.2f %s.",
+		bytesFloat, unit.c_str(), bytesFloatFull, unitFull.c_str()
+	);
+	Logger::logInfo( msg );
+
+	return bytesCompact;
 }
 
 
@@ -380,6 +1144,66 @@ size_t PathTracer::initOpenCLBuffers_Faces(
 }
 
 
+/**
+ * Init OpenCL buffers for the BVH and build it on the OpenCL device.
+ * The faces keep their original order, the leaf nodes reference them directly.
+ * @param  {ModelLoader*}         ml    Model loader already holding the needed model data.
+ * @param  {std::vector<cl_uint>} faces Faces of the model.
+ * @return {size_t}                     Buffer size.
+ */
+size_t PathTracer::initOpenCLBuffers_LBVH( ModelLoader* ml, vector<cl_uint> faces ) {
+	vector<cl_uint> facesVN = ml->getObjParser()->getFacesVN();
+	vector<cl_int> facesMtl = ml->getObjParser()->getFacesMtl();
+	vector<cl_uint4> facesV;
+	vector<cl_uint4> facesN;
+
+	for( cl_uint i = 0; i < facesMtl.size(); i++ ) {
+		cl_uint4 fv = { faces[i * 3], faces[i * 3 + 1], faces[i * 3 + 2], (cl_uint) facesMtl[i] };
+		cl_uint4 fn = { facesVN[i * 3], facesVN[i * 3 + 1], facesVN[i * 3 + 2], 0 };
+
+		facesV.push_back( fv );
+		facesN.push_back( fn );
+	}
+
+	size_t bytesFV = sizeof( cl_uint4 ) * facesV.size();
+	mBufFacesV = mCL->createBuffer( facesV, bytesFV );
+	mFacesV = facesV;
+
+	size_t bytesFN = sizeof( cl_uint4 ) * facesN.size();
+	mBufFacesN = mCL->createBuffer( facesN, bytesFN );
+
+	// The LBVH has 2n-1 nodes. @see flattenBVH() for the limit.
+	if( 2 * (cl_ulong) facesV.size() - 1 > (cl_ulong) CL_INT_MAX ) {
+		Logger::logError( "[PathTracer] The LBVH has too many nodes for the 32 bit indices of the kernel." );
+		exit( EXIT_FAILURE );
+	}
+
+	LBVH* lbvh = new LBVH( mCL );
+	mBufBVH = lbvh->build( mBufFacesV, mBufFacesN, mBufVertices, mBufNormals, facesV.size() );
+	cl_uint numNodes = lbvh->getNumNodes();
+	delete lbvh;
+
+	// The nodes are built on the device in the full layout.
+	mCL->setReplacement( string( "#BVH_COMPACT#" ), string( "0" ) );
+
+	if( Cfg::get().value<bool>( Cfg::BVH_COMPACTNODES ) ) {
+		Logger::logWarning( "[PathTracer] Compact BVH nodes are not available for the LBVH. Using the full nodes." );
+	}
+
+	char msg[16];
+	snprintf( msg, 16, "%u", numNodes );
+	mCL->setReplacement( string( "#BVH_NUM_NODES#" ), string( msg ) );
+
+	// The tree is only on the device, so use the upper bound of its depth.
+	snprintf( msg, 16, "%u", LBVH_MAX_DEPTH );
+	mCL->setReplacement( string( "#BVH_STACK_SIZE#" ), string( msg ) );
+
+	size_t bytesBVH = sizeof( bvhNode_cl ) * numNodes;
+
+	return bytesBVH + bytesFV + bytesFN;
+}
+
+
 /**
  * Init OpenCL buffers for the lights.
  * @param {ModelLoader*} ml Model loader already holding the needed model data.
@@ -533,6 +1357,380 @@ size_t PathTracer::initOpenCLBuffers_Textures() {
 }
 
 
+/**
+ * Init OpenCL buffer of the precomputed triangles for the intersection test,
+ * or the image for the image storage. The faces of the acceleration
+ * structure have to be set already. The
+ * indexed faces and vertices are still used for the shading.
+ * @param  {const std::vector<cl_float>*} vertices Vertices of the model.
+ * @return {size_t}                                Buffer size.
+ */
+size_t PathTracer::initOpenCLBuffers_Triangles( const vector<cl_float>* vertices ) {
+	vector<triangle_cl> triangles = this->getTriangles( vertices );
+	size_t bytesTri = sizeof( triangle_cl ) * triangles.size();
+
+	// Three texels per triangle. The kernel argument for the buffer gets NULL.
+	if( mBVHTexDim > 0 ) {
+		mBufTriangles = NULL;
+		mImageTriangles = this->createTexelImage( &triangles[0].a, triangles.size() * 3, &bytesTri );
+	}
+	else {
+		mBufTriangles = mCL->createBuffer( triangles, bytesTri );
+	}
+
+	// Used by the debug image of the statistics mode.
+	char msg[16];
+	snprintf( msg, 16, "%lu", triangles.size() );
+	mCL->setReplacement( string( "#NUM_FACES#" ), string( msg ) );
+
+	return bytesTri;
+}
+
+
+/**
+ * Init OpenCL buffers for the two-level BVH.
+ * The nodes of the top level come first, followed by the nodes of each bottom level.
+ * Leaf nodes of the top level hold -2 - <instance index> instead of a face index.
+ * @param  {TwoLevelBVH*}         tlbvh The generated two-level BVH.
+ * @param  {ModelLoader*}         ml    Model loader already holding the needed model data.
+ * @param  {std::vector<cl_uint>} faces Faces of the model.
+ * @return {size_t}                     Buffer size.
+ */
+size_t PathTracer::initOpenCLBuffers_TwoLevelBVH(
+	TwoLevelBVH* tlbvh, ModelLoader* ml, vector<cl_uint> faces
+) {
+	const vector<BVHNode>* topNodes = tlbvh->getTopLevelNodes();
+	const vector<BVH*>* bottomLevels = tlbvh->getBottomLevels();
+	const vector<TwoLevelBVHInstance>* instances = tlbvh->getInstances();
+	vector<bvhNode_cl> bvhNodesCL;
+	vector<bvhInstance_cl> instancesCL;
+
+	vector<cl_uint> facesVN = ml->getObjParser()->getFacesVN();
+	vector<cl_int> facesMtl = ml->getObjParser()->getFacesMtl();
+	vector<cl_uint4> facesV;
+	vector<cl_uint4> facesN;
+
+
+	// Top level. The nodes are in depth-first order, so the next node
+	// after a missed node is the right sibling of the node or of the
+	// nearest parent, that is a left child.
+
+	vector<cl_int> nextNode( topNodes->size(), 0 );
+
+	for( cl_uint i = 0; i < topNodes->size(); i++ ) {
+		const BVHNode* node = &(*topNodes)[i];
+
+		if( node->parent >= 0 ) {
+			const BVHNode* parent = &(*topNodes)[node->parent];
+			nextNode[i] = ( parent->leftChild == (cl_int) i ) ? parent->rightChild : nextNode[node->parent];
+		}
+
+		bvhNode_cl sn;
+
+		for( cl_uint axis = 0; axis < 3; axis++ ) {
+			sn.bbMin[axis] = node->bbMin[axis];
+			sn.bbMax[axis] = node->bbMax[axis];
+		}
+
+		sn.first = ( node->numFaces > 0 ) ? -2 - (cl_int) node->facesStart : -1;
+		sn.next = nextNode[i];
+
+		bvhNodesCL.push_back( sn );
+	}
+
+
+	// Bottom levels. Leaving a bottom level means going back to the
+	// top level, so the right-most nodes link to the end of the bottom level.
+
+	vector<cl_int4> bottomLevelNodes( bottomLevels->size() );
+
+	for( cl_uint i = 0; i < bottomLevels->size(); i++ ) {
+		const cl_uint start = bvhNodesCL.size();
+		this->flattenBVH( (*bottomLevels)[i], &faces, &facesVN, &facesMtl, &bvhNodesCL, &facesV, &facesN );
+		const cl_uint end = bvhNodesCL.size();
+
+		for( cl_uint j = start; j < end; j++ ) {
+			if( bvhNodesCL[j].first < 0 && bvhNodesCL[j].next < 0 ) {
+				bvhNodesCL[j].next = end;
+			}
+		}
+
+		// The leaf node of the top level already tested the bounding box of the
+		// object, so start with the left child of the root. Unless it is a leaf node.
+		cl_int4 range = { (cl_int) ( ( end - start > 1 ) ? start + 1 : start ), (cl_int) end, 0, 0 };
+		bottomLevelNodes[i] = range;
+	}
+
+
+	// Instances
+
+	for( cl_uint i = 0; i < instances->size(); i++ ) {
+		const TwoLevelBVHInstance* instance = &(*instances)[i];
+		bvhInstance_cl ic;
+
+		// Rows of the inverse transformation. GLM matrices are column-major.
+		for( cl_uint row = 0; row < 3; row++ ) {
+			ic.worldToObject[row].x = instance->inverse[0][row];
+			ic.worldToObject[row].y = instance->inverse[1][row];
+			ic.worldToObject[row].z = instance->inverse[2][row];
+			ic.worldToObject[row].w = instance->inverse[3][row];
+		}
+
+		ic.nodes = bottomLevelNodes[instance->bottomLevel];
+		instancesCL.push_back( ic );
+	}
+
+	size_t bytesBVH = sizeof( bvhNode_cl ) * bvhNodesCL.size();
+	mBufBVH = mCL->createBuffer( bvhNodesCL, bytesBVH );
+
+	size_t bytesInstances = sizeof( bvhInstance_cl ) * instancesCL.size();
+	mBufInstances = mCL->createBuffer( instancesCL, bytesInstances );
+
+	char msg[16];
+	snprintf( msg, 16, "%lu", bvhNodesCL.size() );
+	mCL->setReplacement( string( "#BVH_NUM_NODES#" ), string( msg ) );
+
+	size_t bytesFV = sizeof( cl_uint4 ) * facesV.size();
+	mBufFacesV = mCL->createBuffer( facesV, bytesFV );
+	mFacesV = facesV;
+
+	size_t bytesFN = sizeof( cl_uint4 ) * facesN.size();
+	mBufFacesN = mCL->createBuffer( facesN, bytesFN );
+
+	return bytesBVH + bytesInstances + bytesFV + bytesFN;
+}
+
+
+/**
+ * Init the OpenCL buffers for the wavefront path tracing: The state of one path
+ * per pixel, stored as one buffer per value, and the queues of path indices.
+ * If the queue is sorted, also the buffers of the sort and the grid over the scene.
+ * @param  {const vector<cl_float>*} vertices Vertices of the model.
+ * @return {size_t}                           Buffer size.
+ */
+size_t PathTracer::initOpenCLBuffers_Wavefront( const vector<cl_float>* vertices ) {
+	const size_t numPaths = mWidth * mHeight;
+	const size_t sizeFloat4 = sizeof( cl_float4 ) * numPaths;
+	const size_t sizeUint = sizeof( cl_uint ) * numPaths;
+
+	mBufQueues[0] = mCL->createEmptyBuffer( sizeUint, CL_MEM_READ_WRITE );
+	mBufQueues[1] = mCL->createEmptyBuffer( sizeUint, CL_MEM_READ_WRITE );
+	mBufQueueShadow = mCL->createEmptyBuffer( sizeUint, CL_MEM_READ_WRITE );
+	mBufCounters = mCL->createEmptyBuffer( sizeof( cl_uint ) * 2, CL_MEM_READ_WRITE );
+
+	mBufPathOrigin = mCL->createEmptyBuffer( sizeFloat4, CL_MEM_READ_WRITE );
+	mBufPathDir = mCL->createEmptyBuffer( sizeFloat4, CL_MEM_READ_WRITE );
+	mBufPathNormal = mCL->createEmptyBuffer( sizeFloat4, CL_MEM_READ_WRITE );
+	mBufPathColor = mCL->createEmptyBuffer( sizeFloat4, CL_MEM_READ_WRITE );
+	mBufPathFinalColor = mCL->createEmptyBuffer( sizeFloat4, CL_MEM_READ_WRITE );
+	mBufPathState = mCL->createEmptyBuffer( sizeof( cl_uint4 ) * numPaths, CL_MEM_READ_WRITE );
+	mBufPathRandom = mCL->createEmptyBuffer( sizeof( cl_float2 ) * numPaths, CL_MEM_READ_WRITE );
+
+	mBufShadowOrigin = mCL->createEmptyBuffer( sizeFloat4, CL_MEM_READ_WRITE );
+	mBufShadowDir = mCL->createEmptyBuffer( sizeFloat4, CL_MEM_READ_WRITE );
+	mBufShadowColor = mCL->createEmptyBuffer( sizeFloat4, CL_MEM_READ_WRITE );
+
+	size_t bytes = sizeUint * 3 + sizeof( cl_uint ) * 2 + sizeFloat4 * 8 +
+		sizeof( cl_uint4 ) * numPaths + sizeof( cl_float2 ) * numPaths;
+
+	char msg[16];
+	snprintf( msg, 16, "%u", PATHTRACER_SORT_AXIS_BITS );
+	mCL->setReplacement( string( "#SORT_AXIS_BITS#" ), string( msg ) );
+	snprintf( msg, 16, "%u", PATHTRACER_SORT_SCAN_BLOCK );
+	mCL->setReplacement( string( "#SORT_SCAN_BLOCK#" ), string( msg ) );
+
+	if( !mWavefrontSort ) {
+		return bytes;
+	}
+
+	// Grid over the bounds of the scene for the cells of the ray origins.
+	glm::vec3 bbMin( INFINITY );
+	glm::vec3 bbMax( -INFINITY );
+
+	for( size_t i = 0; i + 2 < vertices->size(); i += 3 ) {
+		glm::vec3 v( ( *vertices )[i], ( *vertices )[i + 1], ( *vertices )[i + 2] );
+		bbMin = glm::min( bbMin, v );
+		bbMax = glm::max( bbMax, v );
+	}
+
+	const cl_float numCells = (cl_float) ( 1 << PATHTRACER_SORT_AXIS_BITS );
+
+	for( cl_uint axis = 0; axis < 3; axis++ ) {
+		const cl_float extent = fmax( bbMax[axis] - bbMin[axis], 0.00001f );
+		mSortBoundsMin.s[axis] = bbMin[axis];
+		mSortBoundsScale.s[axis] = numCells / extent;
+	}
+
+	mSortBoundsMin.s[3] = 0.0f;
+	mSortBoundsScale.s[3] = 0.0f;
+
+	const cl_uint numBins = 8 << ( 3 * PATHTRACER_SORT_AXIS_BITS );
+	const cl_uint numBlocks = numBins / PATHTRACER_SORT_SCAN_BLOCK;
+	vector<cl_uint> zeros( numBins, 0 );
+
+	// The counts have to start at 0. The prefix sum resets them after each use.
+	mBufSortBins = mCL->createEmptyBuffer( sizeof( cl_uint ) * numBins, CL_MEM_READ_WRITE );
+	mCL->updateBuffer( mBufSortBins, sizeof( cl_uint ) * numBins, &zeros[0] );
+	mBufSortBinOffsets = mCL->createEmptyBuffer( sizeof( cl_uint ) * numBins, CL_MEM_READ_WRITE );
+	mBufSortBlockSums = mCL->createEmptyBuffer( sizeof( cl_uint ) * numBlocks, CL_MEM_READ_WRITE );
+	mBufSortKeys = mCL->createEmptyBuffer( sizeof( cl_uint2 ) * numPaths, CL_MEM_READ_WRITE );
+	mBufQueueSorted = mCL->createEmptyBuffer( sizeUint, CL_MEM_READ_WRITE );
+
+	bytes += sizeof( cl_uint ) * ( numBins * 2 + numBlocks ) + sizeof( cl_uint2 ) * numPaths + sizeUint;
+
+	return bytes;
+}
+
+
+/**
+ * Init OpenCL buffers for the wide BVH.
+ * Children of a node are either other nodes or leaf nodes, which
+ * reference the faces directly (first face and number of faces).
+ * @param  {WideBVH*}             wbvh  The generated wide BVH.
+ * @param  {ModelLoader*}         ml    Model loader already holding the needed model data.
+ * @param  {std::vector<cl_uint>} faces Faces of the model.
+ * @return {size_t}                     Buffer size.
+ */
+size_t PathTracer::initOpenCLBuffers_WideBVH( WideBVH* wbvh, ModelLoader* ml, vector<cl_uint> faces ) {
+	const vector<WideBVHNode>* wideNodes = wbvh->getNodes();
+	const vector<BVHNode>* binaryNodes = wbvh->getBinaryBVH()->getNodes();
+	const vector<Tri>* bvhFaces = wbvh->getBinaryBVH()->getFaces();
+	vector<bvhWideNode_cl> bvhNodesCL;
+
+	vector<cl_uint> facesVN = ml->getObjParser()->getFacesVN();
+	vector<cl_int> facesMtl = ml->getObjParser()->getFacesMtl();
+	vector<cl_uint4> facesV;
+	vector<cl_uint4> facesN;
+
+	bvhNodesCL.reserve( wideNodes->size() );
+
+	for( cl_uint i = 0; i < wideNodes->size(); i++ ) {
+		const WideBVHNode* node = &(*wideNodes)[i];
+		bvhWideNode_cl wn;
+
+		this->quantizeWideBVHNode( node, binaryNodes, &wn );
+
+		for( cl_uint c = 0; c < WIDEBVH_WIDTH; c++ ) {
+			wn.children.s[c] = -1;
+			wn.numFaces.s[c] = 0;
+
+			if( c >= node->numChildren ) {
+				continue;
+			}
+
+			// Inner node
+			if( node->wideChildren[c] >= 0 ) {
+				wn.children.s[c] = node->wideChildren[c];
+				continue;
+			}
+
+			// Leaf node
+			const BVHNode* leaf = &(*binaryNodes)[node->children[c]];
+
+			if( leaf->numFaces == 0 ) {
+				continue;
+			}
+
+			if( leaf->numFaces > 255 ) {
+				Logger::logError( "[PathTracer] Too many faces in a leaf node for the wide BVH." );
+				exit( EXIT_FAILURE );
+			}
+
+			wn.children.s[c] = facesV.size();
+			wn.numFaces.s[c] = leaf->numFaces;
+			this->flattenFaces( bvhFaces, leaf, &faces, &facesVN, &facesMtl, &facesV, &facesN );
+		}
+
+		bvhNodesCL.push_back( wn );
+	}
+
+	size_t bytesBVH = sizeof( bvhWideNode_cl ) * bvhNodesCL.size();
+	mBufBVH = mCL->createBuffer( bvhNodesCL, bytesBVH );
+
+	char msg[16];
+	snprintf( msg, 16, "%lu", bvhNodesCL.size() );
+	mCL->setReplacement( string( "#BVH_NUM_NODES#" ), string( msg ) );
+
+	// Each level pushes at most all but one child onto the stack.
+	snprintf( msg, 16, "%u", ( WIDEBVH_WIDTH - 1 ) * wbvh->getDepth() + 1 );
+	mCL->setReplacement( string( "#WIDEBVH_STACK_SIZE#" ), string( msg ) );
+
+	size_t bytesFV = sizeof( cl_uint4 ) * facesV.size();
+	mBufFacesV = mCL->createBuffer( facesV, bytesFV );
+	mFacesV = facesV;
+
+	size_t bytesFN = sizeof( cl_uint4 ) * facesN.size();
+	mBufFacesN = mCL->createBuffer( facesN, bytesFN );
+
+	return bytesBVH + bytesFV + bytesFN;
+}
+
+
+/**
+ * Read the counters of each pixel of the last frame (statistics mode) and
+ * log the totals of the frame, the mean and maximum per pixel and a
+ * histogram of the counts per pixel. The traced rays (bounces and shadow
+ * rays) are related to the time of a frame to get the rays per second.
+ * @param {cl_double} frameTime Mean time of the kernels of a frame in milliseconds.
+ */
+void PathTracer::logStatistics( cl_double frameTime ) {
+	const cl_uint numPixels = mWidth * mHeight;
+	vector<cl_uint4> stats( numPixels );
+	mCL->readBuffer( mBufStats, sizeof( cl_uint4 ) * numPixels, &stats[0] );
+
+	const char* names[4] = { "Nodes", "Faces", "Bounces", "Shadow rays" };
+	cl_ulong numRays = 0;
+	char msg[128];
+
+	Logger::logDebug( "[PathTracer] Statistics of the last frame:" );
+	Logger::indent( LOG_INDENT );
+
+	for( cl_uint k = 0; k < 4; k++ ) {
+		vector<cl_uint> histogram( PATHTRACER_STATISTICS_BINS, 0 );
+		cl_ulong total = 0;
+		cl_uint maxCount = 0;
+
+		for( cl_uint i = 0; i < numPixels; i++ ) {
+			const cl_uint count = stats[i].s[k];
+			cl_uint bin = 0;
+
+			while( bin < PATHTRACER_STATISTICS_BINS - 1 && ( count >> bin ) > 0 ) {
+				bin++;
+			}
+
+			histogram[bin]++;
+			total += count;
+			maxCount = std::max( maxCount, count );
+		}
+
+		snprintf(
+			msg, 128, "[PathTracer] %s: %llu in total, %.2f per pixel, max %u.",
+			names[k], (unsigned long long) total, total / (cl_double) numPixels, maxCount
+		);
+		Logger::logDebug( msg );
+
+		string line = "[PathTracer]   Pixels per count (0, 1, 2-3, 4-7, ...):";
+
+		for( cl_uint bin = 0; bin < PATHTRACER_STATISTICS_BINS; bin++ ) {
+			snprintf( msg, 128, " %u", histogram[bin] );
+			line.append( msg );
+		}
+
+		Logger::logDebug( line );
+
+		numRays += ( k >= 2 ) ? total : 0;
+	}
+
+	snprintf(
+		msg, 128, "[PathTracer] %.2f million rays per second.",
+		numRays / ( frameTime * 1000.0 )
+	);
+	Logger::logDebug( msg );
+
+	Logger::indent( 0 );
+}
+
+
 /**
  * Move the position of the sun. This will also reset the sample count.
  * @param {const int} key Pressed key.
@@ -570,6 +1768,76 @@ void PathTracer::moveSun( const int key ) {
 }
 
 
+/**
+ * Quantize the bounding boxes of the children of a wide node to 8 bit. The grid
+ * starts at the minimum of the node and is scaled per axis by a power of two, so
+ * the kernel can dequantize exactly. The quantized boxes enclose the real ones.
+ * @param {const WideBVHNode*}            node        The wide node.
+ * @param {const std::vector<BVHNode>*}   binaryNodes Nodes of the binary BVH, holding the boxes of the children.
+ * @param {bvhWideNode_cl*}               wn          Output. Node to set the origin, scale and boxes of.
+ */
+void PathTracer::quantizeWideBVHNode(
+	const WideBVHNode* node, const vector<BVHNode>* binaryNodes, bvhWideNode_cl* wn
+) {
+	cl_float scale[3];
+
+	wn->origin.x = node->bbMin[0];
+	wn->origin.y = node->bbMin[1];
+	wn->origin.z = node->bbMin[2];
+	wn->origin.w = 0.0f;
+	wn->exponents.s[3] = 0;
+
+	for( cl_uint a = 0; a < 3; a++ ) {
+		const cl_float extent = node->bbMax[a] - node->bbMin[a];
+		cl_int e = ( extent > 0.0f ) ? (cl_int) ceilf( log2f( extent / 255.0f ) ) : -126;
+		e = std::min( std::max( e, -126 ), 127 );
+
+		// Rounding of log2f may leave the grid too small.
+		while( e < 127 && node->bbMin[a] + 255.0f * ldexpf( 1.0f, e ) < node->bbMax[a] ) {
+			e++;
+		}
+
+		wn->exponents.s[a] = e;
+		scale[a] = ldexpf( 1.0f, e );
+	}
+
+	for( cl_uint c = 0; c < WIDEBVH_WIDTH; c++ ) {
+		cl_uchar qMin[3] = { 0, 0, 0 };
+		cl_uchar qMax[3] = { 0, 0, 0 };
+
+		if( c < node->numChildren ) {
+			const BVHNode* child = &(*binaryNodes)[node->children[c]];
+
+			for( cl_uint a = 0; a < 3; a++ ) {
+				const cl_float o = node->bbMin[a];
+				cl_int lo = floorf( ( child->bbMin[a] - o ) / scale[a] );
+				cl_int hi = ceilf( ( child->bbMax[a] - o ) / scale[a] );
+				lo = std::min( std::max( lo, 0 ), 255 );
+				hi = std::min( std::max( hi, 0 ), 255 );
+
+				// Make sure the box encloses the child after rounding.
+				while( lo > 0 && o + (cl_float) lo * scale[a] > child->bbMin[a] ) {
+					lo--;
+				}
+				while( hi < 255 && o + (cl_float) hi * scale[a] < child->bbMax[a] ) {
+					hi++;
+				}
+
+				qMin[a] = lo;
+				qMax[a] = hi;
+			}
+		}
+
+		wn->qMinX.s[c] = qMin[0];
+		wn->qMinY.s[c] = qMin[1];
+		wn->qMinZ.s[c] = qMin[2];
+		wn->qMaxX.s[c] = qMax[0];
+		wn->qMaxY.s[c] = qMax[1];
+		wn->qMaxZ.s[c] = qMax[2];
+	}
+}
+
+
 /**
  * Reset the sample counter. Should be done whenever the camera is changed.
  */
@@ -622,6 +1890,53 @@ void PathTracer::setWidthAndHeight( cl_uint width, cl_uint height ) {
 }
 
 
+/**
+ * Add the kernel time of a frame to the benchmark. Every few frames the
+ * mean time is logged, to compare the settings of the path tracing.
+ * @param {cl_double} kernelTime Time of all path tracing kernels of the frame in milliseconds.
+ */
+void PathTracer::updateBenchmark( cl_double kernelTime ) {
+	mBenchmarkTime += kernelTime;
+	mBenchmarkFrames++;
+
+	if( mBenchmarkFrames < PATHTRACER_BENCHMARK_FRAMES ) {
+		return;
+	}
+
+	char msg[128];
+	snprintf(
+		msg, 128, "[PathTracer] Path tracing kernels: %.3f ms per frame (mean of %u frames).",
+		mBenchmarkTime / mBenchmarkFrames, mBenchmarkFrames
+	);
+	Logger::logDebug( msg );
+
+	// Compare with and without sorting: Does the faster extension pay for the sort?
+	if( mWavefrontSort ) {
+		snprintf(
+			msg, 128, "[PathTracer] Sorting the paths: %.3f ms, extending them: %.3f ms per frame.",
+			mBenchmarkSortTime / mBenchmarkFrames, mBenchmarkExtendTime / mBenchmarkFrames
+		);
+		Logger::logDebug( msg );
+	}
+	else if( mWavefront ) {
+		snprintf(
+			msg, 128, "[PathTracer] Extending the paths: %.3f ms per frame.",
+			mBenchmarkExtendTime / mBenchmarkFrames
+		);
+		Logger::logDebug( msg );
+	}
+
+	if( mStatistics ) {
+		this->logStatistics( mBenchmarkTime / mBenchmarkFrames );
+	}
+
+	mBenchmarkFrames = 0;
+	mBenchmarkTime = 0.0;
+	mBenchmarkSortTime = 0.0;
+	mBenchmarkExtendTime = 0.0;
+}
+
+
 /**
  * Update the OpenCL buffer of the camera eye and related vectors.
  */
@@ -650,3 +1965,30 @@ void PathTracer::updateEyeBuffer() {
 	mStructCam.v.y = v[1];
 	mStructCam.v.z = v[2];
 }
+
+
+/**
+ * Update the vertices and normals of the model and refit the BVH on the OpenCL device.
+ * The number of vertices and normals and the faces have to stay the same.
+ * @param {std::vector<cl_float>} vertices The moved vertices.
+ * @param {std::vector<cl_float>} normals  The normals of the moved vertices.
+ */
+void PathTracer::updateVertices( vector<cl_float> vertices, vector<cl_float> normals ) {
+	if( mBVHRefit == NULL ) {
+		Logger::logWarning( "[PathTracer] The BVH has not been prepared for refitting. @see Cfg::BVH_REFIT." );
+		return;
+	}
+
+	vector<cl_float4> vertices4 = AccelStructure::packFloatAsFloat4( &vertices );
+	vector<cl_float4> normals4 = AccelStructure::packFloatAsFloat4( &normals );
+
+	mCL->updateBuffer( mBufVertices, sizeof( cl_float4 ) * vertices4.size(), &vertices4[0] );
+	mCL->updateBuffer( mBufNormals, sizeof( cl_float4 ) * normals4.size(), &normals4[0] );
+
+	vector<triangle_cl> triangles = this->getTriangles( &vertices );
+	mCL->updateBuffer( mBufTriangles, sizeof( triangle_cl ) * triangles.size(), &triangles[0] );
+
+	mBVHRefit->refit( mBufBVH, mBufFacesV, mBufFacesN, mBufVertices, mBufNormals );
+
+	this->resetSampleCount();
+}
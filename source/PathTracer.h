@@ -3,8 +3,23 @@
 
 #define GLM_FORCE_RADIANS
 
+// Log the mean time of the path tracing kernel every n frames.
+#define PATHTRACER_BENCHMARK_FRAMES 100
+// Bins of the histograms of the statistics mode. Bin 0 counts the pixels
+// with a count of 0, bin i those with [2^(i-1), 2^i), the last bin all above.
+#define PATHTRACER_STATISTICS_BINS 16
+// Width of the images for the BVH nodes and triangles (bvh.storage 1).
+// Devices support at least 8192 texels in each dimension.
+#define PATHTRACER_TEX_DIM 8192
+// Sorting the rays of the wavefront path tracing: Bits per axis of the grid
+// cell of the origin. Together with the octant: 8 * 2^(3*bits) sort keys.
+#define PATHTRACER_SORT_AXIS_BITS 3
+// Sort keys per work-item of the prefix sum.
+#define PATHTRACER_SORT_SCAN_BLOCK 64
+
 #include <algorithm>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <cmath>
 #include <ctime>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -15,9 +30,15 @@
 #include "Camera.h"
 #include "CL.h"
 #include "Cfg.h"
+#include "MathHelp.h"
 #include "MtlParser.h"
 #include "qt/GLWidget.h"
 #include "accelstructures/BVH.h"
+#include "accelstructures/BVHCache.h"
+#include "accelstructures/BVHRefit.h"
+#include "accelstructures/LBVH.h"
+#include "accelstructures/TwoLevelBVH.h"
+#include "accelstructures/WideBVH.h"
 
 using std::vector;
 
@@ -36,6 +57,13 @@ struct face_cl {
 	cl_uint4 normals;
 };
 
+// Precomputed for the intersection test, in the order of the faces of the leaf nodes.
+struct triangle_cl {
+	cl_float4 a; // w: normal.x
+	cl_float4 edge1; // w: normal.y
+	cl_float4 edge2; // w: normal.z
+};
+
 struct light_cl {
 	cl_float4 pos;
 	cl_float4 rgb;
@@ -67,9 +95,38 @@ struct material_shirley_ashikhmin_rgb {
 
 // BVH
 
+// The bounding box as floats, the indices as integers in place of the
+// w components. The kernel reads them with as_int().
 struct bvhNode_cl {
-	cl_float4 bbMin; // w: face index
-	cl_float4 bbMax; // w: face index or next node to visit
+	cl_float bbMin[3];
+	cl_int first; // index of the first face, -1 for inner nodes
+	cl_float bbMax[3];
+	cl_int next; // number of faces or next node to visit
+};
+
+// Compact BVH node. 16 bytes instead of 32.
+struct bvhNodeCompact_cl {
+	cl_ushort bb[6]; // bbMin and bbMax as half precision, rounded outwards
+	cl_uint data; // leaf flag, first face and number of faces, or skip ahead flag and next node
+};
+
+// Wide BVH. 4 children per node.
+struct bvhWideNode_cl {
+	cl_float4 origin; // xyz: origin of the grid for the quantized bounding boxes
+	cl_int4 children; // index of the node or first face, -1 for empty slots
+	cl_uchar4 qMinX; // quantized bounding boxes of the children
+	cl_uchar4 qMinY;
+	cl_uchar4 qMinZ;
+	cl_uchar4 qMaxX;
+	cl_uchar4 qMaxY;
+	cl_uchar4 qMaxZ;
+	cl_char4 exponents; // xyz: scale of the grid as power of two
+	cl_uchar4 numFaces; // number of faces of leaf nodes, 0 for inner nodes
+};
+
+struct bvhInstance_cl {
+	cl_float4 worldToObject[3]; // rows of the inverse transformation
+	cl_int4 nodes; // x: first node to visit; y: end of the nodes of the object
 };
 
 
@@ -85,7 +142,7 @@ class PathTracer {
 		vector<cl_float> generateImage( vector<cl_float>* textureDebug );
 		void initOpenCLBuffers(
 			vector<cl_float> vertices, vector<cl_uint> faces, vector<cl_float> normals,
-			ModelLoader* ml, AccelStructure* bvh
+			ModelLoader* ml, AccelStructure* bvh, BVHCache* bvhCache = NULL
 		);
 		void moveSun( const int key );
 		void resetSampleCount();
@@ -93,21 +150,58 @@ class PathTracer {
 		void setFocus( int x, int y );
 		void setFOV( cl_float fov );
 		void setWidthAndHeight( cl_uint width, cl_uint height );
+		void updateVertices( vector<cl_float> vertices, vector<cl_float> normals );
 
 	protected:
 		void clPathTracing( cl_float timeSinceStart );
+		void clPathTracingWavefront( cl_float timeSinceStart );
 		void clSetColors( cl_float timeSinceStart );
+		cl_double clSortPaths( cl_mem queue, cl_uint numPaths );
+		bool compactBVHNodes(
+			const bvhNode_cl* nodes, const cl_uint numNodes, vector<bvhNodeCompact_cl>* compactNodes
+		);
+		cl_mem createTexelImage( const cl_float4* texels, const size_t numTexels, size_t* bytes );
+		void flattenBVH(
+			BVH* bvh, const vector<cl_uint>* faces, const vector<cl_uint>* facesVN, const vector<cl_int>* facesMtl,
+			vector<bvhNode_cl>* bvhNodesCL, vector<cl_uint4>* facesV, vector<cl_uint4>* facesN
+		);
+		void flattenFaces(
+			const vector<Tri>* bvhFaces, const BVHNode* node,
+			const vector<cl_uint>* faces, const vector<cl_uint>* facesVN, const vector<cl_int>* facesMtl,
+			vector<cl_uint4>* facesV, vector<cl_uint4>* facesN
+		);
+		cl_uint getDepthOfFlatBVH( const bvhNode_cl* nodes, const cl_uint numNodes );
+		size_t getPersistentWorkSize();
 		cl_float getTimeSinceStart();
+		vector<triangle_cl> getTriangles( const vector<cl_float>* vertices );
 		void initKernelArgs();
-		size_t initOpenCLBuffers_BVH( BVH* bvh, ModelLoader* ml, vector<cl_uint> faces );
+		cl_uint initKernelArgs_AccelStruct( cl_kernel kernel, cl_uint i );
+		void initKernelArgs_Wavefront( cl_float pxDim );
+		size_t initOpenCLBuffers_BVH(
+			BVH* bvh, ModelLoader* ml, vector<cl_uint> faces, BVHCache* bvhCache
+		);
+		size_t initOpenCLBuffers_BVHCache( BVHCache* bvhCache );
+		size_t initOpenCLBuffers_BVHNodes( const bvhNode_cl* nodes, const cl_uint numNodes );
 		size_t initOpenCLBuffers_Faces(
 			ModelLoader* ml,
 			vector<cl_float> vertices, vector<cl_uint> faces, vector<cl_float> normals
 		);
+		size_t initOpenCLBuffers_LBVH( ModelLoader* ml, vector<cl_uint> faces );
 		size_t initOpenCLBuffers_Lights( ModelLoader* ml );
 		size_t initOpenCLBuffers_Materials( ModelLoader* ml );
 		size_t initOpenCLBuffers_MaterialsRGB( vector<material_t> materials );
 		size_t initOpenCLBuffers_Textures();
+		size_t initOpenCLBuffers_Triangles( const vector<cl_float>* vertices );
+		size_t initOpenCLBuffers_TwoLevelBVH(
+			TwoLevelBVH* tlbvh, ModelLoader* ml, vector<cl_uint> faces
+		);
+		size_t initOpenCLBuffers_Wavefront( const vector<cl_float>* vertices );
+		size_t initOpenCLBuffers_WideBVH( WideBVH* wbvh, ModelLoader* ml, vector<cl_uint> faces );
+		void logStatistics( cl_double frameTime );
+		void quantizeWideBVHNode(
+			const WideBVHNode* node, const vector<BVHNode>* binaryNodes, bvhWideNode_cl* wn
+		);
+		void updateBenchmark( cl_double kernelTime );
 		void updateEyeBuffer();
 
 	private:
@@ -115,14 +209,40 @@ class PathTracer {
 		cl_uint mWidth;
 		cl_float mFOV;
 		cl_uint mSampleCount;
+		bool mStatistics;
+		cl_uint mBVHTexDim;
+		bool mWavefront;
+		bool mWavefrontSort;
+		cl_uint mWavefrontSortMaxBounce;
+		size_t mPersistentWorkSize;
+		cl_uint mBenchmarkFrames;
+		cl_double mBenchmarkTime;
+		cl_double mBenchmarkSortTime;
+		cl_double mBenchmarkExtendTime;
+		cl_float4 mSortBoundsMin;
+		cl_float4 mSortBoundsScale;
 
 		vector<cl_float> mTextureOut;
+		vector<cl_uint4> mFacesV;
 
 		// cl_kernel mKernelNoiseFiltering;
 		cl_kernel mKernelPathTracing;
+		cl_kernel mKernelGenerate;
+		cl_kernel mKernelExtend;
+		cl_kernel mKernelShade;
+		cl_kernel mKernelConnect;
+		cl_kernel mKernelFinish;
+		cl_kernel mKernelSortCount;
+		cl_kernel mKernelSortScan;
+		cl_kernel mKernelSortScanBlockSums;
+		cl_kernel mKernelSortScatter;
 
 		cl_mem mBufBVH;
 		cl_mem mBufBVHFaces;
+		cl_mem mBufInstances;
+		cl_mem mBufTriangles;
+		cl_mem mImageBVH;
+		cl_mem mImageTriangles;
 		cl_mem mBufFacesV;
 		cl_mem mBufFacesN;
 		cl_mem mBufVertices;
@@ -133,11 +253,36 @@ class PathTracer {
 		cl_mem mBufTextureIn;
 		cl_mem mBufTextureOut;
 		cl_mem mBufTextureDebug;
+		cl_mem mBufPixelCounter;
+		cl_mem mBufStats;
+
+		// Wavefront: queues of path indices and the state of the paths
+		cl_mem mBufQueues[2];
+		cl_mem mBufQueueShadow;
+		cl_mem mBufCounters;
+		cl_mem mBufPathOrigin;
+		cl_mem mBufPathDir;
+		cl_mem mBufPathNormal;
+		cl_mem mBufPathColor;
+		cl_mem mBufPathFinalColor;
+		cl_mem mBufPathState;
+		cl_mem mBufPathRandom;
+		cl_mem mBufShadowOrigin;
+		cl_mem mBufShadowDir;
+		cl_mem mBufShadowColor;
+
+		// Wavefront: sorting the queue of the secondary rays
+		cl_mem mBufQueueSorted;
+		cl_mem mBufSortBins;
+		cl_mem mBufSortBinOffsets;
+		cl_mem mBufSortBlockSums;
+		cl_mem mBufSortKeys;
 
 		vector<light_cl> mLights;
 		cl_mem mBufLights;
 
 		GLWidget* mGLWidget;
+		BVHRefit* mBVHRefit;
 		Camera* mCamera;
 		CL* mCL;
 		// CL* mCLNoiseFilter;
@@ -0,0 +1,165 @@
+#include "TaskScheduler.h"
+
+using std::vector;
+
+
+thread_local cl_int TaskScheduler::mWorkerIndex = -1;
+
+
+/**
+ * Constructor.
+ * Work-stealing task scheduler. Each worker has its own queue of tasks.
+ * Spawned tasks are put into the queue of the spawning worker. A worker
+ * takes the newest task of its own queue first. If its queue is empty,
+ * it steals the oldest task from the queue of another worker.
+ * The thread calling wait() is used as worker 0.
+ * @param {const cl_uint} numThreads Number of threads including the calling thread.
+ *                                   0 to use all available hardware threads.
+ */
+TaskScheduler::TaskScheduler( const cl_uint numThreads ) {
+	mNumThreads = ( numThreads > 0 ) ? numThreads : std::thread::hardware_concurrency();
+	mNumThreads = ( mNumThreads > 0 ) ? mNumThreads : 1;
+	mStop = false;
+	mNumPending = 0;
+	mNumQueued = 0;
+
+	mQueues.resize( mNumThreads );
+	mQueueLocks = new std::mutex[mNumThreads];
+
+	for( cl_uint i = 1; i < mNumThreads; i++ ) {
+		mThreads.push_back( std::thread( &TaskScheduler::work, this, i ) );
+	}
+}
+
+
+/**
+ * Destructor.
+ */
+TaskScheduler::~TaskScheduler() {
+	{
+		std::lock_guard<std::mutex> lock( mWakeLock );
+		mStop = true;
+	}
+	mWakeCondition.notify_all();
+
+	for( cl_uint i = 0; i < mThreads.size(); i++ ) {
+		mThreads[i].join();
+	}
+
+	delete [] mQueueLocks;
+}
+
+
+/**
+ * Get the number of used threads.
+ * @return {cl_uint} Number of threads.
+ */
+cl_uint TaskScheduler::getNumThreads() {
+	return mNumThreads;
+}
+
+
+/**
+ * Take the next task and execute it.
+ * @param  {const cl_uint} worker Index of the worker.
+ * @return {bool}                 True, if a task has been executed, false otherwise.
+ */
+bool TaskScheduler::runNextTask( const cl_uint worker ) {
+	std::function<void()> task;
+
+	// Newest task of the own queue.
+	{
+		std::lock_guard<std::mutex> lock( mQueueLocks[worker] );
+
+		if( !mQueues[worker].empty() ) {
+			task = std::move( mQueues[worker].back() );
+			mQueues[worker].pop_back();
+		}
+	}
+
+	// Steal the oldest task of another queue.
+	for( cl_uint i = 1; i < mNumThreads && !task; i++ ) {
+		cl_uint victim = ( worker + i ) % mNumThreads;
+		std::lock_guard<std::mutex> lock( mQueueLocks[victim] );
+
+		if( !mQueues[victim].empty() ) {
+			task = std::move( mQueues[victim].front() );
+			mQueues[victim].pop_front();
+		}
+	}
+
+	if( !task ) {
+		return false;
+	}
+
+	mNumQueued--;
+	task();
+	mNumPending--;
+
+	return true;
+}
+
+
+/**
+ * Add a task. If only one thread is used, the task will be executed immediately.
+ * @param {std::function<void()>} task The task.
+ */
+void TaskScheduler::spawn( std::function<void()> task ) {
+	if( mNumThreads <= 1 ) {
+		task();
+		return;
+	}
+
+	cl_uint worker = ( mWorkerIndex >= 0 ) ? mWorkerIndex : 0;
+	mNumPending++;
+
+	{
+		std::lock_guard<std::mutex> lock( mQueueLocks[worker] );
+		mQueues[worker].push_back( std::move( task ) );
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( mWakeLock );
+		mNumQueued++;
+	}
+	mWakeCondition.notify_one();
+}
+
+
+/**
+ * Execute tasks on the calling thread until all spawned tasks are done.
+ */
+void TaskScheduler::wait() {
+	cl_int prevWorkerIndex = mWorkerIndex;
+	mWorkerIndex = 0;
+
+	while( mNumPending > 0 ) {
+		if( !this->runNextTask( 0 ) ) {
+			std::this_thread::yield();
+		}
+	}
+
+	mWorkerIndex = prevWorkerIndex;
+}
+
+
+/**
+ * Loop of a worker thread.
+ * @param {const cl_uint} worker Index of the worker.
+ */
+void TaskScheduler::work( const cl_uint worker ) {
+	mWorkerIndex = worker;
+
+	while( true ) {
+		if( this->runNextTask( worker ) ) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock( mWakeLock );
+		mWakeCondition.wait( lock, [this] { return mStop || mNumQueued > 0; } );
+
+		if( mStop ) {
+			break;
+		}
+	}
+}
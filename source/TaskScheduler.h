@@ -0,0 +1,46 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <atomic>
+#include "cl.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::vector;
+
+
+class TaskScheduler {
+
+	public:
+		TaskScheduler( const cl_uint numThreads = 0 );
+		~TaskScheduler();
+		cl_uint getNumThreads();
+		void spawn( std::function<void()> task );
+		void wait();
+
+	protected:
+		bool runNextTask( const cl_uint worker );
+		void work( const cl_uint worker );
+
+	private:
+		static thread_local cl_int mWorkerIndex;
+
+		cl_uint mNumThreads;
+		bool mStop;
+
+		vector<std::thread> mThreads;
+		vector< std::deque< std::function<void()> > > mQueues;
+		std::mutex* mQueueLocks;
+
+		std::atomic<cl_uint> mNumPending;
+		std::atomic<cl_uint> mNumQueued;
+		std::condition_variable mWakeCondition;
+		std::mutex mWakeLock;
+
+};
+
+#endif
@@ -2,6 +2,10 @@
 #define ACCELSTRUCT_H
 
 #define ACCELSTRUCT_BVH 0
+// One BVH per object, placed in the scene by instances. See TwoLevelBVH.h.
+#define ACCELSTRUCT_TWOLEVELBVH 1
+// BVH with 4 children per node and quantized bounding boxes. See WideBVH.h.
+#define ACCELSTRUCT_WIDEBVH 2
 
 #include "../cl.hpp"
 #include <glm/glm.hpp>
@@ -15,12 +19,14 @@ struct Tri {
 	cl_uint4 normals;
 	glm::vec3 bbMin;
 	glm::vec3 bbMax;
+	glm::vec3 bbCenter;
 };
 
 
 class AccelStructure {
 
 	public:
+		virtual ~AccelStructure() {};
 		static vector<cl_float4> packFloatAsFloat4( const vector<cl_float>* vertices );
 		virtual void visualize( vector<cl_float>* vertices, vector<cl_uint>* indices ) = 0;
 
@@ -19,16 +19,23 @@ struct sortFacesCmp {
 	};
 
 	/**
-	 * Compare two faces.
-	 * @param  {const Tri} a Indizes for vertices that describe a face.
-	 * @param  {const Tri} b Indizes for vertices that describe a face.
-	 * @return {bool}        a < b
+	 * Compare two faces. Ties are broken by the other axes and
+	 * the face index, so the sorted order does not depend on
+	 * the order the faces were in before.
+	 * @param  {const Tri&} a Indizes for vertices that describe a face.
+	 * @param  {const Tri&} b Indizes for vertices that describe a face.
+	 * @return {bool}         a < b
 	 */
-	bool operator()( const Tri a, const Tri b ) {
-		cl_float cenA = ( a.bbMin[this->axis] + a.bbMax[this->axis] ) * 0.5f;
-		cl_float cenB = ( b.bbMin[this->axis] + b.bbMax[this->axis] ) * 0.5f;
+	bool operator()( const Tri& a, const Tri& b ) {
+		for( cl_uint i = 0; i < 3; i++ ) {
+			cl_uint ax = ( this->axis + i ) % 3;
 
-		return cenA < cenB;
+			if( a.bbCenter[ax] != b.bbCenter[ax] ) {
+				return a.bbCenter[ax] < b.bbCenter[ax];
+			}
+		}
+
+		return a.face.w < b.face.w;
 	};
 
 };
@@ -37,7 +44,12 @@ struct sortFacesCmp {
 /**
  * Constructor.
  */
-BVH::BVH() {}
+BVH::BVH() {
+	mSAHCost = 0.0f;
+	mSAHCostBuild = 0.0f;
+	mSAHCostRefit = 0.0f;
+	mSAHCostTraversal = 1.0f;
+}
 
 
 /**
@@ -45,21 +57,94 @@ BVH::BVH() {}
  * @param  {std::vector<object3D>} sceneObjects
  * @param  {std::vector<cl_float>} vertices
  * @param  {std::vector<cl_float>} normals
+ * @param  {const cl_uint}         faceOffset   Index of the first face of the objects in the face list of the model.
  * @return {BVH*}
  */
 BVH::BVH(
 	const vector<object3D> sceneObjects,
 	const vector<cl_float> vertices,
-	const vector<cl_float> normals
+	const vector<cl_float> normals,
+	const cl_uint faceOffset
 ) {
 	boost::posix_time::ptime timerStart = boost::posix_time::microsec_clock::local_time();
 	mDepthReached = 0;
+	mNumNodes = 0;
+	mNumRefs = 0;
+	mBuildMethod = Cfg::get().value<cl_uint>( Cfg::BVH_BUILDMETHOD );
+	mSAHBins = fmin( fmax( Cfg::get().value<cl_uint>( Cfg::BVH_SAHBINS ), 2 ), BVH_SAH_MAX_BINS );
+	mSAHCostTraversal = fmax( Cfg::get().value<cl_float>( Cfg::BVH_SAHCOSTTRAVERSAL ), 0.0f );
+	mPLOCRadius = fmax( Cfg::get().value<cl_uint>( Cfg::BVH_PLOCRADIUS ), 1 );
+	mSBVHAlpha = Cfg::get().value<cl_float>( Cfg::BVH_SBVHALPHA );
+	mSBVHBudget = fmax( Cfg::get().value<cl_float>( Cfg::BVH_SBVHBUDGET ), 0.0f );
+	mEarlySplitBudget = fmax( Cfg::get().value<cl_float>( Cfg::BVH_EARLYSPLITBUDGET ), 0.0f );
+	mEarlySplitRatio = fmax( Cfg::get().value<cl_float>( Cfg::BVH_EARLYSPLITRATIO ), 0.0f );
+	mPhongTess = ( Cfg::get().value<cl_float>( Cfg::RENDER_PHONGTESS ) > 0.0f );
+	// With Phong Tessellation the surface bulges out of the
+	// triangle, so only the bounding boxes can be clipped.
+	mSBVHClipTris = !mPhongTess;
 	this->setMaxFaces( Cfg::get().value<cl_uint>( Cfg::BVH_MAXFACES ) );
 
-	vector<BVHNode*> subTrees = this->buildTreesFromObjects( &sceneObjects, &vertices, &normals );
-	mRoot = this->makeContainerNode( subTrees, true );
-	this->groupTreesToNodes( subTrees, mRoot, mDepthReached );
+	mScheduler = new TaskScheduler( Cfg::get().value<cl_uint>( Cfg::BVH_BUILDTHREADS ) );
+
+	char msg[128];
+	snprintf( msg, 128, "[BVH] Building with %u thread(s).", mScheduler->getNumThreads() );
+	Logger::logDebug( msg );
+
+	vector<cl_int> subTrees = this->buildTreesFromObjects( &sceneObjects, &vertices, &normals, faceOffset );
+
+	mRoot = this->makeContainerNode( subTrees );
+	const cl_float topCostMean = this->calcTopLevelCostMeanSplit( subTrees );
+	const cl_float topCostSAH = this->groupTreesToNodes( subTrees, mRoot, mDepthReached );
+
+	// The clustering builds bottom-up and doesn't know the depths of the nodes.
+	if( mBuildMethod == BVH_BUILD_PLOC ) {
+		this->updateDepths();
+	}
+
+	mSAHCostBuild = this->calcSAHCost();
+
+	if( subTrees.size() > 1 ) {
+		const cl_float rootSA = MathHelp::getSurfaceArea( mNodes[mRoot].bbMin, mNodes[mRoot].bbMax );
+		const cl_float norm = ( rootSA > 0.0f ) ? 1.0f / rootSA : 0.0f;
+
+		snprintf(
+			msg, 128, "[BVH] Grouped %lu sub-trees by SAH. Top-level SAH cost: %g (mean split: %g).",
+			subTrees.size(), topCostSAH * norm, topCostMean * norm
+		);
+		Logger::logDebug( msg );
+	}
+
+	const cl_uint optimizePasses = Cfg::get().value<cl_uint>( Cfg::BVH_OPTIMIZEPASSES );
+
+	if( optimizePasses > 0 ) {
+		this->optimizeByRotations( optimizePasses );
+	}
+
+	delete mScheduler;
+	mScheduler = NULL;
+
 	this->combineNodes( subTrees.size() );
+	mSAHCost = this->calcSAHCost();
+	mSAHCostRefit = mSAHCost;
+
+	// A refit bounds the whole faces, also those the build clipped (SBVH,
+	// early splits). Refitted trees are compared against the tree refitted
+	// to the unmoved vertices, so the clipping alone doesn't look like a
+	// worse tree.
+	if(
+		Cfg::get().value<bool>( Cfg::BVH_REFIT ) &&
+		( mBuildMethod == BVH_BUILD_SBVH || mEarlySplitBudget > 0.0f )
+	) {
+		vector<BVHNode> nodes( mNodes );
+		vector<Tri> faces( mFaces );
+
+		this->refitBoxes( &vertices, &normals );
+		mSAHCostRefit = this->calcSAHCost();
+
+		mNodes.swap( nodes );
+		mFaces.swap( faces );
+	}
+
 	this->logStats( timerStart );
 }
 
@@ -67,129 +152,393 @@ BVH::BVH(
 /**
  * Destructor.
  */
-BVH::~BVH() {
-	for( cl_uint i = 0; i < mNodes.size(); i++ ) {
-		delete mNodes[i];
+BVH::~BVH() {}
+
+
+/**
+ * Take the next unused node from the node array.
+ * The node array has been sized before the build,
+ * so references to nodes stay valid while building.
+ * @return {cl_int} Index of the node.
+ */
+cl_int BVH::allocateNode() {
+	cl_uint index = mNumNodes++;
+	BVHNode* node = &mNodes[index];
+	node->leftChild = -1;
+	node->rightChild = -1;
+	node->parent = -1;
+	node->facesStart = 0;
+	node->numFaces = 0;
+	node->depth = 0;
+	node->skipNextLeft = false;
+	node->numSkipsToHere = 0;
+
+	return index;
+}
+
+
+/**
+ * Build the sphere tree. The faces of the node are
+ * partitioned in place between the two child nodes.
+ * @param  {const cl_uint} facesStart Index of the first face of the node.
+ * @param  {const cl_uint} numFaces   Number of faces in the node.
+ * @param  {const cl_uint} depth      The current depth of the node in the tree. Starts at 1.
+ * @return {cl_int}                   Index of the node.
+ */
+cl_int BVH::buildTree( const cl_uint facesStart, const cl_uint numFaces, const cl_uint depth ) {
+	cl_int index = this->makeNode( facesStart, numFaces );
+	BVHNode* node = &mNodes[index];
+	node->depth = depth;
+
+	this->updateDepthReached( depth );
+
+	// leaf node
+	if( numFaces <= 1 ) {
+		if( numFaces <= 0 ) {
+			Logger::logWarning( "[BVH] No faces in node." );
+		}
+
+		return index;
+	}
+
+
+	cl_uint numFacesLeft;
+
+	// Binned SAH is fast enough to be used for all nodes.
+	if( mBuildMethod == BVH_BUILD_BINNEDSAH ) {
+		numFacesLeft = this->buildWithBinnedSAH( node );
+	}
+	// SAH takes some time. Don't do it if there are too many faces.
+	else if( numFaces <= Cfg::get().value<cl_uint>( Cfg::BVH_SAHFACESLIMIT ) ) {
+		numFacesLeft = this->buildWithSAH( node );
+	}
+	// Faster to build: Splitting at the midpoint of the longest axis.
+	else {
+		char msg[256];
+		snprintf( msg, 256, "[BVH] Too many faces in node for SAH. Splitting by mean position. (%u faces)", numFaces );
+		Logger::logDebug( msg );
+
+		numFacesLeft = this->buildWithMeanSplit( node );
+	}
+
+	if( numFacesLeft == 0 || numFacesLeft >= numFaces ) {
+		if( numFaces > mMaxFaces ) {
+			Logger::logWarning( "[BVH] Could not split node with more faces than allowed per leaf node." );
+		}
+
+		return index;
+	}
+
+	// Small enough for a leaf node. Only split it, if the SAH says it is cheaper.
+	if(
+		numFaces <= mMaxFaces &&
+		!this->isSplitCheaper( node, this->calcSplitSAH( node, numFacesLeft ), numFaces )
+	) {
+		return index;
 	}
+
+	// Only leaf nodes reference faces.
+	node->numFaces = 0;
+
+	this->buildSubTree( &( node->leftChild ), facesStart, numFacesLeft, depth + 1 );
+	this->buildSubTree(
+		&( node->rightChild ), facesStart + numFacesLeft, numFaces - numFacesLeft, depth + 1
+	);
+
+	return index;
 }
 
 
 /**
- * Assign faces to the created bins.
- * @param {const cl_uint}                              axis
- * @param {const cl_uint}                              splits
- * @param {const std::vector<Tri>*}                    faces
- * @param {const std::vector<std::vector<glm::vec3>>*} leftBin
- * @param {const std::vector<std::vector<glm::vec3>>*} rightBin
- * @param {std::vector<std::vector<Tri>>*}             leftBinFaces
- * @param {std::vector<std::vector<Tri>>*}             rightBinFaces
+ * Build the tree bottom-up by parallel locally-ordered clustering (PLOC).
+ * The faces are sorted by the Morton code of their centroid and each one
+ * starts as a cluster. In each pass every cluster searches the clusters
+ * within the radius before and after it for the one with the smallest
+ * combined bounding box. Clusters that are each other's nearest one are
+ * merged. The faces are reordered in place. The depths of the nodes are
+ * not set.
+ * @param  {const cl_uint} facesStart Index of the first face of the tree.
+ * @param  {const cl_uint} numFaces   Number of faces in the tree.
+ * @param  {const bool}    parallel   Search the nearest clusters in parallel tasks.
+ *                                    Only if not called from a task itself.
+ * @return {cl_int}                   Index of the root node.
  */
-void BVH::assignFacesToBins(
-	const cl_uint axis, const cl_uint splits, const vector<Tri>* faces,
-	const vector< vector<glm::vec3> >* leftBin, const vector< vector<glm::vec3> >* rightBin,
-	vector< vector<Tri> >* leftBinFaces, vector< vector<Tri> >* rightBinFaces
-) {
-	for( cl_uint i = 0; i < splits; i++ ) {
-		vector<glm::vec3> leftAABB = (*leftBin)[i];
-		vector<glm::vec3> rightAABB = (*rightBin)[i];
-
-		for( cl_uint j = 0; j < faces->size(); j++ ) {
-			Tri tri = (*faces)[j];
-
-			if( tri.bbMin[axis] <= leftAABB[1][axis] && tri.bbMax[axis] >= leftAABB[0][axis] ) {
-				Tri triCpy;
-				triCpy.face = tri.face;
-				triCpy.bbMin = glm::vec3( tri.bbMin );
-				triCpy.bbMax = glm::vec3( tri.bbMax );
-				triCpy.bbMin[axis] = fmax( tri.bbMin[axis], leftAABB[0][axis] );
-				triCpy.bbMax[axis] = fmin( tri.bbMax[axis], leftAABB[1][axis] );
-
-				(*leftBinFaces)[i].push_back( triCpy );
+cl_int BVH::buildTreePLOC( const cl_uint facesStart, const cl_uint numFaces, const bool parallel ) {
+	if( numFaces <= 1 ) {
+		return this->buildTree( facesStart, numFaces, 1 );
+	}
+
+	Tri* faces = &mFaces[facesStart];
+	glm::vec3 cenMin = faces[0].bbCenter;
+	glm::vec3 cenMax = faces[0].bbCenter;
+
+	for( cl_uint i = 1; i < numFaces; i++ ) {
+		cenMin = glm::min( cenMin, faces[i].bbCenter );
+		cenMax = glm::max( cenMax, faces[i].bbCenter );
+	}
+
+	// Sort the faces along the Morton curve.
+	const glm::vec3 cenExtent = glm::max( cenMax - cenMin, glm::vec3( FLT_MIN ) );
+	vector< std::pair<cl_uint, cl_uint> > codes( numFaces );
+
+	for( cl_uint i = 0; i < numFaces; i++ ) {
+		codes[i] = std::make_pair( this->getMortonCode( ( faces[i].bbCenter - cenMin ) / cenExtent ), i );
+	}
+
+	std::sort( codes.begin(), codes.end() );
+
+	vector<Tri> sorted( numFaces );
+
+	for( cl_uint i = 0; i < numFaces; i++ ) {
+		sorted[i] = faces[codes[i].second];
+	}
+
+	std::copy( sorted.begin(), sorted.end(), faces );
+	vector<Tri>().swap( sorted );
+
+	vector<cl_int> clusters( numFaces );
+	vector<cl_int> nearest;
+	vector<cl_int> merged;
+	vector<cl_int> innerNodes;
+	innerNodes.reserve( numFaces - 1 );
+
+	for( cl_uint i = 0; i < numFaces; i++ ) {
+		clusters[i] = this->makeNode( facesStart + i, 1 );
+	}
+
+	while( clusters.size() > 1 ) {
+		const cl_uint numClusters = clusters.size();
+		nearest.resize( numClusters );
+
+		if( parallel && numClusters >= 2 * BVH_TASK_MIN_FACES ) {
+			for( cl_uint start = 0; start < numClusters; start += BVH_TASK_MIN_FACES ) {
+				const cl_uint end = std::min( start + BVH_TASK_MIN_FACES, numClusters );
+
+				mScheduler->spawn( [this, &clusters, &nearest, start, end] {
+					this->findNearestClusters( &clusters, start, end, &nearest );
+				} );
+			}
+
+			mScheduler->wait();
+		}
+		else {
+			this->findNearestClusters( &clusters, 0, numClusters, &nearest );
+		}
+
+		// The merged node takes the place of the left cluster,
+		// so the clusters stay in the order of the Morton curve.
+		merged.clear();
+
+		for( cl_uint i = 0; i < numClusters; i++ ) {
+			const cl_int j = nearest[i];
+
+			if( nearest[j] != (cl_int) i ) {
+				merged.push_back( clusters[i] );
+				continue;
 			}
-			if( tri.bbMin[axis] <= rightAABB[1][axis] && tri.bbMax[axis] >= rightAABB[0][axis] ) {
-				Tri triCpy;
-				triCpy.face = tri.face;
-				triCpy.bbMin = glm::vec3( tri.bbMin );
-				triCpy.bbMax = glm::vec3( tri.bbMax );
-				triCpy.bbMin[axis] = fmax( tri.bbMin[axis], rightAABB[0][axis] );
-				triCpy.bbMax[axis] = fmin( tri.bbMax[axis], rightAABB[1][axis] );
-
-				(*rightBinFaces)[i].push_back( triCpy );
+
+			// Already merged with the left cluster.
+			if( j < (cl_int) i ) {
+				continue;
 			}
+
+			const BVHNode* left = &mNodes[clusters[i]];
+			const BVHNode* right = &mNodes[clusters[j]];
+
+			cl_int index = this->allocateNode();
+			BVHNode* node = &mNodes[index];
+			node->leftChild = clusters[i];
+			node->rightChild = clusters[j];
+			node->bbMin = glm::min( left->bbMin, right->bbMin );
+			node->bbMax = glm::max( left->bbMax, right->bbMax );
+
+			merged.push_back( index );
+			innerNodes.push_back( index );
 		}
+
+		clusters.swap( merged );
+	}
+
+	if( mMaxFaces > 1 ) {
+		this->collapseLeavesPLOC( clusters[0], &innerNodes, facesStart, numFaces );
 	}
+
+	return clusters[0];
 }
 
 
 /**
- * Build the sphere tree.
- * @param  {std::vector<Tri>} faces
- * @param  {const glm::vec3}  bbMin
- * @param  {const glm::vec3}  bbMax
- * @param  {cl_uint}          depth  The current depth of the node in the tree. Starts at 1.
- * @param  {const cl_float}   rootSA
- * @return {BVHNode*}
+ * Build a tree with spatial splits (SBVH). Each node chooses between an
+ * object split and a spatial split by their SAH. A spatial split clips the
+ * references at the split plane and duplicates those lying on both sides,
+ * as long as the budget of the node allows for it.
+ * @param  {std::vector<Tri>*} refs   References of the node. Will be emptied.
+ * @param  {const cl_uint}     budget Number of references the node may add by spatial splits.
+ * @param  {const cl_float}    rootSA Surface area of the root node of the tree.
+ * @param  {const cl_uint}     depth  The current depth of the node in the tree. Starts at 1.
+ * @return {cl_int}                   Index of the node.
  */
-BVHNode* BVH::buildTree(
-	vector<Tri> faces, const glm::vec3 bbMin, const glm::vec3 bbMax,
-	cl_uint depth, const cl_float rootSA
+cl_int BVH::buildTreeSBVH(
+	vector<Tri>* refs, const cl_uint budget, const cl_float rootSA, const cl_uint depth
 ) {
-	BVHNode* containerNode = this->makeNode( faces, false );
+	const cl_uint numRefs = refs->size();
+	cl_int index = this->allocateNode();
+	BVHNode* node = &mNodes[index];
+	node->depth = depth;
+	node->bbMin = glm::vec3( 0.0f );
+	node->bbMax = glm::vec3( 0.0f );
+
+	if( numRefs > 0 ) {
+		node->bbMin = (*refs)[0].bbMin;
+		node->bbMax = (*refs)[0].bbMax;
+
+		for( cl_uint i = 1; i < numRefs; i++ ) {
+			node->bbMin = glm::min( node->bbMin, (*refs)[i].bbMin );
+			node->bbMax = glm::max( node->bbMax, (*refs)[i].bbMax );
+		}
+	}
 
-	containerNode->depth = depth;
-	mDepthReached = ( depth > mDepthReached ) ? depth : mDepthReached;
+	this->updateDepthReached( depth );
 
 	// leaf node
-	if( faces.size() <= mMaxFaces ) {
-		if( faces.size() <= 0 ) {
+	if( numRefs <= 1 ) {
+		if( numRefs <= 0 ) {
 			Logger::logWarning( "[BVH] No faces in node." );
 		}
 
-		containerNode->faces = faces;
+		this->makeLeafSBVH( node, refs );
 
-		return containerNode;
+		return index;
 	}
 
+	const cl_float treeSA = ( depth == 1 ) ? MathHelp::getSurfaceArea( node->bbMin, node->bbMax ) : rootSA;
 
-	vector<Tri> leftFaces, rightFaces;
-	glm::vec3 bbMinLeft, bbMaxLeft, bbMinRight, bbMaxRight;
+	SBVHSplit objectSplit;
+	this->findObjectSplit( refs, &objectSplit );
 
-	// SAH takes some time. Don't do it if there are too many faces.
-	if( faces.size() <= Cfg::get().value<cl_uint>( Cfg::BVH_SAHFACESLIMIT ) ) {
-		this->buildWithSAH(
-			containerNode, faces, &leftFaces, &rightFaces
+	// Spatial splits are only worth a try, if the
+	// children of the object split overlap noticeably.
+	glm::vec3 overlapMin = glm::max( objectSplit.leftMin, objectSplit.rightMin );
+	glm::vec3 overlapMax = glm::min( objectSplit.leftMax, objectSplit.rightMax );
+	cl_float overlapSA = 0.0f;
+
+	if( overlapMin.x <= overlapMax.x && overlapMin.y <= overlapMax.y && overlapMin.z <= overlapMax.z ) {
+		overlapSA = MathHelp::getSurfaceArea( overlapMin, overlapMax );
+	}
+
+	bool useSpatialSplit = false;
+	SBVHSplit spatialSplit;
+	spatialSplit.sah = FLT_MAX;
+	spatialSplit.axis = -1;
+
+	if( budget > 0 && depth < BVH_SBVH_MAX_DEPTH && overlapSA > mSBVHAlpha * treeSA ) {
+		this->findSpatialSplit( refs, node, &spatialSplit );
+
+		useSpatialSplit = (
+			spatialSplit.axis >= 0 &&
+			spatialSplit.sah < objectSplit.sah &&
+			spatialSplit.numLeft + spatialSplit.numRight - numRefs <= budget
 		);
 	}
-	// Faster to build: Splitting at the midpoint of the longest axis.
-	else {
-		char msg[256];
-		snprintf( msg, 256, "[BVH] Too many faces in node for SAH. Splitting by mean position. (%lu faces)", faces.size() );
-		Logger::logDebug( msg );
 
-		this->buildWithMeanSplit( containerNode, faces, &leftFaces, &rightFaces );
+	// Small enough for a leaf node. Only split it, if the SAH says it is cheaper.
+	const cl_float splitSAH = useSpatialSplit ? spatialSplit.sah : objectSplit.sah;
+
+	if( numRefs <= mMaxFaces && !this->isSplitCheaper( node, splitSAH, numRefs ) ) {
+		this->makeLeafSBVH( node, refs );
+
+		return index;
 	}
 
-	if(
-		leftFaces.size() == 0 ||
-		rightFaces.size() == 0
-	) {
-		if( faces.size() > mMaxFaces ) {
-			Logger::logWarning( "[BVH] More faces than can be traversed in node." );
+	vector<Tri> leftRefs;
+	vector<Tri> rightRefs;
+
+	if( useSpatialSplit ) {
+		this->performSpatialSplit( refs, node, &spatialSplit, &leftRefs, &rightRefs );
+
+		// Moving references to one side may have emptied the other one.
+		// The budget is checked again with the actual number of references,
+		// because the reserved reference and node arrays rely on it.
+		if(
+			leftRefs.empty() || rightRefs.empty() ||
+			leftRefs.size() + rightRefs.size() - numRefs > budget
+		) {
+			leftRefs.clear();
+			rightRefs.clear();
+			useSpatialSplit = false;
 		}
+	}
+
+	if( !useSpatialSplit ) {
+		this->performObjectSplit( refs, &objectSplit, &leftRefs, &rightRefs );
+	}
+
+	// The children hold the references now.
+	vector<Tri>().swap( *refs );
 
-		containerNode->faces = faces;
+	// Only leaf nodes reference faces.
+	node->numFaces = 0;
 
-		return containerNode;
+	// Split the remaining budget by the number of references of the children.
+	const cl_uint numChildRefs = leftRefs.size() + rightRefs.size();
+	const cl_uint remaining = budget - ( numChildRefs - numRefs );
+	const cl_uint leftBudget = (cl_ulong) remaining * leftRefs.size() / numChildRefs;
+
+	this->buildSubTreeSBVH( &( node->leftChild ), &leftRefs, leftBudget, treeSA, depth + 1 );
+	this->buildSubTreeSBVH( &( node->rightChild ), &rightRefs, remaining - leftBudget, treeSA, depth + 1 );
+
+	return index;
+}
+
+
+/**
+ * Build a sub-tree. Sub-trees with many faces are built as a separate
+ * task, so the node index may only be set after the tasks are done.
+ * @param {cl_int*}       node       Output. Index of the root node of the sub-tree.
+ * @param {const cl_uint} facesStart Index of the first face of the sub-tree.
+ * @param {const cl_uint} numFaces   Number of faces in the sub-tree.
+ * @param {const cl_uint} depth      The depth of the sub-tree root.
+ */
+void BVH::buildSubTree(
+	cl_int* node, const cl_uint facesStart, const cl_uint numFaces, const cl_uint depth
+) {
+	if( numFaces < BVH_TASK_MIN_FACES ) {
+		*node = this->buildTree( facesStart, numFaces, depth );
+		return;
 	}
 
-	containerNode->leftChild = this->buildTree(
-		leftFaces, bbMinLeft, bbMaxLeft, depth + 1, rootSA
-	);
-	containerNode->rightChild = this->buildTree(
-		rightFaces, bbMinRight, bbMaxRight, depth + 1, rootSA
-	);
+	mScheduler->spawn( [this, node, facesStart, numFaces, depth] {
+		*node = this->buildTree( facesStart, numFaces, depth );
+	} );
+}
+
+
+/**
+ * Build a sub-tree of the SBVH. Sub-trees with many references are built as
+ * a separate task, so the node index may only be set after the tasks are done.
+ * @param {cl_int*}          node   Output. Index of the root node of the sub-tree.
+ * @param {std::vector<Tri>*} refs  References of the sub-tree. Will be emptied.
+ * @param {const cl_uint}    budget Number of references the sub-tree may add by spatial splits.
+ * @param {const cl_float}   rootSA Surface area of the root node of the tree.
+ * @param {const cl_uint}    depth  The depth of the sub-tree root.
+ */
+void BVH::buildSubTreeSBVH(
+	cl_int* node, vector<Tri>* refs, const cl_uint budget,
+	const cl_float rootSA, const cl_uint depth
+) {
+	if( refs->size() < BVH_TASK_MIN_FACES ) {
+		*node = this->buildTreeSBVH( refs, budget, rootSA, depth );
+		return;
+	}
+
+	// The task outlives the references of the caller.
+	vector<Tri>* taskRefs = new vector<Tri>();
+	taskRefs->swap( *refs );
 
-	return containerNode;
+	mScheduler->spawn( [this, node, taskRefs, budget, rootSA, depth] {
+		*node = this->buildTreeSBVH( taskRefs, budget, rootSA, depth );
+		delete taskRefs;
+	} );
 }
 
 
@@ -198,47 +547,207 @@ BVHNode* BVH::buildTree(
  * @param  {const std::vector<object3D>*} sceneObjects
  * @param  {const std::vector<cl_float>*} vertices
  * @param  {const std::vector<cl_float>*} normals
- * @return {std::vector<BVHNode*>}
+ * @param  {const cl_uint}                faceOffset   Index of the first face of the objects in the face list of the model.
+ * @return {std::vector<cl_int>}          Indices of the root nodes of the trees.
  */
-vector<BVHNode*> BVH::buildTreesFromObjects(
+vector<cl_int> BVH::buildTreesFromObjects(
 	const vector<object3D>* sceneObjects,
 	const vector<cl_float>* vertices,
-	const vector<cl_float>* normals
+	const vector<cl_float>* normals,
+	const cl_uint faceOffset
 ) {
-	vector<BVHNode*> subTrees;
+	const cl_uint numObjects = sceneObjects->size();
+	vector<cl_int> subTrees( numObjects, -1 );
+	vector< vector<cl_uint4> > faces( numObjects );
+	vector< vector<cl_uint4> > faceNormals( numObjects );
+	vector<cl_uint> facesStart( numObjects );
 	char msg[256];
 	cl_uint offset = 0;
 	cl_uint offsetN = 0;
 
-	vector<cl_float4> vertices4 = this->packFloatAsFloat4( vertices );
+	for( cl_uint i = 0; i < numObjects; i++ ) {
+		facesStart[i] = offset;
+
+		ModelLoader::getFacesOfObject( (*sceneObjects)[i], &faces[i], faceOffset + offset );
+		offset += faces[i].size();
+
+		ModelLoader::getFaceNormalsOfObject( (*sceneObjects)[i], &faceNormals[i], faceOffset + offsetN );
+		offsetN += faceNormals[i].size();
+	}
 
-	for( cl_uint i = 0; i < sceneObjects->size(); i++ ) {
-		vector<cl_uint4> facesThisObj;
-		ModelLoader::getFacesOfObject( (*sceneObjects)[i], &facesThisObj, offset );
-		offset += facesThisObj.size();
+	// Spatial splits and early splits add references to the
+	// faces. Each tree may grow by its share of the budget.
+	vector<cl_uint> budgets( numObjects, 0 );
+	vector<cl_uint> numObjectRefs( numObjects, 0 );
+	cl_uint numRefs = offset;
+	const bool useEarlySplits = ( mBuildMethod != BVH_BUILD_SBVH && mEarlySplitBudget > 0.0f );
+
+	if( mBuildMethod == BVH_BUILD_SBVH ) {
+		for( cl_uint i = 0; i < numObjects; i++ ) {
+			budgets[i] = faces[i].size() * mSBVHBudget;
+			numRefs += budgets[i];
+		}
+
+		mRefs.resize( numRefs );
+	}
+	// The references of each object get room for its budget in
+	// the face array. The unused room is removed after the build.
+	else if( useEarlySplits ) {
+		numRefs = 0;
+
+		for( cl_uint i = 0; i < numObjects; i++ ) {
+			budgets[i] = faces[i].size() * mEarlySplitBudget;
+			facesStart[i] = numRefs;
+			numRefs += faces[i].size() + budgets[i];
+		}
+	}
+
+	// The budgets are never exceeded, so no tree has more references than
+	// reserved. A binary tree with at least one reference per leaf has
+	// 2n - 1 nodes. An object without faces still takes a leaf node.
+	// Grouping the trees adds less than one node per object.
+	mFaces.resize( useEarlySplits ? numRefs : offset );
+	mNodes.resize( 2 * numRefs + 2 * numObjects );
+
+	mVertices4 = this->packFloatAsFloat4( vertices );
+	vector<cl_float4> normals4 = this->packFloatAsFloat4( normals );
 
+	for( cl_uint i = 0; i < numObjects; i++ ) {
 		snprintf(
-			msg, 256, "[BVH] Building tree %u/%lu: \"%s\". %lu faces.",
-			i + 1, sceneObjects->size(), (*sceneObjects)[i].oName.c_str(), facesThisObj.size()
+			msg, 256, "[BVH] Building tree %u/%u: \"%s\". %lu faces.",
+			i + 1, numObjects, (*sceneObjects)[i].oName.c_str(), faces[i].size()
 		);
 		Logger::logInfo( msg );
 
+		// The objects are independent of each other and can be built in parallel.
+		mScheduler->spawn( [this, i, useEarlySplits, &faces, &faceNormals, &facesStart, &normals4, &budgets, &numObjectRefs, &subTrees] {
+			cl_uint numFaces = faces[i].size();
 
-		vector<cl_uint4> faceNormalsThisObj;
-		ModelLoader::getFaceNormalsOfObject( (*sceneObjects)[i], &faceNormalsThisObj, offsetN );
-		offsetN += faceNormalsThisObj.size();
+			this->facesToTriStructs(
+				&faces[i], &faceNormals[i], &mVertices4, &normals4, facesStart[i]
+			);
+			vector<cl_uint4>().swap( faces[i] );
+			vector<cl_uint4>().swap( faceNormals[i] );
 
-		vector<Tri> triFaces = this->facesToTriStructs(
-			&facesThisObj, &faceNormalsThisObj, &vertices4, normals
+			// The builders treat the references like faces.
+			if( useEarlySplits ) {
+				numFaces = this->splitEarly( facesStart[i], numFaces, budgets[i] );
+			}
+
+			numObjectRefs[i] = numFaces;
+
+			if( mBuildMethod == BVH_BUILD_SBVH ) {
+				vector<Tri> refs(
+					mFaces.begin() + facesStart[i],
+					mFaces.begin() + facesStart[i] + numFaces
+				);
+				subTrees[i] = this->buildTreeSBVH( &refs, budgets[i], 0.0f, 1 );
+			}
+			else if( mBuildMethod == BVH_BUILD_PLOC ) {
+				// Big objects are clustered after the tasks are done.
+				if( numFaces < BVH_TASK_MIN_FACES ) {
+					subTrees[i] = this->buildTreePLOC( facesStart[i], numFaces, false );
+				}
+			}
+			else {
+				subTrees[i] = this->buildTree( facesStart[i], numFaces, 1 );
+			}
+		} );
+	}
+
+	mScheduler->wait();
+	vector<cl_float4>().swap( mVertices4 );
+
+	// The passes of the clustering spawn tasks themselves,
+	// so the big objects are built one after another.
+	if( mBuildMethod == BVH_BUILD_PLOC ) {
+		for( cl_uint i = 0; i < numObjects; i++ ) {
+			if( subTrees[i] < 0 ) {
+				subTrees[i] = this->buildTreePLOC( facesStart[i], numObjectRefs[i], true );
+			}
+		}
+	}
+
+	// Close the gaps of the unused budgets and move the faces of the leaf nodes with them.
+	if( useEarlySplits ) {
+		cl_uint next = 0;
+
+		for( cl_uint i = 0; i < numObjects; i++ ) {
+			const cl_uint shift = facesStart[i] - next;
+
+			if( shift > 0 ) {
+				std::copy(
+					mFaces.begin() + facesStart[i],
+					mFaces.begin() + facesStart[i] + numObjectRefs[i],
+					mFaces.begin() + next
+				);
+
+				vector<cl_int> stack;
+				stack.push_back( subTrees[i] );
+
+				while( !stack.empty() ) {
+					BVHNode* node = &mNodes[stack.back()];
+					stack.pop_back();
+					node->facesStart -= shift;
+
+					if( node->leftChild >= 0 ) {
+						stack.push_back( node->leftChild );
+						stack.push_back( node->rightChild );
+					}
+				}
+			}
+
+			next += numObjectRefs[i];
+		}
+
+		mFaces.resize( next );
+		vector<Tri>( mFaces ).swap( mFaces );
+
+		snprintf(
+			msg, 256, "[BVH] Early splits added %u references to %u faces (+%.1f%%).",
+			next - offset, offset, 100.0f * ( next - offset ) / fmax( offset, 1 )
 		);
+		Logger::logInfo( msg );
+	}
+
+	// The leaf nodes of the SBVH index the references. They took their ranges
+	// in the order the tasks finished, so the references are put in the order
+	// of a depth-first traversal of the trees. The build stays reproducible.
+	if( mBuildMethod == BVH_BUILD_SBVH ) {
+		mFaces.resize( mNumRefs );
+		cl_uint next = 0;
+		vector<cl_int> stack;
+
+		for( cl_uint i = 0; i < numObjects; i++ ) {
+			stack.push_back( subTrees[i] );
+
+			while( !stack.empty() ) {
+				BVHNode* node = &mNodes[stack.back()];
+				stack.pop_back();
+
+				if( node->leftChild >= 0 ) {
+					stack.push_back( node->rightChild );
+					stack.push_back( node->leftChild );
+					continue;
+				}
 
+				std::copy(
+					mRefs.begin() + node->facesStart,
+					mRefs.begin() + node->facesStart + node->numFaces,
+					mFaces.begin() + next
+				);
+				node->facesStart = next;
+				next += node->numFaces;
+			}
+		}
 
-		BVHNode* rootNode = this->makeNode( triFaces, true );
-		cl_float rootSA = MathHelp::getSurfaceArea( rootNode->bbMin, rootNode->bbMax );
+		vector<Tri>().swap( mRefs );
 
-		glm::vec3 bbMin, bbMax;
-		BVHNode* st = this->buildTree( triFaces, bbMin, bbMax, 1, rootSA );
-		subTrees.push_back( st );
+		snprintf(
+			msg, 256, "[BVH] Spatial splits added %u references to %u faces (+%.1f%%).",
+			(cl_uint) mFaces.size() - offset, offset, 100.0f * ( mFaces.size() - offset ) / fmax( offset, 1 )
+		);
+		Logger::logInfo( msg );
 	}
 
 	return subTrees;
@@ -247,50 +756,112 @@ vector<BVHNode*> BVH::buildTreesFromObjects(
 
 /**
  * Build the BVH using mean splits.
- * @param {BVHNode*}                node        Container node for the (sub) tree.
- * @param {const std::vector<Tri>*} faces       Faces to be arranged into a BVH.
- * @param {std::vector<Tri>*}       leftFaces   Output. Faces left of the split.
- * @param {std::vector<Tri>*}       rightFaces  Output. Faces right of the split.
- */
-void BVH::buildWithMeanSplit(
-	BVHNode* node, const vector<Tri> faces,
-	vector<Tri>* leftFaces, vector<Tri>* rightFaces
-) {
+ * @param  {const BVHNode*} node Node to split. Its faces will be partitioned in place.
+ * @return {cl_uint}             Number of faces in the left child node.
+ */
+cl_uint BVH::buildWithMeanSplit( const BVHNode* node ) {
 	cl_float bestSAH = FLT_MAX;
+	cl_int bestAxis = -1;
+	cl_float bestPos = 0.0f;
 
 	for( cl_uint axis = 0; axis <= 2; axis++ ) {
-		vector<Tri> leftFacesTmp, rightFacesTmp;
-		cl_float splitPos = this->getMean( faces, axis );
-		cl_float sah = this->splitFaces( faces, splitPos, axis, &leftFacesTmp, &rightFacesTmp );
+		cl_float splitPos = this->getMean( node, axis );
+		cl_float sah = this->splitFaces( node, splitPos, axis );
 
 		if( sah < bestSAH ) {
 			bestSAH = sah;
-			*leftFaces = leftFacesTmp;
-			*rightFaces = rightFacesTmp;
+			bestAxis = axis;
+			bestPos = splitPos;
 		}
 	}
+
+	// Just do it 50:50.
+	if( bestAxis < 0 ) {
+		Logger::logDebugVerbose( "[BVH] Dividing faces by center left one side empty. Just doing it 50:50 now." );
+
+		return node->numFaces / 2;
+	}
+
+	Tri* first = &mFaces[node->facesStart];
+	Tri* last = first + node->numFaces;
+	Tri* middle = std::partition( first, last, [bestAxis, bestPos]( const Tri& tri ) {
+		return tri.bbCenter[bestAxis] <= bestPos;
+	} );
+
+	return middle - first;
+}
+
+
+/**
+ * Build the BVH using a binned SAH. Instead of sorting the faces,
+ * they are sorted into a fixed number of bins by their centroids.
+ * Only the borders between the bins are evaluated as split positions.
+ * @param  {const BVHNode*} node Node to split. Its faces will be partitioned in place.
+ * @return {cl_uint}             Number of faces in the left child node.
+ */
+cl_uint BVH::buildWithBinnedSAH( const BVHNode* node ) {
+	cl_float bestSAH = FLT_MAX;
+	cl_int bestAxis = -1;
+	cl_uint bestBin = 0;
+
+	Tri* first = &mFaces[node->facesStart];
+	Tri* last = first + node->numFaces;
+
+	// The bins are spread over the bounding box of the
+	// centroids, not the bounding box of the faces.
+	glm::vec3 cenMin = first->bbCenter;
+	glm::vec3 cenMax = first->bbCenter;
+
+	for( const Tri* tri = first + 1; tri < last; tri++ ) {
+		cenMin = glm::min( cenMin, tri->bbCenter );
+		cenMax = glm::max( cenMax, tri->bbCenter );
+	}
+
+	// Small nodes have few split positions anyway. Fewer
+	// bins make them cheaper without losing good splits.
+	const cl_uint numBins = std::min( mSAHBins, std::max( node->numFaces / 2, (cl_uint) 4 ) );
+
+	this->splitByBinnedSAH( &bestSAH, numBins, first, last, cenMin, cenMax, &bestAxis, &bestBin );
+
+	// All centroids are at the same position. Just do it 50:50.
+	if( bestAxis < 0 ) {
+		Logger::logDebugVerbose( "[BVH] Binned SAH found no split position. Just doing it 50:50 now." );
+
+		return node->numFaces / 2;
+	}
+
+	const cl_float binScale = this->getBinScale( cenMin[bestAxis], cenMax[bestAxis], numBins );
+	const cl_float binMin = cenMin[bestAxis];
+
+	Tri* middle = std::partition( first, last, [this, bestAxis, bestBin, binMin, binScale, numBins]( const Tri& tri ) {
+		return this->getBinIndex( tri.bbCenter[bestAxis], binMin, binScale, numBins ) <= bestBin;
+	} );
+
+	return middle - first;
 }
 
 
 /**
  * Build the BVH using SAH.
- * @param  {BVHNode*}          node       Container node for the (sub) tree.
- * @param  {std::vector<Tri>}  faces      Faces to be arranged into a BVH.
- * @param  {std::vector<Tri>*} leftFaces  Output. Faces left of the split.
- * @param  {std::vector<Tri>*} rightFaces Output. Faces right of the split.
- * @return {cl_float}                     Best found SAH value.
- */
-cl_float BVH::buildWithSAH(
-	BVHNode* node, vector<Tri> faces,
-	vector<Tri>* leftFaces, vector<Tri>* rightFaces
-) {
+ * @param  {const BVHNode*} node Node to split. Its faces will be sorted in place.
+ * @return {cl_uint}             Number of faces in the left child node.
+ */
+cl_uint BVH::buildWithSAH( const BVHNode* node ) {
 	cl_float bestSAH = FLT_MAX;
+	cl_int bestAxis = -1;
+	cl_uint bestSplit = 0;
 
 	for( cl_uint axis = 0; axis <= 2; axis++ ) {
-		this->splitBySAH( &bestSAH, axis, faces, leftFaces, rightFaces );
+		this->splitBySAH( &bestSAH, axis, node, &bestAxis, &bestSplit );
+	}
+
+	// The faces are still sorted by the last tested axis.
+	if( bestAxis >= 0 && bestAxis != 2 ) {
+		Tri* first = &mFaces[node->facesStart];
+		std::sort( first, first + node->numFaces, sortFacesCmp( bestAxis ) );
 	}
 
-	return bestSAH;
+	return bestSplit;
 }
 
 
@@ -311,85 +882,526 @@ cl_float BVH::calcSAH(
 
 
 /**
- * Combine the container nodes, leaf nodes and the root node into one list.
- * The root node will be at the very beginning of the list.
- * @param {const cl_uint} numSubTrees The number of generated trees (one for each 3D object).
+ * Calculate the SAH cost of the whole tree. The surface area of each node
+ * is weighted relative to the root node. Container nodes add the cost of
+ * a traversal step, leaf nodes the cost of intersecting their faces.
+ * The tree is traversed from the root, so the nodes don't have to be ordered.
+ * @return {cl_float} SAH cost of the tree.
  */
-void BVH::combineNodes( const cl_uint numSubTrees ) {
-	if( numSubTrees > 1 ) {
-		mNodes.push_back( mRoot );
+cl_float BVH::calcSAHCost() {
+	const cl_float rootSA = MathHelp::getSurfaceArea( mNodes[mRoot].bbMin, mNodes[mRoot].bbMax );
+	cl_float cost = 0.0f;
+
+	if( rootSA <= 0.0f ) {
+		return cost;
 	}
 
-	mNodes.insert( mNodes.end(), mContainerNodes.begin(), mContainerNodes.end() );
+	vector<cl_int> stack;
+	stack.push_back( mRoot );
 
-	for( cl_uint i = 0; i < mNodes.size(); i++ ) {
-		// Leaf node
-		if( mNodes[i]->faces.size() > 0 ) {
-			mLeafNodes.push_back( mNodes[i] );
-		}
-		// Not a leaf node
-		else {
-			mNodes[i]->leftChild->parent = mNodes[i];
-			mNodes[i]->rightChild->parent = mNodes[i];
+	while( !stack.empty() ) {
+		const BVHNode* node = &mNodes[stack.back()];
+		stack.pop_back();
 
-			// Set the node with the bigger surface area as the left one
-			cl_float leftSA = MathHelp::getSurfaceArea( mNodes[i]->leftChild->bbMin, mNodes[i]->leftChild->bbMax );
-			cl_float rightSA = MathHelp::getSurfaceArea( mNodes[i]->rightChild->bbMin, mNodes[i]->rightChild->bbMax );
+		cl_float sa = MathHelp::getSurfaceArea( node->bbMin, node->bbMax );
+		cl_float nodeCost = ( node->leftChild < 0 ) ? (cl_float) node->numFaces : mSAHCostTraversal;
 
-			if( rightSA > leftSA ) {
-				BVHNode* tmp = mNodes[i]->leftChild;
-				mNodes[i]->leftChild = mNodes[i]->rightChild;
-				mNodes[i]->rightChild = tmp;
-			}
+		cost += sa / rootSA * nodeCost;
+
+		if( node->leftChild >= 0 ) {
+			stack.push_back( node->leftChild );
+			stack.push_back( node->rightChild );
 		}
 	}
 
-	this->orderNodesByTraversal();
-
-	if( Cfg::get().value<bool>( Cfg::BVH_SKIPAHEAD ) ) {
-		this->skipAheadOfNodes();
-	}
+	return cost;
 }
 
 
 /**
- *
- * @param  {const std::vector<cl_uint4>*}  facesThisObj
- * @param  {const std::vector<cl_uint4>*}  faceNormalsThisObj
- * @param  {const std::vector<cl_float4>*} vertices4
- * @param  {const std::vector<float>*}     normals
- * @return {std::vector<Tri>}
+ * Calculate the SAH value of splitting the faces of a node into two ranges.
+ * @param  {const BVHNode*} node         The node. Its faces are already partitioned.
+ * @param  {const cl_uint}  numFacesLeft Number of faces in the left range.
+ * @return {cl_float}                    Value estimated by the SAH.
  */
-vector<Tri> BVH::facesToTriStructs(
-	const vector<cl_uint4>* facesThisObj, const vector<cl_uint4>* faceNormalsThisObj,
-	const vector<cl_float4>* vertices4, const vector<float>* normals
-) {
-	vector<cl_float4> normals4 = this->packFloatAsFloat4( normals );
-	vector<Tri> triFaces;
+cl_float BVH::calcSplitSAH( const BVHNode* node, const cl_uint numFacesLeft ) {
+	const Tri* first = &mFaces[node->facesStart];
+	const Tri* middle = first + numFacesLeft;
+	const Tri* last = first + node->numFaces;
+
+	glm::vec3 leftMin = first->bbMin;
+	glm::vec3 leftMax = first->bbMax;
+	glm::vec3 rightMin = middle->bbMin;
+	glm::vec3 rightMax = middle->bbMax;
+
+	for( const Tri* tri = first + 1; tri < middle; tri++ ) {
+		leftMin = glm::min( leftMin, tri->bbMin );
+		leftMax = glm::max( leftMax, tri->bbMax );
+	}
 
-	for( uint j = 0; j < facesThisObj->size(); j++ ) {
-		Tri tri;
-		tri.face = (*facesThisObj)[j];
-		tri.normals = (*faceNormalsThisObj)[j];
-		MathHelp::triCalcAABB( &tri, vertices4, &normals4 );
-		triFaces.push_back( tri );
+	for( const Tri* tri = middle + 1; tri < last; tri++ ) {
+		rightMin = glm::min( rightMin, tri->bbMin );
+		rightMax = glm::max( rightMax, tri->bbMax );
 	}
 
-	return triFaces;
+	return this->calcSAH(
+		MathHelp::getSurfaceArea( leftMin, leftMax ), numFacesLeft,
+		MathHelp::getSurfaceArea( rightMin, rightMax ), node->numFaces - numFacesLeft
+	);
 }
 
 
 /**
- * Get all container nodes (all nodes that aren't leaves).
- * @return {std::vector<BVHNode*>} List of all container nodes.
+ * Calculate the cost of the container nodes above the sub-trees, if they were
+ * grouped by splitting at the mean of their centers on the longest axis. No
+ * nodes are created. Used to compare the grouping by SAH against it.
+ * @param  {const std::vector<cl_int>} nodes Root nodes of the sub-trees.
+ * @return {cl_float}                        Sum of the surface areas of the container
+ *                                           nodes, weighted by the traversal cost.
  */
-vector<BVHNode*> BVH::getContainerNodes() {
-	return mContainerNodes;
+cl_float BVH::calcTopLevelCostMeanSplit( const vector<cl_int> nodes ) {
+	if( nodes.size() <= 1 ) {
+		return 0.0f;
+	}
+
+	glm::vec3 bbMin = mNodes[nodes[0]].bbMin;
+	glm::vec3 bbMax = mNodes[nodes[0]].bbMax;
+
+	for( cl_uint i = 1; i < nodes.size(); i++ ) {
+		bbMin = glm::min( bbMin, mNodes[nodes[i]].bbMin );
+		bbMax = glm::max( bbMax, mNodes[nodes[i]].bbMax );
+	}
+
+	cl_uint axis = MathHelp::longestAxis( bbMin, bbMax );
+	vector<cl_int> leftGroup, rightGroup;
+	cl_float mean = this->getMeanOfNodes( nodes, axis );
+	this->splitNodes( nodes, mean, axis, &leftGroup, &rightGroup );
+
+	return MathHelp::getSurfaceArea( bbMin, bbMax ) * mSAHCostTraversal +
+		this->calcTopLevelCostMeanSplit( leftGroup ) +
+		this->calcTopLevelCostMeanSplit( rightGroup );
 }
 
 
 /**
- * Get the max reached depth.
+ * Collapse sub-trees of the clustered tree into leaf nodes, where the SAH
+ * rates a leaf node cheaper than the split (see isSplitCheaper()). The
+ * faces are reordered by the leaf nodes from left to right first, so the
+ * faces of each sub-tree are contiguous. The nodes below a collapsed node
+ * are not referenced anymore and dropped when ordering the nodes.
+ * @param {const cl_int}                root       Index of the root node of the tree.
+ * @param {const std::vector<cl_int>*}  innerNodes Inner nodes in the order they were created.
+ * @param {const cl_uint}               facesStart Index of the first face of the tree.
+ * @param {const cl_uint}               numFaces   Number of faces in the tree.
+ */
+void BVH::collapseLeavesPLOC(
+	const cl_int root, const vector<cl_int>* innerNodes,
+	const cl_uint facesStart, const cl_uint numFaces
+) {
+	vector<Tri> ordered;
+	vector<cl_int> stack;
+	ordered.reserve( numFaces );
+	stack.push_back( root );
+
+	while( !stack.empty() ) {
+		BVHNode* node = &mNodes[stack.back()];
+		stack.pop_back();
+
+		// The leaf nodes of the clustering hold one face each.
+		if( node->leftChild < 0 ) {
+			ordered.push_back( mFaces[node->facesStart] );
+			node->facesStart = facesStart + ordered.size() - 1;
+			continue;
+		}
+
+		stack.push_back( node->rightChild );
+		stack.push_back( node->leftChild );
+	}
+
+	std::copy( ordered.begin(), ordered.end(), mFaces.begin() + facesStart );
+
+	// SAH cost of each inner node, weighted by its surface area.
+	std::unordered_map<cl_int, cl_float> costs;
+	costs.reserve( innerNodes->size() );
+
+	// Children were created before their parents, so this is bottom-up.
+	for( cl_uint i = 0; i < innerNodes->size(); i++ ) {
+		const cl_int index = (*innerNodes)[i];
+		BVHNode* node = &mNodes[index];
+		const BVHNode* left = &mNodes[node->leftChild];
+		const BVHNode* right = &mNodes[node->rightChild];
+
+		const cl_float costLeft = ( left->leftChild < 0 )
+			? MathHelp::getSurfaceArea( left->bbMin, left->bbMax ) * left->numFaces
+			: costs[node->leftChild];
+		const cl_float costRight = ( right->leftChild < 0 )
+			? MathHelp::getSurfaceArea( right->bbMin, right->bbMax ) * right->numFaces
+			: costs[node->rightChild];
+
+		// The faces of the left child come first. Until the end
+		// the number of faces of the whole sub-tree is kept.
+		node->facesStart = left->facesStart;
+		node->numFaces = left->numFaces + right->numFaces;
+
+		if(
+			node->numFaces <= mMaxFaces &&
+			!this->isSplitCheaper( node, costLeft + costRight, node->numFaces )
+		) {
+			node->leftChild = -1;
+			node->rightChild = -1;
+			continue;
+		}
+
+		costs[index] = MathHelp::getSurfaceArea( node->bbMin, node->bbMax ) * mSAHCostTraversal +
+			costLeft + costRight;
+	}
+
+	// Only leaf nodes reference faces.
+	for( cl_uint i = 0; i < innerNodes->size(); i++ ) {
+		BVHNode* node = &mNodes[(*innerNodes)[i]];
+
+		if( node->leftChild >= 0 ) {
+			node->numFaces = 0;
+		}
+	}
+}
+
+
+/**
+ * Link the child nodes to their parents and order the nodes.
+ * The root node will be at the very beginning of the list.
+ * @param {const cl_uint} numSubTrees The number of generated trees (one for each 3D object).
+ */
+void BVH::combineNodes( const cl_uint numSubTrees ) {
+	for( cl_uint i = 0; i < mNumNodes; i++ ) {
+		BVHNode* node = &mNodes[i];
+
+		// Leaf node
+		if( node->leftChild < 0 ) {
+			continue;
+		}
+
+		mNodes[node->leftChild].parent = i;
+		mNodes[node->rightChild].parent = i;
+
+		// Set the node with the bigger surface area as the left one
+		const BVHNode* left = &mNodes[node->leftChild];
+		const BVHNode* right = &mNodes[node->rightChild];
+		cl_float leftSA = MathHelp::getSurfaceArea( left->bbMin, left->bbMax );
+		cl_float rightSA = MathHelp::getSurfaceArea( right->bbMin, right->bbMax );
+
+		if( rightSA > leftSA ) {
+			cl_int tmp = node->leftChild;
+			node->leftChild = node->rightChild;
+			node->rightChild = tmp;
+		}
+	}
+
+	this->orderNodesByTraversal();
+
+	if(
+		Cfg::get().value<bool>( Cfg::BVH_SKIPAHEAD ) &&
+		Cfg::get().value<cl_uint>( Cfg::BVH_TRAVERSAL ) == BVH_TRAVERSAL_STACKLESS
+	) {
+		this->skipAheadOfNodes();
+	}
+}
+
+
+/**
+ * Create the Tri structs for the faces of an object.
+ * @param {const std::vector<cl_uint4>*}  facesThisObj
+ * @param {const std::vector<cl_uint4>*}  faceNormalsThisObj
+ * @param {const std::vector<cl_float4>*} vertices4
+ * @param {const std::vector<cl_float4>*} normals4
+ * @param {const cl_uint}                 offset             Index in the face array to write the first face to.
+ */
+void BVH::facesToTriStructs(
+	const vector<cl_uint4>* facesThisObj, const vector<cl_uint4>* faceNormalsThisObj,
+	const vector<cl_float4>* vertices4, const vector<cl_float4>* normals4,
+	const cl_uint offset
+) {
+	for( cl_uint j = 0; j < facesThisObj->size(); j++ ) {
+		Tri* tri = &mFaces[offset + j];
+		tri->face = (*facesThisObj)[j];
+		tri->normals = (*faceNormalsThisObj)[j];
+
+		// Without Phong Tessellation the box is the one of the vertices.
+		if( mPhongTess ) {
+			MathHelp::triCalcAABB( tri, vertices4, normals4 );
+		}
+		else {
+			MathHelp::getTriangleAABB(
+				(*vertices4)[tri->face.x], (*vertices4)[tri->face.y], (*vertices4)[tri->face.z],
+				&tri->bbMin, &tri->bbMax
+			);
+		}
+
+		tri->bbCenter = ( tri->bbMin + tri->bbMax ) * 0.5f;
+	}
+}
+
+
+/**
+ * Find the nearest cluster of each cluster in a range. The nearest one is
+ * the one within the search radius with the smallest combined bounding box.
+ * Ties go to the smaller index, so the nearest ones are always mutual for
+ * at least one pair of clusters.
+ * @param {const std::vector<cl_int>*} clusters Root nodes of the clusters, in Morton order.
+ * @param {const cl_uint}              start    Index of the first cluster of the range.
+ * @param {const cl_uint}              end      Index after the last cluster of the range.
+ * @param {std::vector<cl_int>*}       nearest  Output. Index of the nearest cluster of each cluster.
+ */
+void BVH::findNearestClusters(
+	const vector<cl_int>* clusters, const cl_uint start, const cl_uint end,
+	vector<cl_int>* nearest
+) {
+	const cl_int numClusters = clusters->size();
+	const cl_int radius = mPLOCRadius;
+
+	for( cl_int i = start; i < (cl_int) end; i++ ) {
+		const BVHNode* node = &mNodes[(*clusters)[i]];
+		const cl_int first = std::max( i - radius, 0 );
+		const cl_int last = std::min( i + radius, numClusters - 1 );
+		cl_float bestSA = FLT_MAX;
+		cl_int best = -1;
+
+		for( cl_int j = first; j <= last; j++ ) {
+			if( j == i ) {
+				continue;
+			}
+
+			const BVHNode* other = &mNodes[(*clusters)[j]];
+			cl_float sa = MathHelp::getSurfaceArea(
+				glm::min( node->bbMin, other->bbMin ),
+				glm::max( node->bbMax, other->bbMax )
+			);
+
+			if( sa < bestSA ) {
+				bestSA = sa;
+				best = j;
+			}
+		}
+
+		(*nearest)[i] = best;
+	}
+}
+
+
+/**
+ * Find the best object split of the references by the binned SAH.
+ * The references are partitioned in place between the two sides.
+ * @param {std::vector<Tri>*} refs  References of the node to split.
+ * @param {SBVHSplit*}        split Output. The found split.
+ */
+void BVH::findObjectSplit( vector<Tri>* refs, SBVHSplit* split ) {
+	Tri* first = &(*refs)[0];
+	Tri* last = first + refs->size();
+
+	glm::vec3 cenMin = first->bbCenter;
+	glm::vec3 cenMax = first->bbCenter;
+
+	for( const Tri* tri = first + 1; tri < last; tri++ ) {
+		cenMin = glm::min( cenMin, tri->bbCenter );
+		cenMax = glm::max( cenMax, tri->bbCenter );
+	}
+
+	split->sah = FLT_MAX;
+	split->axis = -1;
+	split->bin = 0;
+	split->pos = 0.0f;
+
+	this->splitByBinnedSAH( &split->sah, mSAHBins, first, last, cenMin, cenMax, &split->axis, &split->bin );
+
+	Tri* middle = first + refs->size() / 2;
+
+	// All centroids are at the same position. Just do it 50:50.
+	if( split->axis < 0 ) {
+		Logger::logDebugVerbose( "[BVH] Binned SAH found no split position. Just doing it 50:50 now." );
+	}
+	else {
+		const cl_int bestAxis = split->axis;
+		const cl_uint bestBin = split->bin;
+		const cl_float binScale = this->getBinScale( cenMin[bestAxis], cenMax[bestAxis], mSAHBins );
+		const cl_float binMin = cenMin[bestAxis];
+
+		middle = std::partition( first, last, [this, bestAxis, bestBin, binMin, binScale]( const Tri& tri ) {
+			return this->getBinIndex( tri.bbCenter[bestAxis], binMin, binScale, mSAHBins ) <= bestBin;
+		} );
+	}
+
+	split->numLeft = middle - first;
+	split->numRight = last - middle;
+	split->leftMin = glm::vec3( FLT_MAX );
+	split->leftMax = glm::vec3( -FLT_MAX );
+	split->rightMin = glm::vec3( FLT_MAX );
+	split->rightMax = glm::vec3( -FLT_MAX );
+
+	for( const Tri* tri = first; tri < middle; tri++ ) {
+		split->leftMin = glm::min( split->leftMin, tri->bbMin );
+		split->leftMax = glm::max( split->leftMax, tri->bbMax );
+	}
+
+	for( const Tri* tri = middle; tri < last; tri++ ) {
+		split->rightMin = glm::min( split->rightMin, tri->bbMin );
+		split->rightMax = glm::max( split->rightMax, tri->bbMax );
+	}
+
+	if( split->axis < 0 ) {
+		split->sah = this->calcSAH(
+			MathHelp::getSurfaceArea( split->leftMin, split->leftMax ), split->numLeft,
+			MathHelp::getSurfaceArea( split->rightMin, split->rightMax ), split->numRight
+		);
+	}
+}
+
+
+/**
+ * Find the best spatial split of the references. The bins are spread over
+ * the bounding box of the node and each reference is clipped to all the bins
+ * it overlaps. The SAH is evaluated for the borders between the bins.
+ * @param {const std::vector<Tri>*} refs  References of the node to split.
+ * @param {const BVHNode*}          node  The node to split.
+ * @param {SBVHSplit*}              split Output. The found split. Axis is -1 if none has been found.
+ */
+void BVH::findSpatialSplit( const vector<Tri>* refs, const BVHNode* node, SBVHSplit* split ) {
+	const cl_uint numRefs = refs->size();
+
+	split->sah = FLT_MAX;
+	split->axis = -1;
+
+	for( cl_uint axis = 0; axis <= 2; axis++ ) {
+		const cl_float binMin = node->bbMin[axis];
+		const cl_float extent = node->bbMax[axis] - binMin;
+
+		// The node is flat on this axis. Nothing to split.
+		if( extent <= 0.0f ) {
+			continue;
+		}
+
+		const cl_float binScale = mSAHBins / extent;
+		vector<glm::vec3> binMinBB( mSAHBins, glm::vec3( FLT_MAX ) );
+		vector<glm::vec3> binMaxBB( mSAHBins, glm::vec3( -FLT_MAX ) );
+		vector<cl_uint> binEntries( mSAHBins, 0 );
+		vector<cl_uint> binExits( mSAHBins, 0 );
+
+		for( cl_uint i = 0; i < numRefs; i++ ) {
+			cl_uint firstBin, lastBin;
+			this->getSpatialBins( &(*refs)[i], axis, binMin, binScale, &firstBin, &lastBin );
+
+			binEntries[firstBin]++;
+			binExits[lastBin]++;
+
+			// Clip the reference bin by bin.
+			Tri rest = (*refs)[i];
+
+			for( cl_uint bin = firstBin; bin < lastBin; bin++ ) {
+				Tri piece;
+				this->splitReference( &rest, axis, binMin + ( bin + 1 ) / binScale, &piece, &rest );
+
+				binMinBB[bin] = glm::min( binMinBB[bin], piece.bbMin );
+				binMaxBB[bin] = glm::max( binMaxBB[bin], piece.bbMax );
+			}
+
+			binMinBB[lastBin] = glm::min( binMinBB[lastBin], rest.bbMin );
+			binMaxBB[lastBin] = glm::max( binMaxBB[lastBin], rest.bbMax );
+		}
+
+
+		// Grow a bounding box bin by bin starting from the right.
+		// References end in the bin their last piece is in.
+
+		vector<cl_float> rightSA( mSAHBins - 1 );
+		vector<cl_uint> rightRefs( mSAHBins - 1 );
+		vector<glm::vec3> rightMin( mSAHBins - 1 );
+		vector<glm::vec3> rightMax( mSAHBins - 1 );
+		glm::vec3 bbMin( FLT_MAX );
+		glm::vec3 bbMax( -FLT_MAX );
+		cl_uint num = 0;
+
+		for( cl_uint i = mSAHBins - 1; i > 0; i-- ) {
+			bbMin = glm::min( bbMin, binMinBB[i] );
+			bbMax = glm::max( bbMax, binMaxBB[i] );
+			num += binExits[i];
+
+			rightSA[i - 1] = ( num > 0 ) ? MathHelp::getSurfaceArea( bbMin, bbMax ) : 0.0f;
+			rightRefs[i - 1] = num;
+			rightMin[i - 1] = bbMin;
+			rightMax[i - 1] = bbMax;
+		}
+
+
+		// Grow a bounding box bin by bin starting from the left
+		// and compute the SAH for each split position.
+		// References start in the bin their first piece is in.
+
+		bbMin = glm::vec3( FLT_MAX );
+		bbMax = glm::vec3( -FLT_MAX );
+		num = 0;
+
+		for( cl_uint i = 0; i < mSAHBins - 1; i++ ) {
+			bbMin = glm::min( bbMin, binMinBB[i] );
+			bbMax = glm::max( bbMax, binMaxBB[i] );
+			num += binEntries[i];
+
+			// Both sides have to get smaller, or the build would not terminate.
+			if( num == 0 || rightRefs[i] == 0 || num >= numRefs || rightRefs[i] >= numRefs ) {
+				continue;
+			}
+
+			cl_float leftSA = MathHelp::getSurfaceArea( bbMin, bbMax );
+			cl_float newSAH = this->calcSAH( leftSA, num, rightSA[i], rightRefs[i] );
+
+			if( newSAH < split->sah ) {
+				split->sah = newSAH;
+				split->axis = axis;
+				split->bin = i;
+				split->pos = binMin + ( i + 1 ) / binScale;
+				split->leftMin = bbMin;
+				split->leftMax = bbMax;
+				split->rightMin = rightMin[i];
+				split->rightMax = rightMax[i];
+				split->numLeft = num;
+				split->numRight = rightRefs[i];
+			}
+		}
+	}
+}
+
+
+/**
+ * Get the bin a centroid falls into.
+ * @param  {const cl_float} centroid Position of the centroid on the split axis.
+ * @param  {const cl_float} cenMin   Minimum of all centroids on the split axis.
+ * @param  {const cl_float} binScale Scale factor from getBinScale().
+ * @param  {const cl_uint}  numBins  Number of bins on the axis.
+ * @return {cl_uint}                 Index of the bin.
+ */
+cl_uint BVH::getBinIndex(
+	const cl_float centroid, const cl_float cenMin, const cl_float binScale, const cl_uint numBins
+) {
+	cl_uint bin = (cl_uint) ( ( centroid - cenMin ) * binScale );
+
+	return ( bin < numBins ) ? bin : numBins - 1;
+}
+
+
+/**
+ * Get the factor to map a centroid position to its bin.
+ * @param  {const cl_float} cenMin  Minimum of all centroids on the split axis.
+ * @param  {const cl_float} cenMax  Maximum of all centroids on the split axis.
+ * @param  {const cl_uint}  numBins Number of bins on the axis.
+ * @return {cl_float}               Scale factor.
+ */
+cl_float BVH::getBinScale( const cl_float cenMin, const cl_float cenMax, const cl_uint numBins ) {
+	// Slightly less than the number of bins, so the
+	// maximum centroid still ends up in the last bin.
+	return numBins * 0.99999f / ( cenMax - cenMin );
+}
+
+
+/**
+ * Get the max reached depth.
  * @return {cl_uint} The max reached depth.
  */
 cl_uint BVH::getDepth() {
@@ -398,44 +1410,43 @@ cl_uint BVH::getDepth() {
 
 
 /**
- * Get all leaf nodes.
- * @return {std::vector<BVHNode*>} List of all leaf nodes.
+ * Get the faces. Leaf nodes reference them by index.
+ * @return {const std::vector<Tri>*} The faces.
  */
-vector<BVHNode*> BVH::getLeafNodes() {
-	return mLeafNodes;
+const vector<Tri>* BVH::getFaces() {
+	return &mFaces;
 }
 
 
 /**
  * Find the mean of the triangles regarding the given axis.
- * @param  {const std::vector<Tri>} faces
- * @param  {const cl_uint}          axis
+ * @param  {const BVHNode*} node
+ * @param  {const cl_uint}  axis
  * @return {cl_float}
  */
-cl_float BVH::getMean( const vector<Tri> faces, const cl_uint axis ) {
+cl_float BVH::getMean( const BVHNode* node, const cl_uint axis ) {
 	cl_float sum = 0.0f;
 
-	for( cl_uint i = 0; i < faces.size(); i++ ) {
-		Tri tri = faces[i];
-		glm::vec3 center = 0.5f * ( tri.bbMin + tri.bbMax );
-		sum += center[axis];
+	for( cl_uint i = node->facesStart; i < node->facesStart + node->numFaces; i++ ) {
+		sum += mFaces[i].bbCenter[axis];
 	}
 
-	return sum / faces.size();
+	return sum / node->numFaces;
 }
 
 
 /**
  * Find the mean of the centers of the given nodes.
- * @param  {const std::vector<BVHNode*>} nodes
- * @param  {const cl_uint}               axis
+ * @param  {const std::vector<cl_int>} nodes
+ * @param  {const cl_uint}             axis
  * @return {cl_float}
  */
-cl_float BVH::getMeanOfNodes( const vector<BVHNode*> nodes, const cl_uint axis ) {
+cl_float BVH::getMeanOfNodes( const vector<cl_int> nodes, const cl_uint axis ) {
 	cl_float sum = 0.0f;
 
 	for( cl_uint i = 0; i < nodes.size(); i++ ) {
-		glm::vec3 center = ( nodes[i]->bbMax - nodes[i]->bbMin ) * 0.5f;
+		const BVHNode* node = &mNodes[nodes[i]];
+		glm::vec3 center = ( node->bbMin + node->bbMax ) * 0.5f;
 		sum += center[axis];
 	}
 
@@ -444,88 +1455,153 @@ cl_float BVH::getMeanOfNodes( const vector<BVHNode*> nodes, const cl_uint axis )
 
 
 /**
- * Get all nodes (container and leaf nodes).
- * The first node in the list is the root node.
- * @return {std::vector<BVHNode*>} List of all nodes.
+ * 30 bit Morton code of a point inside the unit cube.
+ * Same as morton3D() of the LBVH (lbvh.cl).
+ * @param  {const glm::vec3} pos Point, each coordinate in [0, 1].
+ * @return {cl_uint}             Morton code.
  */
-vector<BVHNode*> BVH::getNodes() {
-	return mNodes;
+cl_uint BVH::getMortonCode( const glm::vec3 pos ) {
+	cl_uint code = 0;
+
+	for( cl_uint axis = 0; axis < 3; axis++ ) {
+		cl_uint v = fmin( fmax( pos[axis] * 1024.0f, 0.0f ), 1023.0f );
+
+		// Two zero bits between each of the 10 bits.
+		v = ( v * 0x00010001u ) & 0xFF0000FFu;
+		v = ( v * 0x00000101u ) & 0x0F00F00Fu;
+		v = ( v * 0x00000011u ) & 0xC30C30C3u;
+		v = ( v * 0x00000005u ) & 0x49249249u;
+
+		code |= v << ( 2 - axis );
+	}
+
+	return code;
+}
+
+
+/**
+ * Get all nodes (container and leaf nodes) in the order
+ * of the traversal. The first node in the list is the root node.
+ * @return {const std::vector<BVHNode>*} List of all nodes.
+ */
+const vector<BVHNode>* BVH::getNodes() {
+	return &mNodes;
+}
+
+
+/**
+ * Get the number of leaf nodes.
+ * @return {cl_uint} Number of leaf nodes.
+ */
+cl_uint BVH::getNumLeaves() {
+	cl_uint numLeaves = 0;
+
+	for( cl_uint i = 0; i < mNodes.size(); i++ ) {
+		if( mNodes[i].leftChild < 0 ) {
+			numLeaves++;
+		}
+	}
+
+	return numLeaves;
 }
 
 
 /**
  * Get the root node.
- * @return {BVHNode*} The root node.
+ * @return {cl_int} Index of the root node.
  */
-BVHNode* BVH::getRoot() {
+cl_int BVH::getRoot() {
 	return mRoot;
 }
 
 
 /**
- * Group the sphere nodes into two groups and assign them to the given parent node.
- * @param {std::vector<BVHNode*>} nodes
- * @param {BVHNode*}              parent
- * @param {cl_uint}               depth
+ * Get the range of spatial bins a reference overlaps.
+ * A reference ending exactly on a bin border does not overlap the next bin.
+ * @param {const Tri*}     ref      The reference.
+ * @param {const cl_uint}  axis     The split axis.
+ * @param {const cl_float} binMin   Start of the first bin.
+ * @param {const cl_float} binScale Number of bins per unit on the split axis.
+ * @param {cl_uint*}       firstBin Output. First overlapped bin.
+ * @param {cl_uint*}       lastBin  Output. Last overlapped bin.
  */
-void BVH::groupTreesToNodes( vector<BVHNode*> nodes, BVHNode* parent, cl_uint depth ) {
+void BVH::getSpatialBins(
+	const Tri* ref, const cl_uint axis, const cl_float binMin, const cl_float binScale,
+	cl_uint* firstBin, cl_uint* lastBin
+) {
+	cl_int first = floor( ( ref->bbMin[axis] - binMin ) * binScale );
+	cl_int last = ceil( ( ref->bbMax[axis] - binMin ) * binScale ) - 1;
+
+	first = ( first < 0 ) ? 0 : first;
+	first = ( first < (cl_int) mSAHBins ) ? first : mSAHBins - 1;
+	last = ( last > first ) ? last : first;
+	last = ( last < (cl_int) mSAHBins ) ? last : mSAHBins - 1;
+
+	*firstBin = first;
+	*lastBin = last;
+}
+
+
+/**
+ * Group the sub-trees into two groups by SAH and assign them to the given parent node.
+ * @param  {std::vector<cl_int>} nodes  Root nodes of the sub-trees.
+ * @param  {const cl_int}        parent
+ * @param  {cl_uint}             depth
+ * @return {cl_float}                   Sum of the surface areas of the created container
+ *                                      nodes, weighted by the traversal cost.
+ */
+cl_float BVH::groupTreesToNodes( vector<cl_int> nodes, const cl_int parent, cl_uint depth ) {
 	if( nodes.size() == 1 ) {
-		return;
+		return 0.0f;
 	}
 
-	parent->depth = depth;
-	mDepthReached = ( depth > mDepthReached ) ? depth : mDepthReached;
+	BVHNode* parentNode = &mNodes[parent];
+	parentNode->depth = depth;
+	this->updateDepthReached( depth );
 
-	cl_uint axis = this->longestAxis( parent );
-	vector<BVHNode*> leftGroup, rightGroup;
-	cl_float mean = this->getMeanOfNodes( nodes, axis );
-	this->splitNodes( nodes, mean, axis, &leftGroup, &rightGroup );
+	cl_float cost = MathHelp::getSurfaceArea( parentNode->bbMin, parentNode->bbMax ) * mSAHCostTraversal;
+	vector<cl_int> leftGroup, rightGroup;
+	this->splitNodesBySAH( nodes, &leftGroup, &rightGroup );
+
+	parentNode->leftChild = this->makeContainerNode( leftGroup );
+	cost += this->groupTreesToNodes( leftGroup, parentNode->leftChild, depth + 1 );
 
-	BVHNode* leftNode = this->makeContainerNode( leftGroup, false );
-	parent->leftChild = leftNode;
-	this->groupTreesToNodes( leftGroup, parent->leftChild, depth + 1 );
+	parentNode->rightChild = this->makeContainerNode( rightGroup );
+	cost += this->groupTreesToNodes( rightGroup, parentNode->rightChild, depth + 1 );
 
-	BVHNode* rightNode = this->makeContainerNode( rightGroup, false );
-	parent->rightChild = rightNode;
-	this->groupTreesToNodes( rightGroup, parent->rightChild, depth + 1 );
+	return cost;
 }
 
 
 /**
  * Grow AABBs according to the contained faces and calculate their surface areas.
- * @param {const std::vector<Tri>*}              faces
- * @param {std::vector<std::vector<glm::vec3>>*} leftBB
- * @param {std::vector<std::vector<glm::vec3>>*} rightBB
- * @param {std::vector<cl_float>*}               leftSA
- * @param {std::vector<cl_float>*}               rightSA
+ * @param {const BVHNode*}         node
+ * @param {std::vector<cl_float>*} leftSA
+ * @param {std::vector<cl_float>*} rightSA
  */
 void BVH::growAABBsForSAH(
-	const vector<Tri>* faces,
-	vector< vector<glm::vec3> >* leftBB, vector< vector<glm::vec3> >* rightBB,
-	vector<cl_float>* leftSA, vector<cl_float>* rightSA
+	const BVHNode* node, vector<cl_float>* leftSA, vector<cl_float>* rightSA
 ) {
 	glm::vec3 bbMin, bbMax;
-	const cl_uint numFaces = faces->size();
+	const Tri* faces = &mFaces[node->facesStart];
+	const cl_int numFaces = node->numFaces;
 
 
 	// Grow a bounding box face by face starting from the left.
 	// Save the growing surface area for each step.
 
-	for( int i = 0; i < numFaces - 1; i++ ) {
-		Tri f = (*faces)[i];
+	for( cl_int i = 0; i < numFaces - 1; i++ ) {
+		const Tri* f = &faces[i];
 
 		if( i == 0 ) {
-			bbMin = glm::vec3( f.bbMin );
-			bbMax = glm::vec3( f.bbMax );
+			bbMin = f->bbMin;
+			bbMax = f->bbMax;
 		}
 		else {
-			bbMin = glm::min( bbMin, f.bbMin );
-			bbMax = glm::max( bbMax, f.bbMax );
+			bbMin = glm::min( bbMin, f->bbMin );
+			bbMax = glm::max( bbMax, f->bbMax );
 		}
 
-		(*leftBB)[i] = vector<glm::vec3>( 2 );
-		(*leftBB)[i][0] = bbMin;
-		(*leftBB)[i][1] = bbMax;
 		(*leftSA)[i] = MathHelp::getSurfaceArea( bbMin, bbMax );
 	}
 
@@ -533,221 +1609,660 @@ void BVH::growAABBsForSAH(
 	// Grow a bounding box face by face starting from the right.
 	// Save the growing surface area for each step.
 
-	for( int i = numFaces - 2; i >= 0; i-- ) {
-		Tri f = (*faces)[i + 1];
+	for( cl_int i = numFaces - 2; i >= 0; i-- ) {
+		const Tri* f = &faces[i + 1];
+
+		if( i == numFaces - 2 ) {
+			bbMin = f->bbMin;
+			bbMax = f->bbMax;
+		}
+		else {
+			bbMin = glm::min( bbMin, f->bbMin );
+			bbMax = glm::max( bbMax, f->bbMax );
+		}
+
+		(*rightSA)[i] = MathHelp::getSurfaceArea( bbMin, bbMax );
+	}
+}
+
+
+/**
+ * Decide by the SAH, if splitting a node is cheaper than making it a leaf node.
+ * The costs are relative to the intersection test of a face: The split costs a
+ * traversal step plus the faces of the children weighted by their surface area,
+ * the leaf node all of its faces.
+ * @param  {const BVHNode*} node     The node.
+ * @param  {const cl_float} splitSAH SAH value of the split (see calcSAH()).
+ * @param  {const cl_uint}  numFaces Number of faces in the node.
+ * @return {bool}                    True, if splitting is cheaper.
+ */
+bool BVH::isSplitCheaper( const BVHNode* node, const cl_float splitSAH, const cl_uint numFaces ) {
+	const cl_float nodeSA = MathHelp::getSurfaceArea( node->bbMin, node->bbMax );
+
+	if( nodeSA <= 0.0f ) {
+		return false;
+	}
+
+	const cl_float costSplit = mSAHCostTraversal + splitSAH / nodeSA;
+
+	return ( costSplit < (cl_float) numFaces );
+}
+
+
+/**
+ * Log some stats.
+ * @param {boost::posix_time::ptime} timerStart
+ */
+void BVH::logStats( boost::posix_time::ptime timerStart ) {
+	boost::posix_time::ptime timerEnd = boost::posix_time::microsec_clock::local_time();
+	cl_float timeDiff = ( timerEnd - timerStart ).total_milliseconds();
+	string timeUnits = "ms";
+
+	if( timeDiff > 1000.0f ) {
+		timeDiff /= 1000.0f;
+		timeUnits = "s";
+	}
+
+	char msg[512];
+	snprintf(
+		msg, 512, "[BVH] Generated in %.2f %s. Contains %lu nodes (%u leaves). Max faces of %u. Max depth of %u. SAH cost of %.2f.",
+		timeDiff, timeUnits.c_str(), mNodes.size(), this->getNumLeaves(), mMaxFaces, mDepthReached.load(), mSAHCost
+	);
+	Logger::logInfo( msg );
+
+	if( Cfg::get().value<cl_uint>( Cfg::BVH_OPTIMIZEPASSES ) > 0 ) {
+		snprintf(
+			msg, 512, "[BVH] SAH cost of %.2f before the optimization, %.2f after it (%.1f%%).",
+			mSAHCostBuild, mSAHCost, 100.0f * ( mSAHCost - mSAHCostBuild ) / fmax( mSAHCostBuild, 0.0001f )
+		);
+		Logger::logInfo( msg );
+	}
+
+	// On Linux ru_maxrss is given in kilobytes.
+	struct rusage usage;
+	getrusage( RUSAGE_SELF, &usage );
+
+	snprintf(
+		msg, 512, "[BVH] Nodes use %.2f MB, faces use %.2f MB. Peak memory usage (RSS) so far: %.2f MB.",
+		mNodes.size() * sizeof( BVHNode ) / 1048576.0f, mFaces.size() * sizeof( Tri ) / 1048576.0f,
+		usage.ru_maxrss / 1024.0f
+	);
+	Logger::logDebug( msg );
+}
+
+
+/**
+ * Get the index of the longest axis.
+ * @param  {const BVHNode*} node The node to find the longest side of.
+ * @return {cl_uint}             Index of the longest axis (X: 0, Y: 1, Z: 2).
+ */
+cl_uint BVH::longestAxis( const BVHNode* node ) {
+	glm::vec3 sides = node->bbMax - node->bbMin;
+
+	if( sides[0] > sides[1] ) {
+		return ( sides[0] > sides[2] ) ? 0 : 2;
+	}
+	else { // sides[1] > sides[0]
+		return ( sides[1] > sides[2] ) ? 1 : 2;
+	}
+}
+
+
+/**
+ * Create a container node that can contain the created sub-trees.
+ * @param  {const std::vector<cl_int>} subTrees
+ * @return {cl_int}                    Index of the node.
+ */
+cl_int BVH::makeContainerNode( const vector<cl_int> subTrees ) {
+	if( subTrees.size() == 1 ) {
+		return subTrees[0];
+	}
+
+	cl_int index = this->allocateNode();
+	BVHNode* node = &mNodes[index];
+	node->bbMin = mNodes[subTrees[0]].bbMin;
+	node->bbMax = mNodes[subTrees[0]].bbMax;
+
+	for( cl_uint i = 1; i < subTrees.size(); i++ ) {
+		node->bbMin = glm::min( node->bbMin, mNodes[subTrees[i]].bbMin );
+		node->bbMax = glm::max( node->bbMax, mNodes[subTrees[i]].bbMax );
+	}
+
+	return index;
+}
+
+
+/**
+ * Make a leaf node of the SBVH. The references are copied into the
+ * reference array of the whole tree. The order of the leaf nodes in
+ * it depends on the tasks and is fixed after the build.
+ * @param {BVHNode*}                node The node.
+ * @param {const std::vector<Tri>*} refs References of the node.
+ */
+void BVH::makeLeafSBVH( BVHNode* node, const vector<Tri>* refs ) {
+	const cl_uint numRefs = refs->size();
+
+	node->facesStart = mNumRefs.fetch_add( numRefs );
+	node->numFaces = numRefs;
+
+	std::copy( refs->begin(), refs->end(), mRefs.begin() + node->facesStart );
+}
+
+
+/**
+ * Create a new node.
+ * @param  {const cl_uint} facesStart Index of the first face of the node.
+ * @param  {const cl_uint} numFaces   Number of faces of the node.
+ * @return {cl_int}                   Index of the node.
+ */
+cl_int BVH::makeNode( const cl_uint facesStart, const cl_uint numFaces ) {
+	cl_int index = this->allocateNode();
+	BVHNode* node = &mNodes[index];
+	node->facesStart = facesStart;
+	node->numFaces = numFaces;
+
+	if( numFaces == 0 ) {
+		node->bbMin = glm::vec3( 0.0f );
+		node->bbMax = glm::vec3( 0.0f );
+
+		return index;
+	}
+
+	node->bbMin = mFaces[facesStart].bbMin;
+	node->bbMax = mFaces[facesStart].bbMax;
+
+	for( cl_uint i = facesStart + 1; i < facesStart + numFaces; i++ ) {
+		node->bbMin = glm::min( node->bbMin, mFaces[i].bbMin );
+		node->bbMax = glm::max( node->bbMax, mFaces[i].bbMax );
+	}
+
+	return index;
+}
+
+
+/**
+ * Lower the SAH cost of the tree by tree rotations. In each pass the
+ * nodes are visited bottom-up and the best rotation of each node is
+ * applied. Sub-trees below BVH_ROTATE_TASK_DEPTH are independent of
+ * each other and are rotated in parallel, the nodes above them after.
+ * @param {const cl_uint} passes Max number of passes.
+ */
+void BVH::optimizeByRotations( const cl_uint passes ) {
+	boost::posix_time::ptime timerStart = boost::posix_time::microsec_clock::local_time();
+	std::atomic<cl_uint> numRotations( 0 );
+	cl_uint pass = 0;
+
+	while( pass < passes ) {
+		pass++;
+
+		vector<cl_int> subTrees;
+		vector<cl_int> stack;
+		vector<cl_uint> depths;
+		stack.push_back( mRoot );
+		depths.push_back( 0 );
+
+		while( !stack.empty() ) {
+			const cl_int index = stack.back();
+			const cl_uint depth = depths.back();
+			stack.pop_back();
+			depths.pop_back();
+
+			if( mNodes[index].leftChild < 0 ) {
+				continue;
+			}
+
+			if( depth == BVH_ROTATE_TASK_DEPTH ) {
+				subTrees.push_back( index );
+				continue;
+			}
+
+			stack.push_back( mNodes[index].leftChild );
+			stack.push_back( mNodes[index].rightChild );
+			depths.push_back( depth + 1 );
+			depths.push_back( depth + 1 );
+		}
+
+		const cl_uint numBefore = numRotations;
+
+		for( cl_uint i = 0; i < subTrees.size(); i++ ) {
+			const cl_int subTree = subTrees[i];
+
+			mScheduler->spawn( [this, subTree, &numRotations] {
+				numRotations += this->rotateSubTree( subTree, 0, UINT_MAX );
+			} );
+		}
+
+		mScheduler->wait();
+		numRotations += this->rotateSubTree( mRoot, 0, BVH_ROTATE_TASK_DEPTH - 1 );
+
+		// Converged.
+		if( numRotations == numBefore ) {
+			break;
+		}
+	}
+
+	this->updateDepths();
+
+	boost::posix_time::ptime timerEnd = boost::posix_time::microsec_clock::local_time();
+	cl_float timeDiff = ( timerEnd - timerStart ).total_milliseconds();
+	char msg[256];
+	snprintf(
+		msg, 256, "[BVH] Optimized by %u tree rotations in %u pass(es) in %g ms.",
+		(cl_uint) numRotations, pass, timeDiff
+	);
+	Logger::logInfo( msg );
+}
+
+
+/**
+ * Order all BVH nodes for worst-case, left-first, stackless BVH
+ * traversal as done in the OpenCL kernel. The node array is
+ * rearranged and the indices of the children and parents updated.
+ */
+void BVH::orderNodesByTraversal() {
+	boost::posix_time::ptime timerStart = boost::posix_time::microsec_clock::local_time();
+
+	vector<BVHNode> nodesOrdered;
+	vector<cl_int> newIndices( mNumNodes, -1 );
+	vector<cl_int> stack;
+
+	nodesOrdered.reserve( mNumNodes );
+	stack.push_back( mRoot );
+
+	// Order the nodes.
+	while( !stack.empty() ) {
+		cl_int index = stack.back();
+		stack.pop_back();
+
+		newIndices[index] = nodesOrdered.size();
+		nodesOrdered.push_back( mNodes[index] );
+
+		// Push the right child first, so the left one is visited first.
+		if( mNodes[index].leftChild >= 0 ) {
+			stack.push_back( mNodes[index].rightChild );
+			stack.push_back( mNodes[index].leftChild );
+		}
+	}
+
+	// Update the links.
+	for( cl_uint i = 0; i < nodesOrdered.size(); i++ ) {
+		BVHNode* node = &nodesOrdered[i];
+
+		if( node->parent >= 0 ) {
+			node->parent = newIndices[node->parent];
+		}
+		if( node->leftChild >= 0 ) {
+			node->leftChild = newIndices[node->leftChild];
+			node->rightChild = newIndices[node->rightChild];
+		}
+	}
+
+	// Also frees the memory reserved for unused nodes.
+	mNodes.swap( nodesOrdered );
+	mNumNodes = mNodes.size();
+	mRoot = 0;
+
+	boost::posix_time::ptime timerEnd = boost::posix_time::microsec_clock::local_time();
+	cl_float timeDiff = ( timerEnd - timerStart ).total_milliseconds();
+	char msg[128];
+	snprintf( msg, 128, "[BVH] Ordered nodes for traversal in %g ms.", timeDiff );
+	Logger::logInfo( msg );
+}
+
+
+/**
+ * Convert an array of floats to an array of float4s.
+ * @param  {const std::vector<cl_float>*} vertices Input array of floats.
+ * @return {std::vector<cl_float4>}                Array of float4s.
+ */
+vector<cl_float4> BVH::packFloatAsFloat4( const vector<cl_float>* vertices ) {
+	vector<cl_float4> vertices4;
+
+	for( cl_uint i = 0; i < vertices->size(); i += 3 ) {
+		cl_float4 v = {
+			(*vertices)[i + 0],
+			(*vertices)[i + 1],
+			(*vertices)[i + 2],
+			0.0f
+		};
+		vertices4.push_back( v );
+	}
+
+	return vertices4;
+}
+
+
+/**
+ * Distribute the references to the children of an object split.
+ * The references have already been partitioned by findObjectSplit().
+ * @param {std::vector<Tri>*}  refs      References of the node to split.
+ * @param {const SBVHSplit*}   split     The split.
+ * @param {std::vector<Tri>*}  leftRefs  Output. References of the left child.
+ * @param {std::vector<Tri>*}  rightRefs Output. References of the right child.
+ */
+void BVH::performObjectSplit(
+	vector<Tri>* refs, const SBVHSplit* split,
+	vector<Tri>* leftRefs, vector<Tri>* rightRefs
+) {
+	leftRefs->assign( refs->begin(), refs->begin() + split->numLeft );
+	rightRefs->assign( refs->begin() + split->numLeft, refs->end() );
+}
+
+
+/**
+ * Distribute the references to the children of a spatial split. References
+ * on both sides of the split plane are clipped and put into both children,
+ * unless moving them completely to one side is cheaper ("unsplitting").
+ * @param {std::vector<Tri>*}  refs      References of the node to split.
+ * @param {const BVHNode*}     node      The node to split.
+ * @param {const SBVHSplit*}   split     The split.
+ * @param {std::vector<Tri>*}  leftRefs  Output. References of the left child.
+ * @param {std::vector<Tri>*}  rightRefs Output. References of the right child.
+ */
+void BVH::performSpatialSplit(
+	vector<Tri>* refs, const BVHNode* node, const SBVHSplit* split,
+	vector<Tri>* leftRefs, vector<Tri>* rightRefs
+) {
+	const cl_uint axis = split->axis;
+	const cl_float binMin = node->bbMin[axis];
+	const cl_float binScale = mSAHBins / ( node->bbMax[axis] - binMin );
+
+	glm::vec3 leftMin = split->leftMin;
+	glm::vec3 leftMax = split->leftMax;
+	glm::vec3 rightMin = split->rightMin;
+	glm::vec3 rightMax = split->rightMax;
+	cl_uint numLeft = split->numLeft;
+	cl_uint numRight = split->numRight;
+
+	leftRefs->reserve( numLeft );
+	rightRefs->reserve( numRight );
+
+	for( cl_uint i = 0; i < refs->size(); i++ ) {
+		const Tri* ref = &(*refs)[i];
+		cl_uint firstBin, lastBin;
+		this->getSpatialBins( ref, axis, binMin, binScale, &firstBin, &lastBin );
+
+		if( lastBin <= split->bin ) {
+			leftRefs->push_back( *ref );
+			continue;
+		}
+
+		if( firstBin > split->bin ) {
+			rightRefs->push_back( *ref );
+			continue;
+		}
+
+		const cl_float leftSA = MathHelp::getSurfaceArea( leftMin, leftMax );
+		const cl_float rightSA = MathHelp::getSurfaceArea( rightMin, rightMax );
+		const cl_float costSplit = this->calcSAH( leftSA, numLeft, rightSA, numRight );
+		const cl_float costLeft = this->calcSAH(
+			MathHelp::getSurfaceArea( glm::min( leftMin, ref->bbMin ), glm::max( leftMax, ref->bbMax ) ), numLeft,
+			rightSA, numRight - 1
+		);
+		const cl_float costRight = this->calcSAH(
+			leftSA, numLeft - 1,
+			MathHelp::getSurfaceArea( glm::min( rightMin, ref->bbMin ), glm::max( rightMax, ref->bbMax ) ), numRight
+		);
 
-		if( i == numFaces - 2 ) {
-			bbMin = glm::vec3( f.bbMin );
-			bbMax = glm::vec3( f.bbMax );
+		if( costLeft < costSplit && costLeft <= costRight ) {
+			leftMin = glm::min( leftMin, ref->bbMin );
+			leftMax = glm::max( leftMax, ref->bbMax );
+			numRight--;
+			leftRefs->push_back( *ref );
+		}
+		else if( costRight < costSplit ) {
+			rightMin = glm::min( rightMin, ref->bbMin );
+			rightMax = glm::max( rightMax, ref->bbMax );
+			numLeft--;
+			rightRefs->push_back( *ref );
 		}
 		else {
-			bbMin = glm::min( bbMin, f.bbMin );
-			bbMax = glm::max( bbMax, f.bbMax );
+			Tri left, right;
+			this->splitReference( ref, axis, split->pos, &left, &right );
+			leftRefs->push_back( left );
+			rightRefs->push_back( right );
 		}
-
-		(*rightBB)[i] = vector<glm::vec3>( 2 );
-		(*rightBB)[i][0] = bbMin;
-		(*rightBB)[i][1] = bbMax;
-		(*rightSA)[i] = MathHelp::getSurfaceArea( bbMin, bbMax );
 	}
 }
 
 
 /**
- * Log some stats.
- * @param {boost::posix_time::ptime} timerStart
+ * Update the bounding boxes for new positions of the vertices.
+ * The tree keeps its topology, so the faces have to stay the same.
+ * Faces referenced by multiple leaf nodes (SBVH) are no longer clipped.
+ * @param  {const std::vector<cl_float>} vertices The moved vertices.
+ * @param  {const std::vector<cl_float>} normals  The normals of the moved vertices.
+ * @return {cl_float}                             SAH cost of the refitted tree relative to the
+ *                                                cost of the tree refitted to the unmoved vertices.
  */
-void BVH::logStats( boost::posix_time::ptime timerStart ) {
+cl_float BVH::refit( const vector<cl_float> vertices, const vector<cl_float> normals ) {
+	boost::posix_time::ptime timerStart = boost::posix_time::microsec_clock::local_time();
+
+	this->refitBoxes( &vertices, &normals );
+
+	cl_float cost = this->calcSAHCost();
+	cl_float ratio = ( mSAHCostRefit > 0.0f ) ? cost / mSAHCostRefit : 1.0f;
+
 	boost::posix_time::ptime timerEnd = boost::posix_time::microsec_clock::local_time();
 	cl_float timeDiff = ( timerEnd - timerStart ).total_milliseconds();
-	string timeUnits = "ms";
-
-	if( timeDiff > 1000.0f ) {
-		timeDiff /= 1000.0f;
-		timeUnits = "s";
-	}
 
-	char msg[512];
+	char msg[128];
 	snprintf(
-		msg, 512, "[BVH] Generated in %.2f %s. Contains %lu nodes (%lu leaves). Max faces of %u. Max depth of %u.",
-		timeDiff, timeUnits.c_str(), mNodes.size(), mLeafNodes.size(), mMaxFaces, mDepthReached
+		msg, 128, "[BVH] Refitted in %g ms. SAH cost of %g (%.2fx of the build).",
+		timeDiff, cost, ratio
 	);
-	Logger::logInfo( msg );
+	Logger::logDebug( msg );
+
+	return ratio;
 }
 
 
 /**
- * Get the index of the longest axis.
- * @param  {const BVHNode*} node The node to find the longest side of.
- * @return {cl_uint}             Index of the longest axis (X: 0, Y: 1, Z: 2).
+ * Set the bounding boxes of the faces and nodes to the given vertices.
+ * The nodes have to be in depth-first order.
+ * @param {const std::vector<cl_float>*} vertices The vertices.
+ * @param {const std::vector<cl_float>*} normals  The normals of the vertices.
  */
-cl_uint BVH::longestAxis( const BVHNode* node ) {
-	glm::vec3 sides = node->bbMax - node->bbMin;
+void BVH::refitBoxes( const vector<cl_float>* vertices, const vector<cl_float>* normals ) {
+	vector<cl_float4> vertices4 = this->packFloatAsFloat4( vertices );
+	vector<cl_float4> normals4 = this->packFloatAsFloat4( normals );
 
-	if( sides[0] > sides[1] ) {
-		return ( sides[0] > sides[2] ) ? 0 : 2;
+	for( cl_uint i = 0; i < mFaces.size(); i++ ) {
+		Tri* tri = &mFaces[i];
+		MathHelp::triCalcAABB( tri, &vertices4, &normals4 );
+		tri->bbCenter = ( tri->bbMin + tri->bbMax ) * 0.5f;
 	}
-	else { // sides[1] > sides[0]
-		return ( sides[1] > sides[2] ) ? 1 : 2;
+
+	// The nodes are in depth-first order, so the
+	// child nodes come after their parent node.
+	for( cl_int i = mNodes.size() - 1; i >= 0; i-- ) {
+		BVHNode* node = &mNodes[i];
+
+		// Leaf node
+		if( node->leftChild < 0 ) {
+			const Tri* first = &mFaces[node->facesStart];
+			node->bbMin = first->bbMin;
+			node->bbMax = first->bbMax;
+
+			for( cl_uint j = 1; j < node->numFaces; j++ ) {
+				node->bbMin = glm::min( node->bbMin, mFaces[node->facesStart + j].bbMin );
+				node->bbMax = glm::max( node->bbMax, mFaces[node->facesStart + j].bbMax );
+			}
+		}
+		else {
+			const BVHNode* left = &mNodes[node->leftChild];
+			const BVHNode* right = &mNodes[node->rightChild];
+			node->bbMin = glm::min( left->bbMin, right->bbMin );
+			node->bbMax = glm::max( left->bbMax, right->bbMax );
+		}
 	}
 }
 
 
 /**
- * Create a container node that can contain the created sub-trees.
- * @param  {const std::vector<BVHNode*>} subTrees
- * @param  {const bool}                  isRoot
- * @return {BVHNode*}
+ * Apply the rotation of a node that lowers the SAH cost the most.
+ * A rotation swaps a child node with a grandchild node on the other
+ * side or two grandchild nodes. Only the bounding boxes of the child
+ * nodes change, so only their surface areas are compared. The leaf
+ * nodes keep their boxes and faces.
+ * @param  {const cl_int} index Index of the node.
+ * @return {bool}               True, if the node has been rotated.
  */
-BVHNode* BVH::makeContainerNode( const vector<BVHNode*> subTrees, const bool isRoot ) {
-	if( subTrees.size() == 1 ) {
-		return subTrees[0];
-	}
-
-	BVHNode* node = new BVHNode();
-
-	node->leftChild = NULL;
-	node->rightChild = NULL;
-	node->parent = NULL;
-	node->depth = 0;
-	node->skipNextLeft = false;
-	node->numSkipsToHere = 0;
-	node->bbMin = glm::vec3( subTrees[0]->bbMin );
-	node->bbMax = glm::vec3( subTrees[0]->bbMax );
+bool BVH::rotateNode( const cl_int index ) {
+	BVHNode* node = &mNodes[index];
 
-	for( cl_uint i = 1; i < subTrees.size(); i++ ) {
-		node->bbMin = glm::min( node->bbMin, subTrees[i]->bbMin );
-		node->bbMax = glm::max( node->bbMax, subTrees[i]->bbMax );
+	if( node->leftChild < 0 ) {
+		return false;
 	}
 
-	if( !isRoot ) {
-		mContainerNodes.push_back( node );
+	BVHNode* left = &mNodes[node->leftChild];
+	BVHNode* right = &mNodes[node->rightChild];
+	const bool leftInner = ( left->leftChild >= 0 );
+	const bool rightInner = ( right->leftChild >= 0 );
+
+	if( !leftInner && !rightInner ) {
+		return false;
 	}
 
-	return node;
-}
+	const cl_float leftSA = leftInner ? MathHelp::getSurfaceArea( left->bbMin, left->bbMax ) : 0.0f;
+	const cl_float rightSA = rightInner ? MathHelp::getSurfaceArea( right->bbMin, right->bbMax ) : 0.0f;
+
+	// Rotations must gain a bit, so float
+	// precision doesn't lead to cycles.
+	const cl_float minGain = BVH_ROTATE_MIN_GAIN * MathHelp::getSurfaceArea( node->bbMin, node->bbMax );
+	cl_float bestGain = minGain;
+	cl_int best = -1;
+
+	// Candidates:
+	// 0: left <-> right->leftChild
+	// 1: left <-> right->rightChild
+	// 2: right <-> left->leftChild
+	// 3: right <-> left->rightChild
+	// 4: left->leftChild <-> right->leftChild
+	// 5: left->leftChild <-> right->rightChild
+	for( cl_int r = 0; r < 6; r++ ) {
+		if( ( r < 2 || r >= 4 ) && !rightInner ) {
+			continue;
+		}
+		if( r >= 2 && !leftInner ) {
+			continue;
+		}
 
+		cl_float newSA = 0.0f;
 
-/**
- * Create a new node.
- * @param  {const std::vector<Tri>} tris
- * @param  {const bool}             ignore
- * @return {BVHNode*}
- */
-BVHNode* BVH::makeNode( const vector<Tri> tris, const bool ignore ) {
-	BVHNode* node = new BVHNode();
-	node->leftChild = NULL;
-	node->rightChild = NULL;
-	node->parent = NULL;
-	node->depth = 0;
-	node->skipNextLeft = false;
-	node->numSkipsToHere = 0;
+		if( r < 2 ) {
+			const BVHNode* stay = &mNodes[( r == 0 ) ? right->rightChild : right->leftChild];
+			newSA = leftSA + MathHelp::getSurfaceArea(
+				glm::min( left->bbMin, stay->bbMin ), glm::max( left->bbMax, stay->bbMax )
+			);
+		}
+		else if( r < 4 ) {
+			const BVHNode* stay = &mNodes[( r == 2 ) ? left->rightChild : left->leftChild];
+			newSA = rightSA + MathHelp::getSurfaceArea(
+				glm::min( right->bbMin, stay->bbMin ), glm::max( right->bbMax, stay->bbMax )
+			);
+		}
+		else {
+			const BVHNode* ll = &mNodes[left->leftChild];
+			const BVHNode* lr = &mNodes[left->rightChild];
+			const BVHNode* moved = &mNodes[( r == 4 ) ? right->leftChild : right->rightChild];
+			const BVHNode* stay = &mNodes[( r == 4 ) ? right->rightChild : right->leftChild];
+			newSA = MathHelp::getSurfaceArea(
+				glm::min( moved->bbMin, lr->bbMin ), glm::max( moved->bbMax, lr->bbMax )
+			);
+			newSA += MathHelp::getSurfaceArea(
+				glm::min( ll->bbMin, stay->bbMin ), glm::max( ll->bbMax, stay->bbMax )
+			);
+		}
 
-	vector<glm::vec3> bbMins, bbMaxs;
+		const cl_float gain = leftSA + rightSA - newSA;
 
-	for( cl_uint i = 0; i < tris.size(); i++ ) {
-		bbMins.push_back( tris[i].bbMin );
-		bbMaxs.push_back( tris[i].bbMax );
+		if( gain > bestGain ) {
+			bestGain = gain;
+			best = r;
+		}
 	}
 
-	glm::vec3 bbMin;
-	glm::vec3 bbMax;
-	MathHelp::getAABB( bbMins, bbMaxs, &bbMin, &bbMax );
-	node->bbMin = bbMin;
-	node->bbMax = bbMax;
-
-	if( !ignore ) {
-		mContainerNodes.push_back( node );
+	if( best < 0 ) {
+		return false;
 	}
 
-	return node;
-}
-
-
-/**
- * Order all BVH nodes for worst-case, left-first, stackless BVH
- * traversal as done in the OpenCL kernel.
- */
-void BVH::orderNodesByTraversal() {
-	boost::posix_time::ptime timerStart = boost::posix_time::microsec_clock::local_time();
+	cl_int tmp;
 
-	vector<BVHNode*> nodesOrdered;
-	BVHNode* node = mNodes[0];
-
-	// Order the nodes.
-	while( true ) {
-		nodesOrdered.push_back( node );
+	if( best == 0 ) {
+		tmp = node->leftChild;
+		node->leftChild = right->leftChild;
+		right->leftChild = tmp;
+	}
+	else if( best == 1 ) {
+		tmp = node->leftChild;
+		node->leftChild = right->rightChild;
+		right->rightChild = tmp;
+	}
+	else if( best == 2 ) {
+		tmp = node->rightChild;
+		node->rightChild = left->leftChild;
+		left->leftChild = tmp;
+	}
+	else if( best == 3 ) {
+		tmp = node->rightChild;
+		node->rightChild = left->rightChild;
+		left->rightChild = tmp;
+	}
+	else if( best == 4 ) {
+		tmp = left->leftChild;
+		left->leftChild = right->leftChild;
+		right->leftChild = tmp;
+	}
+	else {
+		tmp = left->leftChild;
+		left->leftChild = right->rightChild;
+		right->rightChild = tmp;
+	}
 
-		if( node->leftChild != NULL ) {
-			node = node->leftChild;
-		}
-		else {
-			// is left node, visit right sibling next
-			if( node->parent->leftChild == node ) {
-				node = node->parent->rightChild;
-			}
-			// is right node, go up tree
-			else if( node->parent->parent != NULL ) {
-				BVHNode* dummy = new BVHNode();
-				dummy->parent = node->parent;
-
-				// As long as we are on the right side of a (sub)tree,
-				// skip parents until we either are at the root or
-				// our parent has a true sibling again.
-				while( dummy->parent->parent->rightChild == dummy->parent ) {
-					dummy->parent = dummy->parent->parent;
-
-					if( dummy->parent->parent == NULL ) {
-						break;
-					}
-				}
+	// The node itself may have a different child now, but
+	// both former children are still the inner nodes to update.
+	BVHNode* updated[2] = { left, right };
 
-				// Reached a parent with a true sibling.
-				if( dummy->parent->parent != NULL ) {
-					node = dummy->parent->parent->rightChild;
-				}
-			}
-		}
+	for( cl_uint i = 0; i < 2; i++ ) {
+		BVHNode* n = updated[i];
 
-		if( nodesOrdered.size() >= mNodes.size() ) {
-			break;
+		if( n->leftChild < 0 ) {
+			continue;
 		}
-	}
 
-	// Assign IDs.
-	for( cl_uint i = 0; i < mNodes.size(); i++ ) {
-		BVHNode* node = nodesOrdered[i];
-		node->id = i;
-		mNodes[i] = node;
+		n->bbMin = glm::min( mNodes[n->leftChild].bbMin, mNodes[n->rightChild].bbMin );
+		n->bbMax = glm::max( mNodes[n->leftChild].bbMax, mNodes[n->rightChild].bbMax );
 	}
 
-	boost::posix_time::ptime timerEnd = boost::posix_time::microsec_clock::local_time();
-	cl_float timeDiff = ( timerEnd - timerStart ).total_milliseconds();
-	char msg[128];
-	snprintf( msg, 128, "[BVH] Ordered nodes for traversal in %g ms.", timeDiff );
-	Logger::logInfo( msg );
+	return true;
 }
 
 
 /**
- * Convert an array of floats to an array of float4s.
- * @param  {const std::vector<cl_float>*} vertices Input array of floats.
- * @return {std::vector<cl_float4>}                Array of float4s.
+ * Rotate the nodes of a sub-tree bottom-up.
+ * @param  {const cl_int}  index    Index of the root node of the sub-tree.
+ * @param  {const cl_uint} depth    Depth of the node relative to the start.
+ * @param  {const cl_uint} maxDepth Don't descend below this depth. The nodes at this depth are still rotated.
+ * @return {cl_uint}                Number of applied rotations.
  */
-vector<cl_float4> BVH::packFloatAsFloat4( const vector<cl_float>* vertices ) {
-	vector<cl_float4> vertices4;
+cl_uint BVH::rotateSubTree( const cl_int index, const cl_uint depth, const cl_uint maxDepth ) {
+	if( mNodes[index].leftChild < 0 ) {
+		return 0;
+	}
 
-	for( cl_uint i = 0; i < vertices->size(); i += 3 ) {
-		cl_float4 v = {
-			(*vertices)[i + 0],
-			(*vertices)[i + 1],
-			(*vertices)[i + 2],
-			0.0f
-		};
-		vertices4.push_back( v );
+	cl_uint numRotations = 0;
+
+	if( depth < maxDepth ) {
+		numRotations += this->rotateSubTree( mNodes[index].leftChild, depth + 1, maxDepth );
+		numRotations += this->rotateSubTree( mNodes[index].rightChild, depth + 1, maxDepth );
 	}
 
-	return vertices4;
+	if( this->rotateNode( index ) ) {
+		numRotations++;
+	}
+
+	return numRotations;
 }
 
 
@@ -757,7 +2272,7 @@ vector<cl_float4> BVH::packFloatAsFloat4( const vector<cl_float>* vertices ) {
  * @return {cl_uint}             The now set number of max faces per (leaf) node.
  */
 cl_uint BVH::setMaxFaces( const int value ) {
-	mMaxFaces = fmax( value, 1 );
+	mMaxFaces = fmin( fmax( value, 1 ), BVH_LEAF_MAX_FACES );
 
 	return mMaxFaces;
 }
@@ -772,12 +2287,12 @@ void BVH::skipAheadOfNodes() {
 	cl_uint skippedLeft = 0;
 
 	for( cl_uint i = 0; i < mNodes.size(); i++ ) {
-		BVHNode* node = mNodes[i];
+		BVHNode* node = &mNodes[i];
 		node->numSkipsToHere = skippedLeft;
 
 		// Left child exists and is not a leaf node.
-		if( node->leftChild != NULL && node->leftChild->leftChild != NULL ) {
-			BVHNode* left = node->leftChild;
+		if( node->leftChild >= 0 && mNodes[node->leftChild].leftChild >= 0 ) {
+			const BVHNode* left = &mNodes[node->leftChild];
 
 			cl_float saNode = MathHelp::getSurfaceArea( node->bbMin, node->bbMax );
 			cl_float saLeft = MathHelp::getSurfaceArea( left->bbMin, left->bbMax );
@@ -796,32 +2311,146 @@ void BVH::skipAheadOfNodes() {
 
 
 /**
- * Split the faces into two groups.
+ * Find the best split of the faces by the binned SAH. The faces are
+ * sorted into the bins of all three axes in one pass. Boundaries
+ * after an empty bin split the faces like the one before, so only
+ * the boundaries after filled bins are rated.
+ * @param {cl_float*}       bestSAH  Best SAH value that has been found so far (for the faces in this node).
+ * @param {const cl_uint}   numBins  Number of bins per axis.
+ * @param {const Tri*}      first    First face of the node to split.
+ * @param {const Tri*}      last     Position after the last face of the node.
+ * @param {const glm::vec3} cenMin   Minimum of the centroids.
+ * @param {const glm::vec3} cenMax   Maximum of the centroids.
+ * @param {cl_int*}         bestAxis Output. Axis of the best split.
+ * @param {cl_uint*}        bestBin  Output. Last bin left of the best split.
+ */
+void BVH::splitByBinnedSAH(
+	cl_float* bestSAH, const cl_uint numBins, const Tri* first, const Tri* last,
+	const glm::vec3 cenMin, const glm::vec3 cenMax,
+	cl_int* bestAxis, cl_uint* bestBin
+) {
+	SAHBin emptyBin;
+	emptyBin.bbMin = glm::vec3( FLT_MAX );
+	emptyBin.bbMax = glm::vec3( -FLT_MAX );
+	emptyBin.numFaces = 0;
+
+	// The bins of the axes one after another.
+	vector<SAHBin> bins( 3 * numBins, emptyBin );
+	glm::vec3 binScale( 0.0f );
+
+	for( cl_uint axis = 0; axis <= 2; axis++ ) {
+		// All centroids are on a plane. Nothing to split on this axis.
+		if( cenMax[axis] - cenMin[axis] > 0.0f ) {
+			binScale[axis] = this->getBinScale( cenMin[axis], cenMax[axis], numBins );
+		}
+	}
+
+	for( const Tri* tri = first; tri < last; tri++ ) {
+		for( cl_uint axis = 0; axis <= 2; axis++ ) {
+			const cl_uint index = this->getBinIndex( tri->bbCenter[axis], cenMin[axis], binScale[axis], numBins );
+			SAHBin* bin = &bins[axis * numBins + index];
+
+			bin->bbMin = glm::min( bin->bbMin, tri->bbMin );
+			bin->bbMax = glm::max( bin->bbMax, tri->bbMax );
+			bin->numFaces++;
+		}
+	}
+
+	// Surface area and number of faces right of each split position.
+	cl_float rightSA[BVH_SAH_MAX_BINS - 1];
+	cl_uint rightFaces[BVH_SAH_MAX_BINS - 1];
+
+	for( cl_uint axis = 0; axis <= 2; axis++ ) {
+		if( binScale[axis] <= 0.0f ) {
+			continue;
+		}
+
+		const SAHBin* axisBins = &bins[axis * numBins];
+
+
+		// Grow a bounding box bin by bin starting from the right.
+		// Save the surface area and number of faces for each split position.
+
+		glm::vec3 bbMin( FLT_MAX );
+		glm::vec3 bbMax( -FLT_MAX );
+		cl_uint numFaces = 0;
+
+		for( cl_uint i = numBins - 1; i > 0; i-- ) {
+			if( axisBins[i].numFaces > 0 ) {
+				bbMin = glm::min( bbMin, axisBins[i].bbMin );
+				bbMax = glm::max( bbMax, axisBins[i].bbMax );
+				numFaces += axisBins[i].numFaces;
+			}
+
+			rightSA[i - 1] = ( numFaces > 0 ) ? MathHelp::getSurfaceArea( bbMin, bbMax ) : 0.0f;
+			rightFaces[i - 1] = numFaces;
+		}
+
+
+		// Grow a bounding box bin by bin starting from the left
+		// and compute the SAH for each split position.
+
+		bbMin = glm::vec3( FLT_MAX );
+		bbMax = glm::vec3( -FLT_MAX );
+		numFaces = 0;
+
+		for( cl_uint i = 0; i < numBins - 1; i++ ) {
+			if( axisBins[i].numFaces == 0 ) {
+				continue;
+			}
+
+			bbMin = glm::min( bbMin, axisBins[i].bbMin );
+			bbMax = glm::max( bbMax, axisBins[i].bbMax );
+			numFaces += axisBins[i].numFaces;
+
+			if( rightFaces[i] == 0 ) {
+				break;
+			}
+
+			cl_float newSAH = this->calcSAH(
+				MathHelp::getSurfaceArea( bbMin, bbMax ), numFaces,
+				rightSA[i], rightFaces[i]
+			);
+
+			// Better split position found
+			if( newSAH < *bestSAH ) {
+				*bestSAH = newSAH;
+				*bestAxis = axis;
+				*bestBin = i;
+			}
+		}
+	}
+}
+
+
+/**
+ * Find the best split of the faces on the given axis.
  * Determine this splitting point by using a Surface Area Heuristic (SAH).
- * @param {cl_float*}         bestSAH    Best SAH value that has been found so far (for the faces in this node).
- * @param {const cl_uint}     axis       The axis to sort the faces by.
- * @param {std::vector<Tri>}  faces      Faces in this node.
- * @param {std::vector<Tri>*} leftFaces  Output. Group for the faces left of the split.
- * @param {std::vector<Tri>*} rightFaces Output. Group for the faces right of the split.
+ * The faces of the node will be sorted by the given axis.
+ * @param {cl_float*}      bestSAH   Best SAH value that has been found so far (for the faces in this node).
+ * @param {const cl_uint}  axis      The axis to sort the faces by.
+ * @param {const BVHNode*} node      The node to split.
+ * @param {cl_int*}        bestAxis  Output. Axis of the best split.
+ * @param {cl_uint*}       bestSplit Output. Number of faces left of the best split.
  */
 void BVH::splitBySAH(
-	cl_float* bestSAH, const cl_uint axis, vector<Tri> faces,
-	vector<Tri>* leftFaces, vector<Tri>* rightFaces
+	cl_float* bestSAH, const cl_uint axis, const BVHNode* node,
+	cl_int* bestAxis, cl_uint* bestSplit
 ) {
-	std::sort( faces.begin(), faces.end(), sortFacesCmp( axis ) );
-	const cl_uint numFaces = faces.size();
+	Tri* first = &mFaces[node->facesStart];
+	const cl_uint numFaces = node->numFaces;
+
+	std::sort( first, first + numFaces, sortFacesCmp( axis ) );
 
 	vector<cl_float> leftSA( numFaces - 1 );
 	vector<cl_float> rightSA( numFaces - 1 );
-	vector< vector<glm::vec3> > leftBB( numFaces - 1 ), rightBB( numFaces - 1 );
 
-	this->growAABBsForSAH( &faces, &leftBB, &rightBB, &leftSA, &rightSA );
+	this->growAABBsForSAH( node, &leftSA, &rightSA );
 
 
 	// Compute the SAH for each split position and choose the one with the lowest cost.
 	// SAH = SA of node * ( SA left of split * faces left of split + SA right of split * faces right of split )
 
-	int splitAfter = -1;
 	cl_float newSAH;
 
 	for( cl_uint i = 0; i < numFaces - 1; i++ ) {
@@ -833,129 +2462,147 @@ void BVH::splitBySAH(
 		// Better split position found
 		if( newSAH < *bestSAH ) {
 			*bestSAH = newSAH;
+			*bestAxis = axis;
 			// Up to (including) this face it is preferable to split.
-			splitAfter = i + 1;
+			*bestSplit = i + 1;
 		}
 	}
-
-
-	// If a splitting index has been found, split the faces into two groups.
-
-	if( splitAfter >= 0 ) {
-		leftFaces->clear();
-		rightFaces->clear();
-
-		leftFaces->insert( leftFaces->begin(), faces.begin(), faces.begin() + splitAfter );
-		rightFaces->insert( rightFaces->begin(), faces.begin() + splitAfter, faces.end() );
-	}
 }
 
 
 /**
- * Split the faces into two groups using the given pos and axis as criterium.
- * @param {const std::vector<Tri>} faces
- * @param {const cl_float}         pos
- * @param {const cl_uint}          axis
- * @param {std::vector<Tri>*}      leftFaces
- * @param {std::vector<Tri>*}      rightFaces
+ * Split the bounding boxes of the faces of an object before the build (early
+ * split clipping). Long and thin or tilted triangles have a bounding box that
+ * is mostly empty space. A face whose box has a surface area of more than
+ * the ratio times the area of the triangle is split in the middle of the
+ * longest axis of the box into references with the clipped boxes (see
+ * splitReference()). The references with the biggest excess are split first,
+ * until the budget is used up. The new references are appended after the faces.
+ * @param  {const cl_uint} facesStart Index of the first face of the object.
+ * @param  {const cl_uint} numFaces   Number of faces of the object.
+ * @param  {const cl_uint} budget     Number of references that may be added.
+ * @return {cl_uint}                  Number of references of the object.
  */
-cl_float BVH::splitFaces(
-	const vector<Tri> faces, const cl_float pos, const cl_uint axis,
-	vector<Tri>* leftFaces, vector<Tri>* rightFaces
-) {
-	cl_float sah = FLT_MAX;
-	vector<glm::vec3> bbMinsL, bbMinsR, bbMaxsL, bbMaxsR;
+cl_uint BVH::splitEarly( const cl_uint facesStart, const cl_uint numFaces, const cl_uint budget ) {
+	Tri* refs = &mFaces[facesStart];
+	vector<cl_float> areas( numFaces + budget );
 
-	leftFaces->clear();
-	rightFaces->clear();
+	// Surface area of the box above the limit and the index of the reference.
+	std::priority_queue< std::pair<cl_float, cl_uint> > queue;
 
-	for( cl_uint i = 0; i < faces.size(); i++ ) {
-		Tri tri = faces[i];
-		glm::vec3 cen = ( tri.bbMin + tri.bbMax ) * 0.5f;
+	for( cl_uint i = 0; i < numFaces; i++ ) {
+		const cl_uint indices[3] = { refs[i].face.x, refs[i].face.y, refs[i].face.z };
+		glm::vec3 v[3];
 
-		if( cen[axis] <= pos ) {
-			leftFaces->push_back( tri );
-			bbMinsL.push_back( tri.bbMin );
-			bbMaxsL.push_back( tri.bbMax );
+		for( cl_uint j = 0; j < 3; j++ ) {
+			const cl_float4 v4 = mVertices4[indices[j]];
+			v[j] = glm::vec3( v4.x, v4.y, v4.z );
 		}
-		else {
-			rightFaces->push_back( tri );
-			bbMinsR.push_back( tri.bbMin );
-			bbMaxsR.push_back( tri.bbMax );
+
+		areas[i] = 0.5f * glm::length( glm::cross( v[1] - v[0], v[2] - v[0] ) );
+		const cl_float excess = MathHelp::getSurfaceArea( refs[i].bbMin, refs[i].bbMax ) - mEarlySplitRatio * areas[i];
+
+		if( excess > 0.0f ) {
+			queue.push( std::make_pair( excess, i ) );
 		}
 	}
 
-	// Just do it 50:50.
-	if( leftFaces->size() == 0 || rightFaces->size() == 0 ) {
-		Logger::logDebugVerbose( "[BVH] Dividing faces by center left one side empty. Just doing it 50:50 now." );
+	cl_uint numRefs = numFaces;
 
-		bbMinsL.clear();
-		bbMaxsL.clear();
-		bbMinsR.clear();
-		bbMaxsR.clear();
-		leftFaces->clear();
-		rightFaces->clear();
+	while( !queue.empty() && numRefs < numFaces + budget ) {
+		const cl_uint i = queue.top().second;
+		queue.pop();
 
-		for( cl_uint i = 0; i < faces.size(); i++ ) {
-			Tri tri = faces[i];
+		const cl_uint axis = MathHelp::longestAxis( refs[i].bbMin, refs[i].bbMax );
+		const cl_float pos = ( refs[i].bbMin[axis] + refs[i].bbMax[axis] ) * 0.5f;
 
-			if( i < faces.size() / 2 ) {
-				leftFaces->push_back( tri );
-				bbMinsL.push_back( tri.bbMin );
-				bbMaxsL.push_back( tri.bbMax );
-			}
-			else {
-				rightFaces->push_back( tri );
-				bbMinsR.push_back( tri.bbMin );
-				bbMaxsR.push_back( tri.bbMax );
+		// Too small to be split with the float precision.
+		if( pos <= refs[i].bbMin[axis] || pos >= refs[i].bbMax[axis] ) {
+			continue;
+		}
+
+		// The parts are compared to the area of the whole triangle.
+		const cl_uint j = numRefs++;
+		this->splitReference( &refs[i], axis, pos, &refs[i], &refs[j] );
+		areas[j] = areas[i];
+
+		const cl_uint parts[2] = { i, j };
+
+		for( cl_uint k = 0; k < 2; k++ ) {
+			const Tri* part = &refs[parts[k]];
+			const cl_float excess = MathHelp::getSurfaceArea( part->bbMin, part->bbMax ) - mEarlySplitRatio * areas[parts[k]];
+
+			if( excess > 0.0f ) {
+				queue.push( std::make_pair( excess, parts[k] ) );
 			}
 		}
 	}
 
-	glm::vec3 bbMinL, bbMinR, bbMaxL, bbMaxR;
-	MathHelp::getAABB( bbMinsL, bbMaxsL, &bbMinL, &bbMaxL );
-	cl_float leftSA = MathHelp::getSurfaceArea( bbMinL, bbMaxL );
-	cl_float rightSA = MathHelp::getSurfaceArea( bbMinR, bbMaxR );
+	return numRefs;
+}
 
-	sah = leftSA * leftFaces->size() + rightSA * rightFaces->size();
 
-	// There has to be somewhere else something wrong.
-	if( leftFaces->size() == 0 || rightFaces->size() == 0 ) {
-		char msg[256];
-		snprintf(
-			msg, 256, "[BVH] Dividing faces 50:50 left one side empty. Faces: %lu.",
-			faces.size()
-		);
-		Logger::logError( msg );
+/**
+ * Calculate the SAH of splitting the faces into two groups
+ * using the given pos and axis as criterium.
+ * @param  {const BVHNode*} node
+ * @param  {const cl_float} pos
+ * @param  {const cl_uint}  axis
+ * @return {cl_float}       SAH value. FLT_MAX if one side would be empty.
+ */
+cl_float BVH::splitFaces( const BVHNode* node, const cl_float pos, const cl_uint axis ) {
+	glm::vec3 bbMinL( FLT_MAX ), bbMaxL( -FLT_MAX );
+	glm::vec3 bbMinR( FLT_MAX ), bbMaxR( -FLT_MAX );
+	cl_uint numLeft = 0;
+	cl_uint numRight = 0;
+
+	for( cl_uint i = node->facesStart; i < node->facesStart + node->numFaces; i++ ) {
+		const Tri* tri = &mFaces[i];
+
+		if( tri->bbCenter[axis] <= pos ) {
+			bbMinL = glm::min( bbMinL, tri->bbMin );
+			bbMaxL = glm::max( bbMaxL, tri->bbMax );
+			numLeft++;
+		}
+		else {
+			bbMinR = glm::min( bbMinR, tri->bbMin );
+			bbMaxR = glm::max( bbMaxR, tri->bbMax );
+			numRight++;
+		}
+	}
 
-		sah = FLT_MAX;
+	if( numLeft == 0 || numRight == 0 ) {
+		return FLT_MAX;
 	}
 
-	return sah;
+	cl_float leftSA = MathHelp::getSurfaceArea( bbMinL, bbMaxL );
+	cl_float rightSA = MathHelp::getSurfaceArea( bbMinR, bbMaxR );
+
+	return this->calcSAH( leftSA, numLeft, rightSA, numRight );
 }
 
 
 /**
  * Split the nodes into two groups using the given pos and axis as criterium.
- * @param {const std::vector<BVHNode*>}  nodes
- * @param {const cl_float}               pos
- * @param {const cl_uint}                axis
- * @param {std::vector<BVHNode*>*}       leftGroup
- * @param {std::vector<BVHNode*>*}       rightGroup
+ * @param {const std::vector<cl_int>} nodes
+ * @param {const cl_float}            pos
+ * @param {const cl_uint}             axis
+ * @param {std::vector<cl_int>*}      leftGroup
+ * @param {std::vector<cl_int>*}      rightGroup
  */
 void BVH::splitNodes(
-	const vector<BVHNode*> nodes, const cl_float pos, const cl_uint axis,
-	vector<BVHNode*>* leftGroup, vector<BVHNode*>* rightGroup
+	const vector<cl_int> nodes, const cl_float pos, const cl_uint axis,
+	vector<cl_int>* leftGroup, vector<cl_int>* rightGroup
 ) {
 	for( cl_uint i = 0; i < nodes.size(); i++ ) {
-		BVHNode* node = nodes[i];
-		glm::vec3 center = ( node->bbMax - node->bbMin ) / 2.0f;
+		const BVHNode* node = &mNodes[nodes[i]];
+		glm::vec3 center = ( node->bbMin + node->bbMax ) * 0.5f;
 
 		if( center[axis] < pos ) {
-			leftGroup->push_back( node );
+			leftGroup->push_back( nodes[i] );
 		}
 		else {
-			rightGroup->push_back( node );
+			rightGroup->push_back( nodes[i] );
 		}
 	}
 
@@ -987,6 +2634,210 @@ void BVH::splitNodes(
 }
 
 
+/**
+ * Split the nodes into two groups by a full SAH sweep over the centers of
+ * their bounding boxes on each axis. Sub-trees of very different sizes end
+ * up in tight groups, unlike with a split at the mean of the centers.
+ * @param {const std::vector<cl_int>} nodes      Root nodes of the sub-trees. At least 2.
+ * @param {std::vector<cl_int>*}      leftGroup  Output.
+ * @param {std::vector<cl_int>*}      rightGroup Output.
+ */
+void BVH::splitNodesBySAH(
+	const vector<cl_int> nodes, vector<cl_int>* leftGroup, vector<cl_int>* rightGroup
+) {
+	const cl_uint numNodes = nodes.size();
+	vector<cl_int> sorted[3];
+	vector<cl_float> rightSA( numNodes );
+	cl_float bestSAH = FLT_MAX;
+	cl_uint bestAxis = 0;
+	cl_uint bestSplit = numNodes / 2;
+
+	for( cl_uint axis = 0; axis < 3; axis++ ) {
+		sorted[axis] = nodes;
+
+		// The node indices depend on the order the tasks finished, so
+		// ties keep the order of the objects instead of using the index.
+		std::stable_sort(
+			sorted[axis].begin(), sorted[axis].end(),
+			[this, axis]( const cl_int a, const cl_int b ) {
+				cl_float centerA = mNodes[a].bbMin[axis] + mNodes[a].bbMax[axis];
+				cl_float centerB = mNodes[b].bbMin[axis] + mNodes[b].bbMax[axis];
+
+				return ( centerA < centerB );
+			}
+		);
+
+		// Grow the bounding box from the right. rightSA[i] is the
+		// surface area of the nodes i to numNodes - 1.
+		glm::vec3 bbMin = mNodes[sorted[axis][numNodes - 1]].bbMin;
+		glm::vec3 bbMax = mNodes[sorted[axis][numNodes - 1]].bbMax;
+
+		for( cl_uint i = numNodes - 1; i > 0; i-- ) {
+			const BVHNode* node = &mNodes[sorted[axis][i]];
+			bbMin = glm::min( bbMin, node->bbMin );
+			bbMax = glm::max( bbMax, node->bbMax );
+			rightSA[i] = MathHelp::getSurfaceArea( bbMin, bbMax );
+		}
+
+		// Grow the bounding box from the left. A split
+		// at i puts the nodes 0 to i - 1 into the left group.
+		bbMin = mNodes[sorted[axis][0]].bbMin;
+		bbMax = mNodes[sorted[axis][0]].bbMax;
+
+		for( cl_uint i = 1; i < numNodes; i++ ) {
+			cl_float leftSA = MathHelp::getSurfaceArea( bbMin, bbMax );
+			cl_float newSAH = this->calcSAH( leftSA, i, rightSA[i], numNodes - i );
+
+			if( newSAH < bestSAH ) {
+				bestSAH = newSAH;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+
+			const BVHNode* node = &mNodes[sorted[axis][i]];
+			bbMin = glm::min( bbMin, node->bbMin );
+			bbMax = glm::max( bbMax, node->bbMax );
+		}
+	}
+
+	leftGroup->assign( sorted[bestAxis].begin(), sorted[bestAxis].begin() + bestSplit );
+	rightGroup->assign( sorted[bestAxis].begin() + bestSplit, sorted[bestAxis].end() );
+}
+
+
+/**
+ * Split a reference at a plane. The triangle is clipped to each side of the
+ * plane and the bounding box of each part is limited to the box of the reference.
+ * With Phong Tessellation only the bounding box of the reference is clipped.
+ * @param {const Tri*}     ref   The reference to split.
+ * @param {const cl_uint}  axis  Axis of the split plane.
+ * @param {const cl_float} pos   Position of the split plane on the axis.
+ * @param {Tri*}           left  Output. Part left of the plane. May be the same as ref.
+ * @param {Tri*}           right Output. Part right of the plane. May be the same as ref.
+ */
+void BVH::splitReference(
+	const Tri* ref, const cl_uint axis, const cl_float pos, Tri* left, Tri* right
+) {
+	const Tri tri = *ref;
+	glm::vec3 leftMin( FLT_MAX );
+	glm::vec3 leftMax( -FLT_MAX );
+	glm::vec3 rightMin( FLT_MAX );
+	glm::vec3 rightMax( -FLT_MAX );
+
+	if( mSBVHClipTris ) {
+		const cl_uint indices[3] = { tri.face.x, tri.face.y, tri.face.z };
+		glm::vec3 v[3];
+
+		for( cl_uint i = 0; i < 3; i++ ) {
+			const cl_float4 v4 = mVertices4[indices[i]];
+			v[i] = glm::vec3( v4.x, v4.y, v4.z );
+		}
+
+		// Walk the edges and collect the vertices and
+		// the edge intersections with the plane per side.
+		for( cl_uint i = 0; i < 3; i++ ) {
+			const glm::vec3 a = v[i];
+			const glm::vec3 b = v[( i + 1 ) % 3];
+
+			if( a[axis] <= pos ) {
+				leftMin = glm::min( leftMin, a );
+				leftMax = glm::max( leftMax, a );
+			}
+			if( a[axis] >= pos ) {
+				rightMin = glm::min( rightMin, a );
+				rightMax = glm::max( rightMax, a );
+			}
+
+			if( ( a[axis] < pos && b[axis] > pos ) || ( a[axis] > pos && b[axis] < pos ) ) {
+				glm::vec3 p = a + ( b - a ) * ( ( pos - a[axis] ) / ( b[axis] - a[axis] ) );
+				p[axis] = pos;
+
+				leftMin = glm::min( leftMin, p );
+				leftMax = glm::max( leftMax, p );
+				rightMin = glm::min( rightMin, p );
+				rightMax = glm::max( rightMax, p );
+			}
+		}
+	}
+	else {
+		leftMin = rightMin = tri.bbMin;
+		leftMax = rightMax = tri.bbMax;
+	}
+
+	*left = tri;
+	left->bbMin = glm::max( leftMin, tri.bbMin );
+	left->bbMax = glm::min( leftMax, tri.bbMax );
+	left->bbMax[axis] = fmin( left->bbMax[axis], pos );
+
+	*right = tri;
+	right->bbMin = glm::max( rightMin, tri.bbMin );
+	right->bbMax = glm::min( rightMax, tri.bbMax );
+	right->bbMin[axis] = fmax( right->bbMin[axis], pos );
+
+	// The clipped triangle may miss the box of the reference because of
+	// the limited precision. Fall back to clipping the box of the reference.
+	for( cl_uint i = 0; i < 3; i++ ) {
+		if( left->bbMin[i] > left->bbMax[i] ) {
+			left->bbMin = tri.bbMin;
+			left->bbMax = tri.bbMax;
+			left->bbMax[axis] = fmax( fmin( pos, tri.bbMax[axis] ), tri.bbMin[axis] );
+			break;
+		}
+	}
+
+	for( cl_uint i = 0; i < 3; i++ ) {
+		if( right->bbMin[i] > right->bbMax[i] ) {
+			right->bbMin = tri.bbMin;
+			right->bbMax = tri.bbMax;
+			right->bbMin[axis] = fmin( fmax( pos, tri.bbMin[axis] ), tri.bbMax[axis] );
+			break;
+		}
+	}
+
+	left->bbCenter = ( left->bbMin + left->bbMax ) * 0.5f;
+	right->bbCenter = ( right->bbMin + right->bbMax ) * 0.5f;
+}
+
+
+/**
+ * Raise the maximum depth reached so far. Lock-free,
+ * because it is called for every node by all build tasks.
+ * @param {const cl_uint} depth Depth of a node.
+ */
+void BVH::updateDepthReached( const cl_uint depth ) {
+	cl_uint reached = mDepthReached.load();
+
+	while( depth > reached && !mDepthReached.compare_exchange_weak( reached, depth ) ) {
+	}
+}
+
+
+/**
+ * Set the depth of all nodes after the tree has been restructured.
+ * The root node has a depth of 1.
+ */
+void BVH::updateDepths() {
+	vector<cl_int> stack;
+	stack.push_back( mRoot );
+	mNodes[mRoot].depth = 1;
+	mDepthReached = 1;
+
+	while( !stack.empty() ) {
+		const BVHNode* node = &mNodes[stack.back()];
+		stack.pop_back();
+
+		this->updateDepthReached( node->depth );
+
+		if( node->leftChild >= 0 ) {
+			mNodes[node->leftChild].depth = node->depth + 1;
+			mNodes[node->rightChild].depth = node->depth + 1;
+			stack.push_back( node->leftChild );
+			stack.push_back( node->rightChild );
+		}
+	}
+}
+
+
 /**
  * Get vertices and indices to draw a 3D visualization of the bounding box.
  * @param {std::vector<cl_float>*} vertices Vector to put the vertices into.
@@ -999,19 +2850,21 @@ void BVH::visualize( vector<cl_float>* vertices, vector<cl_uint>* indices ) {
 
 /**
  * Visualize the next node in the BVH.
- * @param {const BVHNode*}         node     Current node.
+ * @param {const cl_int}           index    Index of the current node.
  * @param {std::vector<cl_float>*} vertices Vector to put the vertices into.
  * @param {std::vector<cl_uint>*}  indices  Vector to put the indices into.
  */
 void BVH::visualizeNextNode(
-	const BVHNode* node, vector<cl_float>* vertices, vector<cl_uint>* indices
+	const cl_int index, vector<cl_float>* vertices, vector<cl_uint>* indices
 ) {
-	if( node == NULL ) {
+	if( index < 0 ) {
 		return;
 	}
 
+	const BVHNode* node = &mNodes[index];
+
 	// Only visualize leaf nodes
-	if( node->faces.size() > 0 ) {
+	if( node->numFaces > 0 ) {
 		cl_uint i = vertices->size() / 3;
 
 		// bottom
@@ -1,32 +1,96 @@
 #ifndef BVH_H
 #define BVH_H
 
+#define BVH_BUILD_SAH 0
+#define BVH_BUILD_BINNEDSAH 1
+// Built on the OpenCL device (LBVH), see LBVH.h.
+#define BVH_BUILD_GPU_LBVH 2
+// Binned SAH with spatial splits (SBVH).
+#define BVH_BUILD_SBVH 3
+// Bottom-up clustering of the Morton-sorted faces (PLOC).
+#define BVH_BUILD_PLOC 4
+
+// Traversal of the BVH in the kernel (pt_bvh.cl).
+#define BVH_TRAVERSAL_STACKLESS 0
+// With a stack, nearer child node first. Needs the binary
+// tree in the kernel, so no nodes are skipped ahead.
+#define BVH_TRAVERSAL_STACK 1
+
+// Upper limit of the faces per leaf node. The
+// wide BVH stores the number of faces in 8 bit.
+#define BVH_LEAF_MAX_FACES 255
+
+// Upper limit of the bins per axis of the binned SAH.
+// The split positions of a node are rated on the stack.
+#define BVH_SAH_MAX_BINS 128
+
+// Sub-trees with at least this many faces are built as a separate task.
+#define BVH_TASK_MIN_FACES 4096
+
+// No spatial splits below this depth, so the
+// build terminates for degenerated geometry.
+#define BVH_SBVH_MAX_DEPTH 64
+
+// Sub-trees below this depth are rotated as separate tasks.
+#define BVH_ROTATE_TASK_DEPTH 6
+// Min gain of a rotation relative to the surface area of the node.
+#define BVH_ROTATE_MIN_GAIN 0.0001f
+
+#include <atomic>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <climits>
+#include <queue>
 #include <set>
+#include <sys/resource.h>
+#include <unordered_map>
 
 #include "AccelStructure.h"
 #include "../Cfg.h"
 #include "../Logger.h"
 #include "../MathHelp.h"
 #include "../ModelLoader.h"
+#include "../TaskScheduler.h"
 
 using std::vector;
 
 
 struct BVHNode {
-	BVHNode* leftChild;
-	BVHNode* rightChild;
-	BVHNode* parent;
-	vector<Tri> faces;
+	cl_int leftChild;
+	cl_int rightChild;
+	cl_int parent;
+	cl_uint facesStart;
+	cl_uint numFaces;
 	glm::vec3 bbMin;
 	glm::vec3 bbMax;
-	uint id;
-	uint depth;
-	uint numSkipsToHere;
+	cl_uint depth;
+	cl_uint numSkipsToHere;
 	bool skipNextLeft;
 };
 
 
+// Bin of the binned SAH.
+struct SAHBin {
+	glm::vec3 bbMin;
+	glm::vec3 bbMax;
+	cl_uint numFaces;
+};
+
+
+// Candidate for splitting a node of the SBVH.
+struct SBVHSplit {
+	cl_float sah;
+	cl_int axis;
+	cl_uint bin;
+	cl_float pos;
+	glm::vec3 leftMin;
+	glm::vec3 leftMax;
+	glm::vec3 rightMin;
+	glm::vec3 rightMax;
+	cl_uint numLeft;
+	cl_uint numRight;
+};
+
+
 class BVH : public AccelStructure {
 
 	public:
@@ -34,88 +98,152 @@ class BVH : public AccelStructure {
 		BVH(
 			const vector<object3D> sceneObjects,
 			const vector<cl_float> vertices,
-			const vector<cl_float> normals
+			const vector<cl_float> normals,
+			const cl_uint faceOffset = 0
 		);
 		~BVH();
-		vector<BVHNode*> getContainerNodes();
 		cl_uint getDepth();
-		vector<BVHNode*> getLeafNodes();
-		vector<BVHNode*> getNodes();
-		BVHNode* getRoot();
+		const vector<Tri>* getFaces();
+		const vector<BVHNode>* getNodes();
+		cl_uint getNumLeaves();
+		cl_int getRoot();
+		cl_float refit( const vector<cl_float> vertices, const vector<cl_float> normals );
 		virtual void visualize( vector<cl_float>* vertices, vector<cl_uint>* indices );
 
 	protected:
-		void assignFacesToBins(
-			const cl_uint axis, const cl_uint splits, const vector<Tri>* faces,
-			const vector< vector<glm::vec3> >* leftBin,
-			const vector< vector<glm::vec3> >* rightBin,
-			vector< vector<Tri> >* leftBinFaces, vector< vector<Tri> >* rightBinFaces
+		cl_int allocateNode();
+		cl_int buildTree( const cl_uint facesStart, const cl_uint numFaces, const cl_uint depth );
+		cl_int buildTreePLOC( const cl_uint facesStart, const cl_uint numFaces, const bool parallel );
+		cl_int buildTreeSBVH(
+			vector<Tri>* refs, const cl_uint budget, const cl_float rootSA, const cl_uint depth
+		);
+		void buildSubTree(
+			cl_int* node, const cl_uint facesStart, const cl_uint numFaces, const cl_uint depth
 		);
-		BVHNode* buildTree(
-			const vector<Tri> faces, const glm::vec3 bbMin, const glm::vec3 bbMax,
-			cl_uint depth, const cl_float rootSA
+		void buildSubTreeSBVH(
+			cl_int* node, vector<Tri>* refs, const cl_uint budget,
+			const cl_float rootSA, const cl_uint depth
 		);
-		vector<BVHNode*> buildTreesFromObjects(
+		vector<cl_int> buildTreesFromObjects(
 			const vector<object3D>* sceneObjects,
 			const vector<cl_float>* vertices,
-			const vector<cl_float>* normals
-		);
-		void buildWithMeanSplit(
-			BVHNode* node, const vector<Tri> faces,
-			vector<Tri>* leftFaces, vector<Tri>* rightFaces
-		);
-		cl_float buildWithSAH(
-			BVHNode* node, vector<Tri> faces,
-			vector<Tri>* leftFaces, vector<Tri>* rightFaces
+			const vector<cl_float>* normals,
+			const cl_uint faceOffset
 		);
+		cl_uint buildWithMeanSplit( const BVHNode* node );
+		cl_uint buildWithBinnedSAH( const BVHNode* node );
+		cl_uint buildWithSAH( const BVHNode* node );
 		cl_float calcSAH(
 			const cl_float leftSA, const cl_float leftNumFaces,
 			const cl_float rightSA, const cl_float rightNumFaces
 		);
+		cl_float calcSAHCost();
+		cl_float calcSplitSAH( const BVHNode* node, const cl_uint numFacesLeft );
+		cl_float calcTopLevelCostMeanSplit( const vector<cl_int> nodes );
+		void collapseLeavesPLOC(
+			const cl_int root, const vector<cl_int>* innerNodes,
+			const cl_uint facesStart, const cl_uint numFaces
+		);
 		void combineNodes( const cl_uint numSubTrees );
-		vector<Tri> facesToTriStructs(
+		void facesToTriStructs(
 			const vector<cl_uint4>* facesThisObj, const vector<cl_uint4>* faceNormalsThisObj,
-			const vector<cl_float4>* vertices4, const vector<float>* normals
+			const vector<cl_float4>* vertices4, const vector<cl_float4>* normals4,
+			const cl_uint offset
+		);
+		void findNearestClusters(
+			const vector<cl_int>* clusters, const cl_uint start, const cl_uint end,
+			vector<cl_int>* nearest
+		);
+		void findObjectSplit( vector<Tri>* refs, SBVHSplit* split );
+		void findSpatialSplit( const vector<Tri>* refs, const BVHNode* node, SBVHSplit* split );
+		cl_uint getBinIndex(
+			const cl_float centroid, const cl_float cenMin, const cl_float binScale, const cl_uint numBins
 		);
-		cl_float getMean( const vector<Tri> faces, const cl_uint axis );
-		cl_float getMeanOfNodes( const vector<BVHNode*> nodes, const cl_uint axis );
-		void groupTreesToNodes( vector<BVHNode*> nodes, BVHNode* parent, cl_uint depth );
+		cl_float getBinScale( const cl_float cenMin, const cl_float cenMax, const cl_uint numBins );
+		cl_float getMean( const BVHNode* node, const cl_uint axis );
+		cl_float getMeanOfNodes( const vector<cl_int> nodes, const cl_uint axis );
+		cl_uint getMortonCode( const glm::vec3 pos );
+		void getSpatialBins(
+			const Tri* ref, const cl_uint axis, const cl_float binMin, const cl_float binScale,
+			cl_uint* firstBin, cl_uint* lastBin
+		);
+		cl_float groupTreesToNodes( vector<cl_int> nodes, const cl_int parent, cl_uint depth );
 		void growAABBsForSAH(
-			const vector<Tri>* faces,
-			vector< vector<glm::vec3> >* leftBB, vector< vector<glm::vec3> >* rightBB,
-			vector<cl_float>* leftSA, vector<cl_float>* rightSA
+			const BVHNode* node, vector<cl_float>* leftSA, vector<cl_float>* rightSA
 		);
+		bool isSplitCheaper( const BVHNode* node, const cl_float splitSAH, const cl_uint numFaces );
 		void logStats( boost::posix_time::ptime timerStart );
 		cl_uint longestAxis( const BVHNode* node );
-		BVHNode* makeNode( const vector<Tri> faces, bool ignore );
-		BVHNode* makeContainerNode( const vector<BVHNode*> subTrees, const bool isRoot );
+		cl_int makeContainerNode( const vector<cl_int> subTrees );
+		void makeLeafSBVH( BVHNode* node, const vector<Tri>* refs );
+		cl_int makeNode( const cl_uint facesStart, const cl_uint numFaces );
+		void optimizeByRotations( const cl_uint passes );
 		void orderNodesByTraversal();
 		vector<cl_float4> packFloatAsFloat4( const vector<cl_float>* vertices );
+		void performObjectSplit(
+			vector<Tri>* refs, const SBVHSplit* split,
+			vector<Tri>* leftRefs, vector<Tri>* rightRefs
+		);
+		void performSpatialSplit(
+			vector<Tri>* refs, const BVHNode* node, const SBVHSplit* split,
+			vector<Tri>* leftRefs, vector<Tri>* rightRefs
+		);
+		void refitBoxes( const vector<cl_float>* vertices, const vector<cl_float>* normals );
+		bool rotateNode( const cl_int index );
+		cl_uint rotateSubTree( const cl_int index, const cl_uint depth, const cl_uint maxDepth );
 		cl_uint setMaxFaces( const int value );
 		void skipAheadOfNodes();
-		void splitBySAH(
-			cl_float* bestSAH, const cl_uint axis, vector<Tri> faces,
-			vector<Tri>* leftFaces, vector<Tri>* rightFaces
+		void splitByBinnedSAH(
+			cl_float* bestSAH, const cl_uint numBins, const Tri* first, const Tri* last,
+			const glm::vec3 cenMin, const glm::vec3 cenMax,
+			cl_int* bestAxis, cl_uint* bestBin
 		);
-		cl_float splitFaces(
-			const vector<Tri> faces, const cl_float midpoint, const cl_uint axis,
-			vector<Tri>* leftFaces, vector<Tri>* rightFaces
+		void splitBySAH(
+			cl_float* bestSAH, const cl_uint axis, const BVHNode* node,
+			cl_int* bestAxis, cl_uint* bestSplit
 		);
+		cl_uint splitEarly( const cl_uint facesStart, const cl_uint numFaces, const cl_uint budget );
+		cl_float splitFaces( const BVHNode* node, const cl_float pos, const cl_uint axis );
 		void splitNodes(
-			const vector<BVHNode*> nodes, const cl_float midpoint, const cl_uint axis,
-			vector<BVHNode*>* leftGroup, vector<BVHNode*>* rightGroup
+			const vector<cl_int> nodes, const cl_float midpoint, const cl_uint axis,
+			vector<cl_int>* leftGroup, vector<cl_int>* rightGroup
+		);
+		void splitNodesBySAH(
+			const vector<cl_int> nodes, vector<cl_int>* leftGroup, vector<cl_int>* rightGroup
+		);
+		void splitReference(
+			const Tri* ref, const cl_uint axis, const cl_float pos, Tri* left, Tri* right
 		);
+		void updateDepthReached( const cl_uint depth );
+		void updateDepths();
 		void visualizeNextNode(
-			const BVHNode* node, vector<cl_float>* vertices, vector<cl_uint>* indices
+			const cl_int node, vector<cl_float>* vertices, vector<cl_uint>* indices
 		);
 
-		vector<BVHNode*> mContainerNodes;
-		vector<BVHNode*> mLeafNodes;
-		vector<BVHNode*> mNodes;
-		BVHNode* mRoot;
+		vector<BVHNode> mNodes;
+		vector<Tri> mFaces;
+		vector<Tri> mRefs;
+		vector<cl_float4> mVertices4;
+		std::atomic<cl_uint> mNumNodes;
+		std::atomic<cl_uint> mNumRefs;
+		std::atomic<cl_uint> mDepthReached;
+		cl_int mRoot;
+		TaskScheduler* mScheduler;
 
+		cl_uint mBuildMethod;
 		cl_uint mMaxFaces;
-		cl_uint mDepthReached;
+		cl_float mEarlySplitBudget;
+		cl_float mEarlySplitRatio;
+		bool mPhongTess;
+		cl_uint mPLOCRadius;
+		cl_uint mSAHBins;
+		cl_float mSAHCost;
+		cl_float mSAHCostBuild;
+		cl_float mSAHCostRefit;
+		cl_float mSAHCostTraversal;
+		cl_float mSBVHAlpha;
+		cl_float mSBVHBudget;
+		bool mSBVHClipTris;
 
 };
 
@@ -0,0 +1,356 @@
+#include "BVHCache.h"
+
+
+static const char BVHCACHE_MAGIC[8] = { 'P', 'B', 'R', 'B', 'V', 'H', 'C', '\0' };
+
+
+/**
+ * Constructor.
+ * @param {std::string} filepath Path to the OBJ file, without file name.
+ * @param {std::string} filename Name of the OBJ file.
+ */
+BVHCache::BVHCache( string filepath, string filename ) {
+	mMapped = NULL;
+	mMappedLength = 0;
+	mHeader = NULL;
+	mKey = this->makeKey( filepath, filename );
+
+	char name[32];
+	snprintf( name, 32, "%016llx.bvhcache", (unsigned long long) mKey );
+
+	mCacheFile = Cfg::get().value<string>( Cfg::BVH_CACHEDIR );
+
+	if( mCacheFile.size() > 0 && mCacheFile[mCacheFile.size() - 1] != '/' ) {
+		mCacheFile.append( "/" );
+	}
+
+	mCacheFile.append( name );
+}
+
+
+/**
+ * Destructor.
+ */
+BVHCache::~BVHCache() {
+	this->unmap();
+}
+
+
+/**
+ * Get the number of bytes of the cached face normal indices.
+ * @return {size_t} Number of bytes.
+ */
+size_t BVHCache::getBytesFacesN() {
+	return mHeader->bytesFacesN;
+}
+
+
+/**
+ * Get the number of bytes of the cached face vertex indices.
+ * @return {size_t} Number of bytes.
+ */
+size_t BVHCache::getBytesFacesV() {
+	return mHeader->bytesFacesV;
+}
+
+
+/**
+ * Get the number of bytes of the cached nodes.
+ * @return {size_t} Number of bytes.
+ */
+size_t BVHCache::getBytesNodes() {
+	return mHeader->bytesNodes;
+}
+
+
+/**
+ * Get the cached face normal indices.
+ * @return {const void*} Pointer into the mapped cache file.
+ */
+const void* BVHCache::getFacesN() {
+	return (const char*) this->getFacesV() + mHeader->bytesFacesV;
+}
+
+
+/**
+ * Get the cached face vertex indices.
+ * @return {const void*} Pointer into the mapped cache file.
+ */
+const void* BVHCache::getFacesV() {
+	return (const char*) this->getNodes() + mHeader->bytesNodes;
+}
+
+
+/**
+ * Get the cached nodes.
+ * @return {const void*} Pointer into the mapped cache file.
+ */
+const void* BVHCache::getNodes() {
+	return (const char*) mMapped + sizeof( BVHCacheHeader );
+}
+
+
+/**
+ * Get the number of cached nodes.
+ * @return {cl_uint} Number of nodes.
+ */
+cl_uint BVHCache::getNumNodes() {
+	return mHeader->numNodes;
+}
+
+
+/**
+ * Hash some bytes (FNV-1a, 64 bit).
+ * @param  {const void*}  data   Data to hash.
+ * @param  {const size_t} length Number of bytes.
+ * @param  {cl_ulong}     hash   Hash to continue.
+ * @return {cl_ulong}            New hash.
+ */
+cl_ulong BVHCache::hashBytes( const void* data, const size_t length, cl_ulong hash ) {
+	const unsigned char* bytes = (const unsigned char*) data;
+
+	for( size_t i = 0; i < length; i++ ) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+
+/**
+ * Hash the content of a file. A missing file only adds its name to the hash.
+ * @param  {std::string} file Path and name of the file.
+ * @param  {cl_ulong}    hash Hash to continue.
+ * @return {cl_ulong}         New hash.
+ */
+cl_ulong BVHCache::hashFile( string file, cl_ulong hash ) {
+	hash = this->hashBytes( file.c_str(), file.size(), hash );
+
+	int fd = open( file.c_str(), O_RDONLY );
+
+	if( fd < 0 ) {
+		return hash;
+	}
+
+	struct stat st;
+
+	if( fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+		void* data = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+		if( data != MAP_FAILED ) {
+			hash = this->hashValue( (cl_ulong) st.st_size, hash );
+			hash = this->hashBytes( data, st.st_size, hash );
+			munmap( data, st.st_size );
+		}
+	}
+
+	close( fd );
+
+	return hash;
+}
+
+
+/**
+ * Check if the cache is enabled in the config.
+ * The LBVH is built on the OpenCL device and not cached.
+ * @return {bool} True, if enabled.
+ */
+bool BVHCache::isEnabled() {
+	return (
+		Cfg::get().value<bool>( Cfg::BVH_CACHE ) &&
+		Cfg::get().value<cl_uint>( Cfg::BVH_BUILDMETHOD ) != BVH_BUILD_GPU_LBVH
+	);
+}
+
+
+/**
+ * Check if a cache file has been loaded.
+ * @return {bool} True, if loaded.
+ */
+bool BVHCache::isLoaded() {
+	return ( mHeader != NULL );
+}
+
+
+/**
+ * Map the cache file into memory, if it exists and is valid.
+ * @return {bool} True, if loaded.
+ */
+bool BVHCache::load() {
+	boost::posix_time::ptime timerStart = boost::posix_time::microsec_clock::local_time();
+	this->unmap();
+
+	int fd = open( mCacheFile.c_str(), O_RDONLY );
+
+	if( fd < 0 ) {
+		Logger::logDebug( string( "[BVHCache] No cache file " ).append( mCacheFile ) );
+		return false;
+	}
+
+	struct stat st;
+
+	if( fstat( fd, &st ) != 0 || (size_t) st.st_size < sizeof( BVHCacheHeader ) ) {
+		close( fd );
+		Logger::logWarning( string( "[BVHCache] Ignoring invalid cache file " ).append( mCacheFile ) );
+		return false;
+	}
+
+	void* data = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+
+	if( data == MAP_FAILED ) {
+		Logger::logWarning( string( "[BVHCache] Failed to map cache file " ).append( mCacheFile ) );
+		return false;
+	}
+
+	const BVHCacheHeader* header = (const BVHCacheHeader*) data;
+	cl_ulong expectedSize = sizeof( BVHCacheHeader ) + header->bytesNodes + header->bytesFacesV + header->bytesFacesN;
+
+	if(
+		memcmp( header->magic, BVHCACHE_MAGIC, 8 ) != 0 ||
+		header->version != BVHCACHE_VERSION ||
+		header->key != mKey ||
+		expectedSize != (cl_ulong) st.st_size
+	) {
+		munmap( data, st.st_size );
+		Logger::logWarning( string( "[BVHCache] Ignoring invalid cache file " ).append( mCacheFile ) );
+		return false;
+	}
+
+	mMapped = data;
+	mMappedLength = st.st_size;
+	mHeader = header;
+
+	boost::posix_time::ptime timerEnd = boost::posix_time::microsec_clock::local_time();
+	float timeDiff = ( timerEnd - timerStart ).total_microseconds() / 1000.0f;
+
+	char msg[256];
+	snprintf( msg, 256, "[BVHCache] Loaded %s in %g ms (%u nodes).", mCacheFile.c_str(), timeDiff, mHeader->numNodes );
+	Logger::logInfo( msg );
+
+	return true;
+}
+
+
+/**
+ * Hash the model files and the config values that change the BVH or the face buffers.
+ * @param  {std::string} filepath Path to the OBJ file, without file name.
+ * @param  {std::string} filename Name of the OBJ file.
+ * @return {cl_ulong}             Key of the cache file.
+ */
+cl_ulong BVHCache::makeKey( string filepath, string filename ) {
+	boost::posix_time::ptime timerStart = boost::posix_time::microsec_clock::local_time();
+
+	string objFile = filepath + filename;
+	string mtlFile = objFile;
+	size_t extensionIndex = mtlFile.rfind( ".obj" );
+
+	if( extensionIndex != string::npos ) {
+		mtlFile.replace( extensionIndex, 4, ".mtl" );
+	}
+
+	cl_ulong hash = 14695981039346656037ULL;
+	hash = this->hashValue( (cl_uint) BVHCACHE_VERSION, hash );
+	hash = this->hashFile( objFile, hash );
+	hash = this->hashFile( mtlFile, hash );
+
+	hash = this->hashValue( Cfg::get().value<cl_uint>( Cfg::ACCEL_STRUCT ), hash );
+	hash = this->hashValue( Cfg::get().value<cl_uint>( Cfg::BVH_BUILDMETHOD ), hash );
+	hash = this->hashValue( Cfg::get().value<cl_float>( Cfg::BVH_EARLYSPLITBUDGET ), hash );
+	hash = this->hashValue( Cfg::get().value<cl_float>( Cfg::BVH_EARLYSPLITRATIO ), hash );
+	hash = this->hashValue( Cfg::get().value<cl_uint>( Cfg::BVH_MAXFACES ), hash );
+	hash = this->hashValue( Cfg::get().value<cl_uint>( Cfg::BVH_OPTIMIZEPASSES ), hash );
+	hash = this->hashValue( Cfg::get().value<cl_uint>( Cfg::BVH_PLOCRADIUS ), hash );
+	hash = this->hashValue( Cfg::get().value<cl_uint>( Cfg::BVH_SAHBINS ), hash );
+	hash = this->hashValue( Cfg::get().value<cl_float>( Cfg::BVH_SAHCOSTTRAVERSAL ), hash );
+	hash = this->hashValue( Cfg::get().value<cl_uint>( Cfg::BVH_SAHFACESLIMIT ), hash );
+	hash = this->hashValue( Cfg::get().value<cl_float>( Cfg::BVH_SBVHALPHA ), hash );
+	hash = this->hashValue( Cfg::get().value<cl_float>( Cfg::BVH_SBVHBUDGET ), hash );
+	hash = this->hashValue( Cfg::get().value<bool>( Cfg::BVH_SKIPAHEAD ), hash );
+	hash = this->hashValue( Cfg::get().value<cl_float>( Cfg::BVH_SKIPAHEAD_CMP ), hash );
+	hash = this->hashValue( Cfg::get().value<cl_uint>( Cfg::BVH_TRAVERSAL ), hash );
+	hash = this->hashValue( Cfg::get().value<cl_float>( Cfg::RENDER_PHONGTESS ), hash );
+
+	boost::posix_time::ptime timerEnd = boost::posix_time::microsec_clock::local_time();
+	float timeDiff = ( timerEnd - timerStart ).total_milliseconds();
+
+	char msg[256];
+	snprintf( msg, 256, "[BVHCache] Hashed model files in %g ms. Key: %016llx", timeDiff, (unsigned long long) hash );
+	Logger::logDebug( msg );
+
+	return hash;
+}
+
+
+/**
+ * Write the data to the cache file.
+ * The file is written under a temporary name first and then renamed,
+ * so an interrupted write never leaves a broken cache file behind.
+ * @param {const void*}   nodes       Flattened BVH nodes.
+ * @param {const size_t}  bytesNodes  Number of bytes of the nodes.
+ * @param {const cl_uint} numNodes    Number of nodes.
+ * @param {const void*}   facesV      Face vertex indices.
+ * @param {const size_t}  bytesFacesV Number of bytes of the face vertex indices.
+ * @param {const void*}   facesN      Face normal indices.
+ * @param {const size_t}  bytesFacesN Number of bytes of the face normal indices.
+ */
+void BVHCache::save(
+	const void* nodes, const size_t bytesNodes, const cl_uint numNodes,
+	const void* facesV, const size_t bytesFacesV,
+	const void* facesN, const size_t bytesFacesN
+) {
+	string cacheDir = Cfg::get().value<string>( Cfg::BVH_CACHEDIR );
+
+	if( cacheDir.size() > 0 ) {
+		mkdir( cacheDir.c_str(), 0755 );
+	}
+
+	BVHCacheHeader header;
+	memset( &header, 0, sizeof( BVHCacheHeader ) );
+	memcpy( header.magic, BVHCACHE_MAGIC, 8 );
+	header.version = BVHCACHE_VERSION;
+	header.numNodes = numNodes;
+	header.key = mKey;
+	header.bytesNodes = bytesNodes;
+	header.bytesFacesV = bytesFacesV;
+	header.bytesFacesN = bytesFacesN;
+
+	string tmpFile = mCacheFile + ".tmp";
+	FILE* file = fopen( tmpFile.c_str(), "wb" );
+
+	if( file == NULL ) {
+		Logger::logWarning( string( "[BVHCache] Could not write cache file " ).append( tmpFile ) );
+		return;
+	}
+
+	bool success = (
+		fwrite( &header, sizeof( BVHCacheHeader ), 1, file ) == 1 &&
+		fwrite( nodes, 1, bytesNodes, file ) == bytesNodes &&
+		fwrite( facesV, 1, bytesFacesV, file ) == bytesFacesV &&
+		fwrite( facesN, 1, bytesFacesN, file ) == bytesFacesN
+	);
+	success = ( fclose( file ) == 0 ) && success;
+
+	if( !success || rename( tmpFile.c_str(), mCacheFile.c_str() ) != 0 ) {
+		remove( tmpFile.c_str() );
+		Logger::logWarning( string( "[BVHCache] Could not write cache file " ).append( mCacheFile ) );
+		return;
+	}
+
+	Logger::logDebug( string( "[BVHCache] Saved cache file " ).append( mCacheFile ) );
+}
+
+
+/**
+ * Unmap the loaded cache file.
+ */
+void BVHCache::unmap() {
+	if( mMapped != NULL ) {
+		munmap( mMapped, mMappedLength );
+	}
+
+	mMapped = NULL;
+	mMappedLength = 0;
+	mHeader = NULL;
+}
@@ -0,0 +1,81 @@
+#ifndef BVHCACHE_H
+#define BVHCACHE_H
+
+// Increase if the layout of the cached data changes.
+#define BVHCACHE_VERSION 3
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "../cl.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "BVH.h"
+#include "../Cfg.h"
+#include "../Logger.h"
+
+using std::string;
+
+
+struct BVHCacheHeader {
+	char magic[8];
+	cl_uint version;
+	cl_uint numNodes;
+	cl_ulong key;
+	cl_ulong bytesNodes;
+	cl_ulong bytesFacesV;
+	cl_ulong bytesFacesN;
+};
+
+
+/**
+ * Binary file cache for the flattened BVH and the face buffers of the path tracer.
+ * The cache file is identified by a hash of the OBJ and MTL content and the
+ * config values that influence the build.
+ */
+class BVHCache {
+
+	public:
+		BVHCache( string filepath, string filename );
+		~BVHCache();
+		const void* getFacesN();
+		const void* getFacesV();
+		const void* getNodes();
+		size_t getBytesFacesN();
+		size_t getBytesFacesV();
+		size_t getBytesNodes();
+		cl_uint getNumNodes();
+		bool isLoaded();
+		bool load();
+		void save(
+			const void* nodes, const size_t bytesNodes, const cl_uint numNodes,
+			const void* facesV, const size_t bytesFacesV,
+			const void* facesN, const size_t bytesFacesN
+		);
+
+		static bool isEnabled();
+
+	protected:
+		cl_ulong hashBytes( const void* data, const size_t length, cl_ulong hash );
+		cl_ulong hashFile( string file, cl_ulong hash );
+		template<typename T> cl_ulong hashValue( const T value, cl_ulong hash ) {
+			return this->hashBytes( &value, sizeof( T ), hash );
+		}
+		cl_ulong makeKey( string filepath, string filename );
+		void unmap();
+
+	private:
+		string mCacheFile;
+		cl_ulong mKey;
+
+		void* mMapped;
+		size_t mMappedLength;
+		const BVHCacheHeader* mHeader;
+
+};
+
+#endif
@@ -0,0 +1,129 @@
+#include "BVHRefit.h"
+
+
+/**
+ * Constructor.
+ * Loads the OpenCL program of the refit and uploads the links between the nodes.
+ * This has to happen before the program of the path tracer is loaded.
+ * @param {CL*}            cl       OpenCL handler holding the BVH.
+ * @param {const cl_int4*} nodes    The BVH nodes in the layout of the path tracer. bbMin and bbMax of each node.
+ * @param {const cl_uint}  numNodes Number of nodes.
+ */
+BVHRefit::BVHRefit( CL* cl, const cl_int4* nodes, const cl_uint numNodes ) {
+	mCL = cl;
+	mNumNodes = numNodes;
+	mNumLeaves = 0;
+
+	mCL->loadProgram( "source/opencl/bvh_refit.cl" );
+	mKernelRefit = mCL->createKernel( "bvhRefit" );
+
+	this->initLinks( nodes );
+}
+
+
+/**
+ * Destructor.
+ * The kernel and buffers are released together with the CL handler.
+ */
+BVHRefit::~BVHRefit() {}
+
+
+/**
+ * Find the parent and the number of child nodes of each node and upload them.
+ * Inner nodes link to the next node to visit after their sub-tree. So the child
+ * nodes are found by following these links from the node after the parent.
+ * A node marked to be skipped by the traversal does not exist in the layout, its
+ * child nodes become child nodes of its parent.
+ * Only the indices in the w components are used, so the nodes are read as integers.
+ * @param {const cl_int4*} nodes The BVH nodes. bbMin and bbMax of each node.
+ */
+void BVHRefit::initLinks( const cl_int4* nodes ) {
+	vector<cl_int> leaves;
+	vector<cl_int2> links( mNumNodes );
+
+	for( cl_uint i = 0; i < mNumNodes; i++ ) {
+		links[i].x = -1;
+		links[i].y = 0;
+	}
+
+	for( cl_uint i = 0; i < mNumNodes; i++ ) {
+		const cl_int4 bbMin = nodes[2 * i];
+		const cl_int4 bbMax = nodes[2 * i + 1];
+
+		// Leaf node
+		if( bbMin.w >= 0 ) {
+			leaves.push_back( i );
+			continue;
+		}
+
+		// The right-most nodes don't have a next node.
+		const cl_int next = bbMax.w;
+		const cl_int end = ( next > (cl_int) i && next < (cl_int) mNumNodes ) ? next : mNumNodes;
+		cl_int child = i + 1;
+
+		while( child > (cl_int) i && child < end ) {
+			links[child].x = i;
+			links[i].y++;
+
+			const cl_int4 childMin = nodes[2 * child];
+			const cl_int4 childMax = nodes[2 * child + 1];
+			child = ( childMin.w < 0 ) ? childMax.w : child + 1;
+		}
+	}
+
+	mNumLeaves = leaves.size();
+
+	if( mNumLeaves == 0 ) {
+		Logger::logError( "[BVHRefit] The BVH has no leaf nodes." );
+		exit( EXIT_FAILURE );
+	}
+
+	mBufLeaves = mCL->createBuffer( leaves, sizeof( cl_int ) * leaves.size() );
+	mBufLinks = mCL->createBuffer( links, sizeof( cl_int2 ) * links.size() );
+	mBufVisited = mCL->createEmptyBuffer( sizeof( cl_uint ) * mNumNodes, CL_MEM_READ_WRITE );
+
+	char msg[128];
+	snprintf( msg, 128, "[BVHRefit] Prepared %u nodes with %u leaves for refitting.", mNumNodes, mNumLeaves );
+	Logger::logDebug( msg );
+}
+
+
+/**
+ * Refit the BVH to the current vertices.
+ * The vertex and normal buffers have to be updated before.
+ * @param  {cl_mem} bufBVH      The BVH nodes. Has to be writable.
+ * @param  {cl_mem} bufFacesV   Vertex indices of the faces (uint4).
+ * @param  {cl_mem} bufFacesN   Normal indices of the faces (uint4).
+ * @param  {cl_mem} bufVertices Vertices (float4).
+ * @param  {cl_mem} bufNormals  Normals (float4).
+ * @return {double}             Execution time in milliseconds.
+ */
+double BVHRefit::refit(
+	cl_mem bufBVH, cl_mem bufFacesV, cl_mem bufFacesN, cl_mem bufVertices, cl_mem bufNormals
+) {
+	vector<cl_uint> visited( mNumNodes, 0 );
+	mCL->updateBuffer( mBufVisited, sizeof( cl_uint ) * mNumNodes, &visited[0] );
+
+	cl_int numNodesInt = mNumNodes;
+	cl_uint i = 0;
+	mCL->setKernelArg( mKernelRefit, i++, sizeof( cl_int ), &numNodesInt );
+	mCL->setKernelArg( mKernelRefit, i++, sizeof( cl_mem ), &mBufLeaves );
+	mCL->setKernelArg( mKernelRefit, i++, sizeof( cl_mem ), &mBufLinks );
+	mCL->setKernelArg( mKernelRefit, i++, sizeof( cl_mem ), &mBufVisited );
+	mCL->setKernelArg( mKernelRefit, i++, sizeof( cl_mem ), &bufFacesV );
+	mCL->setKernelArg( mKernelRefit, i++, sizeof( cl_mem ), &bufFacesN );
+	mCL->setKernelArg( mKernelRefit, i++, sizeof( cl_mem ), &bufVertices );
+	mCL->setKernelArg( mKernelRefit, i++, sizeof( cl_mem ), &bufNormals );
+	mCL->setKernelArg( mKernelRefit, i++, sizeof( cl_mem ), &bufBVH );
+
+	mCL->execute( mKernelRefit, mNumLeaves );
+	mCL->finish();
+
+	double time = mCL->getKernelTimes()[mKernelRefit];
+
+	char msg[128];
+	snprintf( msg, 128, "[BVHRefit] Refitted %u nodes in %.3f ms.", mNumNodes, time );
+	Logger::logDebug( msg );
+
+	return time;
+}
@@ -0,0 +1,45 @@
+#ifndef BVHREFIT_H
+#define BVHREFIT_H
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <string>
+#include <vector>
+
+#include "../CL.h"
+#include "../Cfg.h"
+#include "../Logger.h"
+
+using std::string;
+using std::vector;
+
+
+/**
+ * Refit of a BVH on the OpenCL device. The bounding boxes of the nodes are
+ * updated for moved vertices, while the tree keeps its topology. Works on the
+ * node layout of the path tracer, so the nodes never have to be uploaded again.
+ */
+class BVHRefit {
+
+	public:
+		BVHRefit( CL* cl, const cl_int4* nodes, const cl_uint numNodes );
+		~BVHRefit();
+		double refit(
+			cl_mem bufBVH, cl_mem bufFacesV, cl_mem bufFacesN, cl_mem bufVertices, cl_mem bufNormals
+		);
+
+	protected:
+		void initLinks( const cl_int4* nodes );
+
+	private:
+		CL* mCL;
+		cl_uint mNumLeaves;
+		cl_uint mNumNodes;
+
+		cl_kernel mKernelRefit;
+		cl_mem mBufLeaves;
+		cl_mem mBufLinks;
+		cl_mem mBufVisited;
+
+};
+
+#endif
@@ -0,0 +1,308 @@
+#include "LBVH.h"
+
+
+/**
+ * Constructor.
+ * Loads the OpenCL program of the builder. This has to happen before
+ * the program of the path tracer is loaded.
+ * @param {CL*} cl OpenCL handler to build with.
+ */
+LBVH::LBVH( CL* cl ) {
+	mCL = cl;
+	mNumFaces = 0;
+
+	char value[16];
+	snprintf( value, 16, "%u", LBVH_CHUNK_SIZE );
+	mCL->setReplacement( string( "#LBVH_CHUNK_SIZE#" ), string( value ) );
+	snprintf( value, 16, "%u", LBVH_RADIX_BITS );
+	mCL->setReplacement( string( "#LBVH_RADIX_BITS#" ), string( value ) );
+	snprintf( value, 16, "%u", LBVH_SCAN_BLOCK );
+	mCL->setReplacement( string( "#LBVH_SCAN_BLOCK#" ), string( value ) );
+
+	mCL->loadProgram( "source/opencl/lbvh.cl" );
+
+	mKernelFaceBounds = mCL->createKernel( "lbvhFaceBounds" );
+	mKernelReduceBounds = mCL->createKernel( "lbvhReduceBounds" );
+	mKernelReduceBoundsFinal = mCL->createKernel( "lbvhReduceBoundsFinal" );
+	mKernelMortonCodes = mCL->createKernel( "lbvhMortonCodes" );
+	mKernelRadixCount = mCL->createKernel( "lbvhRadixCount" );
+	mKernelScanBlocks = mCL->createKernel( "lbvhScanBlocks" );
+	mKernelScanBlockSums = mCL->createKernel( "lbvhScanBlockSums" );
+	mKernelRadixScatter = mCL->createKernel( "lbvhRadixScatter" );
+	mKernelBuildHierarchy = mCL->createKernel( "lbvhBuildHierarchy" );
+	mKernelBuildBounds = mCL->createKernel( "lbvhBuildBounds" );
+	mKernelWriteNodes = mCL->createKernel( "lbvhWriteNodes" );
+}
+
+
+/**
+ * Destructor.
+ * The kernels are released together with the CL handler.
+ */
+LBVH::~LBVH() {}
+
+
+/**
+ * Build the BVH on the OpenCL device.
+ * @param  {cl_mem}        bufFacesV   Vertex indices of the faces (uint4).
+ * @param  {cl_mem}        bufFacesN   Normal indices of the faces (uint4).
+ * @param  {cl_mem}        bufVertices Vertices (float4).
+ * @param  {cl_mem}        bufNormals  Normals (float4).
+ * @param  {const cl_uint} numFaces    Number of faces.
+ * @return {cl_mem}                    Buffer with the BVH nodes in the layout of the path tracer.
+ */
+cl_mem LBVH::build(
+	cl_mem bufFacesV, cl_mem bufFacesN, cl_mem bufVertices, cl_mem bufNormals,
+	const cl_uint numFaces
+) {
+	boost::posix_time::ptime timerStart = boost::posix_time::microsec_clock::local_time();
+	mNumFaces = numFaces;
+
+	// The traversal skips the root node, so at least one inner node is needed.
+	if( mNumFaces < 2 ) {
+		Logger::logError( "[LBVH] At least 2 faces are needed to build the BVH." );
+		exit( EXIT_FAILURE );
+	}
+
+	const cl_uint numNodes = this->getNumNodes();
+	const cl_uint numInternal = mNumFaces - 1;
+	cl_uint numPartials = std::min( (cl_uint) LBVH_REDUCE_ITEMS, mNumFaces );
+
+	cl_mem bufFaceMin = mCL->createEmptyBuffer( sizeof( cl_float4 ) * mNumFaces, CL_MEM_READ_WRITE );
+	cl_mem bufFaceMax = mCL->createEmptyBuffer( sizeof( cl_float4 ) * mNumFaces, CL_MEM_READ_WRITE );
+	cl_mem bufPartialMin = mCL->createEmptyBuffer( sizeof( cl_float4 ) * numPartials, CL_MEM_READ_WRITE );
+	cl_mem bufPartialMax = mCL->createEmptyBuffer( sizeof( cl_float4 ) * numPartials, CL_MEM_READ_WRITE );
+	cl_mem bufBounds = mCL->createEmptyBuffer( sizeof( cl_float4 ) * 2, CL_MEM_READ_WRITE );
+	cl_mem bufCodes = mCL->createEmptyBuffer( sizeof( cl_uint ) * mNumFaces, CL_MEM_READ_WRITE );
+	cl_mem bufIndices = mCL->createEmptyBuffer( sizeof( cl_uint ) * mNumFaces, CL_MEM_READ_WRITE );
+	cl_mem bufCodesTmp = mCL->createEmptyBuffer( sizeof( cl_uint ) * mNumFaces, CL_MEM_READ_WRITE );
+	cl_mem bufIndicesTmp = mCL->createEmptyBuffer( sizeof( cl_uint ) * mNumFaces, CL_MEM_READ_WRITE );
+	cl_mem bufLeftChild = mCL->createEmptyBuffer( sizeof( cl_int ) * numInternal, CL_MEM_READ_WRITE );
+	cl_mem bufRightChild = mCL->createEmptyBuffer( sizeof( cl_int ) * numInternal, CL_MEM_READ_WRITE );
+	cl_mem bufParents = mCL->createEmptyBuffer( sizeof( cl_int ) * numNodes, CL_MEM_READ_WRITE );
+	cl_mem bufVisited = mCL->createEmptyBuffer( sizeof( cl_uint ) * numInternal, CL_MEM_READ_WRITE );
+	cl_mem bufNodeMin = mCL->createEmptyBuffer( sizeof( cl_float4 ) * numNodes, CL_MEM_READ_WRITE );
+	cl_mem bufNodeMax = mCL->createEmptyBuffer( sizeof( cl_float4 ) * numNodes, CL_MEM_READ_WRITE );
+	cl_mem bufTreeSize = mCL->createEmptyBuffer( sizeof( cl_uint ) * numNodes, CL_MEM_READ_WRITE );
+	cl_mem bufBVH = mCL->createEmptyBuffer( sizeof( cl_float4 ) * 2 * numNodes, CL_MEM_READ_WRITE );
+
+	cl_int numFacesInt = mNumFaces;
+	cl_uint i;
+
+
+	// Face bounds and Morton codes
+
+	i = 0;
+	mCL->setKernelArg( mKernelFaceBounds, i++, sizeof( cl_mem ), &bufFacesV );
+	mCL->setKernelArg( mKernelFaceBounds, i++, sizeof( cl_mem ), &bufFacesN );
+	mCL->setKernelArg( mKernelFaceBounds, i++, sizeof( cl_mem ), &bufVertices );
+	mCL->setKernelArg( mKernelFaceBounds, i++, sizeof( cl_mem ), &bufNormals );
+	mCL->setKernelArg( mKernelFaceBounds, i++, sizeof( cl_mem ), &bufFaceMin );
+	mCL->setKernelArg( mKernelFaceBounds, i++, sizeof( cl_mem ), &bufFaceMax );
+	mTimeMorton = this->execute( mKernelFaceBounds, mNumFaces );
+
+	i = 0;
+	mCL->setKernelArg( mKernelReduceBounds, i++, sizeof( cl_mem ), &bufFaceMin );
+	mCL->setKernelArg( mKernelReduceBounds, i++, sizeof( cl_mem ), &bufFaceMax );
+	mCL->setKernelArg( mKernelReduceBounds, i++, sizeof( cl_uint ), &mNumFaces );
+	mCL->setKernelArg( mKernelReduceBounds, i++, sizeof( cl_mem ), &bufPartialMin );
+	mCL->setKernelArg( mKernelReduceBounds, i++, sizeof( cl_mem ), &bufPartialMax );
+	mTimeMorton += this->execute( mKernelReduceBounds, numPartials );
+
+	i = 0;
+	mCL->setKernelArg( mKernelReduceBoundsFinal, i++, sizeof( cl_mem ), &bufPartialMin );
+	mCL->setKernelArg( mKernelReduceBoundsFinal, i++, sizeof( cl_mem ), &bufPartialMax );
+	mCL->setKernelArg( mKernelReduceBoundsFinal, i++, sizeof( cl_uint ), &numPartials );
+	mCL->setKernelArg( mKernelReduceBoundsFinal, i++, sizeof( cl_mem ), &bufBounds );
+	mTimeMorton += this->execute( mKernelReduceBoundsFinal, 1 );
+
+	i = 0;
+	mCL->setKernelArg( mKernelMortonCodes, i++, sizeof( cl_mem ), &bufFaceMin );
+	mCL->setKernelArg( mKernelMortonCodes, i++, sizeof( cl_mem ), &bufFaceMax );
+	mCL->setKernelArg( mKernelMortonCodes, i++, sizeof( cl_mem ), &bufBounds );
+	mCL->setKernelArg( mKernelMortonCodes, i++, sizeof( cl_mem ), &bufCodes );
+	mCL->setKernelArg( mKernelMortonCodes, i++, sizeof( cl_mem ), &bufIndices );
+	mTimeMorton += this->execute( mKernelMortonCodes, mNumFaces );
+
+
+	// Sort faces by Morton code
+
+	mTimeSort = this->radixSort( &bufCodes, &bufIndices, &bufCodesTmp, &bufIndicesTmp );
+
+
+	// Hierarchy
+
+	i = 0;
+	mCL->setKernelArg( mKernelBuildHierarchy, i++, sizeof( cl_mem ), &bufCodes );
+	mCL->setKernelArg( mKernelBuildHierarchy, i++, sizeof( cl_int ), &numFacesInt );
+	mCL->setKernelArg( mKernelBuildHierarchy, i++, sizeof( cl_mem ), &bufLeftChild );
+	mCL->setKernelArg( mKernelBuildHierarchy, i++, sizeof( cl_mem ), &bufRightChild );
+	mCL->setKernelArg( mKernelBuildHierarchy, i++, sizeof( cl_mem ), &bufParents );
+	mCL->setKernelArg( mKernelBuildHierarchy, i++, sizeof( cl_mem ), &bufVisited );
+	mTimeHierarchy = this->execute( mKernelBuildHierarchy, numInternal );
+
+
+	// Bounding boxes
+
+	i = 0;
+	mCL->setKernelArg( mKernelBuildBounds, i++, sizeof( cl_int ), &numFacesInt );
+	mCL->setKernelArg( mKernelBuildBounds, i++, sizeof( cl_mem ), &bufIndices );
+	mCL->setKernelArg( mKernelBuildBounds, i++, sizeof( cl_mem ), &bufFaceMin );
+	mCL->setKernelArg( mKernelBuildBounds, i++, sizeof( cl_mem ), &bufFaceMax );
+	mCL->setKernelArg( mKernelBuildBounds, i++, sizeof( cl_mem ), &bufLeftChild );
+	mCL->setKernelArg( mKernelBuildBounds, i++, sizeof( cl_mem ), &bufRightChild );
+	mCL->setKernelArg( mKernelBuildBounds, i++, sizeof( cl_mem ), &bufParents );
+	mCL->setKernelArg( mKernelBuildBounds, i++, sizeof( cl_mem ), &bufNodeMin );
+	mCL->setKernelArg( mKernelBuildBounds, i++, sizeof( cl_mem ), &bufNodeMax );
+	mCL->setKernelArg( mKernelBuildBounds, i++, sizeof( cl_mem ), &bufTreeSize );
+	mCL->setKernelArg( mKernelBuildBounds, i++, sizeof( cl_mem ), &bufVisited );
+	mTimeBounds = this->execute( mKernelBuildBounds, mNumFaces );
+
+
+	// Nodes in the layout of the path tracer
+
+	i = 0;
+	mCL->setKernelArg( mKernelWriteNodes, i++, sizeof( cl_int ), &numFacesInt );
+	mCL->setKernelArg( mKernelWriteNodes, i++, sizeof( cl_mem ), &bufIndices );
+	mCL->setKernelArg( mKernelWriteNodes, i++, sizeof( cl_mem ), &bufLeftChild );
+	mCL->setKernelArg( mKernelWriteNodes, i++, sizeof( cl_mem ), &bufRightChild );
+	mCL->setKernelArg( mKernelWriteNodes, i++, sizeof( cl_mem ), &bufParents );
+	mCL->setKernelArg( mKernelWriteNodes, i++, sizeof( cl_mem ), &bufNodeMin );
+	mCL->setKernelArg( mKernelWriteNodes, i++, sizeof( cl_mem ), &bufNodeMax );
+	mCL->setKernelArg( mKernelWriteNodes, i++, sizeof( cl_mem ), &bufTreeSize );
+	mCL->setKernelArg( mKernelWriteNodes, i++, sizeof( cl_mem ), &bufBVH );
+	mTimeWrite = this->execute( mKernelWriteNodes, numNodes );
+
+	mCL->finish();
+
+
+	mCL->freeBuffer( bufFaceMin );
+	mCL->freeBuffer( bufFaceMax );
+	mCL->freeBuffer( bufPartialMin );
+	mCL->freeBuffer( bufPartialMax );
+	mCL->freeBuffer( bufBounds );
+	mCL->freeBuffer( bufCodes );
+	mCL->freeBuffer( bufIndices );
+	mCL->freeBuffer( bufCodesTmp );
+	mCL->freeBuffer( bufIndicesTmp );
+	mCL->freeBuffer( bufLeftChild );
+	mCL->freeBuffer( bufRightChild );
+	mCL->freeBuffer( bufParents );
+	mCL->freeBuffer( bufVisited );
+	mCL->freeBuffer( bufNodeMin );
+	mCL->freeBuffer( bufNodeMax );
+	mCL->freeBuffer( bufTreeSize );
+
+	this->logStats( timerStart );
+
+	return bufBVH;
+}
+
+
+/**
+ * Execute a kernel and get its execution time.
+ * @param  {cl_kernel} kernel         Kernel to execute.
+ * @param  {size_t}    globalWorkSize Number of work-items.
+ * @return {double}                   Execution time in milliseconds.
+ */
+double LBVH::execute( cl_kernel kernel, size_t globalWorkSize ) {
+	mCL->execute( kernel, globalWorkSize );
+
+	return mCL->getKernelTimes()[kernel];
+}
+
+
+/**
+ * Get the number of nodes of the BVH.
+ * @return {cl_uint} Number of nodes.
+ */
+cl_uint LBVH::getNumNodes() {
+	return 2 * mNumFaces - 1;
+}
+
+
+/**
+ * Log some stats.
+ * @param {boost::posix_time::ptime} timerStart Time the build started.
+ */
+void LBVH::logStats( boost::posix_time::ptime timerStart ) {
+	boost::posix_time::ptime timerEnd = boost::posix_time::microsec_clock::local_time();
+	float timeDiff = ( timerEnd - timerStart ).total_milliseconds();
+
+	char msg[256];
+	snprintf(
+		msg, 256, "[LBVH] Generated in %g ms. Contains %u nodes and %u leaves.",
+		timeDiff, this->getNumNodes(), mNumFaces
+	);
+	Logger::logInfo( msg );
+
+	snprintf(
+		msg, 256, "[LBVH] Kernel times: Morton codes %.3f ms, sort %.3f ms, hierarchy %.3f ms, bounds %.3f ms, nodes %.3f ms.",
+		mTimeMorton, mTimeSort, mTimeHierarchy, mTimeBounds, mTimeWrite
+	);
+	Logger::logDebug( msg );
+}
+
+
+/**
+ * Sort the Morton codes and face indices with a LSD radix sort.
+ * After an even number of passes the sorted data is in the original buffers again.
+ * @param  {cl_mem*} keys      Morton codes.
+ * @param  {cl_mem*} values    Face indices.
+ * @param  {cl_mem*} keysTmp   Buffer of the same size as the keys.
+ * @param  {cl_mem*} valuesTmp Buffer of the same size as the values.
+ * @return {double}            Execution time in milliseconds.
+ */
+double LBVH::radixSort( cl_mem* keys, cl_mem* values, cl_mem* keysTmp, cl_mem* valuesTmp ) {
+	cl_uint numChunks = ( mNumFaces + LBVH_CHUNK_SIZE - 1 ) / LBVH_CHUNK_SIZE;
+	cl_uint numCounts = numChunks * ( 1 << LBVH_RADIX_BITS );
+	cl_uint numBlocks = ( numCounts + LBVH_SCAN_BLOCK - 1 ) / LBVH_SCAN_BLOCK;
+
+	cl_mem bufCounts = mCL->createEmptyBuffer( sizeof( cl_uint ) * numCounts, CL_MEM_READ_WRITE );
+	cl_mem bufBlockSums = mCL->createEmptyBuffer( sizeof( cl_uint ) * numBlocks, CL_MEM_READ_WRITE );
+
+	cl_mem* keysIn = keys;
+	cl_mem* valuesIn = values;
+	cl_mem* keysOut = keysTmp;
+	cl_mem* valuesOut = valuesTmp;
+	double time = 0.0;
+
+	mCL->setKernelArg( mKernelScanBlocks, 0, sizeof( cl_mem ), &bufCounts );
+	mCL->setKernelArg( mKernelScanBlocks, 1, sizeof( cl_uint ), &numCounts );
+	mCL->setKernelArg( mKernelScanBlocks, 2, sizeof( cl_mem ), &bufBlockSums );
+
+	mCL->setKernelArg( mKernelScanBlockSums, 0, sizeof( cl_mem ), &bufBlockSums );
+	mCL->setKernelArg( mKernelScanBlockSums, 1, sizeof( cl_uint ), &numBlocks );
+
+	for( cl_uint pass = 0; pass < LBVH_RADIX_PASSES; pass++ ) {
+		cl_uint shift = pass * LBVH_RADIX_BITS;
+
+		mCL->setKernelArg( mKernelRadixCount, 0, sizeof( cl_mem ), keysIn );
+		mCL->setKernelArg( mKernelRadixCount, 1, sizeof( cl_uint ), &mNumFaces );
+		mCL->setKernelArg( mKernelRadixCount, 2, sizeof( cl_uint ), &shift );
+		mCL->setKernelArg( mKernelRadixCount, 3, sizeof( cl_mem ), &bufCounts );
+		time += this->execute( mKernelRadixCount, numChunks );
+
+		time += this->execute( mKernelScanBlocks, numBlocks );
+		time += this->execute( mKernelScanBlockSums, 1 );
+
+		cl_uint i = 0;
+		mCL->setKernelArg( mKernelRadixScatter, i++, sizeof( cl_mem ), keysIn );
+		mCL->setKernelArg( mKernelRadixScatter, i++, sizeof( cl_mem ), valuesIn );
+		mCL->setKernelArg( mKernelRadixScatter, i++, sizeof( cl_uint ), &mNumFaces );
+		mCL->setKernelArg( mKernelRadixScatter, i++, sizeof( cl_uint ), &shift );
+		mCL->setKernelArg( mKernelRadixScatter, i++, sizeof( cl_mem ), &bufCounts );
+		mCL->setKernelArg( mKernelRadixScatter, i++, sizeof( cl_mem ), &bufBlockSums );
+		mCL->setKernelArg( mKernelRadixScatter, i++, sizeof( cl_mem ), keysOut );
+		mCL->setKernelArg( mKernelRadixScatter, i++, sizeof( cl_mem ), valuesOut );
+		time += this->execute( mKernelRadixScatter, numChunks );
+
+		std::swap( keysIn, keysOut );
+		std::swap( valuesIn, valuesOut );
+	}
+
+	mCL->freeBuffer( bufCounts );
+	mCL->freeBuffer( bufBlockSums );
+
+	return time;
+}
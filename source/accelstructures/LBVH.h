@@ -0,0 +1,73 @@
+#ifndef LBVH_H
+#define LBVH_H
+
+// Number of keys a work-item of the radix sort handles.
+#define LBVH_CHUNK_SIZE 256
+// Bits sorted per radix sort pass. 8 passes cover the 30 bit Morton codes.
+#define LBVH_RADIX_BITS 4
+#define LBVH_RADIX_PASSES 8
+// Number of values a work-item of the prefix sum handles.
+#define LBVH_SCAN_BLOCK 256
+// Number of work-items for the first pass of the bounds reduction.
+#define LBVH_REDUCE_ITEMS 256
+// Upper bound of the depth of the tree: 30 bit Morton
+// codes, ties are broken by the 32 bit face index.
+#define LBVH_MAX_DEPTH 64
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <string>
+
+#include "../CL.h"
+#include "../Cfg.h"
+#include "../Logger.h"
+
+using std::string;
+
+
+/**
+ * Linear BVH built completely on the OpenCL device.
+ * Faces are sorted by the Morton code of their centroid and the hierarchy
+ * is emitted from the sorted codes. The result is written in the node
+ * layout of the path tracer, so the BVH never leaves the device.
+ */
+class LBVH {
+
+	public:
+		LBVH( CL* cl );
+		~LBVH();
+		cl_mem build(
+			cl_mem bufFacesV, cl_mem bufFacesN, cl_mem bufVertices, cl_mem bufNormals,
+			const cl_uint numFaces
+		);
+		cl_uint getNumNodes();
+
+	protected:
+		double execute( cl_kernel kernel, size_t globalWorkSize );
+		void logStats( boost::posix_time::ptime timerStart );
+		double radixSort( cl_mem* keys, cl_mem* values, cl_mem* keysTmp, cl_mem* valuesTmp );
+
+	private:
+		CL* mCL;
+		cl_uint mNumFaces;
+
+		cl_kernel mKernelFaceBounds;
+		cl_kernel mKernelReduceBounds;
+		cl_kernel mKernelReduceBoundsFinal;
+		cl_kernel mKernelMortonCodes;
+		cl_kernel mKernelRadixCount;
+		cl_kernel mKernelScanBlocks;
+		cl_kernel mKernelScanBlockSums;
+		cl_kernel mKernelRadixScatter;
+		cl_kernel mKernelBuildHierarchy;
+		cl_kernel mKernelBuildBounds;
+		cl_kernel mKernelWriteNodes;
+
+		double mTimeMorton;
+		double mTimeSort;
+		double mTimeHierarchy;
+		double mTimeBounds;
+		double mTimeWrite;
+
+};
+
+#endif
@@ -0,0 +1,413 @@
+#include "TwoLevelBVH.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+
+/**
+ * Build a BVH for each object and the top level over the instances.
+ * Objects without an instance are placed once, untransformed.
+ * @param {std::vector<object3D>}   sceneObjects Objects of the scene.
+ * @param {std::vector<instance_t>} instances    Instances from the INSTANCES file.
+ * @param {std::vector<cl_float>}   vertices     Vertices of the model.
+ * @param {std::vector<cl_float>}   normals      Normals of the model.
+ */
+TwoLevelBVH::TwoLevelBVH(
+	const vector<object3D> sceneObjects,
+	const vector<instance_t> instances,
+	const vector<cl_float> vertices,
+	const vector<cl_float> normals
+) {
+	boost::posix_time::ptime timerStart = boost::posix_time::microsec_clock::local_time();
+	const cl_uint numObjects = sceneObjects.size();
+	vector<cl_int> bottomLevelOfObject( numObjects, -1 );
+	vector<bool> isPlaced( numObjects, false );
+	map<string, cl_uint> objectIndices;
+	cl_uint faceOffset = 0;
+	char msg[256];
+
+	mDepthReached = 0;
+
+	// Bottom levels
+	for( cl_uint i = 0; i < numObjects; i++ ) {
+		const object3D* object = &sceneObjects[i];
+		const cl_uint numFaces = object->facesV.size() / 3;
+
+		objectIndices.insert( std::make_pair( object->oName, i ) );
+
+		if( numFaces > 0 ) {
+			snprintf(
+				msg, 256, "[TwoLevelBVH] Building bottom level %u/%u: \"%s\".",
+				i + 1, numObjects, object->oName.c_str()
+			);
+			Logger::logInfo( msg );
+
+			bottomLevelOfObject[i] = mBottomLevels.size();
+			mBottomLevels.push_back(
+				new BVH( vector<object3D>( 1, *object ), vertices, normals, faceOffset )
+			);
+		}
+
+		faceOffset += numFaces;
+	}
+
+	// Instances
+	for( cl_uint i = 0; i < instances.size(); i++ ) {
+		const instance_t* instance = &instances[i];
+		map<string, cl_uint>::const_iterator it = objectIndices.find( instance->objectName );
+
+		if( it == objectIndices.end() ) {
+			snprintf(
+				msg, 256, "[TwoLevelBVH] Unknown object \"%s\" for instance \"%s\". Ignoring instance.",
+				instance->objectName.c_str(), instance->instanceName.c_str()
+			);
+			Logger::logWarning( msg );
+			continue;
+		}
+
+		isPlaced[it->second] = true;
+
+		if( bottomLevelOfObject[it->second] >= 0 ) {
+			this->addInstance( bottomLevelOfObject[it->second], instance->transform );
+		}
+	}
+
+	for( cl_uint i = 0; i < numObjects; i++ ) {
+		if( !isPlaced[i] && bottomLevelOfObject[i] >= 0 ) {
+			this->addInstance( bottomLevelOfObject[i], glm::mat4( 1.0f ) );
+		}
+	}
+
+	if( mInstances.size() == 0 ) {
+		Logger::logError( "[TwoLevelBVH] No instance of an object with faces. Nothing to build." );
+		exit( EXIT_FAILURE );
+	}
+
+	this->buildTopLevel();
+
+	boost::posix_time::ptime timerEnd = boost::posix_time::microsec_clock::local_time();
+	cl_float timeDiff = ( timerEnd - timerStart ).total_milliseconds();
+
+	snprintf(
+		msg, 256, "[TwoLevelBVH] Generated in %g ms. %lu bottom level(s), %lu instance(s).",
+		timeDiff, mBottomLevels.size(), mInstances.size()
+	);
+	Logger::logInfo( msg );
+}
+
+
+/**
+ * Destructor.
+ */
+TwoLevelBVH::~TwoLevelBVH() {
+	for( cl_uint i = 0; i < mBottomLevels.size(); i++ ) {
+		delete mBottomLevels[i];
+	}
+}
+
+
+/**
+ * Add an instance of a bottom level.
+ * @param {const cl_uint}   bottomLevel Index of the bottom level.
+ * @param {const glm::mat4} transform   Transformation from object to world space.
+ */
+void TwoLevelBVH::addInstance( const cl_uint bottomLevel, const glm::mat4 transform ) {
+	TwoLevelBVHInstance instance;
+	instance.bottomLevel = bottomLevel;
+	instance.transform = transform;
+	instance.inverse = glm::inverse( transform );
+	this->updateInstanceAABB( &instance );
+
+	mInstances.push_back( instance );
+}
+
+
+/**
+ * (Re)build the top level over the instances.
+ * The nodes are stored in the order of a depth-first traversal,
+ * so the root node is at index 0. Each leaf node holds one instance.
+ */
+void TwoLevelBVH::buildTopLevel() {
+	boost::posix_time::ptime timerStart = boost::posix_time::microsec_clock::local_time();
+
+	vector<cl_uint> instances( mInstances.size() );
+
+	for( cl_uint i = 0; i < instances.size(); i++ ) {
+		instances[i] = i;
+	}
+
+	mTopLevelNodes.clear();
+	mTopLevelNodes.reserve( 2 * instances.size() - 1 );
+	mDepthReached = 0;
+	this->buildTopLevelNode( &instances, 0, instances.size(), -1, 1 );
+
+	boost::posix_time::ptime timerEnd = boost::posix_time::microsec_clock::local_time();
+	cl_float timeDiff = ( timerEnd - timerStart ).total_microseconds() / 1000.0f;
+
+	char msg[256];
+	snprintf(
+		msg, 256, "[TwoLevelBVH] Built top level in %g ms. Contains %lu nodes. Max depth of %u.",
+		timeDiff, mTopLevelNodes.size(), mDepthReached
+	);
+	Logger::logInfo( msg );
+}
+
+
+/**
+ * Build a node of the top level and its children.
+ * The child with the bigger surface area is the left one.
+ * @param  {std::vector<cl_uint>*} instances Instance indices. The range of the node will be sorted.
+ * @param  {const cl_uint}         start     Index of the first instance of the node.
+ * @param  {const cl_uint}         num       Number of instances of the node.
+ * @param  {const cl_int}          parent    Index of the parent node. -1 for the root node.
+ * @param  {const cl_uint}         depth     The current depth of the node in the tree. Starts at 1.
+ * @return {cl_int}                          Index of the node.
+ */
+cl_int TwoLevelBVH::buildTopLevelNode(
+	vector<cl_uint>* instances, const cl_uint start, const cl_uint num,
+	const cl_int parent, const cl_uint depth
+) {
+	const cl_int index = mTopLevelNodes.size();
+
+	BVHNode node;
+	node.leftChild = -1;
+	node.rightChild = -1;
+	node.parent = parent;
+	node.facesStart = 0;
+	node.numFaces = 0;
+	node.depth = depth;
+	node.numSkipsToHere = 0;
+	node.skipNextLeft = false;
+	node.bbMin = mInstances[(*instances)[start]].bbMin;
+	node.bbMax = mInstances[(*instances)[start]].bbMax;
+
+	for( cl_uint i = start + 1; i < start + num; i++ ) {
+		node.bbMin = glm::min( node.bbMin, mInstances[(*instances)[i]].bbMin );
+		node.bbMax = glm::max( node.bbMax, mInstances[(*instances)[i]].bbMax );
+	}
+
+	mDepthReached = ( depth > mDepthReached ) ? depth : mDepthReached;
+
+	// Leaf node
+	if( num == 1 ) {
+		node.facesStart = (*instances)[start];
+		node.numFaces = 1;
+		mTopLevelNodes.push_back( node );
+
+		return index;
+	}
+
+	mTopLevelNodes.push_back( node );
+
+	cl_int bestAxis = -1;
+	cl_uint bestSplit = num / 2;
+	this->splitInstancesBySAH( instances, start, num, &bestAxis, &bestSplit );
+	this->sortInstances( instances, start, num, ( bestAxis < 0 ) ? 0 : bestAxis );
+
+	glm::vec3 leftMin = mInstances[(*instances)[start]].bbMin;
+	glm::vec3 leftMax = mInstances[(*instances)[start]].bbMax;
+	glm::vec3 rightMin = mInstances[(*instances)[start + bestSplit]].bbMin;
+	glm::vec3 rightMax = mInstances[(*instances)[start + bestSplit]].bbMax;
+
+	for( cl_uint i = start + 1; i < start + bestSplit; i++ ) {
+		leftMin = glm::min( leftMin, mInstances[(*instances)[i]].bbMin );
+		leftMax = glm::max( leftMax, mInstances[(*instances)[i]].bbMax );
+	}
+
+	for( cl_uint i = start + bestSplit + 1; i < start + num; i++ ) {
+		rightMin = glm::min( rightMin, mInstances[(*instances)[i]].bbMin );
+		rightMax = glm::max( rightMax, mInstances[(*instances)[i]].bbMax );
+	}
+
+	// The left child is next in memory, so build it first.
+	cl_int left, right;
+
+	if( MathHelp::getSurfaceArea( rightMin, rightMax ) > MathHelp::getSurfaceArea( leftMin, leftMax ) ) {
+		left = this->buildTopLevelNode( instances, start + bestSplit, num - bestSplit, index, depth + 1 );
+		right = this->buildTopLevelNode( instances, start, bestSplit, index, depth + 1 );
+	}
+	else {
+		left = this->buildTopLevelNode( instances, start, bestSplit, index, depth + 1 );
+		right = this->buildTopLevelNode( instances, start + bestSplit, num - bestSplit, index, depth + 1 );
+	}
+
+	mTopLevelNodes[index].leftChild = left;
+	mTopLevelNodes[index].rightChild = right;
+
+	return index;
+}
+
+
+/**
+ * Get the bottom levels.
+ * @return {const std::vector<BVH*>*} The BVHs of the objects.
+ */
+const vector<BVH*>* TwoLevelBVH::getBottomLevels() {
+	return &mBottomLevels;
+}
+
+
+/**
+ * Get the instances.
+ * @return {const std::vector<TwoLevelBVHInstance>*} The instances.
+ */
+const vector<TwoLevelBVHInstance>* TwoLevelBVH::getInstances() {
+	return &mInstances;
+}
+
+
+/**
+ * Get the nodes of the top level.
+ * @return {const std::vector<BVHNode>*} The nodes. Leaf nodes hold the instance index in <facesStart>.
+ */
+const vector<BVHNode>* TwoLevelBVH::getTopLevelNodes() {
+	return &mTopLevelNodes;
+}
+
+
+/**
+ * Set the transformation of an instance.
+ * The top level has to be rebuilt afterwards.
+ * @param {const cl_uint}   instance  Index of the instance.
+ * @param {const glm::mat4} transform Transformation from object to world space.
+ */
+void TwoLevelBVH::setTransform( const cl_uint instance, const glm::mat4 transform ) {
+	if( instance >= mInstances.size() ) {
+		Logger::logWarning( "[TwoLevelBVH] Instance index out of range. Ignoring new transformation." );
+		return;
+	}
+
+	mInstances[instance].transform = transform;
+	mInstances[instance].inverse = glm::inverse( transform );
+	this->updateInstanceAABB( &mInstances[instance] );
+}
+
+
+/**
+ * Sort the instances of a node by the centroid of their bounding boxes.
+ * @param {std::vector<cl_uint>*} instances Instance indices.
+ * @param {const cl_uint}         start     Index of the first instance of the node.
+ * @param {const cl_uint}         num       Number of instances of the node.
+ * @param {const cl_uint}         axis      Axis to sort by.
+ */
+void TwoLevelBVH::sortInstances(
+	vector<cl_uint>* instances, const cl_uint start, const cl_uint num, const cl_uint axis
+) {
+	const vector<TwoLevelBVHInstance>* inst = &mInstances;
+
+	std::sort(
+		instances->begin() + start, instances->begin() + start + num,
+		[inst, axis]( const cl_uint a, const cl_uint b ) {
+			cl_float centerA = (*inst)[a].bbMin[axis] + (*inst)[a].bbMax[axis];
+			cl_float centerB = (*inst)[b].bbMin[axis] + (*inst)[b].bbMax[axis];
+
+			return ( centerA != centerB ) ? centerA < centerB : a < b;
+		}
+	);
+}
+
+
+/**
+ * Find the best split of the instances of a node with a full SAH sweep.
+ * There are only few instances, so each axis is sorted completely.
+ * @param {std::vector<cl_uint>*} instances Instance indices. The range of the node will be sorted.
+ * @param {const cl_uint}         start     Index of the first instance of the node.
+ * @param {const cl_uint}         num       Number of instances of the node.
+ * @param {cl_int*}               bestAxis  Output. Axis of the best split.
+ * @param {cl_uint*}              bestSplit Output. Number of instances on the left side.
+ */
+void TwoLevelBVH::splitInstancesBySAH(
+	vector<cl_uint>* instances, const cl_uint start, const cl_uint num,
+	cl_int* bestAxis, cl_uint* bestSplit
+) {
+	cl_float bestSAH = FLT_MAX;
+	vector<cl_float> rightSA( num );
+
+	for( cl_uint axis = 0; axis <= 2; axis++ ) {
+		this->sortInstances( instances, start, num, axis );
+
+		glm::vec3 bbMin = mInstances[(*instances)[start + num - 1]].bbMin;
+		glm::vec3 bbMax = mInstances[(*instances)[start + num - 1]].bbMax;
+
+		for( cl_int i = num - 1; i > 0; i-- ) {
+			bbMin = glm::min( bbMin, mInstances[(*instances)[start + i]].bbMin );
+			bbMax = glm::max( bbMax, mInstances[(*instances)[start + i]].bbMax );
+			rightSA[i] = MathHelp::getSurfaceArea( bbMin, bbMax );
+		}
+
+		bbMin = mInstances[(*instances)[start]].bbMin;
+		bbMax = mInstances[(*instances)[start]].bbMax;
+
+		for( cl_uint i = 1; i < num; i++ ) {
+			cl_float sah = MathHelp::getSurfaceArea( bbMin, bbMax ) * i + rightSA[i] * ( num - i );
+
+			if( sah < bestSAH ) {
+				bestSAH = sah;
+				*bestAxis = axis;
+				*bestSplit = i;
+			}
+
+			bbMin = glm::min( bbMin, mInstances[(*instances)[start + i]].bbMin );
+			bbMax = glm::max( bbMax, mInstances[(*instances)[start + i]].bbMax );
+		}
+	}
+}
+
+
+/**
+ * Update the bounding box in world space of an instance
+ * from the bounding box of its bottom level.
+ * @param {TwoLevelBVHInstance*} instance The instance.
+ */
+void TwoLevelBVH::updateInstanceAABB( TwoLevelBVHInstance* instance ) {
+	BVH* bottomLevel = mBottomLevels[instance->bottomLevel];
+	const BVHNode* root = &(*bottomLevel->getNodes())[bottomLevel->getRoot()];
+
+	for( cl_uint i = 0; i < 8; i++ ) {
+		glm::vec4 corner(
+			( i & 1 ) ? root->bbMax[0] : root->bbMin[0],
+			( i & 2 ) ? root->bbMax[1] : root->bbMin[1],
+			( i & 4 ) ? root->bbMax[2] : root->bbMin[2],
+			1.0f
+		);
+		glm::vec3 p = glm::vec3( instance->transform * corner );
+
+		instance->bbMin = ( i == 0 ) ? p : glm::min( instance->bbMin, p );
+		instance->bbMax = ( i == 0 ) ? p : glm::max( instance->bbMax, p );
+	}
+}
+
+
+/**
+ * Get vertices and indices to draw a 3D visualization of the bounding boxes.
+ * The boxes of the bottom levels are drawn for each instance.
+ * @param {std::vector<cl_float>*} vertices Vector to put the vertices into.
+ * @param {std::vector<cl_uint>*}  indices  Vector to put the indices into.
+ */
+void TwoLevelBVH::visualize( vector<cl_float>* vertices, vector<cl_uint>* indices ) {
+	vector< vector<cl_float> > levelVertices( mBottomLevels.size() );
+	vector< vector<cl_uint> > levelIndices( mBottomLevels.size() );
+
+	for( cl_uint i = 0; i < mBottomLevels.size(); i++ ) {
+		mBottomLevels[i]->visualize( &levelVertices[i], &levelIndices[i] );
+	}
+
+	for( cl_uint i = 0; i < mInstances.size(); i++ ) {
+		const TwoLevelBVHInstance* instance = &mInstances[i];
+		const vector<cl_float>* v = &levelVertices[instance->bottomLevel];
+		const vector<cl_uint>* ind = &levelIndices[instance->bottomLevel];
+		const cl_uint offset = vertices->size() / 3;
+
+		for( cl_uint j = 0; j < v->size(); j += 3 ) {
+			glm::vec4 p = instance->transform * glm::vec4( (*v)[j], (*v)[j + 1], (*v)[j + 2], 1.0f );
+			vertices->push_back( p[0] );
+			vertices->push_back( p[1] );
+			vertices->push_back( p[2] );
+		}
+
+		for( cl_uint j = 0; j < ind->size(); j++ ) {
+			indices->push_back( offset + (*ind)[j] );
+		}
+	}
+}
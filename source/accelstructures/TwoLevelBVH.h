@@ -0,0 +1,80 @@
+#ifndef TWOLEVELBVH_H
+#define TWOLEVELBVH_H
+
+#define GLM_FORCE_RADIANS
+
+#include <algorithm>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <map>
+#include <string>
+
+#include "AccelStructure.h"
+#include "BVH.h"
+#include "../Logger.h"
+#include "../MathHelp.h"
+#include "../ObjParser.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+
+// An object of the scene, placed by a transformation.
+struct TwoLevelBVHInstance {
+	cl_uint bottomLevel;
+	glm::mat4 transform;
+	glm::mat4 inverse;
+	glm::vec3 bbMin;
+	glm::vec3 bbMax;
+};
+
+
+/**
+ * Two-level BVH. Each object has its own BVH (bottom level) in object space.
+ * A small BVH (top level) in world space sits over the instances of the objects.
+ * Moving an instance only needs a rebuild of the top level and an object
+ * placed multiple times is stored only once.
+ */
+class TwoLevelBVH : public AccelStructure {
+
+	public:
+		TwoLevelBVH(
+			const vector<object3D> sceneObjects,
+			const vector<instance_t> instances,
+			const vector<cl_float> vertices,
+			const vector<cl_float> normals
+		);
+		~TwoLevelBVH();
+		void buildTopLevel();
+		const vector<BVH*>* getBottomLevels();
+		const vector<TwoLevelBVHInstance>* getInstances();
+		const vector<BVHNode>* getTopLevelNodes();
+		void setTransform( const cl_uint instance, const glm::mat4 transform );
+		virtual void visualize( vector<cl_float>* vertices, vector<cl_uint>* indices );
+
+	protected:
+		void addInstance( const cl_uint bottomLevel, const glm::mat4 transform );
+		cl_int buildTopLevelNode(
+			vector<cl_uint>* instances, const cl_uint start, const cl_uint num,
+			const cl_int parent, const cl_uint depth
+		);
+		void splitInstancesBySAH(
+			vector<cl_uint>* instances, const cl_uint start, const cl_uint num,
+			cl_int* bestAxis, cl_uint* bestSplit
+		);
+		void sortInstances(
+			vector<cl_uint>* instances, const cl_uint start, const cl_uint num, const cl_uint axis
+		);
+		void updateInstanceAABB( TwoLevelBVHInstance* instance );
+
+	private:
+		vector<BVH*> mBottomLevels;
+		vector<TwoLevelBVHInstance> mInstances;
+		vector<BVHNode> mTopLevelNodes;
+		cl_uint mDepthReached;
+
+};
+
+#endif
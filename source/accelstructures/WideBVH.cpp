@@ -0,0 +1,158 @@
+#include "WideBVH.h"
+
+using std::vector;
+
+
+/**
+ * Build the binary BVH and collapse it into the wide BVH.
+ * @param {std::vector<object3D>} sceneObjects Objects of the scene.
+ * @param {std::vector<cl_float>} vertices     Vertices of the model.
+ * @param {std::vector<cl_float>} normals      Normals of the model.
+ */
+WideBVH::WideBVH(
+	const vector<object3D> sceneObjects,
+	const vector<cl_float> vertices,
+	const vector<cl_float> normals
+) {
+	mBVH = new BVH( sceneObjects, vertices, normals );
+	mDepthReached = 0;
+
+	boost::posix_time::ptime timerStart = boost::posix_time::microsec_clock::local_time();
+
+	// Less than one wide node per leaf node of the binary BVH.
+	mNodes.reserve( mBVH->getNumLeaves() );
+	this->collapseNode( mBVH->getRoot(), 1 );
+
+	boost::posix_time::ptime timerEnd = boost::posix_time::microsec_clock::local_time();
+	cl_float timeDiff = ( timerEnd - timerStart ).total_microseconds() / 1000.0f;
+
+	char msg[256];
+	snprintf(
+		msg, 256, "[WideBVH] Collapsed %lu nodes into %lu nodes in %g ms. Max depth of %u.",
+		mBVH->getNodes()->size(), mNodes.size(), timeDiff, mDepthReached
+	);
+	Logger::logInfo( msg );
+}
+
+
+/**
+ * Destructor.
+ */
+WideBVH::~WideBVH() {
+	delete mBVH;
+}
+
+
+/**
+ * Collapse a node of the binary BVH and its sub-tree into wide nodes.
+ * The children of the binary node are replaced by their own children,
+ * largest surface area first, until the node is full or only has leaf nodes.
+ * The wide nodes are stored in depth-first order, so the root node is at index 0.
+ * @param  {const cl_int}  binaryNode Index of the node in the binary BVH.
+ * @param  {const cl_uint} depth      The current depth of the node in the tree. Starts at 1.
+ * @return {cl_int}                   Index of the wide node.
+ */
+cl_int WideBVH::collapseNode( const cl_int binaryNode, const cl_uint depth ) {
+	const vector<BVHNode>* binaryNodes = mBVH->getNodes();
+	const BVHNode* node = &(*binaryNodes)[binaryNode];
+	const cl_int index = mNodes.size();
+
+	WideBVHNode wn;
+	wn.numChildren = 0;
+	wn.bbMin = node->bbMin;
+	wn.bbMax = node->bbMax;
+
+	for( cl_uint i = 0; i < WIDEBVH_WIDTH; i++ ) {
+		wn.children[i] = -1;
+		wn.wideChildren[i] = -1;
+	}
+
+	// The root node is the only leaf node without a parent.
+	if( node->leftChild < 0 ) {
+		wn.children[wn.numChildren++] = binaryNode;
+	}
+	else {
+		wn.children[wn.numChildren++] = node->leftChild;
+		wn.children[wn.numChildren++] = node->rightChild;
+	}
+
+	while( wn.numChildren < WIDEBVH_WIDTH ) {
+		cl_int best = -1;
+		cl_float bestSA = -1.0f;
+
+		for( cl_uint i = 0; i < wn.numChildren; i++ ) {
+			const BVHNode* child = &(*binaryNodes)[wn.children[i]];
+
+			if( child->leftChild < 0 ) {
+				continue;
+			}
+
+			cl_float sa = MathHelp::getSurfaceArea( child->bbMin, child->bbMax );
+
+			if( sa > bestSA ) {
+				bestSA = sa;
+				best = i;
+			}
+		}
+
+		// Only leaf nodes left.
+		if( best < 0 ) {
+			break;
+		}
+
+		const BVHNode* child = &(*binaryNodes)[wn.children[best]];
+		wn.children[best] = child->leftChild;
+		wn.children[wn.numChildren++] = child->rightChild;
+	}
+
+	mDepthReached = ( depth > mDepthReached ) ? depth : mDepthReached;
+	mNodes.push_back( wn );
+
+	for( cl_uint i = 0; i < wn.numChildren; i++ ) {
+		if( (*binaryNodes)[wn.children[i]].leftChild >= 0 ) {
+			// Not a reference, the node list may grow.
+			cl_int wideChild = this->collapseNode( wn.children[i], depth + 1 );
+			mNodes[index].wideChildren[i] = wideChild;
+		}
+	}
+
+	return index;
+}
+
+
+/**
+ * Get the binary BVH the wide BVH has been collapsed from.
+ * @return {BVH*} The binary BVH.
+ */
+BVH* WideBVH::getBinaryBVH() {
+	return mBVH;
+}
+
+
+/**
+ * Get the max reached depth.
+ * @return {cl_uint} The max reached depth.
+ */
+cl_uint WideBVH::getDepth() {
+	return mDepthReached;
+}
+
+
+/**
+ * Get the wide nodes.
+ * @return {const std::vector<WideBVHNode>*} The nodes in depth-first order.
+ */
+const vector<WideBVHNode>* WideBVH::getNodes() {
+	return &mNodes;
+}
+
+
+/**
+ * Get vertices and indices to draw a 3D visualization of the bounding boxes.
+ * The leaf nodes are the same as those of the binary BVH.
+ * @param {std::vector<cl_float>*} vertices Vector to put the vertices into.
+ * @param {std::vector<cl_uint>*}  indices  Vector to put the indices into.
+ */
+void WideBVH::visualize( vector<cl_float>* vertices, vector<cl_uint>* indices ) {
+	mBVH->visualize( vertices, indices );
+}
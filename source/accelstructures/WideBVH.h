@@ -0,0 +1,58 @@
+#ifndef WIDEBVH_H
+#define WIDEBVH_H
+
+// Max number of children of a node. The node layout
+// of the kernel (pt_header.cl) is made for 4 children.
+#define WIDEBVH_WIDTH 4
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <glm/glm.hpp>
+
+#include "AccelStructure.h"
+#include "BVH.h"
+#include "../Logger.h"
+#include "../MathHelp.h"
+
+using std::vector;
+
+
+// A node of the wide BVH, collapsed from nodes of the binary BVH.
+struct WideBVHNode {
+	cl_uint numChildren;
+	cl_int children[WIDEBVH_WIDTH]; // nodes of the binary BVH
+	cl_int wideChildren[WIDEBVH_WIDTH]; // wide node of an inner child, -1 for leaf nodes
+	glm::vec3 bbMin;
+	glm::vec3 bbMax;
+};
+
+
+/**
+ * Wide BVH (BVH4). The binary BVH is built as usual and then collapsed, so
+ * each node has up to 4 children. The traversal tests all children of a node
+ * at once. The leaf nodes of the binary BVH stay leaf nodes.
+ */
+class WideBVH : public AccelStructure {
+
+	public:
+		WideBVH(
+			const vector<object3D> sceneObjects,
+			const vector<cl_float> vertices,
+			const vector<cl_float> normals
+		);
+		~WideBVH();
+		BVH* getBinaryBVH();
+		cl_uint getDepth();
+		const vector<WideBVHNode>* getNodes();
+		virtual void visualize( vector<cl_float>* vertices, vector<cl_uint>* indices );
+
+	protected:
+		cl_int collapseNode( const cl_int binaryNode, const cl_uint depth );
+
+	private:
+		BVH* mBVH;
+		vector<WideBVHNode> mNodes;
+		cl_uint mDepthReached;
+
+};
+
+#endif
@@ -0,0 +1,139 @@
+/**
+ * Project a point onto a plane.
+ * @param  {const float3} q Point to project.
+ * @param  {const float3} p Point on the plane.
+ * @param  {const float3} n Normal of the plane.
+ * @return {float3}         Projected point.
+ */
+inline float3 projectOnPlane( const float3 q, const float3 p, const float3 n ) {
+	return q - dot( q - p, n ) * n;
+}
+
+
+/**
+ * Phong tessellation of a given barycentric point.
+ * @param  {const float3} p1
+ * @param  {const float3} p2
+ * @param  {const float3} p3
+ * @param  {const float3} n1
+ * @param  {const float3} n2
+ * @param  {const float3} n3
+ * @param  {const float}  u
+ * @param  {const float}  v
+ * @return {float3}          Phong tessellated point.
+ */
+float3 phongTessellate(
+	const float3 p1, const float3 p2, const float3 p3,
+	const float3 n1, const float3 n2, const float3 n3,
+	const float u, const float v
+) {
+	const float w = 1.0f - u - v;
+	const float3 pBary = p1 * u + p2 * v + p3 * w;
+	const float3 pTessellated =
+			u * projectOnPlane( pBary, p1, n1 ) +
+			v * projectOnPlane( pBary, p2, n2 ) +
+			w * projectOnPlane( pBary, p3, n3 );
+
+	return ( 1.0f - PHONGTESS_ALPHA ) * pBary + PHONGTESS_ALPHA * pTessellated;
+}
+
+
+/**
+ * Grow the bounding box of a face to include the Phong tessellated surface.
+ * Same as MathHelp::triCalcAABB() and MathHelp::triThicknessAndSidedrop().
+ * @param {const float3} p1
+ * @param {const float3} p2
+ * @param {const float3} p3
+ * @param {const float3} n1
+ * @param {const float3} n2
+ * @param {const float3} n3
+ * @param {float3*}      bbMin
+ * @param {float3*}      bbMax
+ */
+void growAABBByPhongTess(
+	const float3 p1, const float3 p2, const float3 p3,
+	const float3 n1, const float3 n2, const float3 n3,
+	float3* bbMin, float3* bbMax
+) {
+	const float3 e12 = p2 - p1;
+	const float3 e13 = p3 - p1;
+	const float3 e23 = p3 - p2;
+	const float3 e31 = p1 - p3;
+	const float3 c12 = PHONGTESS_ALPHA * ( dot( n2, e12 ) * n2 - dot( n1, e12 ) * n1 );
+	const float3 c23 = PHONGTESS_ALPHA * ( dot( n3, e23 ) * n3 - dot( n2, e23 ) * n2 );
+	const float3 c31 = PHONGTESS_ALPHA * ( dot( n1, e31 ) * n1 - dot( n3, e31 ) * n3 );
+	const float3 ng = normalize( cross( e12, e13 ) );
+
+	const float kTmp = dot( ng, c12 - c23 - c31 );
+	const float k = 1.0f / ( 4.0f * dot( ng, c23 ) * dot( ng, c31 ) - kTmp * kTmp );
+
+	float u = k * (
+		2.0f * dot( ng, c23 ) * dot( ng, c31 + e31 ) +
+		dot( ng, c23 - e23 ) * dot( ng, c12 - c23 - c31 )
+	);
+	float v = k * (
+		2.0f * dot( ng, c31 ) * dot( ng, c23 - e23 ) +
+		dot( ng, c31 + e31 ) * dot( ng, c12 - c23 - c31 )
+	);
+
+	u = ( u < 0.0f || u > 1.0f ) ? 0.0f : u;
+	v = ( v < 0.0f || v > 1.0f ) ? 0.0f : v;
+
+	const float3 pt = phongTessellate( p1, p2, p3, n1, n2, n3, u, v );
+	const float thickness = dot( ng, pt - p1 );
+
+	*bbMin = fmin( *bbMin, fmin( fmin( p1, p2 ), p3 ) + thickness * ng );
+	*bbMax = fmax( *bbMax, fmax( fmax( p1, p2 ), p3 ) + thickness * ng );
+
+	const float2 sidedrops[9] = {
+		(float2)( 0.0f, 0.5f ), (float2)( 0.5f, 0.0f ), (float2)( 0.5f, 0.5f ),
+		(float2)( 0.25f, 0.75f ), (float2)( 0.75f, 0.25f ), (float2)( 0.25f, 0.0f ),
+		(float2)( 0.75f, 0.0f ), (float2)( 0.0f, 0.25f ), (float2)( 0.0f, 0.75f )
+	};
+
+	for( int i = 0; i < 9; i++ ) {
+		const float3 sd = phongTessellate( p1, p2, p3, n1, n2, n3, sidedrops[i].x, sidedrops[i].y );
+		*bbMin = fmin( *bbMin, sd );
+		*bbMax = fmax( *bbMax, sd );
+	}
+}
+
+
+/**
+ * Bounding box of a face. Grown to include the Phong tessellated surface if enabled.
+ * @param {global const uint4*}  facesV   Vertex indices of the faces.
+ * @param {global const uint4*}  facesN   Normal indices of the faces.
+ * @param {global const float4*} vertices Vertices.
+ * @param {global const float4*} normals  Normals.
+ * @param {const uint}           face     Index of the face.
+ * @param {float3*}              bbMin    Output: Minimum of the bounding box.
+ * @param {float3*}              bbMax    Output: Maximum of the bounding box.
+ */
+void faceBounds(
+	global const uint4* facesV, global const uint4* facesN,
+	global const float4* vertices, global const float4* normals,
+	const uint face, float3* bbMin, float3* bbMax
+) {
+	const uint4 fv = facesV[face];
+
+	const float3 p1 = vertices[fv.x].xyz;
+	const float3 p2 = vertices[fv.y].xyz;
+	const float3 p3 = vertices[fv.z].xyz;
+
+	*bbMin = fmin( fmin( p1, p2 ), p3 );
+	*bbMax = fmax( fmax( p1, p2 ), p3 );
+
+	#if PHONGTESS == 1
+		const uint4 fn = facesN[face];
+		const float3 n1 = normals[fn.x].xyz;
+		const float3 n2 = normals[fn.y].xyz;
+		const float3 n3 = normals[fn.z].xyz;
+
+		// Normals are the same, which means no Phong Tessellation possible.
+		const float3 test = fabs( ( n1 - n2 ) + ( n2 - n3 ) );
+
+		if( test.x > 0.000001f || test.y > 0.000001f || test.z > 0.000001f ) {
+			growAABBByPhongTess( p1, p2, p3, n1, n2, n3, bbMin, bbMax );
+		}
+	#endif
+}
@@ -0,0 +1,94 @@
+#define PHONGTESS #PHONGTESS#
+#define PHONGTESS_ALPHA #PHONGTESS_ALPHA#
+
+
+#FILE:bvh_bounds.cl:FILE#
+
+
+
+/**
+ * KERNEL.
+ * Refit the bounding boxes of the BVH to the current vertices, bottom-up.
+ * Each work-item starts at a leaf node and walks up to the root. Only the
+ * work-item reaching a node last goes on, the others stop. It merges the
+ * boxes of all child nodes, which are found by following the next node to
+ * visit from the first child node to the end of the sub-tree.
+ * The BVH is in the layout of the path tracer (pt_header.cl). It is accessed
+ * as two float4 per node, so the boxes of other work-items are not cached.
+ * The w components hold the bits of the int indices.
+ * One work-item per leaf node.
+ * @param {const int}            numNodes Number of nodes.
+ * @param {global const int*}    leaves   Index of each leaf node.
+ * @param {global const int2*}   links    Per node. x: Parent node. y: Number of child nodes.
+ * @param {global uint*}         visited  Visit counter of each node. Has to be 0.
+ * @param {global const uint4*}  facesV   Vertex indices of the faces.
+ * @param {global const uint4*}  facesN   Normal indices of the faces.
+ * @param {global const float4*} vertices Vertices.
+ * @param {global const float4*} normals  Normals.
+ * @param {global float4*}       bvh      The BVH nodes. bbMin and bbMax of each node.
+ */
+kernel void bvhRefit(
+	const int numNodes, global const int* leaves, global const int2* links, global uint* visited,
+	global const uint4* facesV, global const uint4* facesN,
+	global const float4* vertices, global const float4* normals,
+	global volatile float4* bvh
+) {
+	const int leaf = leaves[get_global_id( 0 )];
+	const float4 leafMin = bvh[2 * leaf];
+	const float4 leafMax = bvh[2 * leaf + 1];
+
+	float3 bbMin;
+	float3 bbMax;
+	const uint first = as_uint( leafMin.w );
+	const uint last = first + as_uint( leafMax.w );
+	faceBounds( facesV, facesN, vertices, normals, first, &bbMin, &bbMax );
+
+	// The other faces of the leaf node follow the first one.
+	for( uint i = first + 1; i < last; i++ ) {
+		float3 faceMin;
+		float3 faceMax;
+		faceBounds( facesV, facesN, vertices, normals, i, &faceMin, &faceMax );
+
+		bbMin = fmin( bbMin, faceMin );
+		bbMax = fmax( bbMax, faceMax );
+	}
+
+	bvh[2 * leaf] = (float4)( bbMin, leafMin.w );
+	bvh[2 * leaf + 1] = (float4)( bbMax, leafMax.w );
+
+	int node = links[leaf].x;
+
+	while( node >= 0 ) {
+		// Make the written node visible before the sibling work-items can read it.
+		mem_fence( CLK_GLOBAL_MEM_FENCE );
+
+		// Not the last to arrive. Other sub-trees are not done yet.
+		if( atomic_inc( &visited[node] ) < links[node].y - 1 ) {
+			return;
+		}
+
+		const float4 nodeMax = bvh[2 * node + 1];
+		const int next = as_int( nodeMax.w );
+		const int end = ( next > node && next < numNodes ) ? next : numNodes;
+		int child = node + 1;
+
+		bbMin = (float3)( INFINITY );
+		bbMax = (float3)( -INFINITY );
+
+		while( child > node && child < end ) {
+			const float4 childMin = bvh[2 * child];
+			const float4 childMax = bvh[2 * child + 1];
+
+			bbMin = fmin( bbMin, childMin.xyz );
+			bbMax = fmax( bbMax, childMax.xyz );
+
+			// Leaf nodes have no sub-tree to skip.
+			child = ( as_int( childMin.w ) < 0 ) ? as_int( childMax.w ) : child + 1;
+		}
+
+		bvh[2 * node] = (float4)( bbMin, as_float( -1 ) );
+		bvh[2 * node + 1] = (float4)( bbMax, nodeMax.w );
+
+		node = links[node].x;
+	}
+}
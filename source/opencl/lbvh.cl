@@ -0,0 +1,492 @@
+#define LBVH_CHUNK_SIZE #LBVH_CHUNK_SIZE#
+#define LBVH_RADIX_BITS #LBVH_RADIX_BITS#
+#define LBVH_RADIX_SIZE ( 1 << LBVH_RADIX_BITS )
+#define LBVH_SCAN_BLOCK #LBVH_SCAN_BLOCK#
+#define PHONGTESS #PHONGTESS#
+#define PHONGTESS_ALPHA #PHONGTESS_ALPHA#
+
+
+// Same layout as used by the path tracer (pt_header.cl).
+// The w components hold the bits of int indices.
+typedef struct {
+	float4 bbMin; // w: index of the first face, -1 for inner nodes
+	float4 bbMax; // w: number of faces or next node to visit
+} bvhNode;
+
+
+// Bounding boxes of the faces, shared with the refit (bvh_refit.cl).
+#FILE:bvh_bounds.cl:FILE#
+
+
+/**
+ * Spread the lower 10 bits of a value, so there are two 0 bits between each.
+ * @param  {uint} v Value.
+ * @return {uint}   Expanded value.
+ */
+inline uint expandBits( uint v ) {
+	v = ( v * 0x00010001u ) & 0xFF0000FFu;
+	v = ( v * 0x00000101u ) & 0x0F00F00Fu;
+	v = ( v * 0x00000011u ) & 0xC30C30C3u;
+	v = ( v * 0x00000005u ) & 0x49249249u;
+
+	return v;
+}
+
+
+/**
+ * 30 bit Morton code of a point inside the unit cube.
+ * @param  {float3} p Point, each coordinate in [0, 1].
+ * @return {uint}     Morton code.
+ */
+inline uint morton3D( float3 p ) {
+	p = clamp( p * 1024.0f, 0.0f, 1023.0f );
+
+	return ( expandBits( (uint) p.x ) << 2 ) | ( expandBits( (uint) p.y ) << 1 ) | expandBits( (uint) p.z );
+}
+
+
+/**
+ * Length of the common prefix of the Morton codes of two sorted faces.
+ * Equal codes are told apart by the index of the faces.
+ * @param  {global const uint*} codes    Sorted Morton codes.
+ * @param  {const int}          numFaces Number of faces.
+ * @param  {const int}          i        Index of the first face.
+ * @param  {const int}          j        Index of the second face.
+ * @return {int}                         Length of the common prefix, -1 if <j> is out of range.
+ */
+inline int commonPrefix( global const uint* codes, const int numFaces, const int i, const int j ) {
+	if( j < 0 || j >= numFaces ) {
+		return -1;
+	}
+
+	const uint a = codes[i];
+	const uint b = codes[j];
+
+	return ( a == b ) ? 32 + clz( (uint) ( i ^ j ) ) : clz( a ^ b );
+}
+
+
+/**
+ * Surface area of a bounding box.
+ * @param  {const float4} bbMin
+ * @param  {const float4} bbMax
+ * @return {float}
+ */
+inline float surfaceArea( const float4 bbMin, const float4 bbMax ) {
+	const float3 d = bbMax.xyz - bbMin.xyz;
+
+	return 2.0f * ( d.x * d.y + d.x * d.z + d.y * d.z );
+}
+
+
+
+/**
+ * KERNEL.
+ * Calculate the bounding box of each face.
+ * One work-item per face.
+ * @param {global const uint4*}  facesV   Vertex indices of the faces.
+ * @param {global const uint4*}  facesN   Normal indices of the faces.
+ * @param {global const float4*} vertices Vertices.
+ * @param {global const float4*} normals  Normals.
+ * @param {global float4*}       faceMin  Output: Minimum of the bounding box.
+ * @param {global float4*}       faceMax  Output: Maximum of the bounding box.
+ */
+kernel void lbvhFaceBounds(
+	global const uint4* facesV, global const uint4* facesN,
+	global const float4* vertices, global const float4* normals,
+	global float4* faceMin, global float4* faceMax
+) {
+	const uint i = get_global_id( 0 );
+	float3 bbMin;
+	float3 bbMax;
+
+	faceBounds( facesV, facesN, vertices, normals, i, &bbMin, &bbMax );
+
+	faceMin[i] = (float4)( bbMin, 0.0f );
+	faceMax[i] = (float4)( bbMax, 0.0f );
+}
+
+
+/**
+ * KERNEL.
+ * First pass of the reduction of the face centroids to their bounding box.
+ * Each work-item reduces every n-th face, with n being the global size.
+ * @param {global const float4*} faceMin    Minimum of the face bounding boxes.
+ * @param {global const float4*} faceMax    Maximum of the face bounding boxes.
+ * @param {const uint}           numFaces   Number of faces.
+ * @param {global float4*}       partialMin Output: Minimum per work-item.
+ * @param {global float4*}       partialMax Output: Maximum per work-item.
+ */
+kernel void lbvhReduceBounds(
+	global const float4* faceMin, global const float4* faceMax, const uint numFaces,
+	global float4* partialMin, global float4* partialMax
+) {
+	const uint g = get_global_id( 0 );
+	float4 cenMin = (float4)( INFINITY );
+	float4 cenMax = (float4)( -INFINITY );
+
+	for( uint i = g; i < numFaces; i += get_global_size( 0 ) ) {
+		const float4 center = ( faceMin[i] + faceMax[i] ) * 0.5f;
+		cenMin = fmin( cenMin, center );
+		cenMax = fmax( cenMax, center );
+	}
+
+	partialMin[g] = cenMin;
+	partialMax[g] = cenMax;
+}
+
+
+/**
+ * KERNEL.
+ * Second pass of the centroid bounds reduction. Single work-item.
+ * @param {global const float4*} partialMin  Minimum per work-item of the first pass.
+ * @param {global const float4*} partialMax  Maximum per work-item of the first pass.
+ * @param {const uint}           numPartials Number of work-items of the first pass.
+ * @param {global float4*}       bounds      Output: [0] minimum, [1] maximum.
+ */
+kernel void lbvhReduceBoundsFinal(
+	global const float4* partialMin, global const float4* partialMax, const uint numPartials,
+	global float4* bounds
+) {
+	float4 cenMin = partialMin[0];
+	float4 cenMax = partialMax[0];
+
+	for( uint i = 1; i < numPartials; i++ ) {
+		cenMin = fmin( cenMin, partialMin[i] );
+		cenMax = fmax( cenMax, partialMax[i] );
+	}
+
+	bounds[0] = cenMin;
+	bounds[1] = cenMax;
+}
+
+
+/**
+ * KERNEL.
+ * Morton code of the centroid of each face.
+ * One work-item per face.
+ * @param {global const float4*} faceMin Minimum of the face bounding boxes.
+ * @param {global const float4*} faceMax Maximum of the face bounding boxes.
+ * @param {global const float4*} bounds  Bounding box of the centroids.
+ * @param {global uint*}         codes   Output: Morton codes.
+ * @param {global uint*}         indices Output: Face indices.
+ */
+kernel void lbvhMortonCodes(
+	global const float4* faceMin, global const float4* faceMax, global const float4* bounds,
+	global uint* codes, global uint* indices
+) {
+	const uint i = get_global_id( 0 );
+	const float3 cenMin = bounds[0].xyz;
+	const float3 extent = fmax( bounds[1].xyz - cenMin, (float3)( 0.000001f ) );
+	const float3 center = ( faceMin[i].xyz + faceMax[i].xyz ) * 0.5f;
+
+	codes[i] = morton3D( ( center - cenMin ) / extent );
+	indices[i] = i;
+}
+
+
+/**
+ * KERNEL.
+ * Radix sort: Count the digits of a chunk of keys.
+ * One work-item per chunk.
+ * @param {global const uint*} keys     Keys to sort.
+ * @param {const uint}         numKeys  Number of keys.
+ * @param {const uint}         shift    Bit position of the current digit.
+ * @param {global uint*}       counts   Output: Count of each digit per chunk, ordered by digit first.
+ */
+kernel void lbvhRadixCount(
+	global const uint* keys, const uint numKeys, const uint shift, global uint* counts
+) {
+	const uint chunk = get_global_id( 0 );
+	const uint numChunks = get_global_size( 0 );
+	const uint start = chunk * LBVH_CHUNK_SIZE;
+	const uint end = min( start + LBVH_CHUNK_SIZE, numKeys );
+
+	uint histogram[LBVH_RADIX_SIZE];
+
+	for( uint d = 0; d < LBVH_RADIX_SIZE; d++ ) {
+		histogram[d] = 0;
+	}
+
+	for( uint i = start; i < end; i++ ) {
+		histogram[( keys[i] >> shift ) & ( LBVH_RADIX_SIZE - 1 )]++;
+	}
+
+	for( uint d = 0; d < LBVH_RADIX_SIZE; d++ ) {
+		counts[d * numChunks + chunk] = histogram[d];
+	}
+}
+
+
+/**
+ * KERNEL.
+ * Exclusive prefix sum of a block of values. The sum of each block is
+ * written out to be scanned by lbvhScanBlockSums().
+ * One work-item per block.
+ * @param {global uint*} values    Values to scan in place.
+ * @param {const uint}   numValues Number of values.
+ * @param {global uint*} blockSums Output: Sum of each block.
+ */
+kernel void lbvhScanBlocks( global uint* values, const uint numValues, global uint* blockSums ) {
+	const uint block = get_global_id( 0 );
+	const uint start = block * LBVH_SCAN_BLOCK;
+	const uint end = min( start + LBVH_SCAN_BLOCK, numValues );
+	uint sum = 0;
+
+	for( uint i = start; i < end; i++ ) {
+		const uint v = values[i];
+		values[i] = sum;
+		sum += v;
+	}
+
+	blockSums[block] = sum;
+}
+
+
+/**
+ * KERNEL.
+ * Exclusive prefix sum of the block sums. Single work-item.
+ * @param {global uint*} blockSums Sums of the blocks to scan in place.
+ * @param {const uint}   numBlocks Number of blocks.
+ */
+kernel void lbvhScanBlockSums( global uint* blockSums, const uint numBlocks ) {
+	uint sum = 0;
+
+	for( uint i = 0; i < numBlocks; i++ ) {
+		const uint v = blockSums[i];
+		blockSums[i] = sum;
+		sum += v;
+	}
+}
+
+
+/**
+ * KERNEL.
+ * Radix sort: Move the keys and values of a chunk to their sorted position.
+ * The order of keys with the same digit is kept (stable).
+ * One work-item per chunk.
+ * @param {global const uint*} keysIn    Keys to sort.
+ * @param {global const uint*} valuesIn  Values to sort.
+ * @param {const uint}         numKeys   Number of keys.
+ * @param {const uint}         shift     Bit position of the current digit.
+ * @param {global const uint*} counts    Block-wise scanned digit counts.
+ * @param {global const uint*} blockSums Scanned block sums.
+ * @param {global uint*}       keysOut   Output: Sorted keys.
+ * @param {global uint*}       valuesOut Output: Sorted values.
+ */
+kernel void lbvhRadixScatter(
+	global const uint* keysIn, global const uint* valuesIn, const uint numKeys, const uint shift,
+	global const uint* counts, global const uint* blockSums,
+	global uint* keysOut, global uint* valuesOut
+) {
+	const uint chunk = get_global_id( 0 );
+	const uint numChunks = get_global_size( 0 );
+	const uint start = chunk * LBVH_CHUNK_SIZE;
+	const uint end = min( start + LBVH_CHUNK_SIZE, numKeys );
+
+	uint offsets[LBVH_RADIX_SIZE];
+
+	for( uint d = 0; d < LBVH_RADIX_SIZE; d++ ) {
+		const uint index = d * numChunks + chunk;
+		offsets[d] = counts[index] + blockSums[index / LBVH_SCAN_BLOCK];
+	}
+
+	for( uint i = start; i < end; i++ ) {
+		const uint key = keysIn[i];
+		const uint target = offsets[( key >> shift ) & ( LBVH_RADIX_SIZE - 1 )]++;
+
+		keysOut[target] = key;
+		valuesOut[target] = valuesIn[i];
+	}
+}
+
+
+/**
+ * KERNEL.
+ * Build the hierarchy from the sorted Morton codes.
+ * Internal nodes are numbered [0, numFaces - 2] with 0 being the root,
+ * leaf nodes are numbered [numFaces - 1, 2 * numFaces - 2].
+ * Source: "Maximizing Parallelism in the Construction of BVHs,
+ * Octrees, and k-d Trees" (Karras, 2012)
+ * One work-item per internal node.
+ * @param {global const uint*} codes      Sorted Morton codes.
+ * @param {const int}          numFaces   Number of faces.
+ * @param {global int*}        leftChild  Output: Left child of each internal node.
+ * @param {global int*}        rightChild Output: Right child of each internal node.
+ * @param {global int*}        parents    Output: Parent of each node.
+ * @param {global uint*}       visited    Output: Visit counter of each internal node, reset to 0.
+ */
+kernel void lbvhBuildHierarchy(
+	global const uint* codes, const int numFaces,
+	global int* leftChild, global int* rightChild, global int* parents,
+	global uint* visited
+) {
+	const int i = get_global_id( 0 );
+
+	// Direction of the range of faces covered by this node.
+	const int d = ( commonPrefix( codes, numFaces, i, i + 1 ) - commonPrefix( codes, numFaces, i, i - 1 ) >= 0 ) ? 1 : -1;
+	const int prefixMin = commonPrefix( codes, numFaces, i, i - d );
+
+	// Upper bound for the length of the range.
+	int lengthMax = 2;
+
+	while( commonPrefix( codes, numFaces, i, i + lengthMax * d ) > prefixMin ) {
+		lengthMax <<= 1;
+	}
+
+	// Other end of the range.
+	int length = 0;
+
+	for( int t = lengthMax >> 1; t >= 1; t >>= 1 ) {
+		if( commonPrefix( codes, numFaces, i, i + ( length + t ) * d ) > prefixMin ) {
+			length += t;
+		}
+	}
+
+	const int j = i + length * d;
+	const int prefixNode = commonPrefix( codes, numFaces, i, j );
+
+	// Split position.
+	int split = 0;
+	int t = length;
+
+	do {
+		t = ( t + 1 ) >> 1;
+
+		if( commonPrefix( codes, numFaces, i, i + ( split + t ) * d ) > prefixNode ) {
+			split += t;
+		}
+	} while( t > 1 );
+
+	const int gamma = i + split * d + min( d, 0 );
+	const int left = ( min( i, j ) == gamma ) ? numFaces - 1 + gamma : gamma;
+	const int right = ( max( i, j ) == gamma + 1 ) ? numFaces + gamma : gamma + 1;
+
+	leftChild[i] = left;
+	rightChild[i] = right;
+	parents[left] = i;
+	parents[right] = i;
+	visited[i] = 0;
+
+	if( i == 0 ) {
+		parents[0] = -1;
+	}
+}
+
+
+/**
+ * KERNEL.
+ * Calculate the bounding boxes and sizes of the sub-trees bottom-up.
+ * Each work-item starts at a leaf and walks up. The work-item reaching
+ * a node second processes it, the first one stops. The child node with
+ * the bigger surface area is moved to the left.
+ * One work-item per leaf.
+ * @param {const int}            numFaces    Number of faces.
+ * @param {global const uint*}   sortedFaces Face indices ordered by Morton code.
+ * @param {global const float4*} faceMin     Minimum of the face bounding boxes.
+ * @param {global const float4*} faceMax     Maximum of the face bounding boxes.
+ * @param {global int*}          leftChild   Left child of each internal node.
+ * @param {global int*}          rightChild  Right child of each internal node.
+ * @param {global const int*}    parents     Parent of each node.
+ * @param {global float4*}       nodeMin     Output: Minimum of the node bounding boxes.
+ * @param {global float4*}       nodeMax     Output: Maximum of the node bounding boxes.
+ * @param {global uint*}         treeSize    Output: Number of nodes in the sub-tree of each node.
+ * @param {global uint*}         visited     Visit counter of each internal node.
+ */
+kernel void lbvhBuildBounds(
+	const int numFaces, global const uint* sortedFaces,
+	global const float4* faceMin, global const float4* faceMax,
+	global int* leftChild, global int* rightChild, global const int* parents,
+	global volatile float4* nodeMin, global volatile float4* nodeMax,
+	global volatile uint* treeSize, global uint* visited
+) {
+	const int i = get_global_id( 0 );
+	const int leaf = numFaces - 1 + i;
+	const uint face = sortedFaces[i];
+
+	nodeMin[leaf] = faceMin[face];
+	nodeMax[leaf] = faceMax[face];
+	treeSize[leaf] = 1;
+
+	int node = parents[leaf];
+
+	while( node >= 0 ) {
+		// Make the written node visible before the sibling work-item can read it.
+		mem_fence( CLK_GLOBAL_MEM_FENCE );
+
+		// First to arrive. The sibling sub-tree is not done yet.
+		if( atomic_inc( &visited[node] ) == 0 ) {
+			return;
+		}
+
+		const int left = leftChild[node];
+		const int right = rightChild[node];
+		const float4 leftMin = nodeMin[left];
+		const float4 leftMax = nodeMax[left];
+		const float4 rightMin = nodeMin[right];
+		const float4 rightMax = nodeMax[right];
+
+		nodeMin[node] = fmin( leftMin, rightMin );
+		nodeMax[node] = fmax( leftMax, rightMax );
+		treeSize[node] = 1 + treeSize[left] + treeSize[right];
+
+		if( surfaceArea( rightMin, rightMax ) > surfaceArea( leftMin, leftMax ) ) {
+			leftChild[node] = right;
+			rightChild[node] = left;
+		}
+
+		node = parents[node];
+	}
+}
+
+
+/**
+ * KERNEL.
+ * Write the nodes in depth-first order into the BVH buffer used by the path tracer.
+ * The position of a node is found by walking up to the root: Each step adds 1
+ * for the parent and, if coming from the right, the size of the left sub-tree.
+ * One work-item per node.
+ * @param {const int}            numFaces    Number of faces.
+ * @param {global const uint*}   sortedFaces Face indices ordered by Morton code.
+ * @param {global const int*}    leftChild   Left child of each internal node.
+ * @param {global const int*}    rightChild  Right child of each internal node.
+ * @param {global const int*}    parents     Parent of each node.
+ * @param {global const float4*} nodeMin     Minimum of the node bounding boxes.
+ * @param {global const float4*} nodeMax     Maximum of the node bounding boxes.
+ * @param {global const uint*}   treeSize    Number of nodes in the sub-tree of each node.
+ * @param {global bvhNode*}      bvh         Output: The BVH nodes.
+ */
+kernel void lbvhWriteNodes(
+	const int numFaces, global const uint* sortedFaces,
+	global const int* leftChild, global const int* rightChild, global const int* parents,
+	global const float4* nodeMin, global const float4* nodeMax, global const uint* treeSize,
+	global bvhNode* bvh
+) {
+	const int node = get_global_id( 0 );
+	int pos = 0;
+	int current = node;
+	int parent = parents[node];
+
+	while( parent >= 0 ) {
+		pos += ( rightChild[parent] == current ) ? 1 + treeSize[leftChild[parent]] : 1;
+		current = parent;
+		parent = parents[parent];
+	}
+
+	bvhNode out;
+	out.bbMin = nodeMin[node];
+	out.bbMax = nodeMax[node];
+
+	// Leaf node: Index of the face. Always one face per leaf node.
+	if( node >= numFaces - 1 ) {
+		out.bbMin.w = as_float( sortedFaces[node - ( numFaces - 1 )] );
+		out.bbMax.w = as_float( 1 );
+	}
+	// Inner node: Next node to visit after the sub-tree.
+	else {
+		out.bbMin.w = as_float( -1 );
+		out.bbMax.w = as_float( (int) ( pos + treeSize[node] ) );
+	}
+
+	bvh[pos] = out;
+}
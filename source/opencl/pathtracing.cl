@@ -7,7 +7,7 @@
 #FILE:pt_intersect.cl:FILE#
 
 
-#if ACCEL_STRUCT == 0
+#if ACCEL_STRUCT == 0 || ACCEL_STRUCT == 1 || ACCEL_STRUCT == 2
 	#FILE:pt_bvh.cl:FILE#
 #endif
 
@@ -15,6 +15,7 @@
 
 /**
  * Generate the initial ray into the scene.
+ * @param  {const int2}   pos     Position of the pixel.
  * @param  {const float}  pxDim   Pixel width and height.
  * @param  {const camera} cam     The camera model.
  * @param  {float*}       seed    Seed for the random number generator.
@@ -23,10 +24,8 @@
  * @return {ray4}                 The ray including adjustments for anti-aliasing and depth-of-field.
  */
 ray4 initRay(
-	const float pxDim, const camera cam, float* seed, float tFocus, float tObject
+	const int2 pos, const float pxDim, const camera cam, float* seed, float tFocus, float tObject
 ) {
-	const int2 pos = { get_global_id( 0 ), get_global_id( 1 ) };
-
 	const float3 initialRay = cam.w + pxDim * 0.5f * (
 		cam.u - IMG_WIDTH * cam.u + 2.0f * pos.x * cam.u +
 		cam.v - IMG_HEIGHT * cam.v + 2.0f * pos.y * cam.v
@@ -51,12 +50,12 @@ ray4 initRay(
 /**
  * Get the t factor for the hit object of this ray and
  * the center ray of the previous frame.
+ * @param  {const int2}          pos     Position of the pixel.
  * @param  {const camera cam}    cam
  * @param  {read_only image2d_t} imageIn
  * @return {float2}
  */
-float2 getPreviousFocus( const camera cam, read_only image2d_t imageIn ) {
-	const int2 pos = { get_global_id( 0 ), get_global_id( 1 ) };
+float2 getPreviousFocus( const int2 pos, const camera cam, read_only image2d_t imageIn ) {
 	const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
 	const float4 thisRayPixel = read_imagef( imageIn, sampler, pos );
 	const float4 centerRayPixel = read_imagef( imageIn, sampler, cam.focusPoint );
@@ -65,16 +64,89 @@ float2 getPreviousFocus( const camera cam, read_only image2d_t imageIn ) {
 }
 
 
+#if STATISTICS == 1
+
+	/**
+	 * Write the tested faces and nodes of a pixel to the debug image,
+	 * relative to the number of faces and nodes of the scene.
+	 * @param {const int2}           pos        Position of the pixel.
+	 * @param {write_only image2d_t} imageDebug
+	 * @param {const uint4}          stats      Counters of the pixel.
+	 */
+	void writeDebugImage( const int2 pos, write_only image2d_t imageDebug, const uint4 stats ) {
+		const float4 color = (float4)(
+			stats.y / (float) NUM_FACES,
+			stats.x / (float) BVH_NUM_NODES,
+			0.0f, 0.0f
+		);
+		write_imagef( imageDebug, pos, color );
+	}
+
+#endif
+
+
 /**
- * Write color to the debug image.
- * @param {write_only image2d_t} imageDebug
- * @param {const float4}         color
+ * Get the color a shadow ray adds to the final color, if the light source is not blocked.
+ * @param  {const ray4*}     ray            The ray that hit the surface.
+ * @param  {const ray4*}     lightRay       The shadow ray from the hit point to the light source.
+ * @param  {const material*} mtl            Material of the hit surface.
+ * @param  {const float4}    lightRaySource Color of the light source.
+ * @param  {const float4}    color          Accumulated color of the path so far.
+ * @param  {float4*}         shadowColor    Output. Color to add to the final color.
+ * @return {bool}                           False, if the light doesn't add anything.
  */
-void writeDebugImage( write_only image2d_t imageDebug, float4 color ) {
-	const int2 pos = { get_global_id( 0 ), get_global_id( 1 ) };
-	color.x /= 1082.0f; // number of faces in the test model
-	color.y /= 1265.0f; // number of BVH nodes in the test model
-	write_imagef( imageDebug, pos, color );
+bool getShadowRayColor(
+	const ray4* ray, const ray4* lightRay, const material* mtl,
+	const float4 lightRaySource, const float4 color, float4* shadowColor
+) {
+	// BRDF: Schlick
+	#if BRDF == 0
+
+		float brdf, pdf, u;
+
+		brdf = brdfSchlick( mtl, ray, lightRay, &( ray->normal ), &u, &pdf );
+
+		if( fabs( pdf ) <= 0.00001f ) {
+			return false;
+		}
+
+		brdf *= lambert( ray->normal, lightRay->dir );
+		brdf = native_divide( brdf, pdf );
+
+		*shadowColor = color * lightRaySource * mtl->rgbDiff *
+			( fresnel4( u, mtl->rgbSpec ) * brdf * mtl->data.s0 + ( 1.0f - mtl->data.s0 ) );
+
+	// BRDF: Shirley/Ashikhmin
+	#elif BRDF == 1
+
+		float brdfDiff, brdfSpec, pdf;
+		float4 brdf_d, brdf_s;
+		float dotHK1;
+
+		brdfShirleyAshikhmin(
+			mtl->data.s2, mtl->data.s3, mtl->data.s4, mtl->data.s5,
+			ray, lightRay, &( ray->normal ), &brdfSpec, &brdfDiff, &dotHK1, &pdf
+		);
+
+		if( fabs( pdf ) <= 0.00001f ) {
+			return false;
+		}
+
+		brdfSpec = native_divide( brdfSpec, pdf );
+		brdfDiff = native_divide( brdfDiff, pdf );
+
+		brdf_s = brdfSpec * mtl->rgbSpec * fresnel( dotHK1, mtl->data.s4 );
+		brdf_d = brdfDiff * mtl->rgbDiff * ( 1.0f - mtl->data.s4 );
+
+		float4 brdfColor = ( brdf_s + brdf_d ) * mtl->data.s0 + ( 1.0f - mtl->data.s0 );
+		float maxRGB = max( 1.0f, max( brdfColor.x, max( brdfColor.y, brdfColor.z ) ) );
+		brdfColor /= maxRGB;
+
+		*shadowColor = clamp( brdfColor, 0.0f, 1.0f ) * lightRaySource * mtl->data.s0 + ( 1.0f - mtl->data.s0 );
+
+	#endif
+
+	return true;
 }
 
 
@@ -94,28 +166,24 @@ void updateColor(
 	const ray4* lightRay, const float4 lightRaySource, uint* secondaryPaths,
 	float4* color, float4* finalColor
 ) {
-	// BRDF: Schlick
-	#if BRDF == 0
-
-		float brdf, pdf, u;
-
-		#if SHADOW_RAYS == 1
+	#if SHADOW_RAYS == 1
 
-			if( lightRaySource.x >= 0 ) {
-				brdf = brdfSchlick( mtl, ray, lightRay, &( ray->normal ), &u, &pdf );
+		float4 shadowColor;
 
-				if( fabs( pdf ) > 0.00001f ) {
-					brdf *= lambert( ray->normal, lightRay->dir );
-					brdf = native_divide( brdf, pdf );
+		if(
+			lightRaySource.x >= 0 &&
+			getShadowRayColor( ray, lightRay, mtl, lightRaySource, *color, &shadowColor )
+		) {
+			*finalColor += shadowColor;
+			*secondaryPaths += 1;
+		}
 
-					*finalColor += *color * lightRaySource * mtl->rgbDiff *
-						( fresnel4( u, mtl->rgbSpec ) * brdf * mtl->data.s0 + ( 1.0f - mtl->data.s0 ) );
+	#endif
 
-					*secondaryPaths += 1;
-				}
-			}
+	// BRDF: Schlick
+	#if BRDF == 0
 
-		#endif
+		float brdf, pdf, u;
 
 		brdf = brdfSchlick( mtl, ray, newRay, &( ray->normal ), &u, &pdf );
 		brdf *= lambert( ray->normal, newRay->dir );
@@ -130,33 +198,6 @@ void updateColor(
 		float4 brdf_d, brdf_s;
 		float dotHK1;
 
-		#if SHADOW_RAYS == 1
-
-			if( lightRaySource.x >= 0 ) {
-				brdfShirleyAshikhmin(
-					mtl->data.s2, mtl->data.s3, mtl->data.s4, mtl->data.s5,
-					ray, lightRay, &( ray->normal ), &brdfSpec, &brdfDiff, &dotHK1, &pdf
-				);
-
-				if( fabs( pdf ) > 0.00001f ) {
-					brdfSpec = native_divide( brdfSpec, pdf );
-					brdfDiff = native_divide( brdfDiff, pdf );
-
-					brdf_s = brdfSpec * mtl->rgbSpec * fresnel( dotHK1, mtl->data.s4 );
-					brdf_d = brdfDiff * mtl->rgbDiff * ( 1.0f - mtl->data.s4 );
-
-					float4 brdfColor = ( brdf_s + brdf_d ) * mtl->data.s0 + ( 1.0f - mtl->data.s0 );
-					float maxRGB = max( 1.0f, max( brdfColor.x, max( brdfColor.y, brdfColor.z ) ) );
-					brdfColor /= maxRGB;
-
-					*finalColor += clamp( brdfColor, 0.0f, 1.0f ) * lightRaySource * mtl->data.s0 + ( 1.0f - mtl->data.s0 );
-
-					*secondaryPaths += 1;
-				}
-			}
-
-		#endif
-
 		brdfShirleyAshikhmin(
 			mtl->data.s2, mtl->data.s3, mtl->data.s4, mtl->data.s5,
 			ray, newRay, &( ray->normal ), &brdfSpec, &brdfDiff, &dotHK1, &pdf
@@ -178,6 +219,22 @@ void updateColor(
 }
 
 
+/**
+ * Get the shadow ray from the hit point of a ray to the light source.
+ * @param  {const Scene*} scene
+ * @param  {const ray4*}  ray      The ray that hit a surface.
+ * @param  {ray4*}        lightRay Output. The shadow ray. <t> is the distance to the light source.
+ * @return {float}                 Distance to the light source.
+ */
+float initShadowRay( const Scene* scene, const ray4* ray, ray4* lightRay ) {
+	lightRay->origin = fma( ray->t, ray->dir, ray->origin );
+	lightRay->dir = fast_normalize( scene->lights[0].pos.xyz - lightRay->origin );
+	lightRay->t = length( scene->lights[0].pos.xyz - lightRay->origin );
+
+	return lightRay->t;
+}
+
+
 /**
  * Shoot shadow rays to the light sources.
  * @param {Scene*}  scene
@@ -185,13 +242,10 @@ void updateColor(
  * @param {ray4*}   lightRay
  * @param {float4*} lightRaySource
  */
-void shadowRayTest( Scene* scene, ray4* ray, ray4* lightRay, float4* lightRaySource ) {
-	lightRay->origin = fma( ray->t, ray->dir, ray->origin );
-	lightRay->dir = fast_normalize( scene->lights[0].pos.xyz - lightRay->origin );
-	float tLight = length( scene->lights[0].pos.xyz - lightRay->origin );
-	lightRay->t = tLight;
+void shadowRayTest( Scene* scene, ray4* ray, ray4* lightRay, float4* lightRaySource BVH_IMAGES_PARAMS ) {
+	const float tLight = initShadowRay( scene, ray, lightRay );
 
-	traverseShadows( scene, lightRay );
+	traverseShadows( scene, lightRay BVH_IMAGES_ARGS );
 
 	if( lightRay->t >= tLight ) {
 		*lightRaySource = scene->lights[0].rgb;
@@ -201,48 +255,35 @@ void shadowRayTest( Scene* scene, ray4* ray, ray4* lightRay, float4* lightRaySou
 
 
 /**
- * KERNEL.
- * Do the path tracing and calculate the final color for the pixel.
+ * Do the path tracing for one pixel and write the final color to the output image.
+ * @param {Scene*}                 scene       The scene. Its counters are reset.
+ * @param {global const material*} materials   Materials of the faces.
+ * @param {const int2}             pos         Position of the pixel.
+ * @param {float}                  seed        Seed for the random number generator.
+ * @param {const float}            pixelWeight Mixing weight of the new color with the old one.
+ * @param {const float}            pxDim       Pixel width and height.
+ * @param {const camera}           cam         The camera model.
+ * @param {read_only image2d_t}    imageIn     The previously generated image.
+ * @param {write_only image2d_t}   imageOut    Output.
+ * @param {write_only image2d_t}   imageDebug  Output of the counters (statistics mode).
  */
-kernel void pathTracing(
-	// changing values
-	float seed,
-	const float pixelWeight,
-
-	// view
-	const float pxDim,
-	const camera cam,
-
-	// acceleration structure
-	#if ACCEL_STRUCT == 0
-		global const bvhNode* bvh,
-	#endif
-
-	// geometry and color related
-	global const uint4* facesV,
-	global const uint4* facesN,
-	global const float4* vertices,
-	global const float4* normals,
-	global const material* materials,
-	global const light_t* lights,
-
-	// old and new frame
-	read_only image2d_t imageIn,
-	write_only image2d_t imageOut,
-
-	write_only image2d_t imageDebug
+void tracePixel(
+	Scene* scene, global const material* materials, const int2 pos, float seed,
+	const float pixelWeight, const float pxDim, const camera cam,
+	read_only image2d_t imageIn, write_only image2d_t imageOut, write_only image2d_t imageDebug
+	BVH_IMAGES_PARAMS
 ) {
 	float4 finalColor = (float4)( 0.0f );
 
-	#if ACCEL_STRUCT == 0
-		Scene scene = { bvh, lights, facesV, facesN, vertices, normals, (float4)( 0.0f ) };
+	#if STATISTICS == 1
+		scene->stats = (uint4)( 0 );
 	#endif
 
 	float focus = 0.0f;
 	float2 prevFocus = (float2)( -1.0f, -1.0f );
 
 	if( cam.focusPoint.x >= 0 && cam.focusPoint.y >= 0 ) {
-		prevFocus = getPreviousFocus( cam, imageIn );
+		prevFocus = getPreviousFocus( pos, cam, imageIn );
 	}
 
 	bool addDepth;
@@ -252,20 +293,24 @@ kernel void pathTracing(
 		float4 color = (float4)( 1.0f );
 		float4 light = (float4)( -1.0f );
 
-		ray4 ray = initRay( pxDim, cam, &seed, prevFocus.y, prevFocus.x );
+		ray4 ray = initRay( pos, pxDim, cam, &seed, prevFocus.y, prevFocus.x );
 		int depthAdded = 0;
 
 		for( uint depth = 0; depth < MAX_DEPTH + depthAdded; depth++ ) {
-			traverse( &scene, &ray );
+			traverse( scene, &ray BVH_IMAGES_ARGS );
+
+			#if STATISTICS == 1
+				scene->stats.z++;
+			#endif
 
 			focus = ( sample + depth == 0 ) ? ray.t : focus;
 
 			if( ray.t == INFINITY ) {
-				light = ( ray.hitFace < 0 ) ? (float4)( scene.lights[-( ray.hitFace + 1 )].rgb ) : SKY_LIGHT;
+				light = ( ray.hitFace < 0 ) ? (float4)( scene->lights[-( ray.hitFace + 1 )].rgb ) : SKY_LIGHT;
 				break;
 			}
 
-			material mtl = materials[scene.facesV[ray.hitFace].w];
+			material mtl = materials[scene->facesV[ray.hitFace].w];
 
 			// Last round, no need to calculate a new ray.
 			// Unless we hit a material that extends the path.
@@ -284,7 +329,11 @@ kernel void pathTracing(
 			#if SHADOW_RAYS == 1
 				#if NUM_LIGHTS > 0
 					if( mtl.data.s0 > 0.0f ) {
-						shadowRayTest( &scene, &ray, &lightRay, &lightRaySource );
+						shadowRayTest( scene, &ray, &lightRay, &lightRaySource BVH_IMAGES_ARGS );
+
+						#if STATISTICS == 1
+							scene->stats.w++;
+						#endif
 					}
 				#endif
 			#endif
@@ -329,6 +378,116 @@ kernel void pathTracing(
 		finalColor /= (float) SAMPLES;
 	#endif
 
-	setColors( imageIn, imageOut, pixelWeight, finalColor, focus );
-	writeDebugImage( imageDebug, scene.debugColor );
+	setColors( pos, imageIn, imageOut, pixelWeight, finalColor, focus );
+
+	#if STATISTICS == 1
+		writeDebugImage( pos, imageDebug, scene->stats );
+	#endif
+}
+
+
+
+/**
+ * KERNEL.
+ * Do the path tracing and calculate the final color for the pixel.
+ * With persistent threads only enough work-items to fill the device are
+ * started. Each one takes the next pixel from a global counter as soon as
+ * its path is done, until all pixels of the frame are done.
+ * In the statistics mode the counters of each pixel are written to a buffer.
+ */
+kernel void pathTracing(
+	// changing values
+	float seed,
+	const float pixelWeight,
+
+	// view
+	const float pxDim,
+	const camera cam,
+
+	// acceleration structure
+	#if ACCEL_STRUCT == 0
+		global const bvhNodeData* bvh,
+	#elif ACCEL_STRUCT == 1
+		global const bvhNode* bvh,
+		global const bvhInstance* instances,
+	#elif ACCEL_STRUCT == 2
+		global const bvhNode* bvh,
+	#endif
+
+	// geometry and color related
+	global const triangle_t* triangles,
+	global const uint4* facesV,
+	global const uint4* facesN,
+	global const float4* vertices,
+	global const float4* normals,
+	global const material* materials,
+	global const light_t* lights,
+
+	// BVH nodes and triangles as images, instead of "bvh" and "triangles"
+	#if BVH_TEX_DIM > 0
+		read_only image2d_t bvhImage,
+		read_only image2d_t triImage,
+	#endif
+
+	// next pixel to trace (persistent threads)
+	#if PERSISTENT_THREADS > 0
+		global uint* pixelCounter,
+	#endif
+
+	// counters of each pixel (statistics mode)
+	#if STATISTICS == 1
+		global uint4* stats,
+	#endif
+
+	// old and new frame
+	read_only image2d_t imageIn,
+	write_only image2d_t imageOut,
+
+	write_only image2d_t imageDebug
+) {
+	#if ACCEL_STRUCT == 0 || ACCEL_STRUCT == 2
+		Scene scene = { bvh, lights, triangles, facesV, facesN, vertices, normals };
+	#elif ACCEL_STRUCT == 1
+		Scene scene = { bvh, instances, lights, triangles, facesV, facesN, vertices, normals };
+	#endif
+
+	#if PERSISTENT_THREADS > 0
+
+		uint pixel = atomic_inc( pixelCounter );
+
+		while( pixel < IMG_WIDTH * IMG_HEIGHT ) {
+			const int2 pos = { pixel % IMG_WIDTH, pixel / IMG_WIDTH };
+
+			tracePixel(
+				&scene, materials, pos, seed, pixelWeight, pxDim, cam,
+				imageIn, imageOut, imageDebug BVH_IMAGES_ARGS
+			);
+
+			#if STATISTICS == 1
+				stats[pixel] = scene.stats;
+			#endif
+
+			pixel = atomic_inc( pixelCounter );
+		}
+
+	#else
+
+		const int2 pos = { get_global_id( 0 ), get_global_id( 1 ) };
+
+		tracePixel(
+			&scene, materials, pos, seed, pixelWeight, pxDim, cam,
+			imageIn, imageOut, imageDebug BVH_IMAGES_ARGS
+		);
+
+		#if STATISTICS == 1
+			stats[pos.y * IMG_WIDTH + pos.x] = scene.stats;
+		#endif
+
+	#endif
 }
+
+
+
+#if WAVEFRONT == 1
+	#FILE:pt_wavefront.cl:FILE#
+#endif
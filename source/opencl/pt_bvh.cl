@@ -1,6 +1,6 @@
 /**
  * Test face for intersections with the given ray and update the ray.
- * @param {const Scene*}      scene
+ * @param {Scene*}            scene
  * @param {ray4*}             ray
  * @param {const int}         faceIndex
  * @param {float3*}           tuv
@@ -8,11 +8,11 @@
  * @param {float tFar}        tFar
  */
 void intersectFace(
-	const Scene* scene, ray4* ray,
+	STATS_CONST Scene* scene, ray4* ray,
 	const int faceIndex, float* t,
-	const float tNear, float tFar
+	const float tNear, float tFar BVH_IMAGES_PARAMS
 ) {
-	const float3 normal = checkFaceIntersection( scene, ray, faceIndex, t, tNear, tFar );
+	const float3 normal = checkFaceIntersection( scene, ray, faceIndex, t, tNear, tFar BVH_IMAGES_ARGS );
 
 	if( ray->t > *t ) {
 		ray->normal = normal;
@@ -20,30 +20,38 @@ void intersectFace(
 		ray->t = *t;
 	}
 
-	scene->debugColor.x += 1.0f;
+	#if STATISTICS == 1
+		scene->stats.y++;
+	#endif
 }
 
 
-/**
- * Test faces of the given node for intersections with the given ray.
- * @param {const Scene*}      scene
- * @param {ray4*}             ray
- * @param {const bvhNode*}    node
- * @param {const float tNear} tNear
- * @param {float tFar}        tFar
- */
-void intersectFaces( const Scene* scene, ray4* ray, const bvhNode* node, const float tNear, float tFar ) {
-	float t = INFINITY;
+#if ACCEL_STRUCT == 0 || ACCEL_STRUCT == 1
 
-	intersectFace( scene, ray, node->bbMin.w, &t, tNear, tFar );
 
-	// Second face, if existing.
-	if( node->bbMax.w == -1 ) {
-		return;
+	/**
+	 * Test faces of the given node for intersections with the given ray.
+	 * @param {Scene*}            scene
+	 * @param {ray4*}             ray
+	 * @param {const bvhNode*}    node
+	 * @param {const float tNear} tNear
+	 * @param {float tFar}        tFar
+	 */
+	void intersectFaces(
+		STATS_CONST Scene* scene, ray4* ray, const bvhNode* node, const float tNear, float tFar BVH_IMAGES_PARAMS
+	) {
+		float t = INFINITY;
+		const int first = as_int( node->bbMin.w );
+		const int last = first + as_int( node->bbMax.w );
+
+		// The faces of a leaf node are stored one after another.
+		for( int i = first; i < last; i++ ) {
+			intersectFace( scene, ray, i, &t, tNear, tFar BVH_IMAGES_ARGS );
+		}
 	}
 
-	intersectFace( scene, ray, node->bbMax.w, &t, tNear, tFar );
-}
+
+#endif
 
 
 /**
@@ -74,104 +82,764 @@ void traverseLights( const Scene* scene, ray4* ray ) {
 }
 
 
-/**
- * Traverse the BVH without using a stack and test the faces against the given ray.
- * @param {const Scene*} scene
- * @param {ray4*}        ray
- */
-void traverse( const Scene* scene, ray4* ray ) {
-	const float3 invDir = native_recip( ray->dir );
-	int index = 1; // Skip the root node (0) and start with the left child node.
+#if ACCEL_STRUCT == 0
 
-	traverseLights( scene, ray );
 
-	do {
-		scene->debugColor.y += 1.0f;
-		const bvhNode node = scene->bvh[index];
-		int currentIndex = index;
+	/**
+	 * Get a node of the BVH. Compact nodes are decoded into the regular layout.
+	 * Nodes stored as image take two texels.
+	 * @param  {const Scene*} scene
+	 * @param  {const int}    index Index of the node.
+	 * @return {bvhNode}            The node.
+	 */
+	bvhNode getNode( const Scene* scene, const int index BVH_IMAGES_PARAMS ) {
+		#if BVH_COMPACT == 1
 
-		// To save memory, we interpret <node.bbMax.w> depending on the situation:
-		// - For a leaf node <node.bbMax.w> is a face index.
-		// - Otherwise it is the index of the next node to visit.
-		// <node.bbMin.w> is used as face index, too. If it is -1.0f the node is NOT a leaf node.
-		//
-		// If a node has a left child, it will always be next in memory (index + 1).
-		// Also, if a node is a leaf node, the next node to visit (a right sibling or
-		// right child of a distinct parent) will also be next in memory (index + 1).
+			const global half* bb = (const global half*) &( scene->bvh[index] );
+			const uint data = scene->bvh[index].w;
+			const bool isLeaf = ( data >> 31 );
 
-		index = ( node.bbMin.w <= -1.0f ) ? (int) node.bbMax.w : currentIndex + 1;
+			bvhNode node;
+			node.bbMin = (float4)( vload_half3( 0, bb ), 0.0f );
+			node.bbMax = (float4)( vload_half3( 1, bb ), 0.0f );
 
-		float tNear = 0.0f;
-		float tFar = INFINITY;
+			if( isLeaf ) {
+				node.bbMin.w = as_float( (int) ( ( data >> 8 ) & 0x7FFFFF ) );
+				node.bbMax.w = as_float( (int) ( data & 0xFF ) );
+			}
+			else {
+				node.bbMin.w = as_float( ( data & 0x40000000 ) ? -2 : -1 );
+				node.bbMax.w = as_float( (int) ( data & 0x3FFFFFFF ) );
+			}
 
-		bool isNodeHit = (
-			intersectBox( ray, &invDir, node.bbMin, node.bbMax, &tNear, &tFar ) &&
-			tFar > EPSILON5 && ray->t > tNear
-		);
+			return node;
 
-		if( !isNodeHit ) {
-			continue;
-		}
+		#elif BVH_TEX_DIM > 0
+
+			bvhNode node;
+			node.bbMin = readTexel( bvhImage, index * 2 );
+			node.bbMax = readTexel( bvhImage, index * 2 + 1 );
+
+			return node;
+
+		#else
+
+			return scene->bvh[index];
+
+		#endif
+	}
+
+
+#endif
+
+
+#if ACCEL_STRUCT == 0 && BVH_TRAVERSAL == 0
+
+
+	/**
+	 * Traverse the BVH without using a stack and test the faces against the given ray.
+	 * @param {Scene*}       scene
+	 * @param {ray4*}        ray
+	 */
+	void traverse( STATS_CONST Scene* scene, ray4* ray BVH_IMAGES_PARAMS ) {
+		const float3 invDir = native_recip( ray->dir );
+		int index = 1; // Skip the root node (0) and start with the left child node.
+
+		traverseLights( scene, ray );
+
+		do {
+			#if STATISTICS == 1
+				scene->stats.x++;
+			#endif
+
+			const bvhNode node = getNode( scene, index BVH_IMAGES_ARGS );
+			int currentIndex = index;
+
+			// To save memory, we interpret <node.bbMax.w> depending on the situation:
+			// - For a leaf node <node.bbMax.w> is the number of faces.
+			// - Otherwise it is the index of the next node to visit.
+			// <node.bbMin.w> is the index of the first face. If it is -1 the node is NOT a leaf node.
+			// Both hold the bits of an int, so indices stay exact beyond 2^24.
+			//
+			// If a node has a left child, it will always be next in memory (index + 1).
+			// Also, if a node is a leaf node, the next node to visit (a right sibling or
+			// right child of a distinct parent) will also be next in memory (index + 1).
+
+			index = ( as_int( node.bbMin.w ) < 0 ) ? as_int( node.bbMax.w ) : currentIndex + 1;
+
+			float tNear = 0.0f;
+			float tFar = INFINITY;
+
+			bool isNodeHit = (
+				intersectBox( ray, &invDir, node.bbMin, node.bbMax, &tNear, &tFar ) &&
+				tFar > EPSILON5 && ray->t > tNear
+			);
+
+			if( !isNodeHit ) {
+				continue;
+			}
+
+			index = currentIndex + 1;
+
+			// Node is leaf node. Test faces.
+			if( as_int( node.bbMin.w ) >= 0 ) {
+				intersectFaces( scene, ray, &node, tNear, tFar BVH_IMAGES_ARGS );
+			}
+		} while( index > 0 && index < BVH_NUM_NODES );
+	}
 
-		index = currentIndex + 1;
 
-		// Node is leaf node. Test faces.
-		if( node.bbMin.w >= 0.0f ) {
-			intersectFaces( scene, ray, &node, tNear, tFar );
+	/**
+	 * Traverse the BVH and test the faces against the given ray.
+	 * This version is for the shadow ray test, so it only checks IF there
+	 * is an intersection and terminates on the first hit.
+	 * @param {Scene*}       scene
+	 * @param {ray4*}        ray
+	 */
+	void traverseShadows( STATS_CONST Scene* scene, ray4* ray BVH_IMAGES_PARAMS ) {
+		float tLight = ray->t;
+		const float3 invDir = native_recip( ray->dir );
+		int index = 1;
+
+		traverseLights( scene, ray );
+
+		do {
+			const bvhNode node = getNode( scene, index BVH_IMAGES_ARGS );
+			int currentIndex = index;
+
+			// @see traverse() for an explanation.
+			index = ( as_int( node.bbMin.w ) < 0 ) ? as_int( node.bbMax.w ) : currentIndex + 1;
+
+			float tNear = 0.0f;
+			float tFar = INFINITY;
+
+			bool isNodeHit = (
+				intersectBox( ray, &invDir, node.bbMin, node.bbMax, &tNear, &tFar ) &&
+				tFar > EPSILON5
+			);
+
+			if( !isNodeHit ) {
+				continue;
+			}
+
+			index = currentIndex + 1;
+
+			// Skip the next left child node.
+			if( as_int( node.bbMin.w ) == -2 ) {
+				index++;
+			}
+
+			// Node is leaf node. Test faces.
+			if( as_int( node.bbMin.w ) >= 0 ) {
+				intersectFaces( scene, ray, &node, tNear, tFar BVH_IMAGES_ARGS );
+
+				// It's enough to know that something blocks the way. It doesn't matter what or where.
+				// TODO: It *does* matter what and where, if the material has transparency.
+				if( ray->t < tLight ) {
+					break;
+				}
+			}
+		} while( index > 0 && index < BVH_NUM_NODES );
+	}
+
+
+#elif ACCEL_STRUCT == 0 && BVH_TRAVERSAL == 1
+
+
+	/**
+	 * Get the right child node of an inner node. The left child node is always next in
+	 * memory. If it is an inner node, its next node to visit is its right sibling.
+	 * Otherwise the right child node follows right after the left leaf node.
+	 * @param  {const int}      left     Index of the left child node.
+	 * @param  {const bvhNode*} leftNode The left child node.
+	 * @return {int}                     Index of the right child node.
+	 */
+	int getRightChild( const int left, const bvhNode* leftNode ) {
+		return ( as_int( leftNode->bbMin.w ) >= 0 ) ? left + 1 : as_int( leftNode->bbMax.w );
+	}
+
+
+	/**
+	 * Traverse the BVH with a stack and test the faces against the given ray.
+	 * Both child nodes are tested at once. Leaf nodes are intersected right away.
+	 * Of two hit inner nodes the nearer one is visited first and the farther one
+	 * is pushed onto the stack with its entry distance, so it can be skipped if
+	 * a closer hit has been found by the time it is popped.
+	 * @param {Scene*}       scene
+	 * @param {ray4*}        ray
+	 */
+	void traverse( STATS_CONST Scene* scene, ray4* ray BVH_IMAGES_PARAMS ) {
+		const float3 invDir = native_recip( ray->dir );
+		int stack[BVH_STACK_SIZE];
+		float stackNear[BVH_STACK_SIZE];
+		int stackIndex = 0;
+		int index = 0;
+
+		traverseLights( scene, ray );
+
+		// Only one leaf node. Nothing to traverse.
+		const bvhNode root = getNode( scene, 0 BVH_IMAGES_ARGS );
+
+		if( as_int( root.bbMin.w ) >= 0 ) {
+			intersectFaces( scene, ray, &root, 0.0f, INFINITY BVH_IMAGES_ARGS );
+			return;
 		}
-	} while( index > 0 && index < BVH_NUM_NODES );
-}
 
+		while( true ) {
+			#if STATISTICS == 1
+				scene->stats.x += 2;
+			#endif
+
+			const int left = index + 1;
+			const bvhNode leftNode = getNode( scene, left BVH_IMAGES_ARGS );
+			const int right = getRightChild( left, &leftNode );
+			const bvhNode rightNode = getNode( scene, right BVH_IMAGES_ARGS );
+
+			float tNearL = 0.0f;
+			float tFarL = INFINITY;
+			float tNearR = 0.0f;
+			float tFarR = INFINITY;
+
+			bool isLeftHit = (
+				intersectBox( ray, &invDir, leftNode.bbMin, leftNode.bbMax, &tNearL, &tFarL ) &&
+				tFarL > EPSILON5 && ray->t > tNearL
+			);
+			bool isRightHit = (
+				intersectBox( ray, &invDir, rightNode.bbMin, rightNode.bbMax, &tNearR, &tFarR ) &&
+				tFarR > EPSILON5 && ray->t > tNearR
+			);
+
+			// Leaf nodes. Test faces.
+			if( isLeftHit && as_int( leftNode.bbMin.w ) >= 0 ) {
+				intersectFaces( scene, ray, &leftNode, tNearL, tFarL BVH_IMAGES_ARGS );
+				isLeftHit = false;
+			}
 
-/**
- * Traverse the BVH and test the faces against the given ray.
- * This version is for the shadow ray test, so it only checks IF there
- * is an intersection and terminates on the first hit.
- * @param {const Scene*} scene
- * @param {ray4*}        ray
- */
-void traverseShadows( const Scene* scene, ray4* ray ) {
-	float tLight = ray->t;
-	const float3 invDir = native_recip( ray->dir );
-	int index = 1;
+			if( isRightHit && as_int( rightNode.bbMin.w ) >= 0 && ray->t > tNearR ) {
+				intersectFaces( scene, ray, &rightNode, tNearR, tFarR BVH_IMAGES_ARGS );
+				isRightHit = false;
+			}
 
-	traverseLights( scene, ray );
+			// A face of a leaf node may be closer than the other node.
+			isLeftHit = isLeftHit && ray->t > tNearL;
+			isRightHit = isRightHit && ray->t > tNearR;
 
-	do {
-		const bvhNode node = scene->bvh[index];
-		int currentIndex = index;
+			if( isLeftHit && isRightHit ) {
+				const bool isLeftNear = ( tNearL <= tNearR );
 
-		// @see traverse() for an explanation.
-		index = ( node.bbMin.w <= -1.0f ) ? (int) node.bbMax.w : currentIndex + 1;
+				stack[stackIndex] = isLeftNear ? right : left;
+				stackNear[stackIndex] = isLeftNear ? tNearR : tNearL;
+				stackIndex++;
 
-		float tNear = 0.0f;
-		float tFar = INFINITY;
+				index = isLeftNear ? left : right;
+				continue;
+			}
 
-		bool isNodeHit = (
-			intersectBox( ray, &invDir, node.bbMin, node.bbMax, &tNear, &tFar ) &&
-			tFar > EPSILON5
-		);
+			if( isLeftHit || isRightHit ) {
+				index = isLeftHit ? left : right;
+				continue;
+			}
 
-		if( !isNodeHit ) {
-			continue;
+			// Pop the next node, unless a closer hit has been found since it was pushed.
+			index = -1;
+
+			while( stackIndex > 0 && index < 0 ) {
+				stackIndex--;
+				index = ( stackNear[stackIndex] < ray->t ) ? stack[stackIndex] : -1;
+			}
+
+			if( index < 0 ) {
+				break;
+			}
 		}
+	}
 
-		index = currentIndex + 1;
 
-		// Skip the next left child node.
-		if( node.bbMin.w == -2.0f ) {
-			index++;
+	/**
+	 * Traverse the BVH with a stack and test the faces against the given ray.
+	 * This version is for the shadow ray test, so it only checks IF there
+	 * is an intersection and terminates on the first hit. The order of the
+	 * child nodes doesn't matter for that.
+	 * @param {Scene*}       scene
+	 * @param {ray4*}        ray
+	 */
+	void traverseShadows( STATS_CONST Scene* scene, ray4* ray BVH_IMAGES_PARAMS ) {
+		float tLight = ray->t;
+		const float3 invDir = native_recip( ray->dir );
+		int stack[BVH_STACK_SIZE];
+		int stackIndex = 0;
+		int index = 0;
+
+		traverseLights( scene, ray );
+
+		const bvhNode root = getNode( scene, 0 BVH_IMAGES_ARGS );
+
+		if( as_int( root.bbMin.w ) >= 0 ) {
+			intersectFaces( scene, ray, &root, 0.0f, INFINITY BVH_IMAGES_ARGS );
+			return;
 		}
 
-		// Node is leaf node. Test faces.
-		if( node.bbMin.w >= 0.0f ) {
-			intersectFaces( scene, ray, &node, tNear, tFar );
+		while( true ) {
+			const int left = index + 1;
+			const bvhNode leftNode = getNode( scene, left BVH_IMAGES_ARGS );
+			const int right = getRightChild( left, &leftNode );
+			const bvhNode rightNode = getNode( scene, right BVH_IMAGES_ARGS );
+
+			float tNearL = 0.0f;
+			float tFarL = INFINITY;
+			float tNearR = 0.0f;
+			float tFarR = INFINITY;
+
+			bool isLeftHit = (
+				intersectBox( ray, &invDir, leftNode.bbMin, leftNode.bbMax, &tNearL, &tFarL ) &&
+				tFarL > EPSILON5
+			);
+			bool isRightHit = (
+				intersectBox( ray, &invDir, rightNode.bbMin, rightNode.bbMax, &tNearR, &tFarR ) &&
+				tFarR > EPSILON5
+			);
+
+			// Leaf nodes. Test faces.
+			if( isLeftHit && as_int( leftNode.bbMin.w ) >= 0 ) {
+				intersectFaces( scene, ray, &leftNode, tNearL, tFarL BVH_IMAGES_ARGS );
+				isLeftHit = false;
+			}
+
+			if( isRightHit && as_int( rightNode.bbMin.w ) >= 0 ) {
+				intersectFaces( scene, ray, &rightNode, tNearR, tFarR BVH_IMAGES_ARGS );
+				isRightHit = false;
+			}
 
 			// It's enough to know that something blocks the way. It doesn't matter what or where.
-			// TODO: It *does* matter what and where, if the material has transparency.
 			if( ray->t < tLight ) {
 				break;
 			}
+
+			if( isLeftHit && isRightHit ) {
+				stack[stackIndex++] = right;
+				index = left;
+			}
+			else if( isLeftHit || isRightHit ) {
+				index = isLeftHit ? left : right;
+			}
+			else if( stackIndex > 0 ) {
+				index = stack[--stackIndex];
+			}
+			else {
+				break;
+			}
 		}
-	} while( index > 0 && index < BVH_NUM_NODES );
-}
+	}
+
+
+#elif ACCEL_STRUCT == 1
+
+
+	/**
+	 * Transform the ray into the object space of an instance.
+	 * The direction is not normalized, so the distances <t> in
+	 * object space are the same as in world space.
+	 * @param {const Scene*} scene
+	 * @param {ray4*}        ray
+	 * @param {const int}    instance Index of the instance.
+	 * @param {const float3} origin   Origin of the ray in world space.
+	 * @param {const float3} dir      Direction of the ray in world space.
+	 * @param {float3*}      invDir   Output. Inverse of the transformed direction.
+	 */
+	void enterInstance(
+		const Scene* scene, ray4* ray, const int instance,
+		const float3 origin, const float3 dir, float3* invDir
+	) {
+		const float4 r0 = scene->instances[instance].worldToObject[0];
+		const float4 r1 = scene->instances[instance].worldToObject[1];
+		const float4 r2 = scene->instances[instance].worldToObject[2];
+
+		ray->origin = (float3)( dot( r0.xyz, origin ), dot( r1.xyz, origin ), dot( r2.xyz, origin ) ) + (float3)( r0.w, r1.w, r2.w );
+		ray->dir = (float3)( dot( r0.xyz, dir ), dot( r1.xyz, dir ), dot( r2.xyz, dir ) );
+		*invDir = native_recip( ray->dir );
+	}
+
+
+	/**
+	 * Transform the normal of a hit face from the object space of an instance into world space.
+	 * @param {const Scene*} scene
+	 * @param {ray4*}        ray
+	 * @param {const int}    instance Index of the instance.
+	 */
+	void normalToWorld( const Scene* scene, ray4* ray, const int instance ) {
+		const float4 r0 = scene->instances[instance].worldToObject[0];
+		const float4 r1 = scene->instances[instance].worldToObject[1];
+		const float4 r2 = scene->instances[instance].worldToObject[2];
+
+		// Transposed inverse of the object-to-world transformation.
+		ray->normal = fast_normalize( r0.xyz * ray->normal.x + r1.xyz * ray->normal.y + r2.xyz * ray->normal.z );
+	}
+
+
+	/**
+	 * Traverse the two-level BVH without using a stack and test the faces against the given ray.
+	 * The traversal starts in the top level. Hitting a leaf node of the top level
+	 * continues in the BVH of its object with the ray in object space. Reaching
+	 * the end of the nodes of the object continues in the top level.
+	 * @param {Scene*}       scene
+	 * @param {ray4*}        ray
+	 */
+	void traverse( STATS_CONST Scene* scene, ray4* ray BVH_IMAGES_PARAMS ) {
+		const float3 origin = ray->origin;
+		const float3 dir = ray->dir;
+		float3 invDir = native_recip( ray->dir );
+		int index = 0;
+		int instance = -1;
+		int instanceEnd = -1;
+		int returnIndex = 0;
+		int hitInstance = -1;
+
+		traverseLights( scene, ray );
+
+		do {
+			#if STATISTICS == 1
+				scene->stats.x++;
+			#endif
+
+			const bvhNode node = scene->bvh[index];
+			int currentIndex = index;
+
+			// @see the traverse() of the BVH for an explanation.
+			// A <node.bbMin.w> of -2 or less marks a leaf node of the top level.
+			index = ( as_int( node.bbMin.w ) < 0 ) ? as_int( node.bbMax.w ) : currentIndex + 1;
+
+			float tNear = 0.0f;
+			float tFar = INFINITY;
+
+			bool isNodeHit = (
+				intersectBox( ray, &invDir, node.bbMin, node.bbMax, &tNear, &tFar ) &&
+				tFar > EPSILON5 && ray->t > tNear
+			);
+
+			if( isNodeHit ) {
+				// Leaf node of the top level. Continue in the object.
+				if( as_int( node.bbMin.w ) <= -2 ) {
+					instance = -2 - as_int( node.bbMin.w );
+					enterInstance( scene, ray, instance, origin, dir, &invDir );
+
+					returnIndex = index;
+					index = scene->instances[instance].nodes.x;
+					instanceEnd = scene->instances[instance].nodes.y;
+				}
+				else {
+					index = currentIndex + 1;
+
+					// Node is leaf node. Test faces.
+					if( as_int( node.bbMin.w ) >= 0 ) {
+						const float t = ray->t;
+						intersectFaces( scene, ray, &node, tNear, tFar BVH_IMAGES_ARGS );
+						hitInstance = ( ray->t < t ) ? instance : hitInstance;
+					}
+				}
+			}
+
+			// Left the nodes of the object. Back to the top level.
+			if( index == instanceEnd ) {
+				ray->origin = origin;
+				ray->dir = dir;
+				invDir = native_recip( dir );
+
+				index = returnIndex;
+				instance = -1;
+				instanceEnd = -1;
+			}
+		} while( index > 0 && index < BVH_NUM_NODES );
+
+		ray->origin = origin;
+		ray->dir = dir;
+
+		if( hitInstance >= 0 ) {
+			normalToWorld( scene, ray, hitInstance );
+		}
+	}
+
+
+	/**
+	 * Traverse the two-level BVH and test the faces against the given ray.
+	 * This version is for the shadow ray test, so it only checks IF there
+	 * is an intersection and terminates on the first hit.
+	 * @param {Scene*}       scene
+	 * @param {ray4*}        ray
+	 */
+	void traverseShadows( STATS_CONST Scene* scene, ray4* ray BVH_IMAGES_PARAMS ) {
+		float tLight = ray->t;
+		const float3 origin = ray->origin;
+		const float3 dir = ray->dir;
+		float3 invDir = native_recip( ray->dir );
+		int index = 0;
+		int instance = -1;
+		int instanceEnd = -1;
+		int returnIndex = 0;
+
+		traverseLights( scene, ray );
+
+		do {
+			const bvhNode node = scene->bvh[index];
+			int currentIndex = index;
+
+			// @see traverse() for an explanation.
+			index = ( as_int( node.bbMin.w ) < 0 ) ? as_int( node.bbMax.w ) : currentIndex + 1;
+
+			float tNear = 0.0f;
+			float tFar = INFINITY;
+
+			bool isNodeHit = (
+				intersectBox( ray, &invDir, node.bbMin, node.bbMax, &tNear, &tFar ) &&
+				tFar > EPSILON5
+			);
+
+			if( isNodeHit ) {
+				// Leaf node of the top level. Continue in the object.
+				if( as_int( node.bbMin.w ) <= -2 ) {
+					instance = -2 - as_int( node.bbMin.w );
+					enterInstance( scene, ray, instance, origin, dir, &invDir );
+
+					returnIndex = index;
+					index = scene->instances[instance].nodes.x;
+					instanceEnd = scene->instances[instance].nodes.y;
+				}
+				else {
+					index = currentIndex + 1;
+
+					// Node is leaf node. Test faces.
+					if( as_int( node.bbMin.w ) >= 0 ) {
+						intersectFaces( scene, ray, &node, tNear, tFar BVH_IMAGES_ARGS );
+
+						// It's enough to know that something blocks the way. It doesn't matter what or where.
+						if( ray->t < tLight ) {
+							break;
+						}
+					}
+				}
+			}
+
+			// Left the nodes of the object. Back to the top level.
+			if( index == instanceEnd ) {
+				ray->origin = origin;
+				ray->dir = dir;
+				invDir = native_recip( dir );
+
+				index = returnIndex;
+				instance = -1;
+				instanceEnd = -1;
+			}
+		} while( index > 0 && index < BVH_NUM_NODES );
+
+		ray->origin = origin;
+		ray->dir = dir;
+	}
+
+
+#elif ACCEL_STRUCT == 2
+
+
+	/**
+	 * Test the quantized bounding box of a child of a wide node.
+	 * @param  {const ray4*}   ray
+	 * @param  {const float3*} invDir
+	 * @param  {const bvhNode*} node
+	 * @param  {const float3}  scale  Scale of the grid of the node.
+	 * @param  {const int}     c      Index of the child.
+	 * @param  {float*}        tNear
+	 * @param  {float*}        tFar
+	 * @return {bool}                 True, if the box is hit.
+	 */
+	bool intersectChildBox(
+		const ray4* ray, const float3* invDir, const bvhNode* node,
+		const float3 scale, const int c, float* tNear, float* tFar
+	) {
+		const uchar* qMinX = (const uchar*) &( node->qMinX );
+		const uchar* qMinY = (const uchar*) &( node->qMinY );
+		const uchar* qMinZ = (const uchar*) &( node->qMinZ );
+		const uchar* qMaxX = (const uchar*) &( node->qMaxX );
+		const uchar* qMaxY = (const uchar*) &( node->qMaxY );
+		const uchar* qMaxZ = (const uchar*) &( node->qMaxZ );
+
+		const float3 bbMin = node->origin.xyz + (float3)( qMinX[c], qMinY[c], qMinZ[c] ) * scale;
+		const float3 bbMax = node->origin.xyz + (float3)( qMaxX[c], qMaxY[c], qMaxZ[c] ) * scale;
+
+		return intersectBox( ray, invDir, (float4)( bbMin, 0.0f ), (float4)( bbMax, 0.0f ), tNear, tFar );
+	}
+
+
+	/**
+	 * Get the scale of the grid of a wide node.
+	 * The exponents are turned into floats directly, so no rounding happens.
+	 * @param  {const bvhNode*} node
+	 * @return {float3}              Scale per axis.
+	 */
+	float3 getGridScale( const bvhNode* node ) {
+		return (float3)(
+			as_float( ( (int) node->exponents.x + 127 ) << 23 ),
+			as_float( ( (int) node->exponents.y + 127 ) << 23 ),
+			as_float( ( (int) node->exponents.z + 127 ) << 23 )
+		);
+	}
+
+
+	/**
+	 * Traverse the wide BVH with a stack and test the faces against the given ray.
+	 * All children of a node are tested together. Faces of hit leaf nodes are
+	 * tested right away, hit inner nodes are visited nearest first. Nodes on the
+	 * stack are skipped, if a closer face has been hit in the meantime.
+	 * @param {Scene*}       scene
+	 * @param {ray4*}        ray
+	 */
+	void traverse( STATS_CONST Scene* scene, ray4* ray BVH_IMAGES_PARAMS ) {
+		const float3 invDir = native_recip( ray->dir );
+		int stack[WIDEBVH_STACK_SIZE];
+		float stackT[WIDEBVH_STACK_SIZE];
+		int sp = 0;
+		int index = 0;
+
+		traverseLights( scene, ray );
+
+		while( index >= 0 ) {
+			#if STATISTICS == 1
+				scene->stats.x++;
+			#endif
+
+			const bvhNode node = scene->bvh[index];
+			const float3 scale = getGridScale( &node );
+			const int* children = (const int*) &( node.children );
+			const uchar* numFaces = (const uchar*) &( node.numFaces );
+
+			int next[4];
+			float nextT[4];
+			int numNext = 0;
+
+			for( int c = 0; c < 4; c++ ) {
+				if( children[c] < 0 ) {
+					continue;
+				}
+
+				float tNear = 0.0f;
+				float tFar = INFINITY;
+
+				bool isNodeHit = (
+					intersectChildBox( ray, &invDir, &node, scale, c, &tNear, &tFar ) &&
+					tFar > EPSILON5 && ray->t > tNear
+				);
+
+				if( !isNodeHit ) {
+					continue;
+				}
+
+				// Leaf node. Test faces.
+				if( numFaces[c] > 0 ) {
+					float t = INFINITY;
+
+					for( int f = children[c]; f < children[c] + numFaces[c]; f++ ) {
+						intersectFace( scene, ray, f, &t, tNear, tFar BVH_IMAGES_ARGS );
+					}
+
+					continue;
+				}
+
+				// Insert sorted by distance, nearest first.
+				int j = numNext++;
+
+				while( j > 0 && nextT[j - 1] > tNear ) {
+					next[j] = next[j - 1];
+					nextT[j] = nextT[j - 1];
+					j--;
+				}
+
+				next[j] = children[c];
+				nextT[j] = tNear;
+			}
+
+			// Farthest first onto the stack, continue with the nearest.
+			for( int j = numNext - 1; j > 0; j-- ) {
+				stack[sp] = next[j];
+				stackT[sp] = nextT[j];
+				sp++;
+			}
+
+			if( numNext > 0 ) {
+				index = next[0];
+				continue;
+			}
+
+			index = -1;
+
+			while( sp > 0 ) {
+				sp--;
+
+				if( stackT[sp] < ray->t ) {
+					index = stack[sp];
+					break;
+				}
+			}
+		}
+	}
+
+
+	/**
+	 * Traverse the wide BVH and test the faces against the given ray.
+	 * This version is for the shadow ray test, so it only checks IF there
+	 * is an intersection and terminates on the first hit.
+	 * @param {Scene*}       scene
+	 * @param {ray4*}        ray
+	 */
+	void traverseShadows( STATS_CONST Scene* scene, ray4* ray BVH_IMAGES_PARAMS ) {
+		float tLight = ray->t;
+		const float3 invDir = native_recip( ray->dir );
+		int stack[WIDEBVH_STACK_SIZE];
+		int sp = 0;
+		int index = 0;
+
+		traverseLights( scene, ray );
+
+		while( index >= 0 ) {
+			const bvhNode node = scene->bvh[index];
+			const float3 scale = getGridScale( &node );
+			const int* children = (const int*) &( node.children );
+			const uchar* numFaces = (const uchar*) &( node.numFaces );
+
+			for( int c = 0; c < 4; c++ ) {
+				if( children[c] < 0 ) {
+					continue;
+				}
+
+				float tNear = 0.0f;
+				float tFar = INFINITY;
+
+				bool isNodeHit = (
+					intersectChildBox( ray, &invDir, &node, scale, c, &tNear, &tFar ) &&
+					tFar > EPSILON5
+				);
+
+				if( !isNodeHit ) {
+					continue;
+				}
+
+				if( numFaces[c] == 0 ) {
+					stack[sp++] = children[c];
+					continue;
+				}
+
+				// Leaf node. Test faces.
+				float t = INFINITY;
+
+				for( int f = children[c]; f < children[c] + numFaces[c]; f++ ) {
+					intersectFace( scene, ray, f, &t, tNear, tFar BVH_IMAGES_ARGS );
+				}
+
+				// It's enough to know that something blocks the way. It doesn't matter what or where.
+				if( ray->t < tLight ) {
+					return;
+				}
+			}
+
+			index = ( sp > 0 ) ? stack[--sp] : -1;
+		}
+	}
+
+
+#endif
@@ -11,13 +11,37 @@
 #define MAX_ADDED_DEPTH #MAX_ADDED_DEPTH#
 #define MAX_DEPTH #MAX_DEPTH#
 #define NI_AIR 1.00028f
+#define NUM_FACES #NUM_FACES#
 #define NUM_LIGHTS #NUM_LIGHTS#
+#define PERSISTENT_THREADS #PERSISTENT_THREADS#
 #define PHONGTESS #PHONGTESS#
 #define PHONGTESS_ALPHA #PHONGTESS_ALPHA#
 #define PI_X2 6.28318530718f
 #define SAMPLES #SAMPLES#
 #define SHADOW_RAYS #SHADOW_RAYS#
 #define SKY_LIGHT #SKY_LIGHT#
+#define STATISTICS #STATISTICS#
+#define WAVEFRONT #WAVEFRONT#
+
+
+// The BVH nodes and the triangles are either stored in buffers or, for
+// BVH_TEX_DIM > 0, in images of that width. Images can't be members of
+// the Scene struct, so they are passed on as additional parameters.
+#if BVH_TEX_DIM > 0
+	#define BVH_IMAGES_PARAMS , read_only image2d_t bvhImage, read_only image2d_t triImage
+	#define BVH_IMAGES_ARGS , bvhImage, triImage
+#else
+	#define BVH_IMAGES_PARAMS
+	#define BVH_IMAGES_ARGS
+#endif
+
+// The traversal counts the tested nodes and faces in the stats of the
+// Scene, so it can only take the Scene as const without STATISTICS.
+#if STATISTICS == 1
+	#define STATS_CONST
+#else
+	#define STATS_CONST const
+#endif
 
 
 // Only used inside kernel.
@@ -58,23 +82,113 @@ typedef struct {
 	float4 data; // x: type
 } light_t;
 
+// Precomputed for the intersection test, in the order of the faces of the leaf nodes.
+typedef struct {
+	float4 a; // w: normal.x
+	float4 edge1; // w: normal.y
+	float4 edge2; // w: normal.z
+} triangle_t;
+
 
 // BVH
 #if ACCEL_STRUCT == 0
 
+	// 0: stackless, 1: with a stack, nearer child node first
+	#define BVH_TRAVERSAL #BVH_TRAVERSAL#
+	#define BVH_STACK_SIZE #BVH_STACK_SIZE#
+	// 0: 32 byte nodes, 1: 16 byte nodes
+	#define BVH_COMPACT #BVH_COMPACT#
+
+	// The w components hold the bits of int indices (read with as_int()),
+	// so they stay exact beyond 2^24 faces or nodes.
+	typedef struct {
+		float4 bbMin; // w: index of the first face, -1 for inner nodes
+		float4 bbMax; // w: number of faces or next node to visit
+	} bvhNode;
+
+	#if BVH_COMPACT == 1
+		// Compact node, decoded into a bvhNode by getNode().
+		// xyz: bbMin and bbMax as 6 halfs, rounded outwards.
+		// w: Leaf nodes: bit 31 set, first face (bits 8-30), number of faces (bits 0-7).
+		//    Inner nodes: skip ahead (bit 30), next node to visit (bits 0-29, 0 for none).
+		typedef uint4 bvhNodeData;
+	#else
+		typedef bvhNode bvhNodeData;
+	#endif
+
+	typedef struct {
+		global const bvhNodeData* bvh;
+		global const light_t* lights;
+		global const triangle_t* triangles;
+		global const uint4* facesV;
+		global const uint4* facesN;
+		global const float4* vertices;
+		global const float4* normals;
+		// Left out of the initializers, so it starts at 0.
+		#if STATISTICS == 1
+			uint4 stats; // x: nodes, y: faces, z: bounces, w: shadow rays
+		#endif
+	} Scene;
+
+// Two-level BVH
+#elif ACCEL_STRUCT == 1
+
+	// The w components hold the bits of int indices (read with as_int()).
+	typedef struct {
+		float4 bbMin; // w: index of the first face, -1 for inner nodes or -2 - instance index
+		float4 bbMax; // w: number of faces or next node to visit
+	} bvhNode;
+
+	typedef struct {
+		float4 worldToObject[3]; // rows of the inverse transformation
+		int4 nodes; // x: first node to visit; y: end of the nodes of the object
+	} bvhInstance;
+
+	typedef struct {
+		global const bvhNode* bvh;
+		global const bvhInstance* instances;
+		global const light_t* lights;
+		global const triangle_t* triangles;
+		global const uint4* facesV;
+		global const uint4* facesN;
+		global const float4* vertices;
+		global const float4* normals;
+		// Left out of the initializers, so it starts at 0.
+		#if STATISTICS == 1
+			uint4 stats; // x: nodes, y: faces, z: bounces, w: shadow rays
+		#endif
+	} Scene;
+
+// Wide BVH
+#elif ACCEL_STRUCT == 2
+
+	#define WIDEBVH_STACK_SIZE #WIDEBVH_STACK_SIZE#
+
 	typedef struct {
-		float4 bbMin; // w: face index
-		float4 bbMax; // w: face index or next node to visit
+		float4 origin; // xyz: origin of the grid for the quantized bounding boxes
+		int4 children; // index of the node or first face, -1 for empty slots
+		uchar4 qMinX; // quantized bounding boxes of the children
+		uchar4 qMinY;
+		uchar4 qMinZ;
+		uchar4 qMaxX;
+		uchar4 qMaxY;
+		uchar4 qMaxZ;
+		char4 exponents; // xyz: scale of the grid as power of two
+		uchar4 numFaces; // number of faces of leaf nodes, 0 for inner nodes
 	} bvhNode;
 
 	typedef struct {
 		global const bvhNode* bvh;
 		global const light_t* lights;
+		global const triangle_t* triangles;
 		global const uint4* facesV;
 		global const uint4* facesN;
 		global const float4* vertices;
 		global const float4* normals;
-		float4 debugColor;
+		// Left out of the initializers, so it starts at 0.
+		#if STATISTICS == 1
+			uint4 stats; // x: nodes, y: faces, z: bounces, w: shadow rays
+		#endif
 	} Scene;
 
 #endif
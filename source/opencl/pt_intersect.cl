@@ -80,23 +80,21 @@ const bool intersectSphere(
 /**
  * Find intersection of a triangle and a ray. (No tessellation.)
  * After Möller and Trumbore.
- * @param  {const float3}         a
- * @param  {const float3}         b
- * @param  {const float3}         c
- * @param  {const uint4}          fn
- * @param  {global const float4*} normals
- * @param  {const ray4*}          ray
- * @param  {float*}               t
+ * @param  {const float3} a      First vertex of the triangle.
+ * @param  {const float3} edge1  Edge from the first to the second vertex.
+ * @param  {const float3} edge2  Edge from the first to the third vertex.
+ * @param  {const float3} normal Normal of the triangle.
+ * @param  {const ray4*}  ray
+ * @param  {float*}       t
+ * @param  {const float}  tNear
  * @return {float3}
  */
 float3 flatTriAndRayIntersect(
-	const float3 a, const float3 b, const float3 c,
+	const float3 a, const float3 edge1, const float3 edge2, const float3 normal,
 	const ray4* ray, float* t, const float tNear
 ) {
 	const float f = fmax( 0.0f, tNear - 0.001f );
 	const float3 closeOrigin = fma( ray->dir, f, ray->origin );
-	const float3 edge1 = b - a;
-	const float3 edge2 = c - a;
 	const float3 tVec = closeOrigin - a;
 	const float3 pVec = cross( ray->dir, edge2 );
 	const float3 qVec = cross( tVec, edge1 );
@@ -119,7 +117,7 @@ float3 flatTriAndRayIntersect(
 
 	*t += f;
 
-	return fast_normalize( cross( edge1, edge2 ) );
+	return normal;
 
 	// const float3 an = normals[fn.x].xyz;
 	// const float3 bn = normals[fn.y].xyz;
@@ -141,14 +139,31 @@ float3 flatTriAndRayIntersect(
  */
 float3 checkFaceIntersection(
 	const Scene* scene, const ray4* ray, const int fIndex, float* t,
-	const float tNear, const float tFar
+	const float tNear, const float tFar BVH_IMAGES_PARAMS
 ) {
-	const uint4 fv = scene->facesV[fIndex];
-	const float3 a = scene->vertices[fv.x].xyz;
-	const float3 b = scene->vertices[fv.y].xyz;
-	const float3 c = scene->vertices[fv.z].xyz;
+	// One fetch of the precomputed triangle instead of the
+	// face and its three vertices.
+	#if PHONGTESS == 0
+
+		#if BVH_TEX_DIM > 0
+			triangle_t tri;
+			tri.a = readTexel( triImage, fIndex * 3 );
+			tri.edge1 = readTexel( triImage, fIndex * 3 + 1 );
+			tri.edge2 = readTexel( triImage, fIndex * 3 + 2 );
+		#else
+			const triangle_t tri = scene->triangles[fIndex];
+		#endif
+
+		const float3 normal = (float3)( tri.a.w, tri.edge1.w, tri.edge2.w );
+
+		return flatTriAndRayIntersect( tri.a.xyz, tri.edge1.xyz, tri.edge2.xyz, normal, ray, t, tNear );
+
+	#elif PHONGTESS == 1
 
-	#if PHONGTESS == 1
+		const uint4 fv = scene->facesV[fIndex];
+		const float3 a = scene->vertices[fv.x].xyz;
+		const float3 b = scene->vertices[fv.y].xyz;
+		const float3 c = scene->vertices[fv.z].xyz;
 
 		const uint4 fn = scene->facesN[fIndex];
 		const float3 an = scene->normals[fn.x].xyz;
@@ -157,19 +172,15 @@ float3 checkFaceIntersection(
 		const int3 cmp = ( an == bn ) + ( bn == cn );
 
 		// Comparing vectors in OpenCL: 0/false/not equal; -1/true/equal
-		if( cmp.x + cmp.y + cmp.z == -6 )
+		if( cmp.x + cmp.y + cmp.z == -6 ) {
+			const float3 edge1 = b - a;
+			const float3 edge2 = c - a;
 
-	#endif
-
-	{
-		return flatTriAndRayIntersect( a, b, c, ray, t, tNear );
-	}
-
-
-	// Phong Tessellation
-	// Based on: "Direct Ray Tracing of Phong Tessellation" by Shinji Ogaki, Yusuke Tokuyoshi
-	#if PHONGTESS == 1
+			return flatTriAndRayIntersect( a, edge1, edge2, fast_normalize( cross( edge1, edge2 ) ), ray, t, tNear );
+		}
 
+		// Phong Tessellation
+		// Based on: "Direct Ray Tracing of Phong Tessellation" by Shinji Ogaki, Yusuke Tokuyoshi
 		return phongTessTriAndRayIntersect( a, b, c, an, bn, cn, ray, t, tNear, tFar );
 
 	#endif
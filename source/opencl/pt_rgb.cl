@@ -1,5 +1,6 @@
 /**
  * Write the final color to the output image.
+ * @param {const int2}           pos         Position of the pixel.
  * @param {read_only image2d_t}  imageIn     The previously generated image.
  * @param {write_only image2d_t} imageOut    Output.
  * @param {const float}          pixelWeight Mixing weight of the new color with the old one.
@@ -7,10 +8,9 @@
  * @param {float}                focus       Value <t> of the first ray.
  */
 void setColors(
-	read_only image2d_t imageIn, write_only image2d_t imageOut,
+	const int2 pos, read_only image2d_t imageIn, write_only image2d_t imageOut,
 	const float pixelWeight, float4 finalColor, float focus
 ) {
-	const int2 pos = { get_global_id( 0 ), get_global_id( 1 ) };
 	const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
 	const float4 imagePixel = read_imagef( imageIn, sampler, pos );
 
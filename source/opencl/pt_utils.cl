@@ -10,6 +10,24 @@
 constant uint MOD_3[6] = { 0, 1, 2, 0, 1, 2 };
 
 
+#if BVH_TEX_DIM > 0
+
+	/**
+	 * Read a texel of the BVH nodes or triangles stored as image.
+	 * The texels are in rows of BVH_TEX_DIM.
+	 * @param  {read_only image2d_t} image
+	 * @param  {const int}           index Index of the texel.
+	 * @return {float4}
+	 */
+	inline float4 readTexel( read_only image2d_t image, const int index ) {
+		const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_NONE | CLK_FILTER_NEAREST;
+
+		return read_imagef( image, sampler, (int2)( index % BVH_TEX_DIM, index / BVH_TEX_DIM ) );
+	}
+
+#endif
+
+
 // // PCG - random number generator
 
 // typedef struct {
@@ -0,0 +1,563 @@
+/**
+ * Wavefront path tracing.
+ * The loop of the "pathTracing" kernel is split into one kernel per stage. The host
+ * runs them one after another for each bounce. Each path belongs to one pixel.
+ * Its state is kept in global memory with one buffer per value (SoA), and the
+ * paths that are still alive are listed in queues of path indices.
+ *
+ * generatePaths: Camera rays for all pixels.
+ * sortPaths*:    Optional. Order the queue of the secondary rays by the direction
+ *                octant and the Morton code of the origin, so neighbouring
+ *                work-items of extendPaths traverse similar parts of the BVH.
+ * extendPaths:   Closest hit of the rays in the queue.
+ * shadePaths:    Material, next ray and shadow ray of each path. Paths that go on
+ *                are appended to the next queue, shadow rays to the shadow queue.
+ * connectPaths:  Test the shadow rays. Adds the light of those that are not blocked.
+ * finishPaths:   Write the final color of each pixel.
+ *
+ * In the statistics mode the counters of each path are added up in a buffer
+ * over all samples of the frame.
+ */
+
+
+/**
+ * KERNEL.
+ * Generate the camera rays for one sample of all pixels.
+ * The first sample also resets the final color of the paths.
+ */
+kernel void generatePaths(
+	float seed,
+	const uint sample,
+	const float pxDim,
+	const camera cam,
+	read_only image2d_t imageIn,
+
+	#if STATISTICS == 1
+		global uint4* stats,
+	#endif
+
+	global uint* queue,
+	global float4* pathOrigin,
+	global float4* pathDir,
+	global float4* pathColor,
+	global float4* pathFinalColor,
+	global uint4* pathState,
+	global float2* pathRandom
+) {
+	const int2 pos = { get_global_id( 0 ), get_global_id( 1 ) };
+	const uint path = pos.y * IMG_WIDTH + pos.x;
+
+	float2 prevFocus = (float2)( -1.0f, -1.0f );
+
+	if( cam.focusPoint.x >= 0 && cam.focusPoint.y >= 0 ) {
+		prevFocus = getPreviousFocus( pos, cam, imageIn );
+	}
+
+	// x: depth, y: added depth, z: secondary paths, w: sample
+	uint4 state = (uint4)( 0, 0, 1, sample );
+
+	if( sample == 0 ) {
+		pathFinalColor[path] = (float4)( 0.0f );
+
+		#if STATISTICS == 1
+			stats[path] = (uint4)( 0 );
+		#endif
+	}
+	else {
+		state.z = pathState[path].z;
+		seed = pathRandom[path].x;
+	}
+
+	ray4 ray = initRay( pos, pxDim, cam, &seed, prevFocus.y, prevFocus.x );
+
+	pathOrigin[path] = (float4)( ray.origin, 0.0f );
+	pathDir[path] = (float4)( ray.dir, INFINITY );
+	pathColor[path] = (float4)( 1.0f );
+	pathState[path] = state;
+	pathRandom[path].x = seed; // y: focus, set by the first hit
+	queue[path] = path;
+}
+
+
+#define SORT_AXIS_BITS #SORT_AXIS_BITS#
+#define SORT_NUM_BINS ( 8 << ( 3 * SORT_AXIS_BITS ) )
+#define SORT_SCAN_BLOCK #SORT_SCAN_BLOCK#
+
+
+/**
+ * Sort key of a ray: The octant of the direction in the upper 3 bits, below
+ * that the Morton code of the cell of the origin in a grid over the scene.
+ * @param  {const float3} origin      Origin of the ray.
+ * @param  {const float3} dir         Direction of the ray.
+ * @param  {const float4} boundsMin   Minimum of the scene bounds.
+ * @param  {const float4} boundsScale Cells per unit on each axis.
+ * @return {uint}                     Sort key in [0, SORT_NUM_BINS).
+ */
+inline uint getSortKey(
+	const float3 origin, const float3 dir, const float4 boundsMin, const float4 boundsScale
+) {
+	const float3 cellF = clamp(
+		( origin - boundsMin.xyz ) * boundsScale.xyz,
+		0.0f, (float) ( ( 1 << SORT_AXIS_BITS ) - 1 )
+	);
+	const uint3 cell = convert_uint3( cellF );
+	uint key = ( dir.x < 0.0f ) | ( ( dir.y < 0.0f ) << 1 ) | ( ( dir.z < 0.0f ) << 2 );
+
+	for( int b = SORT_AXIS_BITS - 1; b >= 0; b-- ) {
+		key = ( key << 3 ) | ( ( ( cell.x >> b ) & 1 ) << 2 ) |
+			( ( ( cell.y >> b ) & 1 ) << 1 ) | ( ( cell.z >> b ) & 1 );
+	}
+
+	return key;
+}
+
+
+/**
+ * KERNEL.
+ * Sorting the queue, step 1: Count the rays per sort key. Each ray
+ * remembers its key and its rank among the rays with the same key.
+ * @param {const uint}         numPaths    Number of paths in the queue.
+ * @param {global const uint*} queue       Queue of path indices.
+ * @param {const float4}       boundsMin   Minimum of the scene bounds.
+ * @param {const float4}       boundsScale Cells per unit on each axis.
+ * @param {global uint*}       bins        Count per sort key. Has to be 0.
+ * @param {global uint2*}      sortKeys    Output: Key and rank of each ray.
+ */
+kernel void sortPathsCount(
+	const uint numPaths,
+	global const uint* queue,
+	const float4 boundsMin,
+	const float4 boundsScale,
+	global uint* bins,
+	global uint2* sortKeys,
+	global const float4* pathOrigin,
+	global const float4* pathDir
+) {
+	const uint i = get_global_id( 0 );
+
+	if( i >= numPaths ) {
+		return;
+	}
+
+	const uint path = queue[i];
+	const uint key = getSortKey( pathOrigin[path].xyz, pathDir[path].xyz, boundsMin, boundsScale );
+
+	sortKeys[i] = (uint2)( key, atomic_inc( &bins[key] ) );
+}
+
+
+/**
+ * KERNEL.
+ * Sorting the queue, step 2: Exclusive prefix sum of a block of the counts.
+ * The counts are reset to 0 for the next bounce.
+ * One work-item per block.
+ * @param {global uint*} bins       Count per sort key.
+ * @param {global uint*} binOffsets Output: Offset of each key inside its block.
+ * @param {global uint*} blockSums  Output: Sum of each block.
+ */
+kernel void sortPathsScan(
+	global uint* bins, global uint* binOffsets, global uint* blockSums
+) {
+	const uint block = get_global_id( 0 );
+	const uint start = block * SORT_SCAN_BLOCK;
+	uint sum = 0;
+
+	for( uint k = start; k < start + SORT_SCAN_BLOCK; k++ ) {
+		const uint v = bins[k];
+		bins[k] = 0;
+		binOffsets[k] = sum;
+		sum += v;
+	}
+
+	blockSums[block] = sum;
+}
+
+
+/**
+ * KERNEL.
+ * Sorting the queue, step 3: Exclusive prefix sum of the block sums.
+ * Single work-item.
+ * @param {global uint*} blockSums Sums of the blocks to scan in place.
+ */
+kernel void sortPathsScanBlockSums( global uint* blockSums ) {
+	uint sum = 0;
+
+	for( uint b = 0; b < SORT_NUM_BINS / SORT_SCAN_BLOCK; b++ ) {
+		const uint v = blockSums[b];
+		blockSums[b] = sum;
+		sum += v;
+	}
+}
+
+
+/**
+ * KERNEL.
+ * Sorting the queue, step 4: Write the path indices to their sorted position.
+ * The state of the paths stays where it is, only the queue is reordered.
+ * @param {const uint}          numPaths    Number of paths in the queue.
+ * @param {global const uint*}  queue       Queue of path indices.
+ * @param {global const uint2*} sortKeys    Key and rank of each ray.
+ * @param {global const uint*}  binOffsets  Offset of each key inside its block.
+ * @param {global const uint*}  blockSums   Scanned block sums.
+ * @param {global uint*}        queueSorted Output: Sorted queue.
+ */
+kernel void sortPathsScatter(
+	const uint numPaths,
+	global const uint* queue,
+	global const uint2* sortKeys,
+	global const uint* binOffsets,
+	global const uint* blockSums,
+	global uint* queueSorted
+) {
+	const uint i = get_global_id( 0 );
+
+	if( i >= numPaths ) {
+		return;
+	}
+
+	const uint2 keyRank = sortKeys[i];
+	const uint target = blockSums[keyRank.x / SORT_SCAN_BLOCK] + binOffsets[keyRank.x] + keyRank.y;
+
+	queueSorted[target] = queue[i];
+}
+
+
+/**
+ * KERNEL.
+ * Find the closest hit of the rays of the paths in the queue.
+ */
+kernel void extendPaths(
+	const uint numPaths,
+	global const uint* queue,
+
+	// acceleration structure
+	#if ACCEL_STRUCT == 0
+		global const bvhNodeData* bvh,
+	#elif ACCEL_STRUCT == 1
+		global const bvhNode* bvh,
+		global const bvhInstance* instances,
+	#elif ACCEL_STRUCT == 2
+		global const bvhNode* bvh,
+	#endif
+
+	// geometry
+	global const triangle_t* triangles,
+	global const uint4* facesV,
+	global const uint4* facesN,
+	global const float4* vertices,
+	global const float4* normals,
+	global const light_t* lights,
+
+	// BVH nodes and triangles as images, instead of "bvh" and "triangles"
+	#if BVH_TEX_DIM > 0
+		read_only image2d_t bvhImage,
+		read_only image2d_t triImage,
+	#endif
+
+	#if STATISTICS == 1
+		global uint4* stats,
+	#endif
+
+	global const float4* pathOrigin,
+	global float4* pathDir,
+	global float4* pathNormal
+) {
+	const uint i = get_global_id( 0 );
+
+	if( i >= numPaths ) {
+		return;
+	}
+
+	#if ACCEL_STRUCT == 0 || ACCEL_STRUCT == 2
+		Scene scene = { bvh, lights, triangles, facesV, facesN, vertices, normals };
+	#elif ACCEL_STRUCT == 1
+		Scene scene = { bvh, instances, lights, triangles, facesV, facesN, vertices, normals };
+	#endif
+
+	const uint path = queue[i];
+
+	ray4 ray;
+	ray.origin = pathOrigin[path].xyz;
+	ray.dir = pathDir[path].xyz;
+	ray.t = INFINITY;
+	ray.hitFace = 0;
+
+	traverse( &scene, &ray BVH_IMAGES_ARGS );
+
+	pathDir[path].w = ray.t;
+	pathNormal[path] = (float4)( ray.normal, as_float( ray.hitFace ) );
+
+	#if STATISTICS == 1
+		scene.stats.z = 1;
+		stats[path] += scene.stats;
+	#endif
+}
+
+
+/**
+ * KERNEL.
+ * Evaluate the hit of each path in the queue: Add the light of a missed ray to
+ * the final color, or choose the next ray by the BRDF of the hit material.
+ * Paths that go on are appended to the next queue. Shadow rays are appended to
+ * the shadow queue, together with the color they add if the light isn't blocked.
+ */
+kernel void shadePaths(
+	const uint numPaths,
+	global const uint* queue,
+	global uint* queueNext,
+	global uint* queueShadow,
+	global uint* counters,
+
+	global const uint4* facesV,
+	global const material* materials,
+	global const light_t* lights,
+
+	global float4* pathOrigin,
+	global float4* pathDir,
+	global const float4* pathNormal,
+	global float4* pathColor,
+	global float4* pathFinalColor,
+	global uint4* pathState,
+	global float2* pathRandom,
+
+	global float4* shadowOrigin,
+	global float4* shadowDir,
+	global float4* shadowColor
+) {
+	const uint i = get_global_id( 0 );
+
+	if( i >= numPaths ) {
+		return;
+	}
+
+	const uint path = queue[i];
+	const float4 hit = pathNormal[path];
+
+	ray4 ray;
+	ray.origin = pathOrigin[path].xyz;
+	ray.dir = pathDir[path].xyz;
+	ray.t = pathDir[path].w;
+	ray.normal = hit.xyz;
+	ray.hitFace = as_int( hit.w );
+
+	uint4 state = pathState[path];
+	float seed = pathRandom[path].x;
+	float focus = pathRandom[path].y;
+	float4 color = pathColor[path];
+	const int depth = state.x;
+	int depthAdded = state.y;
+
+	if( depth == 0 && state.w == 0 ) {
+		focus = ray.t;
+	}
+
+	if( ray.t == INFINITY ) {
+		const float4 light = ( ray.hitFace < 0 ) ? lights[-( ray.hitFace + 1 )].rgb : SKY_LIGHT;
+		pathFinalColor[path] += color * light;
+		pathRandom[path].y = focus;
+		return;
+	}
+
+	material mtl = materials[facesV[ray.hitFace].w];
+
+	// Last round, no need to calculate a new ray.
+	// Unless we hit a material that extends the path.
+	bool addDepth = extendDepth( &mtl, &seed );
+
+	if( mtl.data.s0 == 1.0f && !addDepth && depth == MAX_DEPTH + depthAdded - 1 ) {
+		pathRandom[path] = (float2)( seed, focus );
+		return;
+	}
+
+	seed += ray.t;
+
+	// The shadow ray starts from the original face normal, as in the megakernel.
+	#if SHADOW_RAYS == 1
+		#if NUM_LIGHTS > 0
+			ray4 lightRay;
+			float tLight = 0.0f;
+
+			if( mtl.data.s0 > 0.0f ) {
+				// Only the light sources are needed.
+				Scene scene;
+				scene.lights = lights;
+
+				tLight = initShadowRay( &scene, &ray, &lightRay );
+			}
+		#endif
+	#endif
+
+	// New direction of the ray (bouncing of the hit surface)
+	ray4 newRay = getNewRay( &ray, &mtl, &seed, &addDepth );
+
+	// Flip the normal if it points in the wrong direction.
+	// Do it only now, becuause we still need the original face normal
+	// for the refraction calculation.
+	if( dot( ray.normal, -ray.dir ) <= 0.0f ) {
+		ray.normal = -ray.normal;
+	}
+
+	// The shadow ray is tested later, so the color it adds is prepared now.
+	// Like updateColor() in the megakernel it uses the flipped normal.
+	#if SHADOW_RAYS == 1
+		#if NUM_LIGHTS > 0
+			float4 lightColor;
+
+			if(
+				mtl.data.s0 > 0.0f &&
+				getShadowRayColor( &ray, &lightRay, &mtl, lights[0].rgb, color, &lightColor )
+			) {
+				const uint s = atomic_inc( &counters[1] );
+				queueShadow[s] = path;
+				shadowOrigin[path] = (float4)( lightRay.origin, tLight );
+				shadowDir[path] = (float4)( lightRay.dir, 0.0f );
+				shadowColor[path] = lightColor;
+			}
+		#endif
+	#endif
+
+	// The shadow ray is left out here, connectPaths adds its color.
+	ray4 noLightRay;
+	uint secondaryPaths = state.z;
+	float4 finalColor = (float4)( 0.0f );
+	updateColor(
+		&ray, &newRay, &mtl, &noLightRay, (float4)( -1.0f ), &secondaryPaths,
+		&color, &finalColor
+	);
+
+	// Extend max path depth
+	depthAdded += ( addDepth && depthAdded < MAX_ADDED_DEPTH );
+
+	// Russian roulette termination
+	float maxValColor = fmax( color.x, fmax( color.y, color.z ) );
+	bool isDone = russianRoulette( depth, depthAdded, maxValColor, &seed );
+
+	isDone = isDone || ( depth + 1 >= MAX_DEPTH + depthAdded );
+	pathRandom[path] = (float2)( seed, focus );
+
+	if( isDone ) {
+		return;
+	}
+
+	state.x = depth + 1;
+	state.y = depthAdded;
+	pathState[path] = state;
+	pathOrigin[path] = (float4)( newRay.origin, 0.0f );
+	pathDir[path] = (float4)( newRay.dir, INFINITY );
+	pathColor[path] = color;
+
+	queueNext[atomic_inc( &counters[0] )] = path;
+}
+
+
+/**
+ * KERNEL.
+ * Test the shadow rays in the shadow queue. If nothing blocks the way
+ * to the light source, its color is added to the final color of the path.
+ */
+kernel void connectPaths(
+	const uint numShadowRays,
+	global const uint* queueShadow,
+
+	// acceleration structure
+	#if ACCEL_STRUCT == 0
+		global const bvhNodeData* bvh,
+	#elif ACCEL_STRUCT == 1
+		global const bvhNode* bvh,
+		global const bvhInstance* instances,
+	#elif ACCEL_STRUCT == 2
+		global const bvhNode* bvh,
+	#endif
+
+	// geometry
+	global const triangle_t* triangles,
+	global const uint4* facesV,
+	global const uint4* facesN,
+	global const float4* vertices,
+	global const float4* normals,
+	global const light_t* lights,
+
+	// BVH nodes and triangles as images, instead of "bvh" and "triangles"
+	#if BVH_TEX_DIM > 0
+		read_only image2d_t bvhImage,
+		read_only image2d_t triImage,
+	#endif
+
+	#if STATISTICS == 1
+		global uint4* stats,
+	#endif
+
+	global float4* pathFinalColor,
+	global uint4* pathState,
+	global const float4* shadowOrigin,
+	global const float4* shadowDir,
+	global const float4* shadowColor
+) {
+	const uint i = get_global_id( 0 );
+
+	if( i >= numShadowRays ) {
+		return;
+	}
+
+	#if ACCEL_STRUCT == 0 || ACCEL_STRUCT == 2
+		Scene scene = { bvh, lights, triangles, facesV, facesN, vertices, normals };
+	#elif ACCEL_STRUCT == 1
+		Scene scene = { bvh, instances, lights, triangles, facesV, facesN, vertices, normals };
+	#endif
+
+	const uint path = queueShadow[i];
+	const float4 origin = shadowOrigin[path];
+
+	ray4 lightRay;
+	lightRay.origin = origin.xyz;
+	lightRay.dir = shadowDir[path].xyz;
+	lightRay.t = origin.w;
+	lightRay.hitFace = 0;
+
+	traverseShadows( &scene, &lightRay BVH_IMAGES_ARGS );
+
+	if( lightRay.t >= origin.w ) {
+		pathFinalColor[path] += shadowColor[path];
+		pathState[path].z += 1;
+	}
+
+	#if STATISTICS == 1
+		scene.stats.w = 1;
+		stats[path] += scene.stats;
+	#endif
+}
+
+
+/**
+ * KERNEL.
+ * Write the final color of each pixel to the output image.
+ */
+kernel void finishPaths(
+	const float pixelWeight,
+	read_only image2d_t imageIn,
+	write_only image2d_t imageOut,
+	write_only image2d_t imageDebug,
+
+	#if STATISTICS == 1
+		global const uint4* stats,
+	#endif
+
+	global const float4* pathFinalColor,
+	global const uint4* pathState,
+	global const float2* pathRandom
+) {
+	const int2 pos = { get_global_id( 0 ), get_global_id( 1 ) };
+	const uint path = pos.y * IMG_WIDTH + pos.x;
+
+	float4 finalColor = pathFinalColor[path] / (float) pathState[path].z;
+
+	#if SAMPLES > 1
+		finalColor /= (float) SAMPLES;
+	#endif
+
+	setColors( pos, imageIn, imageOut, pixelWeight, finalColor, pathRandom[path].y );
+
+	#if STATISTICS == 1
+		writeDebugImage( pos, imageDebug, stats[path] );
+	#endif
+}
@@ -18,13 +18,16 @@ GLWidget::GLWidget( QWidget* parent ) : QGLWidget( parent ) {
 	mPreviousTime = 0;
 
 	mMoveLight = false;
+	mModelTwist = 0.0f;
 	mViewBVH = false;
 	mViewDebug = false;
 	mViewLights = false;
 	mViewOverlay = false;
 	mViewTracer = true;
 
+	mBVH = NULL;
 	mInfoWindow = NULL;
+	mModelLoader = NULL;
 	mPathTracer = new PathTracer( this );
 	mCamera = new Camera( this );
 	mTimer = new QTimer( this );
@@ -167,6 +170,17 @@ void GLWidget::deleteOldModel() {
 			texIter++;
 		}
 	}
+
+	// Kept for refitting the BVH
+	if( mBVH != NULL ) {
+		delete mBVH;
+		mBVH = NULL;
+	}
+
+	if( mModelLoader != NULL ) {
+		delete mModelLoader;
+		mModelLoader = NULL;
+	}
 }
 
 
@@ -342,6 +356,7 @@ void GLWidget::loadModel( string filepath, string filename ) {
 
 	ModelLoader* ml = new ModelLoader();
 	ml->loadModel( filepath, filename );
+	mModelTwist = 0.0f;
 
 	ObjParser* op = ml->getObjParser();
 
@@ -350,16 +365,45 @@ void GLWidget::loadModel( string filepath, string filename ) {
 	mVertices = op->getVertices();
 
 	const short usedAccelStruct = Cfg::get().value<short>( Cfg::ACCEL_STRUCT );
-	AccelStructure* accelStruct;
+	AccelStructure* accelStruct = NULL;
+	BVHCache* bvhCache = NULL;
+
+	// Refitting needs the BVH on the host to check its quality,
+	// so it is built and not loaded from the cache.
+	const bool keepForRefit = (
+		Cfg::get().value<bool>( Cfg::BVH_REFIT ) &&
+		usedAccelStruct == ACCELSTRUCT_BVH &&
+		Cfg::get().value<cl_uint>( Cfg::BVH_BUILDMETHOD ) != BVH_BUILD_GPU_LBVH
+	);
+
+	if( usedAccelStruct == ACCELSTRUCT_BVH && BVHCache::isEnabled() && !keepForRefit ) {
+		bvhCache = new BVHCache( filepath, filename );
+		bvhCache->load();
+	}
 
-	if( usedAccelStruct == ACCELSTRUCT_BVH ) {
+	// The LBVH is built by the PathTracer on the OpenCL device.
+	// A cached BVH doesn't need to be built at all.
+	if(
+		usedAccelStruct == ACCELSTRUCT_BVH &&
+		Cfg::get().value<cl_uint>( Cfg::BVH_BUILDMETHOD ) != BVH_BUILD_GPU_LBVH &&
+		( bvhCache == NULL || !bvhCache->isLoaded() )
+	) {
 		accelStruct = new BVH( op->getObjects(), mVertices, mNormals );
 	}
+	else if( usedAccelStruct == ACCELSTRUCT_TWOLEVELBVH ) {
+		accelStruct = new TwoLevelBVH( op->getObjects(), op->getInstances(), mVertices, mNormals );
+	}
+	else if( usedAccelStruct == ACCELSTRUCT_WIDEBVH ) {
+		accelStruct = new WideBVH( op->getObjects(), mVertices, mNormals );
+	}
 
 	// Visualization of the acceleration structure
 	vector<GLfloat> visVertices;
 	vector<GLuint> visIndices;
-	accelStruct->visualize( &visVertices, &visIndices );
+
+	if( accelStruct != NULL ) {
+		accelStruct->visualize( &visVertices, &visIndices );
+	}
 	mAccelStructNumIndices = visIndices.size();
 
 	// Visualization of the light positions
@@ -376,10 +420,17 @@ void GLWidget::loadModel( string filepath, string filename ) {
 	this->initShaders();
 
 	// OpenCL buffers
-	mPathTracer->initOpenCLBuffers( mVertices, mFaces, mNormals, ml, accelStruct );
+	mPathTracer->initOpenCLBuffers( mVertices, mFaces, mNormals, ml, accelStruct, bvhCache );
 
-	delete ml;
-	delete accelStruct;
+	if( keepForRefit ) {
+		mBVH = (BVH*) accelStruct;
+		mModelLoader = ml;
+	}
+	else {
+		delete ml;
+		delete accelStruct;
+	}
+	delete bvhCache;
 
 	// Ready
 	this->startRendering();
@@ -904,6 +955,81 @@ void GLWidget::toggleViewTracer() {
 }
 
 
+/**
+ * Twist the loaded model around its vertical axis, as a simple vertex
+ * animation. The twist adds up, starting from the loaded vertices.
+ * The normals are kept. @see updateVertices().
+ * @param {const cl_float} angle Rotation to add at the top of the model in radians.
+ */
+void GLWidget::twistModel( const cl_float angle ) {
+	if( mBVH == NULL || mModelLoader == NULL ) {
+		Logger::logWarning( "[GLWidget] Moving vertices needs a BVH prepared for refitting. @see Cfg::BVH_REFIT." );
+		return;
+	}
+
+	mModelTwist += angle;
+
+	char msg[64];
+	snprintf( msg, 64, "[GLWidget] Twisting the model by %g degree.", MathHelp::radToDeg( mModelTwist ) );
+	Logger::logInfo( msg );
+
+	vector<cl_float> vertices = mModelLoader->getObjParser()->getVertices();
+	this->updateVertices( MathHelp::twistVertices( &vertices, mModelTwist ), mNormals );
+}
+
+
+/**
+ * Move the vertices of the loaded model, for example for vertex animation.
+ * The faces stay the same. The BVH is refitted to the new positions and
+ * rebuilt if its quality got too bad. @see Cfg::BVH_REFITREBUILD.
+ * @param {std::vector<cl_float>} vertices The moved vertices.
+ * @param {std::vector<cl_float>} normals  The normals of the moved vertices.
+ */
+void GLWidget::updateVertices( vector<cl_float> vertices, vector<cl_float> normals ) {
+	if( mBVH == NULL ) {
+		Logger::logWarning( "[GLWidget] Moving vertices needs a BVH prepared for refitting. @see Cfg::BVH_REFIT." );
+		return;
+	}
+
+	if( vertices.size() != mVertices.size() || normals.size() != mNormals.size() ) {
+		Logger::logWarning( "[GLWidget] Number of vertices or normals changed. The model has to be loaded again." );
+		return;
+	}
+
+	mVertices = vertices;
+	mNormals = normals;
+
+	const cl_float rebuildRatio = Cfg::get().value<cl_float>( Cfg::BVH_REFITREBUILD );
+	const cl_float ratio = mBVH->refit( mVertices, mNormals );
+
+	if( rebuildRatio > 0.0f && ratio > rebuildRatio ) {
+		char msg[128];
+		snprintf( msg, 128, "[GLWidget] SAH cost of the refitted BVH is %.2fx of the build. Rebuilding it.", ratio );
+		Logger::logInfo( msg );
+
+		delete mBVH;
+		mBVH = new BVH( mModelLoader->getObjParser()->getObjects(), mVertices, mNormals );
+
+		this->destroyKernelWindow();
+		mPathTracer->initOpenCLBuffers( mVertices, mFaces, mNormals, mModelLoader, mBVH );
+		mPathTracer->resetSampleCount();
+	}
+	else {
+		mPathTracer->updateVertices( mVertices, mNormals );
+	}
+
+	// Visualization of the acceleration structure
+	vector<GLfloat> visVertices;
+	vector<GLuint> visIndices;
+	mBVH->visualize( &visVertices, &visIndices );
+	mAccelStructNumIndices = visIndices.size();
+
+	this->setShaderBuffersForOverlay( mVertices, mFaces );
+	this->setShaderBuffersForBVH( visVertices, visIndices );
+	this->resetRenderTime();
+}
+
+
 /**
  * Visualize the light positions for an OpenGL overlay.
  * @param {std::vector<light_t>}  lights   The parsed lights.
@@ -15,6 +15,9 @@
 #include <QGLWidget>
 
 #include "../accelstructures/BVH.h"
+#include "../accelstructures/BVHCache.h"
+#include "../accelstructures/TwoLevelBVH.h"
+#include "../accelstructures/WideBVH.h"
 #include "../Camera.h"
 #include "../CL.h"
 #include "../Cfg.h"
@@ -71,6 +74,8 @@ class GLWidget : public QGLWidget {
 		void startRendering();
 		void stopRendering();
 		void toggleLightMovement();
+		void twistModel( const cl_float angle );
+		void updateVertices( vector<cl_float> vertices, vector<cl_float> normals );
 
 		static const GLuint ATTRIB_POINTER_VERTEX = 0;
 		Camera* mCamera;
@@ -116,6 +121,7 @@ class GLWidget : public QGLWidget {
 		bool mViewTracer;
 
 		cl_float mFOV;
+		cl_float mModelTwist;
 
 		GLuint mAccelStructNumIndices;
 		GLuint mFrameCount;
@@ -127,7 +133,9 @@ class GLWidget : public QGLWidget {
 		GLuint mPreviousTime;
 		GLuint mRenderStartTime;
 
+		BVH* mBVH;
 		InfoWindow* mInfoWindow;
+		ModelLoader* mModelLoader;
 		QTimer* mTimer;
 		PathTracer* mPathTracer;
 
@@ -200,6 +200,14 @@ void Window::keyPressEvent( QKeyEvent* e ) {
 			mGLWidget->modifyCameraStep( -0.1f );
 			break;
 
+		case Qt::Key_T:
+			mGLWidget->twistModel( 0.1f );
+			break;
+
+		case Qt::Key_Y:
+			mGLWidget->twistModel( -0.1f );
+			break;
+
 		case Qt::Key_F11:
 			this->toggleFullscreen();
 			break;
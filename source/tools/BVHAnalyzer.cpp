@@ -0,0 +1,799 @@
+#include "BVHAnalyzer.h"
+
+using std::string;
+using std::vector;
+
+
+/**
+ * Analyze a built BVH.
+ * @param {BVH*}                  bvh          The BVH. Its nodes have to be in depth-first order.
+ * @param {std::vector<object3D>} sceneObjects Objects of the scene the BVH has been built for.
+ * @param {std::vector<cl_float>} vertices     Vertices of the model.
+ */
+BVHAnalyzer::BVHAnalyzer(
+	BVH* bvh, const vector<object3D> sceneObjects, const vector<cl_float> vertices
+) {
+	boost::posix_time::ptime timerStart = boost::posix_time::microsec_clock::local_time();
+
+	mBVH = bvh;
+	mNodes = bvh->getNodes();
+	mVertices = vertices;
+	mCostTraversal = fmax( Cfg::get().value<cl_float>( Cfg::BVH_SAHCOSTTRAVERSAL ), 0.0f );
+
+	const BVHNode* root = &(*mNodes)[bvh->getRoot()];
+	mRootSA = MathHelp::getSurfaceArea( root->bbMin, root->bbMax );
+
+	this->analyzeNodes();
+	this->analyzeObjects( &sceneObjects );
+	this->analyzeEPO();
+	this->analyzeTraversal();
+
+	boost::posix_time::ptime timerEnd = boost::posix_time::microsec_clock::local_time();
+	cl_float timeDiff = ( timerEnd - timerStart ).total_milliseconds();
+
+	char msg[256];
+	snprintf( msg, 256, "[BVHAnalyzer] Analyzed %lu nodes in %g ms.", mNodes->size(), timeDiff );
+	Logger::logInfo( msg );
+}
+
+
+/**
+ * Destructor.
+ */
+BVHAnalyzer::~BVHAnalyzer() {}
+
+
+/**
+ * Calculate the end-point overlap (EPO). For each node, the surface area of the
+ * faces that are inside the bounding box, but not in the sub-tree of the node,
+ * is weighted by the cost of the node. The sum is relative to the surface area
+ * of all faces. Unlike the SAH it accounts for rays that start or end on a face
+ * and still have to visit overlapping nodes.
+ */
+void BVHAnalyzer::analyzeEPO() {
+	const vector<Tri>* faces = mBVH->getFaces();
+	const cl_uint numFaces = mFaces.size();
+
+	// The leaf nodes of each face. With spatial splits a face can be in more than one.
+	vector<cl_uint> leavesStart( numFaces + 1, 0 );
+	vector<cl_int> leaves( mNumRefs );
+
+	for( cl_uint i = 0; i < mNodes->size(); i++ ) {
+		const BVHNode* node = &(*mNodes)[i];
+
+		for( cl_uint j = 0; j < node->numFaces; j++ ) {
+			leavesStart[(*faces)[node->facesStart + j].face.w + 1]++;
+		}
+	}
+
+	for( cl_uint i = 0; i < numFaces; i++ ) {
+		leavesStart[i + 1] += leavesStart[i];
+	}
+
+	vector<cl_uint> leavesNext( leavesStart.begin(), leavesStart.end() - 1 );
+
+	for( cl_uint i = 0; i < mNodes->size(); i++ ) {
+		const BVHNode* node = &(*mNodes)[i];
+
+		for( cl_uint j = 0; j < node->numFaces; j++ ) {
+			leaves[leavesNext[(*faces)[node->facesStart + j].face.w]++] = i;
+		}
+	}
+
+	// The faces are independent of each other and can be tested in parallel.
+	TaskScheduler scheduler( Cfg::get().value<cl_uint>( Cfg::BVH_BUILDTHREADS ) );
+	const cl_uint numTasks = ( numFaces + BVHANALYZER_TASK_FACES - 1 ) / BVHANALYZER_TASK_FACES;
+	vector<cl_double> taskOverlap( numTasks, 0.0 );
+	vector<cl_double> taskArea( numTasks, 0.0 );
+
+	for( cl_uint t = 0; t < numTasks; t++ ) {
+		scheduler.spawn( [this, t, numFaces, &leavesStart, &leaves, &taskOverlap, &taskArea] {
+			const cl_uint first = t * BVHANALYZER_TASK_FACES;
+			const cl_uint last = std::min( first + BVHANALYZER_TASK_FACES, numFaces );
+			vector<cl_int> stack;
+
+			for( cl_uint f = first; f < last; f++ ) {
+				const cl_uint4 face = mFaces[f];
+				const glm::vec3 tri[3] = {
+					this->getVertex( face.x ), this->getVertex( face.y ), this->getVertex( face.z )
+				};
+				const cl_float area = 0.5f * glm::length( glm::cross( tri[1] - tri[0], tri[2] - tri[0] ) );
+
+				if( area <= 0.0f ) {
+					continue;
+				}
+
+				taskArea[t] += area;
+
+				const glm::vec3 triMin = glm::min( tri[0], glm::min( tri[1], tri[2] ) );
+				const glm::vec3 triMax = glm::max( tri[0], glm::max( tri[1], tri[2] ) );
+
+				stack.clear();
+				stack.push_back( mBVH->getRoot() );
+
+				while( !stack.empty() ) {
+					const cl_int index = stack.back();
+					const BVHNode* node = &(*mNodes)[index];
+					stack.pop_back();
+
+					if(
+						glm::any( glm::lessThan( node->bbMax, triMin ) ) ||
+						glm::any( glm::greaterThan( node->bbMin, triMax ) )
+					) {
+						continue;
+					}
+
+					// The sub-tree of a node is the range of nodes up to <mSubTreeEnd>.
+					bool isInSubTree = false;
+
+					for( cl_uint k = leavesStart[f]; k < leavesStart[f + 1]; k++ ) {
+						if( leaves[k] >= index && leaves[k] < mSubTreeEnd[index] ) {
+							isInSubTree = true;
+							break;
+						}
+					}
+
+					if( !isInSubTree ) {
+						taskOverlap[t] += this->getNodeCost( node ) * this->calcClippedArea( tri, node->bbMin, node->bbMax );
+					}
+
+					if( node->leftChild >= 0 ) {
+						stack.push_back( node->leftChild );
+						stack.push_back( node->rightChild );
+					}
+				}
+			}
+		} );
+	}
+
+	scheduler.wait();
+
+	cl_double overlap = 0.0;
+	cl_double area = 0.0;
+
+	for( cl_uint t = 0; t < numTasks; t++ ) {
+		overlap += taskOverlap[t];
+		area += taskArea[t];
+	}
+
+	mEPO = ( area > 0.0 ) ? overlap / area : 0.0f;
+}
+
+
+/**
+ * Collect the stats of the nodes: SAH cost, empty space,
+ * histograms of the leaf sizes and depths and the sub-trees.
+ */
+void BVHAnalyzer::analyzeNodes() {
+	const cl_uint numNodes = mNodes->size();
+	vector<cl_uint> depths( numNodes, 1 );
+	cl_float emptySpace = 0.0f;
+	cl_float emptySpaceWeights = 0.0f;
+
+	mNumLeaves = 0;
+	mNumRefs = 0;
+	mNumSkipAhead = 0;
+	mMaxDepth = 0;
+	mSAHCost = 0.0f;
+	mLeafSizes.clear();
+	mLeafDepths.clear();
+
+	// The nodes are in depth-first order, so
+	// a parent node comes before its children.
+	for( cl_uint i = 0; i < numNodes; i++ ) {
+		const BVHNode* node = &(*mNodes)[i];
+
+		if( node->parent >= 0 ) {
+			depths[i] = depths[node->parent] + 1;
+		}
+
+		mMaxDepth = std::max( mMaxDepth, depths[i] );
+
+		cl_float sa = MathHelp::getSurfaceArea( node->bbMin, node->bbMax );
+		cl_float weight = ( mRootSA > 0.0f ) ? sa / mRootSA : 0.0f;
+		mSAHCost += weight * this->getNodeCost( node );
+
+		if( node->skipNextLeft ) {
+			mNumSkipAhead++;
+		}
+
+		// Leaf node
+		if( node->leftChild < 0 ) {
+			mNumLeaves++;
+			mNumRefs += node->numFaces;
+
+			if( node->numFaces >= mLeafSizes.size() ) {
+				mLeafSizes.resize( node->numFaces + 1, 0 );
+			}
+			if( depths[i] >= mLeafDepths.size() ) {
+				mLeafDepths.resize( depths[i] + 1, 0 );
+			}
+
+			mLeafSizes[node->numFaces]++;
+			mLeafDepths[depths[i]]++;
+
+			continue;
+		}
+
+		// Part of the volume of the node, that none of its children covers.
+		const BVHNode* left = &(*mNodes)[node->leftChild];
+		const BVHNode* right = &(*mNodes)[node->rightChild];
+		cl_float volume = this->getVolume( node->bbMin, node->bbMax );
+
+		if( volume > 0.0f ) {
+			cl_float covered = this->getVolume( left->bbMin, left->bbMax ) +
+				this->getVolume( right->bbMin, right->bbMax ) -
+				this->getVolume( glm::max( left->bbMin, right->bbMin ), glm::min( left->bbMax, right->bbMax ) );
+
+			emptySpace += weight * ( 1.0f - fmin( covered / volume, 1.0f ) );
+			emptySpaceWeights += weight;
+		}
+	}
+
+	mEmptySpace = ( emptySpaceWeights > 0.0f ) ? emptySpace / emptySpaceWeights : 0.0f;
+
+	// Children come after their parent, so the sub-trees are complete bottom-up.
+	mSubTreeEnd.assign( numNodes, 0 );
+
+	for( cl_int i = numNodes - 1; i >= 0; i-- ) {
+		const BVHNode* node = &(*mNodes)[i];
+
+		mSubTreeEnd[i] = ( node->leftChild < 0 )
+			? i + 1
+			: std::max( mSubTreeEnd[node->leftChild], mSubTreeEnd[node->rightChild] );
+	}
+}
+
+
+/**
+ * Split the SAH cost of the tree between the objects. A node belongs
+ * to an object, if all faces in its sub-tree do. Nodes with faces of
+ * more than one object are shared, e.g. the nodes grouping the objects.
+ * @param {const std::vector<object3D>*} sceneObjects Objects of the scene.
+ */
+void BVHAnalyzer::analyzeObjects( const vector<object3D>* sceneObjects ) {
+	const vector<Tri>* faces = mBVH->getFaces();
+	const cl_uint numNodes = mNodes->size();
+
+	mFaces.clear();
+	mFaceObjects.clear();
+	mObjects.resize( sceneObjects->size() );
+	mSharedNodes = 0;
+	mSharedCost = 0.0f;
+
+	for( cl_uint i = 0; i < sceneObjects->size(); i++ ) {
+		BVHObjectStats* stats = &mObjects[i];
+		stats->name = (*sceneObjects)[i].oName;
+		stats->numFaces = (*sceneObjects)[i].facesV.size() / 3;
+		stats->numNodes = 0;
+		stats->numLeaves = 0;
+		stats->sahCost = 0.0f;
+
+		// The faces of the objects are numbered in the same order as in the BVH.
+		ModelLoader::getFacesOfObject( (*sceneObjects)[i], &mFaces, 0 );
+		mFaceObjects.insert( mFaceObjects.end(), stats->numFaces, (cl_int) i );
+	}
+
+	vector<cl_int> nodeObjects( numNodes, -1 );
+
+	for( cl_int i = numNodes - 1; i >= 0; i-- ) {
+		const BVHNode* node = &(*mNodes)[i];
+		cl_int object = -1;
+
+		if( node->leftChild < 0 ) {
+			for( cl_uint j = 0; j < node->numFaces; j++ ) {
+				cl_int faceObject = mFaceObjects[(*faces)[node->facesStart + j].face.w];
+				object = ( j == 0 || object == faceObject ) ? faceObject : -1;
+
+				if( object < 0 ) {
+					break;
+				}
+			}
+		}
+		else if( nodeObjects[node->leftChild] == nodeObjects[node->rightChild] ) {
+			object = nodeObjects[node->leftChild];
+		}
+
+		nodeObjects[i] = object;
+
+		cl_float sa = MathHelp::getSurfaceArea( node->bbMin, node->bbMax );
+		cl_float cost = ( mRootSA > 0.0f ) ? sa / mRootSA * this->getNodeCost( node ) : 0.0f;
+
+		if( object < 0 ) {
+			mSharedNodes++;
+			mSharedCost += cost;
+			continue;
+		}
+
+		mObjects[object].numNodes++;
+		mObjects[object].numLeaves += ( node->leftChild < 0 ) ? 1 : 0;
+		mObjects[object].sahCost += cost;
+	}
+}
+
+
+/**
+ * Trace a ray from the camera of the config file through the pixels of the
+ * window and count the tested nodes and faces for each traversal of the kernel.
+ * No anti-aliasing, depth-of-field or secondary rays. Skip-ahead isn't applied.
+ */
+void BVHAnalyzer::analyzeTraversal() {
+	const cl_uint width = Cfg::get().value<cl_uint>( Cfg::WINDOW_WIDTH );
+	const cl_uint height = Cfg::get().value<cl_uint>( Cfg::WINDOW_HEIGHT );
+	const cl_float fov = Cfg::get().value<cl_float>( Cfg::PERS_FOV );
+
+	const glm::vec3 eye(
+		Cfg::get().value<cl_float>( Cfg::CAM_EYE_X ),
+		Cfg::get().value<cl_float>( Cfg::CAM_EYE_Y ),
+		Cfg::get().value<cl_float>( Cfg::CAM_EYE_Z )
+	);
+	// Same as the adjusted center of the Camera.
+	const glm::vec3 center(
+		eye.x + Cfg::get().value<cl_float>( Cfg::CAM_CENTER_X ),
+		eye.y - Cfg::get().value<cl_float>( Cfg::CAM_CENTER_Y ),
+		eye.z - Cfg::get().value<cl_float>( Cfg::CAM_CENTER_Z )
+	);
+
+	const glm::vec3 w = glm::normalize( center - eye );
+	const glm::vec3 u = glm::normalize( glm::cross( w, glm::vec3( 0.0f, 1.0f, 0.0f ) ) );
+	const glm::vec3 v = glm::normalize( glm::cross( u, w ) );
+
+	const cl_float aspect = (cl_float) width / (cl_float) height;
+	const cl_float pxDim = aspect * 2.0f * tan( MathHelp::degToRad( fov ) / 2.0f ) / (cl_float) width;
+
+	const cl_uint numRows = ( height + BVHANALYZER_RAY_STEP - 1 ) / BVHANALYZER_RAY_STEP;
+	const cl_uint numCols = ( width + BVHANALYZER_RAY_STEP - 1 ) / BVHANALYZER_RAY_STEP;
+	vector<BVHTraversalStats> rowStackless( numRows, { 0.0, 0.0 } );
+	vector<BVHTraversalStats> rowStack( numRows, { 0.0, 0.0 } );
+
+	// Each row of pixels is a task.
+	TaskScheduler scheduler( Cfg::get().value<cl_uint>( Cfg::BVH_BUILDTHREADS ) );
+
+	for( cl_uint r = 0; r < numRows; r++ ) {
+		scheduler.spawn( [this, r, numCols, width, height, pxDim, eye, u, v, w, &rowStackless, &rowStack] {
+			const cl_float y = r * BVHANALYZER_RAY_STEP + 0.5f - 0.5f * height;
+
+			for( cl_uint c = 0; c < numCols; c++ ) {
+				const cl_float x = c * BVHANALYZER_RAY_STEP + 0.5f - 0.5f * width;
+				const glm::vec3 dir = glm::normalize( w + pxDim * ( x * u + y * v ) );
+
+				this->traceStackless( eye, dir, &rowStackless[r] );
+				this->traceStack( eye, dir, &rowStack[r] );
+			}
+		} );
+	}
+
+	scheduler.wait();
+
+	mNumRays = numRows * numCols;
+	mStackless = { 0.0, 0.0 };
+	mStack = { 0.0, 0.0 };
+
+	for( cl_uint r = 0; r < numRows; r++ ) {
+		mStackless.nodes += rowStackless[r].nodes;
+		mStackless.faces += rowStackless[r].faces;
+		mStack.nodes += rowStack[r].nodes;
+		mStack.faces += rowStack[r].faces;
+	}
+}
+
+
+/**
+ * Clip a triangle to a bounding box (Sutherland-Hodgman) and calculate the area of the rest.
+ * @param  {const glm::vec3*} tri   The three vertices of the triangle.
+ * @param  {const glm::vec3}  bbMin Minimum of the bounding box.
+ * @param  {const glm::vec3}  bbMax Maximum of the bounding box.
+ * @return {cl_float}               Area of the triangle inside the bounding box.
+ */
+cl_float BVHAnalyzer::calcClippedArea( const glm::vec3* tri, const glm::vec3 bbMin, const glm::vec3 bbMax ) {
+	// Each of the 6 planes adds at most one vertex.
+	glm::vec3 poly[9];
+	glm::vec3 clipped[9];
+	cl_uint numVertices = 3;
+
+	poly[0] = tri[0];
+	poly[1] = tri[1];
+	poly[2] = tri[2];
+
+	for( cl_uint axis = 0; axis <= 2; axis++ ) {
+		for( cl_uint side = 0; side <= 1; side++ ) {
+			cl_uint numClipped = 0;
+
+			for( cl_uint i = 0; i < numVertices; i++ ) {
+				const glm::vec3 a = poly[i];
+				const glm::vec3 b = poly[( i + 1 ) % numVertices];
+
+				// Distance to the plane, positive inside.
+				cl_float da = ( side == 0 ) ? a[axis] - bbMin[axis] : bbMax[axis] - a[axis];
+				cl_float db = ( side == 0 ) ? b[axis] - bbMin[axis] : bbMax[axis] - b[axis];
+
+				if( da >= 0.0f ) {
+					clipped[numClipped++] = a;
+				}
+				if( ( da >= 0.0f ) != ( db >= 0.0f ) ) {
+					clipped[numClipped++] = a + ( b - a ) * ( da / ( da - db ) );
+				}
+			}
+
+			if( numClipped < 3 ) {
+				return 0.0f;
+			}
+
+			std::copy( clipped, clipped + numClipped, poly );
+			numVertices = numClipped;
+		}
+	}
+
+	glm::vec3 sum( 0.0f );
+
+	for( cl_uint i = 1; i < numVertices - 1; i++ ) {
+		sum += glm::cross( poly[i] - poly[0], poly[i + 1] - poly[0] );
+	}
+
+	return 0.5f * glm::length( sum );
+}
+
+
+/**
+ * Escape a string to be used as JSON value.
+ * @param  {const std::string} value The string.
+ * @return {std::string}             The escaped string, without quotes.
+ */
+string BVHAnalyzer::escapeJSON( const string value ) {
+	string escaped;
+
+	for( cl_uint i = 0; i < value.size(); i++ ) {
+		const char c = value[i];
+
+		if( c == '"' || c == '\\' ) {
+			escaped += '\\';
+			escaped += c;
+		}
+		else if( (unsigned char) c < 0x20 ) {
+			char code[8];
+			snprintf( code, 8, "\\u%04x", (unsigned int) c );
+			escaped += code;
+		}
+		else {
+			escaped += c;
+		}
+	}
+
+	return escaped;
+}
+
+
+/**
+ * Get the cost of a node, relative to the intersection test of a face.
+ * @param  {const BVHNode*} node The node.
+ * @return {cl_float}            Cost of a traversal step or of intersecting the faces.
+ */
+cl_float BVHAnalyzer::getNodeCost( const BVHNode* node ) {
+	return ( node->leftChild < 0 ) ? (cl_float) node->numFaces : mCostTraversal;
+}
+
+
+/**
+ * Get a vertex of the model.
+ * @param  {const cl_uint} index Index of the vertex.
+ * @return {glm::vec3}           The vertex.
+ */
+glm::vec3 BVHAnalyzer::getVertex( const cl_uint index ) {
+	return glm::vec3( mVertices[index * 3], mVertices[index * 3 + 1], mVertices[index * 3 + 2] );
+}
+
+
+/**
+ * Get the volume of a bounding box.
+ * @param  {const glm::vec3} bbMin Minimum of the bounding box.
+ * @param  {const glm::vec3} bbMax Maximum of the bounding box.
+ * @return {cl_float}              Volume. 0, if the box is empty.
+ */
+cl_float BVHAnalyzer::getVolume( const glm::vec3 bbMin, const glm::vec3 bbMax ) {
+	const glm::vec3 side = bbMax - bbMin;
+
+	if( side.x <= 0.0f || side.y <= 0.0f || side.z <= 0.0f ) {
+		return 0.0f;
+	}
+
+	return side.x * side.y * side.z;
+}
+
+
+/**
+ * Test a ray against the bounding box of a node.
+ * @param  {const glm::vec3} origin Origin of the ray.
+ * @param  {const glm::vec3} invDir Inverse direction of the ray.
+ * @param  {const BVHNode*}  node   The node.
+ * @param  {const cl_float}  t      Distance to the closest hit so far.
+ * @param  {cl_float*}       tNear  Distance to the entry point of the box.
+ * @return {bool}                   True, if the box is hit before <t>.
+ */
+bool BVHAnalyzer::intersectBox(
+	const glm::vec3 origin, const glm::vec3 invDir, const BVHNode* node,
+	const cl_float t, cl_float* tNear
+) {
+	const glm::vec3 t1 = ( node->bbMin - origin ) * invDir;
+	const glm::vec3 t2 = ( node->bbMax - origin ) * invDir;
+	const glm::vec3 tMin = glm::min( t1, t2 );
+	const glm::vec3 tMax = glm::max( t1, t2 );
+
+	*tNear = fmax( fmax( tMin.x, tMin.y ), fmax( tMin.z, 0.0f ) );
+	const cl_float tFar = fmin( fmin( tMax.x, tMax.y ), tMax.z );
+
+	return ( *tNear <= tFar && *tNear < t );
+}
+
+
+/**
+ * Test a ray against the faces of a leaf node (Möller-Trumbore).
+ * @param {const glm::vec3}    origin Origin of the ray.
+ * @param {const glm::vec3}    dir    Direction of the ray.
+ * @param {const BVHNode*}     node   The leaf node.
+ * @param {cl_float*}          t      Distance to the closest hit so far. Updated on a closer hit.
+ * @param {BVHTraversalStats*} stats  Counter of the tested faces.
+ */
+void BVHAnalyzer::intersectFaces(
+	const glm::vec3 origin, const glm::vec3 dir, const BVHNode* node,
+	cl_float* t, BVHTraversalStats* stats
+) {
+	const vector<Tri>* faces = mBVH->getFaces();
+
+	for( cl_uint i = 0; i < node->numFaces; i++ ) {
+		const cl_uint4 face = mFaces[(*faces)[node->facesStart + i].face.w];
+		const glm::vec3 a = this->getVertex( face.x );
+		const glm::vec3 edge1 = this->getVertex( face.y ) - a;
+		const glm::vec3 edge2 = this->getVertex( face.z ) - a;
+
+		stats->faces += 1.0;
+
+		const glm::vec3 p = glm::cross( dir, edge2 );
+		const cl_float det = glm::dot( edge1, p );
+
+		if( fabs( det ) < 1e-12f ) {
+			continue;
+		}
+
+		const cl_float invDet = 1.0f / det;
+		const glm::vec3 s = origin - a;
+		const cl_float bu = glm::dot( s, p ) * invDet;
+
+		if( bu < 0.0f || bu > 1.0f ) {
+			continue;
+		}
+
+		const glm::vec3 q = glm::cross( s, edge1 );
+		const cl_float bv = glm::dot( dir, q ) * invDet;
+
+		if( bv < 0.0f || bu + bv > 1.0f ) {
+			continue;
+		}
+
+		const cl_float tHit = glm::dot( edge2, q ) * invDet;
+
+		if( tHit > 0.0f && tHit < *t ) {
+			*t = tHit;
+		}
+	}
+}
+
+
+/**
+ * Set the steps of refitting the BVH to moved vertices,
+ * which are added to the report.
+ * @param {const std::vector<BVHRefitStep>} steps The refit steps.
+ */
+void BVHAnalyzer::setRefitSteps( const vector<BVHRefitStep> steps ) {
+	mRefitSteps = steps;
+}
+
+
+/**
+ * Get the report of the analysis as JSON.
+ * @param  {const std::string} model Path and name of the model file.
+ * @return {std::string}             The report.
+ */
+string BVHAnalyzer::toJSON( const string model ) {
+	std::ostringstream json;
+
+	json << "{\n";
+	json << "\t\"model\": \"" << this->escapeJSON( model ) << "\",\n";
+
+	json << "\t\"settings\": {\n";
+	json << "\t\t\"build_method\": " << Cfg::get().value<cl_uint>( Cfg::BVH_BUILDMETHOD ) << ",\n";
+	json << "\t\t\"max_faces\": " << Cfg::get().value<cl_uint>( Cfg::BVH_MAXFACES ) << ",\n";
+	json << "\t\t\"optimize_passes\": " << Cfg::get().value<cl_uint>( Cfg::BVH_OPTIMIZEPASSES ) << ",\n";
+	json << "\t\t\"sah_bins\": " << Cfg::get().value<cl_uint>( Cfg::BVH_SAHBINS ) << ",\n";
+	json << "\t\t\"sah_cost_traversal\": " << Cfg::get().value<cl_float>( Cfg::BVH_SAHCOSTTRAVERSAL ) << ",\n";
+	json << "\t\t\"sah_faces_limit\": " << Cfg::get().value<cl_uint>( Cfg::BVH_SAHFACESLIMIT ) << ",\n";
+	json << "\t\t\"sbvh_budget\": " << Cfg::get().value<cl_float>( Cfg::BVH_SBVHBUDGET ) << ",\n";
+	json << "\t\t\"skip_ahead\": " << ( Cfg::get().value<bool>( Cfg::BVH_SKIPAHEAD ) ? "true" : "false" ) << ",\n";
+	json << "\t\t\"skip_ahead_compare\": " << Cfg::get().value<cl_float>( Cfg::BVH_SKIPAHEAD_CMP ) << ",\n";
+	json << "\t\t\"traversal\": " << Cfg::get().value<cl_uint>( Cfg::BVH_TRAVERSAL ) << "\n";
+	json << "\t},\n";
+
+	json << "\t\"nodes\": " << mNodes->size() << ",\n";
+	json << "\t\"leaves\": " << mNumLeaves << ",\n";
+	json << "\t\"faces\": " << mFaces.size() << ",\n";
+	json << "\t\"face_references\": " << mNumRefs << ",\n";
+	json << "\t\"skip_ahead_nodes\": " << mNumSkipAhead << ",\n";
+	json << "\t\"max_depth\": " << mMaxDepth << ",\n";
+	json << "\t\"sah_cost\": " << mSAHCost << ",\n";
+	json << "\t\"epo\": " << mEPO << ",\n";
+	json << "\t\"empty_space_ratio\": " << mEmptySpace << ",\n";
+
+	// Histograms as objects, only with the used keys.
+	const vector<cl_uint>* histograms[2] = { &mLeafSizes, &mLeafDepths };
+	const char* histogramNames[2] = { "leaf_sizes", "leaf_depths" };
+
+	for( cl_uint h = 0; h < 2; h++ ) {
+		bool isFirst = true;
+		json << "\t\"" << histogramNames[h] << "\": {";
+
+		for( cl_uint i = 0; i < histograms[h]->size(); i++ ) {
+			if( (*histograms[h])[i] == 0 ) {
+				continue;
+			}
+
+			json << ( isFirst ? " " : ", " ) << "\"" << i << "\": " << (*histograms[h])[i];
+			isFirst = false;
+		}
+
+		json << " },\n";
+	}
+
+	json << "\t\"objects\": [\n";
+
+	for( cl_uint i = 0; i < mObjects.size(); i++ ) {
+		const BVHObjectStats* stats = &mObjects[i];
+
+		json << "\t\t{ \"name\": \"" << this->escapeJSON( stats->name ) << "\"";
+		json << ", \"faces\": " << stats->numFaces;
+		json << ", \"nodes\": " << stats->numNodes;
+		json << ", \"leaves\": " << stats->numLeaves;
+		json << ", \"sah_cost\": " << stats->sahCost << " }";
+		json << ( ( i + 1 < mObjects.size() ) ? ",\n" : "\n" );
+	}
+
+	json << "\t],\n";
+	json << "\t\"shared\": { \"nodes\": " << mSharedNodes << ", \"sah_cost\": " << mSharedCost << " },\n";
+
+	// Averages per ray from the camera.
+	const cl_double numRays = std::max( mNumRays, (cl_uint) 1 );
+	json << "\t\"traversal\": {\n";
+	json << "\t\t\"rays\": " << mNumRays << ",\n";
+	json << "\t\t\"stackless\": { \"nodes_per_ray\": " << mStackless.nodes / numRays;
+	json << ", \"faces_per_ray\": " << mStackless.faces / numRays << " },\n";
+	json << "\t\t\"stack\": { \"nodes_per_ray\": " << mStack.nodes / numRays;
+	json << ", \"faces_per_ray\": " << mStack.faces / numRays << " }\n";
+	json << ( mRefitSteps.empty() ? "\t}\n" : "\t},\n" );
+
+	if( !mRefitSteps.empty() ) {
+		json << "\t\"refit\": [\n";
+
+		for( cl_uint i = 0; i < mRefitSteps.size(); i++ ) {
+			json << "\t\t{ \"step\": " << ( i + 1 );
+			json << ", \"sah_ratio\": " << mRefitSteps[i].sahRatio;
+			json << ", \"rebuilt\": " << ( mRefitSteps[i].rebuilt ? "true" : "false" ) << " }";
+			json << ( ( i + 1 < mRefitSteps.size() ) ? ",\n" : "\n" );
+		}
+
+		json << "\t]\n";
+	}
+
+	json << "}\n";
+
+	return json.str();
+}
+
+
+/**
+ * Trace a ray like the ordered stack traversal of the kernel: Both child
+ * nodes are tested, leaf nodes are intersected right away, the nearer inner
+ * node is visited first and the farther one is skipped when it is popped,
+ * if a closer hit has been found in the meantime.
+ * @param {const glm::vec3}    origin Origin of the ray.
+ * @param {const glm::vec3}    dir    Direction of the ray.
+ * @param {BVHTraversalStats*} stats  Counter of the tested nodes and faces.
+ */
+void BVHAnalyzer::traceStack( const glm::vec3 origin, const glm::vec3 dir, BVHTraversalStats* stats ) {
+	const glm::vec3 invDir = 1.0f / dir;
+	cl_float t = INFINITY;
+	cl_int index = mBVH->getRoot();
+	const BVHNode* root = &(*mNodes)[index];
+
+	if( root->leftChild < 0 ) {
+		this->intersectFaces( origin, dir, root, &t, stats );
+		return;
+	}
+
+	vector<cl_int> stack;
+	vector<cl_float> stackNear;
+
+	while( true ) {
+		const BVHNode* node = &(*mNodes)[index];
+		const BVHNode* left = &(*mNodes)[node->leftChild];
+		const BVHNode* right = &(*mNodes)[node->rightChild];
+		cl_float tNearL;
+		cl_float tNearR;
+
+		stats->nodes += 2.0;
+		bool isLeftHit = this->intersectBox( origin, invDir, left, t, &tNearL );
+		bool isRightHit = this->intersectBox( origin, invDir, right, t, &tNearR );
+
+		if( isLeftHit && left->leftChild < 0 ) {
+			this->intersectFaces( origin, dir, left, &t, stats );
+			isLeftHit = false;
+		}
+
+		if( isRightHit && right->leftChild < 0 && t > tNearR ) {
+			this->intersectFaces( origin, dir, right, &t, stats );
+			isRightHit = false;
+		}
+
+		isLeftHit = isLeftHit && t > tNearL;
+		isRightHit = isRightHit && t > tNearR;
+
+		if( isLeftHit && isRightHit ) {
+			const bool isLeftNear = ( tNearL <= tNearR );
+
+			stack.push_back( isLeftNear ? node->rightChild : node->leftChild );
+			stackNear.push_back( isLeftNear ? tNearR : tNearL );
+			index = isLeftNear ? node->leftChild : node->rightChild;
+			continue;
+		}
+
+		if( isLeftHit || isRightHit ) {
+			index = isLeftHit ? node->leftChild : node->rightChild;
+			continue;
+		}
+
+		index = -1;
+
+		while( !stack.empty() && index < 0 ) {
+			index = ( stackNear.back() < t ) ? stack.back() : -1;
+			stack.pop_back();
+			stackNear.pop_back();
+		}
+
+		if( index < 0 ) {
+			break;
+		}
+	}
+}
+
+
+/**
+ * Trace a ray like the stackless traversal of the kernel: Each visited
+ * node is tested on its own, always the left child node first.
+ * @param {const glm::vec3}    origin Origin of the ray.
+ * @param {const glm::vec3}    dir    Direction of the ray.
+ * @param {BVHTraversalStats*} stats  Counter of the tested nodes and faces.
+ */
+void BVHAnalyzer::traceStackless( const glm::vec3 origin, const glm::vec3 dir, BVHTraversalStats* stats ) {
+	const glm::vec3 invDir = 1.0f / dir;
+	cl_float t = INFINITY;
+	vector<cl_int> next;
+	next.push_back( mBVH->getRoot() );
+
+	// The order of the pops is the same as following the next node indices.
+	while( !next.empty() ) {
+		const BVHNode* node = &(*mNodes)[next.back()];
+		cl_float tNear;
+		next.pop_back();
+
+		stats->nodes += 1.0;
+
+		if( !this->intersectBox( origin, invDir, node, t, &tNear ) ) {
+			continue;
+		}
+
+		if( node->leftChild < 0 ) {
+			this->intersectFaces( origin, dir, node, &t, stats );
+			continue;
+		}
+
+		next.push_back( node->rightChild );
+		next.push_back( node->leftChild );
+	}
+}
@@ -0,0 +1,119 @@
+#ifndef BVHANALYZER_H
+#define BVHANALYZER_H
+
+// Faces per task when calculating the EPO.
+#define BVHANALYZER_TASK_FACES 4096
+// Rays from the camera are traced for every n-th pixel of the window in each direction.
+#define BVHANALYZER_RAY_STEP 2
+// Twist of the model after the last refit step in radians.
+#define BVHANALYZER_REFIT_TWIST ( MH_PI * 0.5f )
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <glm/glm.hpp>
+#include <sstream>
+#include <string>
+
+#include "../accelstructures/BVH.h"
+#include "../Cfg.h"
+#include "../Logger.h"
+#include "../MathHelp.h"
+#include "../ModelLoader.h"
+#include "../ObjParser.h"
+#include "../TaskScheduler.h"
+
+using std::string;
+using std::vector;
+
+
+// Tested nodes and faces of the traced rays.
+struct BVHTraversalStats {
+	cl_double nodes;
+	cl_double faces;
+};
+
+
+// SAH cost of a refitted BVH relative to the build.
+struct BVHRefitStep {
+	cl_float sahRatio;
+	bool rebuilt;
+};
+
+
+// Nodes and costs of the sub-tree of an object.
+struct BVHObjectStats {
+	string name;
+	cl_uint numFaces;
+	cl_uint numNodes;
+	cl_uint numLeaves;
+	cl_float sahCost;
+};
+
+
+/**
+ * Measures the quality of a built BVH: SAH cost, end-point overlap (EPO),
+ * histograms of the leaf sizes and depths, the empty space of the nodes
+ * and the cost of the nodes of each object. Rays from the camera count the
+ * tested nodes and faces of the stackless and the ordered traversal of the
+ * kernel. The nodes have to be in depth-first order, as they are at the end
+ * of the build.
+ */
+class BVHAnalyzer {
+
+	public:
+		BVHAnalyzer( BVH* bvh, const vector<object3D> sceneObjects, const vector<cl_float> vertices );
+		~BVHAnalyzer();
+		void setRefitSteps( const vector<BVHRefitStep> steps );
+		string toJSON( const string model );
+
+	protected:
+		void analyzeEPO();
+		void analyzeNodes();
+		void analyzeObjects( const vector<object3D>* sceneObjects );
+		void analyzeTraversal();
+		cl_float calcClippedArea( const glm::vec3* tri, const glm::vec3 bbMin, const glm::vec3 bbMax );
+		string escapeJSON( const string value );
+		cl_float getNodeCost( const BVHNode* node );
+		glm::vec3 getVertex( const cl_uint index );
+		cl_float getVolume( const glm::vec3 bbMin, const glm::vec3 bbMax );
+		bool intersectBox(
+			const glm::vec3 origin, const glm::vec3 invDir, const BVHNode* node,
+			const cl_float t, cl_float* tNear
+		);
+		void intersectFaces(
+			const glm::vec3 origin, const glm::vec3 dir, const BVHNode* node,
+			cl_float* t, BVHTraversalStats* stats
+		);
+		void traceStack( const glm::vec3 origin, const glm::vec3 dir, BVHTraversalStats* stats );
+		void traceStackless( const glm::vec3 origin, const glm::vec3 dir, BVHTraversalStats* stats );
+
+	private:
+		BVH* mBVH;
+		const vector<BVHNode>* mNodes;
+		vector<cl_float> mVertices;
+		vector<cl_uint4> mFaces;
+		vector<cl_int> mFaceObjects;
+		vector<cl_int> mSubTreeEnd;
+
+		cl_float mCostTraversal;
+		cl_float mRootSA;
+
+		cl_uint mNumLeaves;
+		cl_uint mNumRefs;
+		cl_uint mNumSkipAhead;
+		cl_uint mMaxDepth;
+		cl_float mSAHCost;
+		cl_float mEPO;
+		cl_float mEmptySpace;
+		vector<cl_uint> mLeafSizes;
+		vector<cl_uint> mLeafDepths;
+		vector<BVHObjectStats> mObjects;
+		cl_uint mSharedNodes;
+		cl_float mSharedCost;
+		cl_uint mNumRays;
+		BVHTraversalStats mStackless;
+		BVHTraversalStats mStack;
+		vector<BVHRefitStep> mRefitSteps;
+
+};
+
+#endif
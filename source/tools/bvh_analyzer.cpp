@@ -0,0 +1,109 @@
+#include <clocale>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include "BVHAnalyzer.h"
+#include "../Cfg.h"
+#include "../Logger.h"
+#include "../ModelLoader.h"
+
+using std::string;
+using std::vector;
+
+
+/**
+ * Build the BVH of a model with the settings of the config file and
+ * report its quality as JSON, without starting the GUI. The report is
+ * written to the given file or printed (also for "-"), so set the logging
+ * level to 1 or lower to get clean JSON on the standard output.
+ * With refit steps the model is twisted step by step and the BVH refitted
+ * to it, like the vertex animation of the GUI. The BVH is rebuilt if the
+ * SAH cost grows too much. The report is of the BVH after the last step.
+ * Usage: bvh_analyzer <model.obj> [<config.json>] [<report.json>] [<refit steps>]
+ */
+int main( int argc, char** argv ) {
+	setlocale( LC_ALL, "C" );
+
+	if( argc < 2 ) {
+		std::cerr << "Usage: " << argv[0] << " <model.obj> [<config.json>] [<report.json>] [<refit steps>]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	Cfg::get().loadConfigFile( ( argc > 2 ) ? argv[2] : "config.json" );
+
+	const cl_uint refitSteps = ( argc > 4 ) ? atoi( argv[4] ) : 0;
+
+	if( refitSteps > 0 && !Cfg::get().value<bool>( Cfg::BVH_REFIT ) ) {
+		Logger::logError( "[BVHAnalyzer] Refitting needs the BVH prepared for it. @see Cfg::BVH_REFIT." );
+		return EXIT_FAILURE;
+	}
+
+	string file( argv[1] );
+	size_t separator = file.rfind( '/' );
+	string filepath = ( separator == string::npos ) ? "" : file.substr( 0, separator + 1 );
+	string filename = ( separator == string::npos ) ? file : file.substr( separator + 1 );
+
+	if( Cfg::get().value<cl_uint>( Cfg::BVH_BUILDMETHOD ) == BVH_BUILD_GPU_LBVH ) {
+		Logger::logWarning( "[BVHAnalyzer] The LBVH is built on the OpenCL device. Analyzing the BVH built by SAH instead." );
+	}
+
+	ModelLoader* ml = new ModelLoader();
+	ml->loadModel( filepath, filename );
+
+	ObjParser* op = ml->getObjParser();
+	vector<object3D> objects = op->getObjects();
+	vector<cl_float> vertices = op->getVertices();
+	vector<cl_float> normals = op->getNormals();
+
+	BVH* bvh = new BVH( objects, vertices, normals );
+	vector<BVHRefitStep> steps;
+
+	if( refitSteps > 0 ) {
+		const cl_float rebuildRatio = Cfg::get().value<cl_float>( Cfg::BVH_REFITREBUILD );
+		vector<cl_float> moved;
+
+		for( cl_uint i = 1; i <= refitSteps; i++ ) {
+			moved = MathHelp::twistVertices( &vertices, BVHANALYZER_REFIT_TWIST * i / refitSteps );
+
+			BVHRefitStep step;
+			step.sahRatio = bvh->refit( moved, normals );
+			step.rebuilt = ( rebuildRatio > 0.0f && step.sahRatio > rebuildRatio );
+
+			if( step.rebuilt ) {
+				delete bvh;
+				bvh = new BVH( objects, moved, normals );
+			}
+
+			steps.push_back( step );
+		}
+
+		vertices = moved;
+	}
+
+	BVHAnalyzer* analyzer = new BVHAnalyzer( bvh, objects, vertices );
+	analyzer->setRefitSteps( steps );
+	string report = analyzer->toJSON( file );
+
+	delete analyzer;
+	delete bvh;
+	delete ml;
+
+	if( argc <= 3 || string( argv[3] ) == "-" ) {
+		std::cout << report;
+		return EXIT_SUCCESS;
+	}
+
+	std::ofstream out( argv[3] );
+	out << report;
+	out.close();
+
+	if( !out ) {
+		Logger::logError( string( "[BVHAnalyzer] Could not write report " ).append( argv[3] ) );
+		return EXIT_FAILURE;
+	}
+
+	Logger::logInfo( string( "[BVHAnalyzer] Wrote report " ).append( argv[3] ) );
+
+	return EXIT_SUCCESS;
+}